@@ -3,6 +3,11 @@
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <cctype>
+#include <functional>
+#include <set>
+#include <utility>
+#include <vector>
 
 namespace mrpc {
 namespace generator {
@@ -11,197 +16,5356 @@ class CppStubGenerator : public StubGeneratorBase {
 private:
     std::string namespace_name;
 
+    bool splitMode() const { return !options.split_source_path.empty(); }
+
+    // 共享内存传输按段写入环形队列，因此也需要分散-聚集编码
+    bool segmentsEnabled() const { return options.scatter_gather || options.shm; }
+
+    std::string importPrefix(const std::string& from) const override { return from + "::"; }
+
+    // 引入的IDL按约定生成为<name>.mrpc.h
+    void generateImportIncludes() {
+        for (const auto& imported : usedImports()) {
+            output << "#include \"" << imported.name << ".mrpc.h\"\n";
+        }
+    }
+
+    // 辅助类实现所需的标准库头文件
+    std::set<std::string> helperIncludes() {
+        std::set<std::string> includes = {"string"};
+        if (hasCachedMethods()) {
+            includes.insert({"algorithm", "array", "atomic", "chrono", "list", "mutex",
+                             "string_view", "unordered_map"});
+        }
+        if (hasCoalescedMethods()) {
+            includes.insert({"atomic", "condition_variable", "functional", "memory", "mutex",
+                             "unordered_map", "utility", "vector"});
+        }
+        if (options.pool) {
+            includes.insert({"algorithm", "atomic", "chrono", "functional", "memory", "random", "vector"});
+        }
+        if (hasHedgedMethods()) {
+            includes.insert({"algorithm", "array", "atomic", "chrono", "condition_variable", "functional",
+                             "future", "map", "memory", "mutex", "thread", "vector"});
+        }
+        if (hasWindows()) {
+            includes.insert({"algorithm", "atomic", "condition_variable", "cstdint", "deque",
+                             "functional", "mutex"});
+        }
+        if (segmentsEnabled()) {
+            includes.insert({"algorithm", "cerrno", "cstdint", "stdexcept", "string_view", "vector"});
+        }
+        if (hasShardedMethods()) {
+            includes.insert({"algorithm", "atomic", "charconv", "condition_variable", "cstdint", "functional",
+                             "memory", "mutex", "string_view", "thread", "vector"});
+        }
+        if (hasPriorities()) {
+            includes.insert({"algorithm", "array", "condition_variable", "cstdint", "deque", "memory", "mutex",
+                             "thread", "vector"});
+        }
+        if (options.shm) {
+            includes.insert({"atomic", "cerrno", "chrono", "condition_variable", "cstdint", "cstdlib", "cstring",
+                             "fcntl.h", "functional", "memory", "mutex", "signal.h", "string_view", "sys/file.h",
+                             "sys/mman.h", "thread", "unistd.h", "unordered_map", "utility"});
+        }
+        return includes;
+    }
+
     // 生成头文件保护和包含声明
     void generateHeader() {
         output << "#pragma once\n\n";
         output << "#include \"mrpcpp/server.h\"\n";
         output << "#include \"mrpcpp/client.h\"\n";
-        output << "#include <string>\n\n";
+        generateImportIncludes();
+        // 标准库头文件按需收集
+        for (const auto& header : helperIncludes()) {
+            output << "#include <" << header << ">\n";
+        }
+        generateSegmentsIncludes();
+        generateShardIncludes(output);
+        output << "\n";
         output << "using json = nlohmann::json;\n\n";
     }
 
-    // 生成命名空间开始
-    void generateNamespaceStart() {
-        output << "namespace " << namespace_name << " {\n\n";
+    // MrpcSegments::Writev只在POSIX平台提供
+    void generateSegmentsIncludes() {
+        if (!segmentsEnabled()) return;
+        output << "#if defined(__unix__) || defined(__APPLE__)\n";
+        output << "#include <climits>\n";
+        output << "#include <sys/uio.h>\n";
+        output << "#include <unistd.h>\n";
+        output << "#endif\n";
+    }
+
+    // 分片执行器绑核所需的系统头文件
+    void generateShardIncludes(std::ostream &out) {
+        if (!hasShardedMethods()) return;
+        out << "#ifdef __linux__\n";
+        out << "#include <pthread.h>\n";
+        out << "#include <sched.h>\n";
+        out << "#endif\n";
+    }
+
+    // 拆分模式的头文件：不包含运行时和json，运行时类型只做前置声明
+    void generateSplitHeader() {
+        output << "#pragma once\n\n";
+        generateImportIncludes();
+        std::set<std::string> includes = {"functional", "memory", "string"};
+        if (hasCachedMethods() || options.pool) includes.insert({"cstddef", "cstdint"});
+        if (hasCoalescedMethods()) includes.insert("cstdint");
+        if (hasWindows()) includes.insert({"cstddef", "cstdint"});
+        if (options.pool) includes.insert("vector");
+        if (hasShardedMethods()) includes.insert({"atomic", "charconv", "cstddef", "cstdint", "string_view", "vector"});
+        if (hasPriorities()) includes.insert({"cstddef", "cstdint"});
+        if (segmentsEnabled()) {
+            includes.insert({"algorithm", "cerrno", "cstdint", "stdexcept", "string_view", "vector"});
+        }
+        for (const auto& header : includes) {
+            output << "#include <" << header << ">\n";
+        }
+        generateSegmentsIncludes();
+        output << "\n";
+        output << "// 实现位于" << baseName(options.split_source_path)
+               << "；调用方需要使用mrpc::Status时自行包含运行时头文件\n";
+        output << "namespace mrpc {\n";
+        output << "class Status;\n";
+        output << "namespace client {\n";
+        output << "class MrpcClient;\n";
+        output << "} // namespace client\n";
+        output << "namespace server {\n";
+        output << "class MrpcService;\n";
+        output << "} // namespace server\n";
+        output << "} // namespace mrpc\n\n";
+    }
+
+    // 生成命名空间开始
+    void generateNamespaceStart() {
+        output << "namespace " << namespace_name << " {\n\n";
+    }
+
+    // 生成方法名数组
+    void generateMethodNames() override {
+        output << "static const char *" << service.name << "_method_names[] = {\n";
+        for (const auto& method : service.methods) {
+            output << "    \"/" << namespace_name << "." << service.name << "/" 
+                  << method.name << "\",\n";
+        }
+        output << "};\n\n";
+    }
+
+    // 辅助类的输出范围：拆分模式下头文件只放公开类型和前置声明，模板实现放到源文件
+    enum class HelperPart { kAll, kDeclarations, kDefinitions };
+
+    // 生成分片加锁的LRU响应缓存，仅在存在cache注解时输出
+    void generateCacheHelper(std::ostream &out, HelperPart part) {
+        if (!hasCachedMethods()) return;
+        if (part != HelperPart::kDefinitions) {
+            out << R"(// 响应缓存的统计快照
+struct MrpcCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+  uint64_t expirations = 0;
+  uint64_t invalidations = 0;
+  size_t size = 0;
+};
+
+)";
+        }
+        if (part == HelperPart::kDeclarations) {
+            out << "template <typename Response, size_t kShards = 16>\n";
+            out << "class MrpcResponseCache;\n\n";
+            return;
+        }
+        // 默认模板实参只能出现一次，拆分模式下已由头文件中的前置声明给出
+        out << "// 分片加锁的LRU响应缓存，键为编码后的请求，按键的哈希选择分片\n";
+        out << "template <typename Response, size_t kShards"
+            << (part == HelperPart::kAll ? " = 16" : "") << ">\n";
+        out << R"(class MrpcResponseCache {
+public:
+  using Stats = MrpcCacheStats;
+
+  MrpcResponseCache(int64_t ttl_ms, size_t max_entries)
+      : ttl_(std::chrono::milliseconds(ttl_ms)),
+        shard_capacity_(std::max<size_t>(1, (max_entries + kShards - 1) / kShards)) {}
+
+  bool Get(const std::string &key, Response &response) {
+    Shard &shard = ShardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+      misses_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    if (it->second->expire_at <= std::chrono::steady_clock::now()) {
+      auto entry = it->second;
+      shard.index.erase(it);
+      shard.lru.erase(entry);
+      expirations_.fetch_add(1, std::memory_order_relaxed);
+      misses_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    response = it->second->response;
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  void Put(const std::string &key, const Response &response) {
+    Shard &shard = ShardFor(key);
+    auto expire_at = std::chrono::steady_clock::now() + ttl_;
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+      it->second->response = response;
+      it->second->expire_at = expire_at;
+      shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+      return;
+    }
+    if (shard.lru.size() >= shard_capacity_) {
+      shard.index.erase(shard.lru.back().key);
+      shard.lru.pop_back();
+      evictions_.fetch_add(1, std::memory_order_relaxed);
+    }
+    shard.lru.push_front(Entry{key, response, expire_at});
+    shard.index.emplace(shard.lru.front().key, shard.lru.begin());
+  }
+
+  void Invalidate(const std::string &key) {
+    Shard &shard = ShardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) return;
+    auto entry = it->second;
+    shard.index.erase(it);
+    shard.lru.erase(entry);
+    invalidations_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void Clear() {
+    for (auto &shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      invalidations_.fetch_add(shard.lru.size(), std::memory_order_relaxed);
+      shard.index.clear();
+      shard.lru.clear();
+    }
+  }
+
+  Stats GetStats() const {
+    Stats stats;
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    stats.evictions = evictions_.load(std::memory_order_relaxed);
+    stats.expirations = expirations_.load(std::memory_order_relaxed);
+    stats.invalidations = invalidations_.load(std::memory_order_relaxed);
+    for (const auto &shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      stats.size += shard.lru.size();
+    }
+    return stats;
+  }
+
+private:
+  struct Entry {
+    std::string key;
+    Response response;
+    std::chrono::steady_clock::time_point expire_at;
+  };
+
+  struct Shard {
+    mutable std::mutex mutex;
+    std::list<Entry> lru;
+    std::unordered_map<std::string_view, typename std::list<Entry>::iterator> index;
+  };
+
+  Shard &ShardFor(const std::string &key) {
+    return shards_[std::hash<std::string>{}(key) % kShards];
+  }
+
+  std::chrono::steady_clock::duration ttl_;
+  size_t shard_capacity_;
+  std::array<Shard, kShards> shards_;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> evictions_{0};
+  std::atomic<uint64_t> expirations_{0};
+  std::atomic<uint64_t> invalidations_{0};
+};
+
+)";
+    }
+
+    // 生成请求合并辅助类，仅在存在coalesce注解时输出
+    void generateFlightHelper(std::ostream &out, HelperPart part) {
+        if (!hasCoalescedMethods()) return;
+        if (part == HelperPart::kDeclarations) {
+            out << "template <typename Response>\n";
+            out << "class MrpcSingleFlight;\n\n";
+            return;
+        }
+        out << R"(// 合并在途的相同请求：同一请求已发出时，后来者挂到首个调用上并共享其响应
+template <typename Response>
+class MrpcSingleFlight {
+public:
+  using Callback = std::function<void(mrpc::Status)>;
+
+  template <typename Call>
+  mrpc::Status Do(const std::string &key, Response &response, Call &&call) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = flights_.find(key);
+    if (it != flights_.end()) {
+      std::shared_ptr<Flight> flight = it->second;
+      flight->waiters++;
+      shared_.fetch_add(1, std::memory_order_relaxed);
+      flight->cv.wait(lock, [&flight] { return flight->done; });
+      response = flight->response;
+      return flight->status;
+    }
+    auto flight = std::make_shared<Flight>();
+    flights_.emplace(key, flight);
+    lock.unlock();
+    mrpc::Status status = call(response);
+    Finish(key, flight, status, response);
+    return status;
+  }
+
+  template <typename Start>
+  void DoCallback(const std::string &key, Response &response, Callback callback, Start &&start) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = flights_.find(key);
+    if (it != flights_.end()) {
+      it->second->followers.emplace_back(&response, std::move(callback));
+      shared_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    auto flight = std::make_shared<Flight>();
+    flights_.emplace(key, flight);
+    lock.unlock();
+    start(response, [this, key, flight, &response, callback](mrpc::Status status) {
+      Finish(key, flight, status, response);
+      callback(status);
+    });
+  }
+
+  // 被合并（未实际发出）的调用数
+  uint64_t SharedCalls() const { return shared_.load(std::memory_order_relaxed); }
+
+private:
+  struct Flight {
+    std::condition_variable cv;
+    bool done = false;
+    int waiters = 0;
+    mrpc::Status status;
+    Response response;
+    std::vector<std::pair<Response *, Callback>> followers;
+  };
+
+  void Finish(const std::string &key, const std::shared_ptr<Flight> &flight,
+              const mrpc::Status &status, const Response &response) {
+    std::vector<std::pair<Response *, Callback>> followers;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      flights_.erase(key);
+      flight->status = status;
+      if (flight->waiters > 0) flight->response = response;
+      flight->done = true;
+      followers.swap(flight->followers);
+    }
+    flight->cv.notify_all();
+    for (auto &follower : followers) {
+      *follower.first = response;
+      follower.second(status);
+    }
+  }
+
+  std::mutex mutex_;
+  std::unordered_map<std::string, std::shared_ptr<Flight>> flights_;
+  std::atomic<uint64_t> shared_{0};
+};
+
+)";
+    }
+
+    // 生成连接池辅助类，仅在开启--pool时输出
+    void generatePoolHelper(std::ostream &out, HelperPart part) {
+        if (!options.pool) return;
+        if (part != HelperPart::kDefinitions) {
+            out << R"(// 连接池的选路策略
+enum class MrpcBalancePolicy { kRoundRobin, kLeastOutstanding, kPowerOfTwoChoices };
+
+// 单条连接的状态快照
+struct MrpcChannelStats {
+  std::string addr;
+  int64_t outstanding;
+  int consecutive_failures;
+  bool healthy;
+};
+
+)";
+        }
+        if (part == HelperPart::kDeclarations) {
+            out << "template <typename Stub>\n";
+            out << "class MrpcChannelPool;\n\n";
+            return;
+        }
+        out << R"(// 多端点、多连接的通道池：按策略选出健康的连接，连续失败的连接会被暂时摘除
+template <typename Stub>
+class MrpcChannelPool {
+public:
+  using ChannelStats = MrpcChannelStats;
+
+  struct Channel {
+    std::string addr;
+    std::unique_ptr<Stub> stub;
+    std::atomic<int64_t> outstanding{0};
+    std::atomic<int> consecutive_failures{0};
+    std::atomic<int64_t> ejected_until_ms{0};
+  };
+
+  MrpcChannelPool(const std::vector<std::string> &addrs, size_t connections_per_addr,
+                  MrpcBalancePolicy policy, int max_failures = 3, int64_t eject_ms = 1000)
+      : policy_(policy), max_failures_(max_failures), eject_ms_(eject_ms) {
+    for (const auto &addr : addrs) {
+      for (size_t i = 0; i < std::max<size_t>(1, connections_per_addr); ++i) {
+        auto channel = std::make_unique<Channel>();
+        channel->addr = addr;
+        channel->stub = std::make_unique<Stub>(addr);
+        channels_.push_back(std::move(channel));
+      }
+    }
+  }
+
+  // 选出一条连接并占用一个在途名额，调用结束后必须Release
+  size_t Pick() {
+    size_t index = Select(NowMs());
+    channels_[index]->outstanding.fetch_add(1, std::memory_order_relaxed);
+    return index;
+  }
+
+  // 对冲的备份请求尽量发往尚未使用的健康连接，找不到时退化为Pick
+  size_t PickExcept(const std::vector<size_t> &used) {
+    int64_t now = NowMs();
+    size_t index = Select(now);
+    auto is_used = [&used](size_t i) { return std::find(used.begin(), used.end(), i) != used.end(); };
+    for (size_t step = 1; step < channels_.size() && is_used(index); ++step) {
+      size_t next = (index + step) % channels_.size();
+      if (!is_used(next) && Healthy(*channels_[next], now)) index = next;
+    }
+    channels_[index]->outstanding.fetch_add(1, std::memory_order_relaxed);
+    return index;
+  }
+
+  void Release(size_t index, bool ok) {
+    Channel &channel = *channels_[index];
+    channel.outstanding.fetch_sub(1, std::memory_order_relaxed);
+    if (ok) {
+      channel.consecutive_failures.store(0, std::memory_order_relaxed);
+      return;
+    }
+    if (channel.consecutive_failures.fetch_add(1, std::memory_order_relaxed) + 1 >= max_failures_) {
+      channel.ejected_until_ms.store(NowMs() + eject_ms_, std::memory_order_relaxed);
+      channel.consecutive_failures.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  Stub &At(size_t index) { return *channels_[index]->stub; }
+  const Stub &At(size_t index) const { return *channels_[index]->stub; }
+  size_t Size() const { return channels_.size(); }
+
+  std::vector<ChannelStats> Stats() const {
+    std::vector<ChannelStats> stats;
+    int64_t now = NowMs();
+    for (const auto &channel : channels_) {
+      stats.push_back({channel->addr, channel->outstanding.load(std::memory_order_relaxed),
+                       channel->consecutive_failures.load(std::memory_order_relaxed),
+                       Healthy(*channel, now)});
+    }
+    return stats;
+  }
+
+private:
+  static int64_t NowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  static bool Healthy(const Channel &channel, int64_t now) {
+    return channel.ejected_until_ms.load(std::memory_order_relaxed) <= now;
+  }
+
+  int64_t Outstanding(size_t index) const {
+    return channels_[index]->outstanding.load(std::memory_order_relaxed);
+  }
+
+  size_t Select(int64_t now) {
+    size_t n = channels_.size();
+    size_t start = next_.fetch_add(1, std::memory_order_relaxed);
+    if (policy_ == MrpcBalancePolicy::kPowerOfTwoChoices && n > 1) {
+      thread_local std::minstd_rand rng(std::random_device{}());
+      size_t a = rng() % n;
+      size_t b = (a + 1 + rng() % (n - 1)) % n;
+      bool a_ok = Healthy(*channels_[a], now);
+      bool b_ok = Healthy(*channels_[b], now);
+      if (a_ok && b_ok) return Outstanding(a) <= Outstanding(b) ? a : b;
+      if (a_ok) return a;
+      if (b_ok) return b;
+    }
+    // 轮询或最少在途：从轮转起点扫描健康连接，全部不健康时退化为不过滤
+    size_t best = n;
+    for (size_t i = 0; i < n; ++i) {
+      size_t index = (start + i) % n;
+      if (!Healthy(*channels_[index], now)) continue;
+      if (policy_ == MrpcBalancePolicy::kRoundRobin) return index;
+      if (best == n || Outstanding(index) < Outstanding(best)) best = index;
+    }
+    return best == n ? start % n : best;
+  }
+
+  MrpcBalancePolicy policy_;
+  int max_failures_;
+  int64_t eject_ms_;
+  std::vector<std::unique_ptr<Channel>> channels_;
+  std::atomic<size_t> next_{0};
+};
+
+)";
+    }
+
+    // 生成对冲请求的辅助类，仅在连接池存根存在hedge注解时输出
+    void generateHedgeHelper(std::ostream &out, HelperPart part) {
+        if (!hasHedgedMethods()) return;
+        if (part != HelperPart::kDefinitions) {
+            out << R"(// 对冲请求的统计快照，hedges / calls即对冲带来的额外负载
+struct MrpcHedgeStats {
+  uint64_t calls = 0;
+  uint64_t hedges = 0;      // 额外发出的备份请求数
+  uint64_t hedge_wins = 0;  // 由备份请求先成功返回的调用数
+  uint64_t hedges_skipped = 0;  // 因在途窗口已满而放弃的备份请求数
+  int64_t threshold_us = -1;  // 当前的对冲阈值，-1表示样本不足、暂不对冲
+};
+
+)";
+        }
+        if (part == HelperPart::kDeclarations) {
+            out << "class MrpcHedgePolicy;\n";
+            out << "class MrpcHedgeTimer;\n\n";
+            return;
+        }
+        out << R"(// 对冲阈值与统计：阈值为固定时长，或最近若干次尝试延迟的分位数
+class MrpcHedgePolicy {
+public:
+  static constexpr size_t kSamples = 512;    // 按分位数对冲时保留的最近延迟样本数
+  static constexpr size_t kMinSamples = 64;  // 样本少于此数时不对冲
+  static constexpr size_t kRecompute = 32;   // 每收到这么多样本重新计算一次阈值
+
+  MrpcHedgePolicy(int64_t after_ms, double after_percentile, size_t max_extra)
+      : percentile_(after_percentile), max_extra_(max_extra),
+        threshold_us_(after_percentile > 0 ? -1 : after_ms * 1000) {}
+
+  size_t MaxExtra() const { return max_extra_; }
+  int64_t ThresholdUs() const { return threshold_us_.load(std::memory_order_relaxed); }
+
+  void Record(int64_t latency_us) {
+    if (percentile_ <= 0) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    samples_[recorded_++ % kSamples] = latency_us;
+    size_t count = std::min(recorded_, kSamples);
+    if (count < kMinSamples || recorded_ % kRecompute != 0) return;
+    std::vector<int64_t> sorted(samples_.begin(), samples_.begin() + count);
+    size_t k = std::min(count - 1, static_cast<size_t>(count * percentile_ / 100));
+    std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+    threshold_us_.store(sorted[k], std::memory_order_relaxed);
+  }
+
+  void CountCall() { calls_.fetch_add(1, std::memory_order_relaxed); }
+  void CountHedge() { hedges_.fetch_add(1, std::memory_order_relaxed); }
+  void CountWin() { wins_.fetch_add(1, std::memory_order_relaxed); }
+  void CountSkipped() { skipped_.fetch_add(1, std::memory_order_relaxed); }
+
+  MrpcHedgeStats Stats() const {
+    MrpcHedgeStats stats;
+    stats.calls = calls_.load(std::memory_order_relaxed);
+    stats.hedges = hedges_.load(std::memory_order_relaxed);
+    stats.hedge_wins = wins_.load(std::memory_order_relaxed);
+    stats.hedges_skipped = skipped_.load(std::memory_order_relaxed);
+    stats.threshold_us = ThresholdUs();
+    return stats;
+  }
+
+private:
+  double percentile_;
+  size_t max_extra_;
+  std::atomic<int64_t> threshold_us_;
+  std::mutex mutex_;
+  std::array<int64_t, kSamples> samples_{};
+  size_t recorded_ = 0;
+  std::atomic<uint64_t> calls_{0};
+  std::atomic<uint64_t> hedges_{0};
+  std::atomic<uint64_t> wins_{0};
+  std::atomic<uint64_t> skipped_{0};
+};
+
+// 发出备份请求的定时器：一个后台线程按到期时间执行任务，首次使用时启动
+class MrpcHedgeTimer {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  MrpcHedgeTimer() = default;
+  MrpcHedgeTimer(const MrpcHedgeTimer &) = delete;
+  MrpcHedgeTimer &operator=(const MrpcHedgeTimer &) = delete;
+
+  ~MrpcHedgeTimer() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
+  }
+
+  void Schedule(Clock::time_point at, std::function<void()> task) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!thread_.joinable()) thread_ = std::thread([this] { Run(); });
+    tasks_.emplace(at, std::move(task));
+    cv_.notify_one();
+  }
+
+private:
+  void Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+      if (tasks_.empty()) {
+        cv_.wait(lock);
+        continue;
+      }
+      auto next = tasks_.begin();
+      if (next->first > Clock::now()) {
+        cv_.wait_until(lock, next->first);
+        continue;
+      }
+      std::function<void()> task = std::move(next->second);
+      tasks_.erase(next);
+      lock.unlock();
+      task();
+      lock.lock();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::multimap<Clock::time_point, std::function<void()>> tasks_;
+  bool stop_ = false;
+  std::thread thread_;
+};
+
+// 一次对冲调用：首个请求超过阈值仍未返回时向其他连接发出备份请求，采用最先成功的响应；
+// 运行时不支持取消在途请求，落后的尝试返回后直接丢弃。备份请求在定时器线程上发出，
+// send收到backup为true时不能阻塞，窗口满时返回false放弃这次备份
+template <typename Pool, typename Request, typename Response>
+class MrpcHedgedCall : public std::enable_shared_from_this<MrpcHedgedCall<Pool, Request, Response>> {
+public:
+  using Callback = std::function<void(mrpc::Status)>;
+  using Send = std::function<bool(size_t, Request &, Response &, bool backup, Callback)>;
+  using Healthy = std::function<bool(const mrpc::Status &)>;  // 尝试的结果是否不计为连接失败
+
+  MrpcHedgedCall(Pool &pool, MrpcHedgePolicy &policy, MrpcHedgeTimer &timer, const Request &request,
+                 Response &response, Callback callback, Send send, Healthy healthy)
+      : pool_(pool), policy_(policy), timer_(timer), request_(request), response_(response),
+        callback_(std::move(callback)), send_(std::move(send)), healthy_(std::move(healthy)),
+        attempts_(policy.MaxExtra() + 1) {}
+
+  void Start() {
+    policy_.CountCall();
+    Launch();
+  }
+
+private:
+  struct Attempt {
+    size_t index = 0;
+    Response response;
+    MrpcHedgeTimer::Clock::time_point start;
+  };
+
+  void Launch() {
+    size_t n;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (done_ || launched_ == attempts_.size()) return;
+      std::vector<size_t> used;
+      for (size_t i = 0; i < launched_; ++i) used.push_back(attempts_[i].index);
+      n = launched_++;
+      ++pending_;
+      attempts_[n].index = pool_.PickExcept(used);
+      attempts_[n].start = MrpcHedgeTimer::Clock::now();
+    }
+    auto self = this->shared_from_this();
+    int64_t threshold_us = policy_.ThresholdUs();
+    if (n + 1 < attempts_.size() && threshold_us >= 0) {
+      timer_.Schedule(attempts_[n].start + std::chrono::microseconds(threshold_us),
+                      [self] { self->Launch(); });
+    }
+    bool sent = send_(attempts_[n].index, request_, attempts_[n].response, n > 0,
+                      [self, n](mrpc::Status status) { self->Finish(n, status); });
+    if (n == 0) return;
+    if (sent) {
+      policy_.CountHedge();
+    } else {
+      Skip(n);
+    }
+  }
+
+  // 放弃的备份请求归还连接，不计为失败；其他尝试都已失败时以最后一次失败作为结果
+  void Skip(size_t n) {
+    policy_.CountSkipped();
+    pool_.Release(attempts_[n].index, true);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --pending_;
+      if (done_ || pending_ > 0) return;
+      done_ = true;
+    }
+    callback_(failure_);
+  }
+
+  void Finish(size_t n, mrpc::Status status) {
+    Attempt &attempt = attempts_[n];
+    policy_.Record(std::chrono::duration_cast<std::chrono::microseconds>(
+                       MrpcHedgeTimer::Clock::now() - attempt.start)
+                       .count());
+    pool_.Release(attempt.index, healthy_(status));
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --pending_;
+      // 失败的尝试只在没有其他尝试在途时才作为结果
+      if (done_) return;
+      if (!status.ok() && pending_ > 0) {
+        failure_ = status;
+        return;
+      }
+      done_ = true;
+    }
+    if (status.ok()) {
+      if (n > 0) policy_.CountWin();
+      response_ = attempt.response;
+    }
+    callback_(status);
+  }
+
+  Pool &pool_;
+  MrpcHedgePolicy &policy_;
+  MrpcHedgeTimer &timer_;
+  Request request_;  // 落后的尝试可能在调用返回后才发出，请求需要自己的副本
+  Response &response_;
+  Callback callback_;
+  Send send_;
+  Healthy healthy_;
+  std::mutex mutex_;
+  std::vector<Attempt> attempts_;
+  size_t launched_ = 0;
+  size_t pending_ = 0;
+  bool done_ = false;
+  mrpc::Status failure_;
+};
+
+)";
+    }
+
+    // 生成在途窗口辅助类，仅在存在max_in_flight注解时输出
+    void generateWindowHelper(std::ostream &out, HelperPart part) {
+        if (!hasWindows()) return;
+        if (part != HelperPart::kDefinitions) {
+            out << R"(// 在途窗口满时的处理策略
+enum class MrpcWindowPolicy {
+  kBlock,     // 阻塞调用线程，直到有调用完成归还信用
+  kFailFast,  // 立即返回kMrpcWindowFull
+  kAwait,     // 回调方式的调用挂起，有信用归还时再发出；同步和Async调用等同kBlock
+};
+
+// 窗口满时返回的状态码，取值与gRPC的RESOURCE_EXHAUSTED一致
+constexpr int kMrpcWindowFull = 8;
+
+// 在途窗口的统计快照
+struct MrpcWindowStats {
+  size_t capacity = 0;
+  size_t in_flight = 0;
+  size_t parked = 0;
+  uint64_t rejected = 0;
+};
+
+)";
+        }
+        if (part == HelperPart::kDeclarations) {
+            out << "class MrpcInFlightWindow;\n\n";
+            return;
+        }
+        out << R"(// 基于信用的在途调用窗口：每个发出的调用占用一个信用，完成后归还；
+// 挂起的调用也以容量为上限，窗口满时存根占用的内存因此有界
+class MrpcInFlightWindow {
+public:
+  explicit MrpcInFlightWindow(size_t capacity) : capacity_(std::max<size_t>(1, capacity)) {}
+
+  void SetPolicy(MrpcWindowPolicy policy) { policy_.store(policy, std::memory_order_relaxed); }
+
+  // 占用一个信用；kFailFast在窗口满时立即失败，其余策略阻塞等待
+  mrpc::Status Acquire() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (Full() && Policy() == MrpcWindowPolicy::kFailFast) return Reject();
+    cv_.wait(lock, [this] { return !Full(); });
+    ++in_flight_;
+    return mrpc::Status();
+  }
+
+  template <typename Send>
+  mrpc::Status Call(Send &&send) {
+    mrpc::Status status = Acquire();
+    if (!status.ok()) return status;
+    status = send();
+    Release();
+    return status;
+  }
+
+  // 回调方式的调用：start收到包装后的完成回调，完成时先归还信用再通知调用方；
+  // 被拒绝时直接以失败状态调用callback
+  template <typename Start>
+  void Callback(Start start, std::function<void(mrpc::Status)> callback) {
+    mrpc::Status admitted = Admit([this, start, callback] {
+      start([this, callback](mrpc::Status status) {
+        Release();
+        callback(status);
+      });
+    });
+    if (!admitted.ok()) callback(admitted);
+  }
+
+  // 只在有空闲信用时发出，不按策略等待或挂起；窗口满时返回false，不调用callback
+  template <typename Start>
+  bool TryCallback(Start start, std::function<void(mrpc::Status)> callback) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (Full()) {
+        ++rejected_;
+        return false;
+      }
+      ++in_flight_;
+    }
+    start([this, callback](mrpc::Status status) {
+      Release();
+      callback(status);
+    });
+    return true;
+  }
+
+  // 归还一个信用；有挂起的调用时信用直接转交给最早挂起的那个，由当前线程发出
+  void Release() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (parked_.empty()) {
+      --in_flight_;
+      lock.unlock();
+      cv_.notify_one();
+      return;
+    }
+    std::function<void()> run = std::move(parked_.front());
+    parked_.pop_front();
+    lock.unlock();
+    run();
+  }
+
+  MrpcWindowStats Stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    MrpcWindowStats stats;
+    stats.capacity = capacity_;
+    stats.in_flight = in_flight_;
+    stats.parked = parked_.size();
+    stats.rejected = rejected_;
+    return stats;
+  }
+
+private:
+  MrpcWindowPolicy Policy() const { return policy_.load(std::memory_order_relaxed); }
+  bool Full() const { return in_flight_ >= capacity_; }
+
+  mrpc::Status Reject() {
+    ++rejected_;
+    return mrpc::Status(kMrpcWindowFull, "in-flight window is full");
+  }
+
+  // 有信用时立即执行run；窗口满时按策略拒绝、挂起或阻塞
+  mrpc::Status Admit(std::function<void()> run) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (Full()) {
+      MrpcWindowPolicy policy = Policy();
+      if (policy == MrpcWindowPolicy::kFailFast ||
+          (policy == MrpcWindowPolicy::kAwait && parked_.size() >= capacity_)) {
+        return Reject();
+      }
+      if (policy == MrpcWindowPolicy::kAwait) {
+        parked_.push_back(std::move(run));
+        return mrpc::Status();
+      }
+      cv_.wait(lock, [this] { return !Full(); });
+    }
+    ++in_flight_;
+    lock.unlock();
+    run();
+    return mrpc::Status();
+  }
+
+  const size_t capacity_;
+  std::atomic<MrpcWindowPolicy> policy_{MrpcWindowPolicy::kBlock};
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  size_t in_flight_ = 0;
+  uint64_t rejected_ = 0;
+  std::deque<std::function<void()>> parked_;
+};
+
+)";
+    }
+
+    // 生成分片键哈希和分片执行器，仅在存在shard_key注解时输出；哈希不依赖运行时，拆分模式下放在头文件中
+    void generateShardHelper(std::ostream &out, HelperPart part) {
+        if (!hasShardedMethods()) return;
+        if (part != HelperPart::kDefinitions) {
+            out << R"(// 分片键的哈希：对键的文本形式（字符串取原字节，整数取十进制，布尔取true/false）做FNV-1a 64后取模，
+// 各语言的存根和服务按同一规则选择分片
+inline size_t MrpcShardOf(std::string_view key, size_t shards) {
+  uint64_t hash = 14695981039346656037ull;
+  for (unsigned char c : key) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return static_cast<size_t>(hash % shards);
+}
+
+// 字面量否则会经指针到bool的转换选中布尔的重载
+inline size_t MrpcShardOf(const char *key, size_t shards) { return MrpcShardOf(std::string_view(key), shards); }
+
+inline size_t MrpcShardOf(int64_t key, size_t shards) {
+  char buffer[24];
+  auto result = std::to_chars(buffer, buffer + sizeof(buffer), key);
+  return MrpcShardOf(std::string_view(buffer, result.ptr - buffer), shards);
+}
+
+inline size_t MrpcShardOf(bool key, size_t shards) {
+  return MrpcShardOf(key ? std::string_view("true") : std::string_view("false"), shards);
+}
+
+)";
+        }
+        if (part == HelperPart::kDeclarations) return;
+        out << R"(// 分片执行器：每个分片一个工作线程（Linux下依次绑定到进程可用的各个核），
+// 分片的服务实例只在它的线程上被调用，实例内的状态无需加锁
+class MrpcShardExecutor {
+public:
+  explicit MrpcShardExecutor(size_t shards)
+      : size_(shards > 0 ? shards : std::max(1u, std::thread::hardware_concurrency())),
+        shards_(new Shard[size_]) {
+    for (size_t i = 0; i < size_; ++i) {
+      shards_[i].thread = std::thread([this, i] { Loop(i); });
+    }
+  }
+
+  // 先执行完已入队的任务再退出，等待中的调用不会被丢下
+  ~MrpcShardExecutor() {
+    for (size_t i = 0; i < size_; ++i) {
+      std::lock_guard<std::mutex> lock(shards_[i].mutex);
+      shards_[i].stop = true;
+      shards_[i].cv.notify_one();
+    }
+    for (size_t i = 0; i < size_; ++i) shards_[i].thread.join();
+  }
+
+  size_t Size() const { return size_; }
+
+  // 没有分片键的方法轮流分给各分片
+  size_t Next() { return next_.fetch_add(1, std::memory_order_relaxed) % size_; }
+
+  // 在分片的线程上执行fn并等待返回；调用方已在该线程上时直接执行
+  template <typename F>
+  auto Run(size_t shard, F &&fn) -> decltype(fn()) {
+    using Result = decltype(fn());
+    if (current_ == &shards_[shard]) return fn();
+    struct Call : Task {
+      F *fn;
+      Result result{};
+      std::mutex mutex;
+      std::condition_variable cv;
+      bool done = false;
+    } call;
+    call.fn = &fn;
+    call.run = [](Task *task) {
+      auto *self = static_cast<Call *>(task);
+      Result result = (*self->fn)();
+      std::lock_guard<std::mutex> lock(self->mutex);
+      self->result = std::move(result);
+      self->done = true;
+      self->cv.notify_one();
+    };
+    Push(shard, &call);
+    std::unique_lock<std::mutex> lock(call.mutex);
+    call.cv.wait(lock, [&call] { return call.done; });
+    return std::move(call.result);
+  }
+
+  // 投递到分片的线程上执行，不等待；fn需持有它用到的数据的副本
+  template <typename F>
+  void Post(size_t shard, F fn) {
+    struct Posted : Task {
+      explicit Posted(F f) : fn(std::move(f)) {}
+      F fn;
+    };
+    auto *posted = new Posted(std::move(fn));
+    posted->run = [](Task *task) {
+      std::unique_ptr<Posted> self(static_cast<Posted *>(task));
+      self->fn();
+    };
+    Push(shard, posted);
+  }
+
+private:
+  // 任务由调用方分配：Run的任务在调用方的栈上，Post的任务在堆上并在执行后释放
+  struct Task {
+    void (*run)(Task *task) = nullptr;
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<Task *> queue;
+    bool stop = false;
+    std::thread thread;
+  };
+
+  void Push(size_t shard, Task *task) {
+    std::lock_guard<std::mutex> lock(shards_[shard].mutex);
+    shards_[shard].queue.push_back(task);
+    shards_[shard].cv.notify_one();
+  }
+
+  void Loop(size_t index) {
+    Shard &shard = shards_[index];
+    current_ = &shard;
+    Pin(index);
+    std::vector<Task *> batch;
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    for (;;) {
+      shard.cv.wait(lock, [&shard] { return shard.stop || !shard.queue.empty(); });
+      if (shard.queue.empty()) return;
+      // 整批取出，执行期间不持锁；两个缓冲轮换使用，稳定后不再分配
+      batch.swap(shard.queue);
+      lock.unlock();
+      for (Task *task : batch) task->run(task);
+      batch.clear();
+      lock.lock();
+    }
+  }
+
+  // 绑定到进程可用的第index个核（取模）；容器等受限环境下绑定失败时照常运行
+  static void Pin(size_t index) {
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return;
+    int count = CPU_COUNT(&allowed);
+    if (count == 0) return;
+    int target = static_cast<int>(index % count);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (!CPU_ISSET(cpu, &allowed) || target-- > 0) continue;
+      cpu_set_t one;
+      CPU_ZERO(&one);
+      CPU_SET(cpu, &one);
+      pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+      return;
+    }
+#else
+    (void)index;
+#endif
+  }
+
+  static inline thread_local const Shard *current_ = nullptr;
+  size_t size_;
+  std::unique_ptr<Shard[]> shards_;
+  std::atomic<size_t> next_{0};
+};
+
+)";
+    }
+
+    // 生成按优先级分队列的分发器，仅在存在priority注解时输出；优先级类型和统计不依赖运行时，拆分模式下放在头文件中
+    void generatePriorityHelper(std::ostream &out, HelperPart part) {
+        if (!hasPriorities()) return;
+        if (part != HelperPart::kDefinitions) {
+            out << R"(// 服务端分发的优先级类别，由方法的priority注解决定
+enum class MrpcPriority { kHigh = 0, kNormal = 1, kBulk = 2 };
+
+// 各优先级类别的分发统计，下标为MrpcPriority
+struct MrpcPriorityStats {
+  uint64_t dispatched[3] = {};  // 已开始执行的请求数
+  uint64_t rejected[3] = {};    // 因队列已满被拒绝的请求数
+  size_t queued[3] = {};        // 当前排队的请求数
+};
+
+)";
+        }
+        if (part == HelperPart::kDeclarations) return;
+        out << R"(constexpr int kMrpcQueueFull = 8;      // 优先级队列已满，与gRPC的RESOURCE_EXHAUSTED一致
+constexpr int kMrpcShuttingDown = 14;  // 服务析构时仍在排队的请求，与gRPC的UNAVAILABLE一致
+
+// 按优先级分队列的分发器：处理函数不在运行时的线程上直接执行，而是按方法的优先级进入各自的队列，
+// 由工作线程取出。几个类别都有请求排队时按权重（默认8:4:1）平滑轮转，且批量请求最多占用批量线程数
+// （默认为工作线程数的一半）个工作线程；高优先级和普通队列为空时批量请求可借用其余空闲的工作线程，
+// 借出的线程要等手上的批量请求执行完才能处理新到的高优先级请求。
+// 运行时的处理函数是同步的，同步请求排队期间仍占着运行时的分发线程，优先级只决定已入队的请求谁先执行；
+// 排队上限默认不限，批量请求积压时可能占满运行时的分发线程，使高优先级请求无法入队，
+// 需要时用SetQueueLimit为批量类别设置上限，多出的请求立即以kMrpcQueueFull失败
+class MrpcPriorityScheduler {
+public:
+  explicit MrpcPriorityScheduler(size_t workers)
+      : workers_(workers > 0 ? workers : std::max(2u, std::thread::hardware_concurrency())),
+        bulk_limit_(std::max<size_t>(1, workers_ / 2)) {}
+
+  // 派生的Service此时已析构，仍在排队的请求不再执行：同步请求返回kMrpcShuttingDown，单向请求丢弃；
+  // 正在执行的处理函数仍会用到Service，因此应先停止服务器再析构Service
+  ~MrpcPriorityScheduler() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto &thread : threads_) thread.join();
+    for (auto &queue : queues_) {
+      for (Task *task : queue) task->run(task, false);
+    }
+  }
+
+  // 每轮调度中各类别所占的份额，默认高:普通:批量为8:4:1
+  void SetWeights(unsigned high, unsigned normal, unsigned bulk) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    weights_ = {std::max(1u, high), std::max(1u, normal), std::max(1u, bulk)};
+  }
+
+  // 有高优先级或普通请求排队时批量请求可同时占用的工作线程数，默认为工作线程数的一半
+  void SetBulkLimit(size_t workers) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bulk_limit_ = std::max<size_t>(1, workers);
+  }
+
+  // 类别的排队上限，默认0为不限；队列满时新请求立即以kMrpcQueueFull失败，单向请求被丢弃
+  void SetQueueLimit(MrpcPriority priority, size_t limit) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    limits_[Index(priority)] = limit;
+  }
+
+  MrpcPriorityStats Stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    MrpcPriorityStats stats;
+    for (size_t i = 0; i < 3; ++i) {
+      stats.dispatched[i] = dispatched_[i];
+      stats.rejected[i] = rejected_[i];
+      stats.queued[i] = queues_[i].size();
+    }
+    return stats;
+  }
+
+  // 在工作线程上执行fn并等待返回，等待期间阻塞调用方（运行时的分发线程）；调用方已在工作线程上时直接执行
+  template <typename F>
+  mrpc::Status Run(MrpcPriority priority, F &&fn) {
+    if (current_ == this) return fn();
+    struct Call : Task {
+      F *fn;
+      mrpc::Status status;
+      std::mutex mutex;
+      std::condition_variable cv;
+      bool done = false;
+    } call;
+    call.fn = &fn;
+    call.run = [](Task *task, bool execute) {
+      auto *self = static_cast<Call *>(task);
+      mrpc::Status status = execute ? (*self->fn)() : mrpc::Status(kMrpcShuttingDown, "service is shutting down");
+      std::lock_guard<std::mutex> lock(self->mutex);
+      self->status = std::move(status);
+      self->done = true;
+      self->cv.notify_one();
+    };
+    if (!Push(priority, &call)) return mrpc::Status(kMrpcQueueFull, "priority queue is full");
+    std::unique_lock<std::mutex> lock(call.mutex);
+    call.cv.wait(lock, [&call] { return call.done; });
+    return std::move(call.status);
+  }
+
+  // 投递到队列后立即返回；fn需持有它用到的数据的副本
+  template <typename F>
+  bool Post(MrpcPriority priority, F fn) {
+    struct Posted : Task {
+      explicit Posted(F f) : fn(std::move(f)) {}
+      F fn;
+    };
+    auto *posted = new Posted(std::move(fn));
+    posted->run = [](Task *task, bool execute) {
+      std::unique_ptr<Posted> self(static_cast<Posted *>(task));
+      if (execute) self->fn();
+    };
+    if (Push(priority, posted)) return true;
+    delete posted;
+    return false;
+  }
+
+private:
+  // 任务由调用方分配：Run的任务在调用方的栈上，Post的任务在堆上并在执行或丢弃后释放
+  struct Task {
+    void (*run)(Task *task, bool execute) = nullptr;
+  };
+
+  static size_t Index(MrpcPriority priority) { return static_cast<size_t>(priority); }
+
+  bool Push(MrpcPriority priority, Task *task) {
+    // 工作线程在首个请求到来时才启动，没有请求的Service不占用线程
+    std::call_once(started_, [this] {
+      for (size_t i = 0; i < workers_; ++i) threads_.emplace_back([this] { Loop(); });
+    });
+    size_t index = Index(priority);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (limits_[index] > 0 && queues_[index].size() >= limits_[index]) {
+        ++rejected_[index];
+        return false;
+      }
+      queues_[index].push_back(task);
+    }
+    cv_.notify_one();
+    return true;
+  }
+
+  // 平滑加权轮转：可取的类别各加上自己的权重，取累计最大者，再减去可取类别的权重和；
+  // 队列为空的类别不参与本次选择；批量已达线程上限且还有其他请求排队时批量也不参与，调用时持有mutex_
+  int Pick() {
+    int best = -1;
+    unsigned total = 0;
+    bool others = !queues_[Index(MrpcPriority::kHigh)].empty() || !queues_[Index(MrpcPriority::kNormal)].empty();
+    for (size_t i = 0; i < 3; ++i) {
+      if (queues_[i].empty() || (i == Index(MrpcPriority::kBulk) && others && running_bulk_ >= bulk_limit_)) continue;
+      total += weights_[i];
+      credits_[i] += weights_[i];
+      if (best < 0 || credits_[i] > credits_[best]) best = static_cast<int>(i);
+    }
+    if (best >= 0) credits_[best] -= static_cast<int64_t>(total);
+    return best;
+  }
+
+  void Loop() {
+    current_ = this;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      int index = -1;
+      cv_.wait(lock, [this, &index] { return stop_ || (index = Pick()) >= 0; });
+      if (index < 0) return;
+      Task *task = queues_[index].front();
+      queues_[index].pop_front();
+      ++dispatched_[index];
+      bool bulk = index == static_cast<int>(Index(MrpcPriority::kBulk));
+      if (bulk) ++running_bulk_;
+      // 取走的可能是最后一个高优先级或普通请求，此后积压的批量请求可借用空闲线程
+      if (!bulk && !queues_[Index(MrpcPriority::kBulk)].empty()) cv_.notify_one();
+      lock.unlock();
+      task->run(task, true);
+      lock.lock();
+      // 让出的批量名额可能正有其他线程在等
+      if (bulk && running_bulk_-- >= bulk_limit_) cv_.notify_one();
+    }
+  }
+
+  static inline thread_local const MrpcPriorityScheduler *current_ = nullptr;
+  const size_t workers_;
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::array<std::deque<Task *>, 3> queues_;
+  std::array<unsigned, 3> weights_ = {8, 4, 1};
+  std::array<int64_t, 3> credits_ = {};
+  std::array<size_t, 3> limits_ = {};
+  std::array<uint64_t, 3> dispatched_ = {};
+  std::array<uint64_t, 3> rejected_ = {};
+  size_t bulk_limit_;
+  size_t running_bulk_ = 0;
+  bool stop_ = false;
+  std::once_flag started_;
+  std::vector<std::thread> threads_;
+};
+
+)";
+    }
+
+    // 生成分散-聚集编码的段列表类；不依赖json和运行时，拆分模式下也完整放在头文件中
+    void generateSegmentsHelper() {
+        if (!segmentsEnabled()) return;
+        output << R"(// 分散-聚集编码的结果：字段名、数字等小片段编码进自有缓冲，长字符串字段直接引用消息内存，
+// 按顺序拼接即为Encode()的输出；消息在段被发送完之前不能修改或析构
+class MrpcSegments {
+public:
+  static constexpr size_t kInlineMax = 1024;  // 短于此长度的字符串仍然拷贝进缓冲
+
+  void Append(std::string_view text) { buffer_.append(text.data(), text.size()); }
+
+  // 按JSON规则追加字符串，转义规则与nlohmann::json一致；足够长且无需转义时只记录引用
+  void AppendString(std::string_view s) {
+    bool escape = NeedsEscape(s);
+    buffer_ += '"';
+    if (!escape && s.size() >= kInlineMax) {
+      refs_.push_back({buffer_.size(), s});
+    } else if (!escape) {
+      Append(s);
+    } else {
+      AppendEscaped(s);
+    }
+    buffer_ += '"';
+  }
+
+  // 依次访问每一段
+  template <typename Visit>
+  void ForEach(Visit &&visit) const {
+    size_t pos = 0;
+    for (const auto &ref : refs_) {
+      if (ref.offset > pos) visit(std::string_view(buffer_).substr(pos, ref.offset - pos));
+      visit(ref.data);
+      pos = ref.offset;
+    }
+    if (pos < buffer_.size()) visit(std::string_view(buffer_).substr(pos));
+  }
+
+  std::vector<std::string_view> Segments() const {
+    std::vector<std::string_view> segments;
+    ForEach([&](std::string_view segment) { segments.push_back(segment); });
+    return segments;
+  }
+
+  size_t Size() const {
+    size_t size = buffer_.size();
+    for (const auto &ref : refs_) size += ref.data.size();
+    return size;
+  }
+
+  // 不支持分散写的传输退化为拼接成一个连续缓冲
+  std::string Flatten() const {
+    std::string out;
+    out.reserve(Size());
+    ForEach([&](std::string_view segment) { out.append(segment.data(), segment.size()); });
+    return out;
+  }
+
+  void Clear() {
+    buffer_.clear();
+    refs_.clear();
+  }
+
+#if defined(__unix__) || defined(__APPLE__)
+  // 用writev把全部段写到fd，处理部分写入和EINTR；返回false时errno指示错误
+  bool Writev(int fd) const {
+    std::vector<iovec> iov;
+    ForEach([&](std::string_view segment) {
+      iov.push_back({const_cast<char *>(segment.data()), segment.size()});
+    });
+    size_t index = 0;
+    while (index < iov.size()) {
+      int count = static_cast<int>(std::min<size_t>(iov.size() - index, IOV_MAX));
+      ssize_t written = ::writev(fd, iov.data() + index, count);
+      if (written < 0) {
+        if (errno == EINTR) continue;
+        return false;
+      }
+      size_t left = static_cast<size_t>(written);
+      while (index < iov.size() && left >= iov[index].iov_len) left -= iov[index++].iov_len;
+      if (left > 0) {
+        iov[index].iov_base = static_cast<char *>(iov[index].iov_base) + left;
+        iov[index].iov_len -= left;
+      }
+    }
+    return true;
+  }
+#endif
+
+private:
+  struct Ref {
+    size_t offset;  // 引用插在buffer_的这个位置之前
+    std::string_view data;
+  };
+
+  // 返回从i开始的UTF-8序列长度，非法序列返回0；与nlohmann::json同样拒绝过长编码和代理项
+  static size_t Utf8Length(std::string_view s, size_t i) {
+    unsigned char c = static_cast<unsigned char>(s[i]);
+    size_t n;
+    uint32_t cp;
+    if (c >= 0xc2 && c <= 0xdf) {
+      n = 2;
+      cp = c & 0x1f;
+    } else if (c >= 0xe0 && c <= 0xef) {
+      n = 3;
+      cp = c & 0x0f;
+    } else if (c >= 0xf0 && c <= 0xf4) {
+      n = 4;
+      cp = c & 0x07;
+    } else {
+      return 0;
+    }
+    if (i + n > s.size()) return 0;
+    for (size_t k = 1; k < n; ++k) {
+      unsigned char b = static_cast<unsigned char>(s[i + k]);
+      if ((b & 0xc0) != 0x80) return 0;
+      cp = (cp << 6) | (b & 0x3f);
+    }
+    if ((n == 3 && (cp < 0x800 || (cp >= 0xd800 && cp <= 0xdfff))) ||
+        (n == 4 && (cp < 0x10000 || cp > 0x10ffff))) {
+      return 0;
+    }
+    return n;
+  }
+
+  // 检查是否含需要转义的字符；非法UTF-8与Encode()一样抛出异常
+  static bool NeedsEscape(std::string_view s) {
+    bool escape = false;
+    for (size_t i = 0; i < s.size();) {
+      unsigned char c = static_cast<unsigned char>(s[i]);
+      if (c < 0x80) {
+        escape = escape || c < 0x20 || c == '"' || c == '\\';
+        ++i;
+        continue;
+      }
+      size_t n = Utf8Length(s, i);
+      if (n == 0) throw std::invalid_argument("invalid UTF-8 in string field");
+      i += n;
+    }
+    return escape;
+  }
+
+  void AppendEscaped(std::string_view s) {
+    static const char kHex[] = "0123456789abcdef";
+    for (char ch : s) {
+      unsigned char c = static_cast<unsigned char>(ch);
+      switch (c) {
+        case '"': buffer_ += "\\\""; break;
+        case '\\': buffer_ += "\\\\"; break;
+        case '\b': buffer_ += "\\b"; break;
+        case '\f': buffer_ += "\\f"; break;
+        case '\n': buffer_ += "\\n"; break;
+        case '\r': buffer_ += "\\r"; break;
+        case '\t': buffer_ += "\\t"; break;
+        default:
+          if (c < 0x20) {
+            buffer_ += "\\u00";
+            buffer_ += kHex[c >> 4];
+            buffer_ += kHex[c & 0xf];
+          } else {
+            buffer_ += ch;
+          }
+      }
+    }
+  }
+
+  std::string buffer_;
+  std::vector<Ref> refs_;
+};
+
+)";
+    }
+
+    // 单向方法在运行时中仍要登记一个响应类型，服务端回送的空确认由它接收后丢弃；
+    // 拆分模式下只在源文件中使用
+    void generateNoReplyHelper(std::ostream &out) {
+        if (!hasOnewayMethods()) return;
+        out << R"(// 单向方法的占位响应：不含字段，收到的确认直接丢弃
+class MrpcNoReply : public mrpc::Parser {
+private:
+  json toJson() const override { return json(); }
+  void fromJson(const json &) override {}
+};
+
+)";
+    }
+
+    // 生成共享内存传输的辅助类，仅在指定--shm时输出
+    void generateShmHelper() {
+        if (!options.shm) return;
+        output << R"(// 共享内存传输：shm://name对应一个POSIX共享内存段，段内每个客户端独占一个槽位，
+// 槽位由请求、响应两个单生产者单消费者环形队列组成，编码后的消息直接拷入环中，收发不经过内核
+constexpr size_t kMrpcShmRingBytes = 1 << 20;
+constexpr size_t kMrpcShmSlots = 8;
+constexpr uint64_t kMrpcShmMagic = 0x6d7270632d73686dULL;
+constexpr std::chrono::seconds kMrpcShmTimeout{10};
+constexpr std::chrono::seconds kMrpcShmReapInterval{1};  // 服务端检查占用槽位的客户端是否存活的间隔
+constexpr uint64_t kMrpcShmOneway = 0;  // 单向请求的帧序号，服务端不回响应
+
+// 共享内存通道返回的错误码，取值与gRPC的状态码一致
+enum MrpcShmCode : int {
+  kMrpcShmDeadlineExceeded = 4,
+  kMrpcShmResourceExhausted = 8,
+  kMrpcShmUnimplemented = 12,
+  kMrpcShmInternal = 13,
+  kMrpcShmUnavailable = 14,
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shm ring requires lock-free atomics");
+
+inline bool MrpcIsShmAddress(const std::string &addr) { return addr.compare(0, 6, "shm://") == 0; }
+
+// shm://greeter 对应的共享内存对象名为 /mrpc.greeter
+inline std::string MrpcShmName(const std::string &addr) {
+  return "/mrpc." + addr.substr(MrpcIsShmAddress(addr) ? 6 : 0);
+}
+
+// 忙等的退避：先自旋，再让出CPU，长时间空闲后睡眠，避免空转占满核心
+class MrpcShmBackoff {
+public:
+  void Pause() {
+    if (++spins_ < 128) {
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+    } else if (spins_ < 4096) {
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  }
+  void Reset() { spins_ = 0; }
+
+private:
+  int spins_ = 0;
+};
+
+// 单生产者单消费者字节环：帧为[长度:4][状态码:4][序号:8][数据]，按16字节对齐；
+// 尾部放不下整帧时写入回绕标记，从头开始写
+struct MrpcShmRing {
+  static constexpr uint32_t kWrap = 0xffffffffu;
+  static constexpr size_t kHeader = 16;
+
+  struct Frame {
+    uint64_t seq;
+    int32_t code;
+    std::string_view data;
+    uint64_t next;
+  };
+
+  alignas(64) std::atomic<uint64_t> head;  // 消费者读到的位置
+  alignas(64) std::atomic<uint64_t> tail;  // 生产者写到的位置
+  alignas(64) char bytes[kMrpcShmRingBytes];
+
+  static size_t FrameSize(size_t n) { return (kHeader + n + 15) & ~size_t{15}; }
+
+  void Reset() {
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_release);
+  }
+
+  // 写入一帧，数据为prefix和body各段的拼接；空间不足时返回false，由调用方退避重试
+  bool TryWrite(uint64_t seq, int32_t code, std::string_view prefix, const MrpcSegments &body) {
+    uint32_t n = static_cast<uint32_t>(prefix.size() + body.Size());
+    size_t frame = FrameSize(n);
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    size_t offset = t % kMrpcShmRingBytes;
+    size_t skip = kMrpcShmRingBytes - offset < frame ? kMrpcShmRingBytes - offset : 0;
+    if (t + skip + frame - head.load(std::memory_order_acquire) > kMrpcShmRingBytes) return false;
+    if (skip > 0) {
+      std::memcpy(bytes + offset, &kWrap, sizeof(kWrap));
+      offset = 0;
+    }
+    char *p = bytes + offset;
+    std::memcpy(p, &n, 4);
+    std::memcpy(p + 4, &code, 4);
+    std::memcpy(p + 8, &seq, 8);
+    std::memcpy(p + kHeader, prefix.data(), prefix.size());
+    p += kHeader + prefix.size();
+    body.ForEach([&p](std::string_view segment) {
+      std::memcpy(p, segment.data(), segment.size());
+      p += segment.size();
+    });
+    tail.store(t + skip + frame, std::memory_order_release);
+    return true;
+  }
+
+  // 查看下一帧，数据指向环内存，处理完后调用Pop释放空间
+  bool Peek(Frame &frame) {
+    uint64_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) return false;
+    size_t offset = h % kMrpcShmRingBytes;
+    uint32_t n;
+    std::memcpy(&n, bytes + offset, 4);
+    if (n == kWrap) {
+      h += kMrpcShmRingBytes - offset;
+      offset = 0;
+      std::memcpy(&n, bytes, 4);
+    }
+    std::memcpy(&frame.code, bytes + offset + 4, 4);
+    std::memcpy(&frame.seq, bytes + offset + 8, 8);
+    frame.data = std::string_view(bytes + offset + kHeader, n);
+    frame.next = h + FrameSize(n);
+    return true;
+  }
+
+  void Pop(const Frame &frame) { head.store(frame.next, std::memory_order_release); }
+};
+
+struct MrpcShmSlot {
+  static constexpr uint32_t kFree = 0, kClaiming = 1, kActive = 2;
+  alignas(64) std::atomic<uint32_t> state;
+  std::atomic<uint32_t> generation;  // 每次被占用加一，服务端据此丢弃已断开客户端的响应
+  std::atomic<int32_t> pid;          // 占用槽位的客户端进程，进程退出后由服务端回收
+  MrpcShmRing requests;
+  MrpcShmRing responses;
+};
+
+// 进程是否存在；无权发信号(EPERM)的进程也算存在。客户端与服务端须在同一个pid命名空间
+inline bool MrpcShmProcessAlive(int32_t pid) { return kill(pid, 0) == 0 || errno != ESRCH; }
+
+struct MrpcShmSegment {
+  std::atomic<uint64_t> magic;
+  std::atomic<uint32_t> alive;  // 服务端Stop后清零，等待中的客户端立即失败
+  MrpcShmSlot slots[kMrpcShmSlots];
+};
+
+// 映射一个共享内存段；服务端创建并在析构时删除，客户端只打开。
+// 服务端在整个生命周期内持有段上的排他flock，进程退出时由内核释放，据此区分运行中的服务端和残留的段
+class MrpcShmMapping {
+public:
+  static std::unique_ptr<MrpcShmMapping> Open(const std::string &name, bool create) {
+    if (!create) {
+      int fd = shm_open(name.c_str(), O_RDWR, 0600);
+      if (fd < 0) return nullptr;
+      auto mapping = Map(name, fd, false);
+      close(fd);
+      if (mapping != nullptr && mapping->segment->magic.load(std::memory_order_acquire) != kMrpcShmMagic) {
+        return nullptr;
+      }
+      return mapping;
+    }
+    // 同名段加锁失败说明其服务端仍在运行，拒绝接管；残留的段在持锁期间删除，
+    // 同时启动的另一个服务端因此拿不到旧段的锁，不会误删新建的段
+    int stale = shm_open(name.c_str(), O_RDWR, 0600);
+    if (stale >= 0) {
+      if (flock(stale, LOCK_EX | LOCK_NB) != 0) {
+        close(stale);
+        return nullptr;
+      }
+      shm_unlink(name.c_str());
+    }
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (stale >= 0) close(stale);
+    if (fd < 0) return nullptr;
+    // 新段在加锁前就可能被另一个服务端抢先锁住，此时由它接管，本端放弃且不删除
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+      close(fd);
+      return nullptr;
+    }
+    std::unique_ptr<MrpcShmMapping> mapping;
+    if (ftruncate(fd, sizeof(MrpcShmSegment)) == 0) mapping = Map(name, fd, true);
+    if (mapping == nullptr) {
+      shm_unlink(name.c_str());
+      close(fd);
+      return nullptr;
+    }
+    mapping->lock_fd_ = fd;
+    return mapping;
+  }
+
+  ~MrpcShmMapping() {
+    munmap(segment, sizeof(MrpcShmSegment));
+    if (owner_) shm_unlink(name_.c_str());
+    if (lock_fd_ >= 0) close(lock_fd_);
+  }
+
+  MrpcShmSegment *segment;
+
+private:
+  MrpcShmMapping(const std::string &name, void *addr, bool owner)
+      : segment(static_cast<MrpcShmSegment *>(addr)), name_(name), owner_(owner) {}
+
+  static std::unique_ptr<MrpcShmMapping> Map(const std::string &name, int fd, bool owner) {
+    void *addr = mmap(nullptr, sizeof(MrpcShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) return nullptr;
+    return std::unique_ptr<MrpcShmMapping>(new MrpcShmMapping(name, addr, owner));
+  }
+
+  std::string name_;
+  bool owner_;
+  int lock_fd_ = -1;
+};
+
+// 客户端通道：占用一个槽位，请求写入请求环，按序号从响应环取回；
+// 调用前才连接，服务端未启动或重启后下一次调用会重新连接
+class MrpcShmChannel {
+public:
+  explicit MrpcShmChannel(const std::string &addr) : name_(MrpcShmName(addr)) {}
+  ~MrpcShmChannel() { Detach(); }
+
+  template <typename Request>
+  mrpc::Status AsyncSend(const char *method, Request &request, std::string &key) {
+    uint64_t seq = 0;
+    mrpc::Status status = Write(method, request, &seq);
+    if (status.ok()) key = std::to_string(seq);
+    return status;
+  }
+
+  // 单向调用：请求写入请求环即返回，服务端不回响应
+  template <typename Request>
+  mrpc::Status OnewaySend(const char *method, Request &request) {
+    return Write(method, request, nullptr);
+  }
+
+  // 同一时刻只有一个调用读响应环，其余调用在条件变量上等它把各自的响应放进arrived_；
+  // 读环期间不持锁，发送和其他调用的接收照常进行
+  template <typename Response>
+  mrpc::Status Receive(const std::string &key, Response &response) {
+    uint64_t seq = std::strtoull(key.c_str(), nullptr, 10);
+    auto deadline = std::chrono::steady_clock::now() + kMrpcShmTimeout;
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = arrived_.find(seq);
+    while (it == arrived_.end()) {
+      if (!reading_) {
+        if (slot_ == nullptr) return mrpc::Status(kMrpcShmUnavailable, "shm channel is not connected");
+        reading_ = true;
+        lock.unlock();
+        mrpc::Status status = Wait(seq, deadline);
+        lock.lock();
+        reading_ = false;
+        ready_.notify_all();
+        if (!status.ok()) return status;
+      } else if (ready_.wait_until(lock, deadline) == std::cv_status::timeout && !arrived_.count(seq)) {
+        return mrpc::Status(kMrpcShmDeadlineExceeded, "shm call timed out");
+      }
+      it = arrived_.find(seq);
+    }
+    auto [code, data] = std::move(it->second);
+    arrived_.erase(it);
+    if (code != 0) return mrpc::Status(code, data);
+    try {
+      response.Decode(data);
+    } catch (const std::exception &e) {
+      return mrpc::Status(kMrpcShmInternal, e.what());
+    }
+    return mrpc::Status();
+  }
+
+  template <typename Request, typename Response>
+  mrpc::Status Send(const char *method, Request &request, Response &response) {
+    std::string key;
+    mrpc::Status status = AsyncSend(method, request, key);
+    return status.ok() ? Receive(key, response) : status;
+  }
+
+  // 共享内存调用延迟在微秒级，回调在调用线程内同步完成
+  template <typename Request, typename Response>
+  void CallbackSend(const char *method, Request &request, Response &response,
+                    std::function<void(mrpc::Status)> callback) {
+    callback(Send(method, request, response));
+  }
+
+private:
+  bool Alive() const { return mapping_->segment->alive.load(std::memory_order_acquire) != 0; }
+
+  // 编码并写入一个请求帧；seq为空时是单向请求，帧序号为kMrpcShmOneway
+  template <typename Request>
+  mrpc::Status Write(const char *method, Request &request, uint64_t *seq) {
+    MrpcSegments body;
+    request.EncodeSegments(body);
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    mrpc::Status status = Attach();
+    if (!status.ok()) return status;
+    std::string_view prefix(method, std::strlen(method) + 1);
+    if (MrpcShmRing::FrameSize(prefix.size() + body.Size()) > kMrpcShmRingBytes) {
+      return mrpc::Status(kMrpcShmResourceExhausted, "message exceeds shm ring capacity");
+    }
+    uint64_t frame_seq = seq == nullptr ? kMrpcShmOneway : ++next_seq_;
+    auto deadline = std::chrono::steady_clock::now() + kMrpcShmTimeout;
+    MrpcShmBackoff backoff;
+    while (!slot_->requests.TryWrite(frame_seq, 0, prefix, body)) {
+      if (!Alive() || std::chrono::steady_clock::now() > deadline) {
+        return mrpc::Status(kMrpcShmUnavailable, "shm server is not consuming requests");
+      }
+      backoff.Pause();
+    }
+    if (seq != nullptr) *seq = frame_seq;
+    return mrpc::Status();
+  }
+
+  // 占用一个空闲槽位，清空其环形队列后再交给服务端；有调用正在读响应环时不重连，
+  // 它发现服务端已停止后会自行返回
+  mrpc::Status Attach() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (slot_ != nullptr && Alive()) return mrpc::Status();
+    if (reading_) return mrpc::Status(kMrpcShmUnavailable, "shm server " + name_ + " stopped");
+    Detach();
+    mapping_ = MrpcShmMapping::Open(name_, false);
+    if (mapping_ == nullptr || !Alive()) {
+      mapping_.reset();
+      return mrpc::Status(kMrpcShmUnavailable, "shm server " + name_ + " is not running");
+    }
+    for (auto &slot : mapping_->segment->slots) {
+      uint32_t expected = MrpcShmSlot::kFree;
+      if (slot.state.compare_exchange_strong(expected, MrpcShmSlot::kClaiming,
+                                             std::memory_order_acq_rel)) {
+        slot.generation.fetch_add(1, std::memory_order_relaxed);
+        slot.pid.store(static_cast<int32_t>(getpid()), std::memory_order_relaxed);
+        slot.requests.Reset();
+        slot.responses.Reset();
+        slot.state.store(MrpcShmSlot::kActive, std::memory_order_release);
+        slot_ = &slot;
+        return mrpc::Status();
+      }
+    }
+    mapping_.reset();
+    return mrpc::Status(kMrpcShmResourceExhausted, "no free slot on shm server " + name_);
+  }
+
+  void Detach() {
+    if (slot_ != nullptr) slot_->state.store(MrpcShmSlot::kFree, std::memory_order_release);
+    slot_ = nullptr;
+    mapping_.reset();
+  }
+
+  // 读取响应直到拿到seq，途中读到的其他响应先暂存并唤醒等待者；调用方已置reading_，
+  // 期间槽位和映射不会被替换
+  mrpc::Status Wait(uint64_t seq, std::chrono::steady_clock::time_point deadline) {
+    MrpcShmBackoff backoff;
+    MrpcShmRing::Frame frame;
+    for (;;) {
+      while (slot_->responses.Peek(frame)) {
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          arrived_[frame.seq] = {frame.code, std::string(frame.data)};
+        }
+        slot_->responses.Pop(frame);
+        if (frame.seq == seq) return mrpc::Status();
+        ready_.notify_all();
+        backoff.Reset();
+      }
+      if (!Alive()) return mrpc::Status(kMrpcShmUnavailable, "shm server " + name_ + " stopped");
+      if (std::chrono::steady_clock::now() > deadline) {
+        return mrpc::Status(kMrpcShmDeadlineExceeded, "shm call timed out");
+      }
+      backoff.Pause();
+    }
+  }
+
+  std::string name_;
+  std::unique_ptr<MrpcShmMapping> mapping_;
+  MrpcShmSlot *slot_ = nullptr;
+  uint64_t next_seq_ = 0;
+  std::mutex write_mutex_;  // 请求环是单生产者的，同一通道上的发送串行进行
+  std::mutex mutex_;        // 保护槽位、arrived_和reading_
+  std::condition_variable ready_;
+  bool reading_ = false;    // 已有调用在读响应环，它是该环唯一的消费者
+  std::unordered_map<uint64_t, std::pair<int32_t, std::string>> arrived_;
+};
+
+// 服务端的处理函数表，生成的Service在构造时登记各方法；
+// 响应按段直接写入响应环，写完之前响应消息一直存活
+class MrpcShmService {
+public:
+  using Reply = std::function<void(const mrpc::Status &, const MrpcSegments &)>;
+  using Handler = std::function<void(const std::string &, const Reply &)>;
+
+  template <typename Request, typename Response, typename Handle>
+  void AddShmHandler(const std::string &method, Handle handle) {
+    shm_handlers_[method] = [handle](const std::string &data, const Reply &reply) {
+      Request request;
+      Response response;
+      MrpcSegments body;
+      request.Decode(data);
+      mrpc::Status status = handle(request, response);
+      if (status.ok()) response.EncodeSegments(body);
+      reply(status, body);
+    };
+  }
+
+  // 单向方法没有响应，处理完即结束
+  template <typename Request, typename Handle>
+  void AddShmOnewayHandler(const std::string &method, Handle handle) {
+    shm_handlers_[method] = [handle](const std::string &data, const Reply &) {
+      Request request;
+      request.Decode(data);
+      handle(request);
+    };
+  }
+
+  const std::unordered_map<std::string, Handler> &ShmHandlers() const { return shm_handlers_; }
+
+private:
+  std::unordered_map<std::string, Handler> shm_handlers_;
+};
+
+// 共享内存服务端：Start创建共享内存段并在当前线程轮询全部槽位，直到Stop；同名段的服务端仍在运行时
+// Start返回false。响应环满的槽位暂停读取请求，不读响应的慢客户端只阻塞自己，不影响其他槽位；
+// 客户端进程退出后它占用的槽位定期回收
+class MrpcShmServer {
+public:
+  explicit MrpcShmServer(const std::string &addr) : name_(MrpcShmName(addr)) {}
+  ~MrpcShmServer() { Stop(); }
+
+  void RegisterService(MrpcShmService *service) {
+    for (const auto &entry : service->ShmHandlers()) handlers_[entry.first] = entry.second;
+  }
+
+  bool Start() {
+    std::unique_ptr<MrpcShmMapping> mapping = MrpcShmMapping::Open(name_, true);
+    if (mapping == nullptr) return false;
+    MrpcShmSegment *segment = mapping->segment;
+    for (auto &slot : segment->slots) {
+      slot.state.store(MrpcShmSlot::kFree, std::memory_order_relaxed);
+      slot.generation.store(0, std::memory_order_relaxed);
+      slot.pid.store(0, std::memory_order_relaxed);
+    }
+    for (auto &pending : pending_) pending.waiting = false;
+    segment->alive.store(1, std::memory_order_relaxed);
+    segment->magic.store(kMrpcShmMagic, std::memory_order_release);
+
+    MrpcShmBackoff backoff;
+    MrpcShmRing::Frame frame;
+    auto next_reap = std::chrono::steady_clock::now() + kMrpcShmReapInterval;
+    while (!stop_.load(std::memory_order_acquire)) {
+      bool idle = true;
+      if (std::chrono::steady_clock::now() >= next_reap) {
+        Reap(segment);
+        next_reap = std::chrono::steady_clock::now() + kMrpcShmReapInterval;
+      }
+      for (size_t i = 0; i < kMrpcShmSlots; ++i) {
+        MrpcShmSlot &slot = segment->slots[i];
+        PendingReply &pending = pending_[i];
+        if (slot.state.load(std::memory_order_acquire) != MrpcShmSlot::kActive) {
+          pending.waiting = false;
+          continue;
+        }
+        uint32_t generation = slot.generation.load(std::memory_order_relaxed);
+        if (pending.waiting && !Flush(slot, pending, generation)) continue;
+        while (!pending.waiting && !stop_.load(std::memory_order_relaxed) && Owned(slot, generation) &&
+               slot.requests.Peek(frame)) {
+          idle = false;
+          Serve(slot, pending, generation, frame);
+          if (Owned(slot, generation)) slot.requests.Pop(frame);
+        }
+      }
+      if (idle) {
+        backoff.Pause();
+      } else {
+        backoff.Reset();
+      }
+    }
+    segment->alive.store(0, std::memory_order_release);
+    return true;
+  }
+
+  void Stop() { stop_.store(true, std::memory_order_release); }
+
+private:
+  // 响应环放不下时暂存的一个响应；暂存期间该槽位不再读取请求，因此每个槽位最多一个
+  struct PendingReply {
+    bool waiting = false;
+    uint32_t generation = 0;
+    uint64_t seq = 0;
+    int32_t code = 0;
+    MrpcSegments data;
+  };
+
+  // 槽位仍被同一个客户端占用；客户端断开后槽位可能已被新客户端清空重用
+  static bool Owned(const MrpcShmSlot &slot, uint32_t generation) {
+    return slot.state.load(std::memory_order_acquire) == MrpcShmSlot::kActive &&
+           slot.generation.load(std::memory_order_relaxed) == generation;
+  }
+
+  // 回收客户端进程已退出的槽位。先置为kClaiming挡住新的占用，若期间槽位已换了主人(代数变化)则还给它；
+  // 在轮询线程中执行，轮询循环看不到中间状态
+  static void Reap(MrpcShmSegment *segment) {
+    for (auto &slot : segment->slots) {
+      uint32_t generation = slot.generation.load();
+      if (slot.state.load() != MrpcShmSlot::kActive || MrpcShmProcessAlive(slot.pid.load())) continue;
+      uint32_t expected = MrpcShmSlot::kActive;
+      if (!slot.state.compare_exchange_strong(expected, MrpcShmSlot::kClaiming)) continue;
+      expected = MrpcShmSlot::kClaiming;
+      slot.state.compare_exchange_strong(
+          expected, slot.generation.load() == generation ? MrpcShmSlot::kFree : MrpcShmSlot::kActive);
+    }
+  }
+
+  // 尝试写出暂存的响应，返回该槽位能否继续读取请求；客户端已断开时丢弃
+  static bool Flush(MrpcShmSlot &slot, PendingReply &pending, uint32_t generation) {
+    if (pending.generation == generation &&
+        !slot.responses.TryWrite(pending.seq, pending.code, {}, pending.data)) {
+      return false;
+    }
+    pending.waiting = false;
+    pending.data = MrpcSegments();
+    return true;
+  }
+
+  // 处理一个请求帧：数据为方法名、'\0'和编码后的请求
+  void Serve(MrpcShmSlot &slot, PendingReply &pending, uint32_t generation,
+             const MrpcShmRing::Frame &frame) {
+    size_t end = frame.data.find('\0');
+    std::string method(frame.data.substr(0, end));
+    auto it = handlers_.find(method);
+    if (end == std::string_view::npos || it == handlers_.end()) {
+      Reply(slot, pending, generation, frame.seq,
+            mrpc::Status(kMrpcShmUnimplemented, "unknown method " + method), {});
+      return;
+    }
+    bool replied = false;
+    try {
+      it->second(std::string(frame.data.substr(end + 1)),
+                 [&](const mrpc::Status &status, const MrpcSegments &body) {
+                   replied = true;
+                   Reply(slot, pending, generation, frame.seq, status, body);
+                 });
+    } catch (const std::exception &e) {
+      if (!replied) {
+        Reply(slot, pending, generation, frame.seq, mrpc::Status(kMrpcShmInternal, e.what()), {});
+      }
+    }
+  }
+
+  // 写响应帧：失败时数据为错误信息；响应环满时拷贝一份暂存，由轮询循环稍后重试，不在此等待；
+  // 单向请求连错误也不回
+  static void Reply(MrpcShmSlot &slot, PendingReply &pending, uint32_t generation, uint64_t seq,
+                    mrpc::Status status, const MrpcSegments &body) {
+    if (seq == kMrpcShmOneway) return;
+    MrpcSegments error;
+    if (status.ok() && MrpcShmRing::FrameSize(body.Size()) > kMrpcShmRingBytes) {
+      status = mrpc::Status(kMrpcShmResourceExhausted, "response exceeds shm ring capacity");
+    }
+    if (!status.ok()) error.Append(status.msg());
+    const MrpcSegments &data = status.ok() ? body : error;
+    if (!Owned(slot, generation) || slot.responses.TryWrite(seq, status.code(), {}, data)) return;
+    pending.waiting = true;
+    pending.generation = generation;
+    pending.seq = seq;
+    pending.code = status.code();
+    pending.data = MrpcSegments();
+    pending.data.Append(data.Flatten());
+  }
+
+  std::string name_;
+  std::unordered_map<std::string, MrpcShmService::Handler> handlers_;
+  PendingReply pending_[kMrpcShmSlots];
+  std::atomic<bool> stop_{false};
+};
+
+)";
+    }
+
+    // 对冲的回调调用：各次尝试由MrpcHedgedCall选连接、计时并采用最先成功的响应
+    void generateHedgedCallback(const Method& method) {
+        std::string stub = service.name + "Stub";
+        std::string deref = splitMode() ? "*" : "";
+        output << "    using Call = MrpcHedgedCall<MrpcChannelPool<" << stub << ">, " << requestType(method)
+               << ", " << responseType(method) << ">;\n";
+        output << "    auto call = std::make_shared<Call>(\n";
+        output << "        " << deref << "pool_, " << deref << method.name << "_hedge_, " << deref
+               << "hedge_timer_, request, response, callback,\n";
+        output << "        [this](size_t index, " << requestType(method) << " &hedged, " << responseType(method)
+               << " &result, bool" << (hasWindow(method) ? " backup" : "") << ",\n";
+        output << "               std::function<void(mrpc::Status)> done) {\n";
+        if (hasWindow(method)) {
+            output << "          if (backup) return pool_.At(index).TryCallback" << method.name
+                   << "(hedged, result, done);\n";
+        }
+        output << "          pool_.At(index).Callback" << method.name << "(hedged, result, done);\n";
+        output << "          return true;\n";
+        output << "        },\n";
+        output << "        [](const mrpc::Status &status) { return " << poolOk(method, "status") << "; });\n";
+        output << "    call->Start();\n  }\n\n";
+    }
+
+    // 窗口满是本地的背压，不计为连接失败
+    std::string poolOk(const Method& method, const std::string& status) const {
+        if (!hasWindow(method)) return status + ".ok()";
+        return status + ".ok() || " + status + ".code() == kMrpcWindowFull";
+    }
+
+    // 生成多连接的PoolStub类，每次调用按策略选择连接
+    void generatePoolClient() {
+        if (!options.pool) return;
+        std::string stub = service.name + "Stub";
+        std::string pool_stub = service.name + "PoolStub";
+        output << "class " << pool_stub << " {\n";
+        output << "public:\n";
+        output << "  " << pool_stub << "(const std::vector<std::string> &addrs,\n";
+        output << "      size_t connections_per_addr = 1,\n";
+        if (splitMode()) {
+            output << "      MrpcBalancePolicy policy = MrpcBalancePolicy::kPowerOfTwoChoices);\n";
+            output << "  ~" << pool_stub << "();\n\n";
+        } else {
+            output << "      MrpcBalancePolicy policy = MrpcBalancePolicy::kPowerOfTwoChoices)\n";
+            output << "      : pool_(addrs, connections_per_addr, policy) {}\n\n";
+        }
+
+        for (const auto& method : service.methods) {
+            // 单向调用只有一种方式，入队失败的连接记为失败
+            if (method.oneway) {
+                output << "  mrpc::Status " << method.name << "(" << requestType(method)
+                       << " &request) {\n";
+                output << "    size_t index = pool_.Pick();\n";
+                output << "    mrpc::Status status = pool_.At(index)." << method.name << "(request);\n";
+                output << "    pool_.Release(index, status.ok());\n";
+                output << "    return status;\n  }\n\n";
+                continue;
+            }
+
+            // 同步调用
+            output << "  mrpc::Status " << method.name << "(" << requestType(method)
+                   << " &request, " << responseType(method) << " &response) {\n";
+            if (method.hedge.enabled) {
+                output << "    // 同步调用等待对冲调用完成\n";
+                output << "    auto done = std::make_shared<std::promise<mrpc::Status>>();\n";
+                output << "    std::future<mrpc::Status> result = done->get_future();\n";
+                output << "    Callback" << method.name
+                       << "(request, response, [done](mrpc::Status status) { done->set_value(status); });\n";
+                output << "    return result.get();\n  }\n\n";
+            } else {
+                output << "    size_t index = pool_.Pick();\n";
+                output << "    mrpc::Status status = pool_.At(index)." << method.name
+                       << "(request, response);\n";
+                output << "    pool_.Release(index, " << poolOk(method, "status") << ");\n";
+                output << "    return status;\n  }\n\n";
+            }
+
+            // 异步调用，key中带上连接序号以便Receive找回连接；key只对应一次发出的请求，因此不对冲
+            output << "  mrpc::Status Async" << method.name << "(" << requestType(method)
+                   << " &request, std::string &key) {\n";
+            output << "    size_t index = pool_.Pick();\n";
+            output << "    mrpc::Status status = pool_.At(index).Async" << method.name
+                   << "(request, key);\n";
+            output << "    if (!status.ok()) {\n";
+            output << "      pool_.Release(index, " << (hasWindow(method) ? "status.code() == kMrpcWindowFull" : "false")
+                   << ");\n";
+            output << "      return status;\n";
+            output << "    }\n";
+            output << "    key = std::to_string(index) + \"#\" + key;\n";
+            output << "    return status;\n  }\n\n";
+
+            // 回调方式
+            output << "  void Callback" << method.name << "(" << requestType(method) << " &request, "
+                   << responseType(method) << " &response,\n"
+                   << "                        std::function<void(mrpc::Status)> callback) {\n";
+            if (method.hedge.enabled) {
+                generateHedgedCallback(method);
+                continue;
+            }
+            output << "    size_t index = pool_.Pick();\n";
+            output << "    pool_.At(index).Callback" << method.name
+                   << "(request, response, [this, index, callback](mrpc::Status status) {\n";
+            output << "      pool_.Release(index, " << poolOk(method, "status") << ");\n";
+            output << "      callback(status);\n";
+            output << "    });\n  }\n\n";
+        }
+
+        // 拆分模式下按响应类型生成重载，头文件中不出现使用mrpc::Status的模板
+        std::vector<std::string> receive_types = {"T"};
+        if (splitMode()) {
+            receive_types.clear();
+            for (const auto& method : service.methods) {
+                if (!method.oneway) receive_types.push_back(responseType(method));
+            }
+        } else {
+            output << "  template<typename T>\n";
+        }
+        for (const auto& type : receive_types) {
+            output << "  mrpc::Status Receive(const std::string &key, " << type << " &response) {\n";
+            output << "    size_t sep = key.find('#');\n";
+            output << "    size_t index = std::stoul(key.substr(0, sep));\n";
+            output << "    mrpc::Status status = pool_.At(index).Receive(key.substr(sep + 1), response);\n";
+            output << "    pool_.Release(index, status.ok());\n";
+            output << "    return status;\n";
+            output << "  }\n\n";
+        }
+
+        output << "  std::vector<MrpcChannelStats> ChannelStats() const {\n";
+        output << "    return pool_.Stats();\n";
+        output << "  }\n\n";
+
+        if (hasCachedMethods() || hasCoalescedMethods()) {
+            output << "  // 每条连接的存根各有自己的缓存和请求合并，落到不同连接的相同请求互不共享；\n";
+            output << "  // 失效作用于全部连接，统计为各连接之和\n";
+        }
+        for (const auto& method : service.methods) {
+            if (method.cache.enabled) {
+                output << "  void Invalidate" << method.name << "(const " << requestType(method)
+                       << " &request) {\n";
+                output << "    for (size_t i = 0; i < pool_.Size(); ++i) pool_.At(i).Invalidate" << method.name
+                       << "(request);\n  }\n\n";
+                output << "  void Invalidate" << method.name << "Cache() {\n";
+                output << "    for (size_t i = 0; i < pool_.Size(); ++i) pool_.At(i).Invalidate" << method.name
+                       << "Cache();\n  }\n\n";
+                output << "  MrpcCacheStats " << method.name << "CacheStats() const {\n";
+                output << "    MrpcCacheStats total;\n";
+                output << "    for (size_t i = 0; i < pool_.Size(); ++i) {\n";
+                output << "      MrpcCacheStats stats = pool_.At(i)." << method.name << "CacheStats();\n";
+                output << "      total.hits += stats.hits;\n";
+                output << "      total.misses += stats.misses;\n";
+                output << "      total.evictions += stats.evictions;\n";
+                output << "      total.expirations += stats.expirations;\n";
+                output << "      total.invalidations += stats.invalidations;\n";
+                output << "      total.size += stats.size;\n";
+                output << "    }\n";
+                output << "    return total;\n  }\n\n";
+            }
+            if (method.coalesce) {
+                output << "  uint64_t " << method.name << "CoalescedCalls() const {\n";
+                output << "    uint64_t total = 0;\n";
+                output << "    for (size_t i = 0; i < pool_.Size(); ++i) total += pool_.At(i)." << method.name
+                       << "CoalescedCalls();\n";
+                output << "    return total;\n  }\n\n";
+            }
+        }
+
+        // 每条连接的存根各有自己的窗口
+        if (hasWindows()) {
+            output << "  void SetWindowPolicy(MrpcWindowPolicy policy) {\n";
+            output << "    for (size_t i = 0; i < pool_.Size(); ++i) pool_.At(i).SetWindowPolicy(policy);\n";
+            output << "  }\n\n";
+        }
+
+        for (const auto& method : service.methods) {
+            if (!method.hedge.enabled) continue;
+            output << "  MrpcHedgeStats " << method.name << "HedgeStats() const {\n";
+            output << "    return " << method.name << "_hedge_.Stats();\n  }\n\n";
+        }
+
+        output << "private:\n";
+        if (splitMode()) {
+            output << "  std::unique_ptr<MrpcChannelPool<" << stub << ">> pool_;\n";
+        } else {
+            output << "  MrpcChannelPool<" << stub << "> pool_;\n";
+        }
+        for (const auto& method : service.methods) {
+            if (!method.hedge.enabled) continue;
+            if (splitMode()) {
+                output << "  std::unique_ptr<MrpcHedgePolicy> " << method.name << "_hedge_;\n";
+            } else {
+                output << "  MrpcHedgePolicy " << method.name << "_hedge_{" << method.hedge.after_ms << ", "
+                       << method.hedge.after_percentile << ", " << method.hedge.max_extra << "};\n";
+            }
+        }
+        // 最后声明，析构时先停止定时线程
+        if (hasHedgedMethods()) {
+            output << "  " << (splitMode() ? "std::unique_ptr<MrpcHedgeTimer>" : "MrpcHedgeTimer")
+                   << " hedge_timer_;\n";
+        }
+        output << "};\n\n";
+    }
+
+    // 分片键在MrpcShardOf中的实参；整数统一按int64_t哈希，与Go、Python的十进制文本一致
+    std::string shardKeyArg(const Method& method, const std::string& prefix) const {
+        std::string field = prefix + method.shard_key;
+        return shardKeyType(method) == "int" ? "static_cast<int64_t>(" + field + ")" : field;
+    }
+
+    // 生成分片存根：addrs[i]为注册了ShardedService::Endpoint(i)的地址，分片数即地址数；
+    // 带分片键的方法按键的哈希对地址数取模直接选择分片的连接，没有分片键的方法轮流使用各连接
+    void generateShardedClient() {
+        if (!hasShardedMethods()) return;
+        std::string stub = service.name + "Stub";
+        std::string sharded_stub = service.name + "ShardedStub";
+        output << "// addrs[i]为注册了" << service.name << "ShardedService::Endpoint(i)的服务器地址，顺序与分片一致\n";
+        output << "class " << sharded_stub << " {\n";
+        output << "public:\n";
+        if (splitMode()) {
+            output << "  explicit " << sharded_stub << "(const std::vector<std::string> &addrs);\n";
+            output << "  ~" << sharded_stub << "();\n\n";
+        } else {
+            output << "  explicit " << sharded_stub << "(const std::vector<std::string> &addrs) {\n";
+            output << "    for (const auto &addr : addrs) stubs_.push_back(std::make_unique<" << stub
+                   << ">(addr));\n";
+            output << "  }\n\n";
+        }
+        output << "  size_t Shards() const { return stubs_.size(); }\n\n";
+
+        for (const auto& method : service.methods) {
+            std::string shard = method.shard_key.empty()
+                                    ? "next_.fetch_add(1, std::memory_order_relaxed) % stubs_.size()"
+                                    : "MrpcShardOf(" + shardKeyArg(method, "request.") + ", stubs_.size())";
+            if (method.oneway) {
+                output << "  mrpc::Status " << method.name << "(" << requestType(method) << " &request) {\n";
+                output << "    return stubs_[" << shard << "]->" << method.name << "(request);\n  }\n\n";
+                continue;
+            }
+
+            // 同步调用
+            output << "  mrpc::Status " << method.name << "(" << requestType(method)
+                   << " &request, " << responseType(method) << " &response) {\n";
+            output << "    return stubs_[" << shard << "]->" << method.name << "(request, response);\n  }\n\n";
+
+            // 异步调用，key中带上分片序号以便Receive找回连接
+            output << "  mrpc::Status Async" << method.name << "(" << requestType(method)
+                   << " &request, std::string &key) {\n";
+            output << "    size_t shard = " << shard << ";\n";
+            output << "    mrpc::Status status = stubs_[shard]->Async" << method.name << "(request, key);\n";
+            output << "    if (status.ok()) key = std::to_string(shard) + \"#\" + key;\n";
+            output << "    return status;\n  }\n\n";
+
+            // 回调方式
+            output << "  void Callback" << method.name << "(" << requestType(method) << " &request, "
+                   << responseType(method) << " &response,\n"
+                   << "                        std::function<void(mrpc::Status)> callback) {\n";
+            output << "    stubs_[" << shard << "]->Callback" << method.name
+                   << "(request, response, std::move(callback));\n  }\n\n";
+        }
+
+        // 拆分模式下按响应类型生成重载，与连接池存根一致
+        std::vector<std::string> receive_types = {"T"};
+        if (splitMode()) {
+            receive_types.clear();
+            for (const auto& method : service.methods) {
+                if (!method.oneway) receive_types.push_back(responseType(method));
+            }
+        } else {
+            output << "  template<typename T>\n";
+        }
+        for (const auto& type : receive_types) {
+            output << "  mrpc::Status Receive(const std::string &key, " << type << " &response) {\n";
+            output << "    size_t sep = key.find('#');\n";
+            output << "    return stubs_[std::stoul(key.substr(0, sep))]->Receive(key.substr(sep + 1), response);\n";
+            output << "  }\n\n";
+        }
+
+        output << "private:\n";
+        output << "  std::vector<std::unique_ptr<" << stub << ">> stubs_;\n";
+        output << "  std::atomic<size_t> next_{0};\n";
+        output << "};\n\n";
+    }
+
+    // 生成参数的JSON处理代码
+    std::string generateJsonCode(const std::vector<Parameter>& params, bool isToJson,
+                                 const std::string& prefix = "") {
+        std::stringstream ss;
+        if (isToJson) {
+            ss << "return json{";
+            for (size_t i = 0; i < params.size(); ++i) {
+                if (i > 0) ss << ",";
+                ss << "{\"" << params[i].name << "\", " << prefix << params[i].name << "}";
+            }
+            ss << "};";
+        } else {
+            for (const auto& param : params) {
+                std::string defaultValue;
+                if (param.type == "string") defaultValue = "\"\"";
+                else if (param.type == "int") defaultValue = "0";
+                else if (param.type == "float") defaultValue = "0.0f";
+                else if (param.type == "bool") defaultValue = "false";
+                
+                ss << prefix << param.name << " = j.value(\"" << param.name << "\", " 
+                   << defaultValue << "); ";
+            }
+        }
+        return ss.str();
+    }
+
+    // 生成构造函数参数列表
+    std::string generateConstructorParams(const std::vector<Parameter>& params) {
+        std::stringstream ss;
+        for (size_t i = 0; i < params.size(); ++i) {
+            if (i > 0) ss << ", ";
+            if (params[i].type == "string") 
+                ss << "std::string " << params[i].name;
+            else
+                ss << params[i].type << " " << params[i].name;
+        }
+        return ss.str();
+    }
+
+    // 生成初始化列表
+    std::string generateInitList(const std::vector<Parameter>& params) {
+        std::stringstream ss;
+        for (size_t i = 0; i < params.size(); ++i) {
+            if (i > 0) ss << ", ";
+            ss << params[i].name << "(" << params[i].name << ")";
+        }
+        return ss.str();
+    }
+
+    // 生成EncodeSegments的函数体：按键名排序输出，与json对象dump的顺序一致；
+    // 无字段的消息Encode()输出null
+    std::string generateSegmentsCode(const std::vector<Parameter>& params, const std::string& indent) {
+        std::stringstream ss;
+        if (params.empty()) {
+            ss << indent << "(void)segments;\n";
+            ss << indent << "segments.Append(\"null\");\n";
+            return ss.str();
+        }
+        std::vector<Parameter> sorted = params;
+        std::sort(sorted.begin(), sorted.end(),
+                  [](const Parameter& a, const Parameter& b) { return a.name < b.name; });
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            ss << indent << "segments.Append(\"" << (i == 0 ? "{" : ",") << "\\\"" << sorted[i].name
+               << "\\\":\");\n";
+            if (sorted[i].type == "string") {
+                ss << indent << "segments.AppendString(" << sorted[i].name << ");\n";
+            } else {
+                ss << indent << "segments.Append(json(" << sorted[i].name << ").dump());\n";
+            }
+        }
+        ss << indent << "segments.Append(\"}\");\n";
+        return ss.str();
+    }
+
+    // 生成单个消息类；Encode/Decode供缓存键和编解码测试使用
+    void generateMessageClass(const std::string& name, const std::vector<Parameter>& params,
+                              bool encode) {
+        bool codec_tests = !options.codec_tests_path.empty();
+        if (splitMode()) {
+            generateSplitMessageClass(name, params);
+            return;
+        }
+        output << "class " << name << " : public mrpc::Parser {\n";
+        output << "public:\n";
+        output << "  " << name << "() {}\n";
+        output << "  " << name << "("
+               << generateConstructorParams(params) << ") : "
+               << generateInitList(params) << " {}\n";
+        // 共享内存通道直接收发编码后的消息
+        if (encode || codec_tests || options.shm) {
+            output << "  std::string Encode() const { return toJson().dump(); }\n";
+        }
+        if (codec_tests || options.shm) {
+            output << "  void Decode(const std::string &data) { fromJson(json::parse(data)); }\n";
+        }
+        if (segmentsEnabled()) {
+            output << "\n  // 分散-聚集编码，各段拼接后与Encode()相同\n";
+            output << "  void EncodeSegments(MrpcSegments &segments) const {\n";
+            output << generateSegmentsCode(params, "    ");
+            output << "  }\n";
+        }
+        output << "\n";
+
+        output << "private:\n";
+        output << "  json toJson() const override { "
+               << generateJsonCode(params, true) << " }\n";
+        output << "  void fromJson(const json &j) override { "
+               << generateJsonCode(params, false) << "}\n\n";
+
+        output << "public:\n";
+        for (const auto& param : params) {
+            if (param.type == "string")
+                output << "  std::string " << param.name << ";\n";
+            else
+                output << "  " << param.type << " " << param.name << ";\n";
+        }
+        output << "};\n\n";
+    }
+
+    // 拆分模式的消息类：不继承mrpc::Parser，JSON编解码放到源文件
+    void generateSplitMessageClass(const std::string& name, const std::vector<Parameter>& params) {
+        output << "class " << name << " {\n";
+        output << "public:\n";
+        output << "  " << name << "() {}\n";
+        output << "  " << name << "("
+               << generateConstructorParams(params) << ") : "
+               << generateInitList(params) << " {}\n";
+        output << "  std::string Encode() const;\n";
+        output << "  void Decode(const std::string &data);\n";
+        if (segmentsEnabled()) output << "  void EncodeSegments(MrpcSegments &segments) const;\n";
+        output << "\n";
+        for (const auto& param : params) {
+            if (param.type == "string")
+                output << "  std::string " << param.name << ";\n";
+            else
+                output << "  " << param.type << " " << param.name << ";\n";
+        }
+        output << "};\n\n";
+    }
+
+    // 生成请求/响应类
+    void generateStructs() override {
+        // 具名消息可能被引入方用作缓存键，总是生成Encode
+        for (const auto& message : service.messages) {
+            generateMessageClass(message.name, message.params, true);
+        }
+        for (const auto& method : service.methods) {
+            // 缓存和请求合并以编码后的请求作为键
+            if (!method.request.named) {
+                generateMessageClass(method.request.type, method.request_params,
+                                     method.needsRequestKey());
+            }
+            if (!method.response.named && !method.oneway) {
+                generateMessageClass(method.response.type, method.response_params, false);
+            }
+        }
+    }
+
+    // 生成Stub类
+    void generateClient() override {
+        if (splitMode()) {
+            output << "class " << service.name << "Stub {\n";
+            output << "public:\n";
+            output << "  " << service.name << "Stub(const std::string &addr);\n";
+            output << "  ~" << service.name << "Stub();\n\n";
+        } else {
+            output << "class " << service.name << "Stub : mrpc::client::MrpcClient {\n";
+            output << "public:\n";
+            if (options.shm) {
+                output << "  " << service.name << "Stub(const std::string &addr)\n";
+                output << "      : mrpc::client::MrpcClient(addr),\n";
+                output << "        shm_(MrpcIsShmAddress(addr) ? std::make_unique<MrpcShmChannel>(addr) : nullptr) {}\n\n";
+            } else {
+                output << "  " << service.name << "Stub(const std::string &addr) : "
+                       << "mrpc::client::MrpcClient(addr) {}\n\n";
+            }
+        }
+
+        // 为每个方法生成三种调用方式
+        for (size_t i = 0; i < service.methods.size(); ++i) {
+            const auto& method = service.methods[i];
+            std::string method_name = service.name + "_method_names[" + std::to_string(i) + "]";
+
+            // 单向调用：请求入队即返回，不占用等待响应的调用；返回的状态只反映是否入队
+            if (method.oneway) {
+                output << "  mrpc::Status " << method.name << "(" << requestType(method)
+                       << " &request) {\n";
+                output << "    return OnewaySend(" << method_name << ", request);\n  }\n\n";
+                continue;
+            }
+            
+            // 同步调用
+            output << "  mrpc::Status " << method.name << "("
+                   << requestType(method) << " &request, "
+                   << responseType(method) << " &response) {\n";
+            if (method.needsRequestKey()) {
+                output << "    std::string request_key = request.Encode();\n";
+                if (method.cache.enabled) {
+                    output << "    if (" << method.name << "_cache_.Get(request_key, response)) {\n";
+                    output << "      return mrpc::Status();\n";
+                    output << "    }\n";
+                }
+                if (method.coalesce) {
+                    output << "    mrpc::Status status = " << method.name
+                           << "_flight_.Do(request_key, response, [&](" << responseType(method)
+                           << " &result) {\n";
+                    output << "      return "
+                           << windowedSend(method, "Send(" + method_name + ", request, result)") << ";\n";
+                    output << "    });\n";
+                } else {
+                    output << "    mrpc::Status status = "
+                           << windowedSend(method, "Send(" + method_name + ", request, response)") << ";\n";
+                }
+                if (method.cache.enabled) {
+                    output << "    if (status.ok()) {\n";
+                    output << "      " << method.name << "_cache_.Put(request_key, response);\n";
+                    output << "    }\n";
+                }
+                output << "    return status;\n  }\n\n";
+            } else {
+                output << "    return " << windowedSend(method, "Send(" + method_name + ", request, response)")
+                       << ";\n  }\n\n";
+            }
+
+            // 异步调用（结果通过Receive取回，不经过缓存和请求合并）
+            output << "  mrpc::Status Async" << method.name << "("
+                   << requestType(method) << " &request, std::string &key) {\n";
+            generateWindowedAsync(i);
+
+            // 回调方式
+            output << "  void Callback" << method.name << "("
+                   << requestType(method) << " &request, "
+                   << responseType(method) << " &response,\n"
+                   << "                        std::function<void(mrpc::Status)> callback) {\n";
+            if (method.needsRequestKey()) {
+                output << "    std::string request_key = request.Encode();\n";
+                if (method.cache.enabled) {
+                    output << "    if (" << method.name << "_cache_.Get(request_key, response)) {\n";
+                    output << "      callback(mrpc::Status());\n";
+                    output << "      return;\n";
+                    output << "    }\n";
+                }
+                // 带缓存时在回调前写入缓存
+                std::string done = "callback";
+                if (method.cache.enabled) {
+                    done = "on_done";
+                    output << "    std::function<void(mrpc::Status)> on_done = "
+                           << "[this, request_key, &response, callback](mrpc::Status status) {\n";
+                    output << "      if (status.ok()) {\n";
+                    output << "        " << method.name << "_cache_.Put(request_key, response);\n";
+                    output << "      }\n";
+                    output << "      callback(status);\n";
+                    output << "    };\n";
+                }
+                if (method.coalesce) {
+                    output << "    " << method.name << "_flight_.DoCallback(request_key, response, "
+                           << done << ",\n";
+                    output << "        [this, &request](" << responseType(method) << " &result,\n";
+                    output << "                         std::function<void(mrpc::Status)> done) {\n";
+                    generateWindowedCallback(method, method_name, "result", "done", "          ");
+                    output << "        });\n  }\n\n";
+                } else {
+                    generateWindowedCallback(method, method_name, "response", done, "    ");
+                    output << "  }\n\n";
+                }
+            } else {
+                generateWindowedCallback(method, method_name, "response", "callback", "    ");
+                output << "  }\n\n";
+            }
+
+            // 对冲的备份请求：窗口满时不等待，返回false且不调用callback；不经过缓存和请求合并
+            if (options.pool && method.hedge.enabled && hasWindow(method)) {
+                output << "  bool TryCallback" << method.name << "(" << requestType(method) << " &request, "
+                       << responseType(method) << " &response,\n"
+                       << "                           std::function<void(mrpc::Status)> callback) {\n";
+                output << "    return " << windowName(method) << ".TryCallback(\n";
+                output << "        [this, &request, &response](std::function<void(mrpc::Status)> sent) {\n";
+                output << "          CallbackSend(" << method_name << ", request, response, sent);\n";
+                output << "        },\n";
+                output << "        callback);\n  }\n\n";
+            }
+
+            // 缓存失效与统计接口
+            if (method.cache.enabled) {
+                output << "  void Invalidate" << method.name << "(const " << requestType(method)
+                       << " &request) {\n";
+                output << "    " << method.name << "_cache_.Invalidate(request.Encode());\n  }\n\n";
+                output << "  void Invalidate" << method.name << "Cache() { "
+                       << method.name << "_cache_.Clear(); }\n\n";
+                output << "  MrpcCacheStats " << method.name << "CacheStats() const {\n";
+                output << "    return " << method.name << "_cache_.GetStats();\n  }\n\n";
+            }
+
+            // 请求合并统计接口
+            if (method.coalesce) {
+                output << "  uint64_t " << method.name << "CoalescedCalls() const {\n";
+                output << "    return " << method.name << "_flight_.SharedCalls();\n  }\n\n";
+            }
+        }
+
+        generateWindowAccessors();
+
+        if (splitMode()) {
+            generateSplitClientMembers();
+            output << "};\n\n";
+            return;
+        }
+
+        // 模板化的Receive方法
+        output << "  template<typename T>\n";
+        output << "  mrpc::Status Receive(const std::string &key, T &response) {\n";
+        if (hasWindows()) {
+            // key前缀为方法序号，取回响应后归还该方法的窗口信用
+            output << "    size_t sep = key.find('#');\n";
+            output << "    std::string call_key = key.substr(sep + 1);\n";
+            if (options.shm) {
+                output << "    mrpc::Status status = shm_ ? shm_->Receive(call_key, response)\n";
+                output << "                               : mrpc::client::MrpcClient::Receive(call_key, response);\n";
+            } else {
+                output << "    mrpc::Status status = mrpc::client::MrpcClient::Receive(call_key, response);\n";
+            }
+            output << "    ReleaseWindow(std::stoul(key.substr(0, sep)));\n";
+            output << "    return status;\n";
+        } else {
+            if (options.shm) output << "    if (shm_) return shm_->Receive(key, response);\n";
+            output << "    return mrpc::client::MrpcClient::Receive(key, response);\n";
+        }
+        output << "  }\n";
+
+        // 每个带缓存或请求合并注解的方法各持有自己的状态
+        if (hasCachedMethods() || hasCoalescedMethods() || hasOnewayMethods() || hasWindows() ||
+            options.shm) {
+            output << "\nprivate:\n";
+            generateShmForwarders();
+            generateOnewayForwarder();
+            generateReleaseWindow();
+            for (const auto& method : service.methods) {
+                if (method.cache.enabled) {
+                    output << "  MrpcResponseCache<" << responseType(method) << "> " << method.name
+                           << "_cache_{" << method.cache.ttl_ms << ", " << method.cache.max_entries
+                           << "};\n";
+                }
+                if (method.coalesce) {
+                    output << "  MrpcSingleFlight<" << responseType(method) << "> " << method.name
+                           << "_flight_;\n";
+                }
+            }
+            generateWindowMembers();
+            if (hasOnewayMethods()) output << "  MrpcNoReply no_reply_;\n";
+            if (options.shm) output << "  std::unique_ptr<MrpcShmChannel> shm_;\n";
+        }
+        output << "};\n\n";
+    }
+
+    // 方法占用的窗口：配置了方法级窗口时用自己的，否则共用存根级窗口
+    std::string windowName(const Method& method) const {
+        return method.max_in_flight > 0 ? method.name + "_window_" : "window_";
+    }
+
+    // 同步调用在窗口内发出
+    std::string windowedSend(const Method& method, const std::string& call) const {
+        if (!hasWindow(method)) return call;
+        return windowName(method) + ".Call([&] { return " + call + "; })";
+    }
+
+    // 回调方式的调用经窗口准入后发出，完成回调中归还信用
+    void generateWindowedCallback(const Method& method, const std::string& method_name,
+                                  const std::string& response, const std::string& callback,
+                                  const std::string& indent) {
+        if (!hasWindow(method)) {
+            output << indent << "CallbackSend(" << method_name << ", request, " << response << ", "
+                   << callback << ");\n";
+            return;
+        }
+        output << indent << windowName(method) << ".Callback(\n";
+        output << indent << "    [this, &request, &" << response
+               << "](std::function<void(mrpc::Status)> sent) {\n";
+        output << indent << "      CallbackSend(" << method_name << ", request, " << response
+               << ", sent);\n";
+        output << indent << "    },\n";
+        output << indent << "    " << callback << ");\n";
+    }
+
+    // 异步调用：发出前占用信用，由Receive归还；存在窗口时key带上方法序号以便Receive找到窗口
+    void generateWindowedAsync(size_t i) {
+        const auto& method = service.methods[i];
+        std::string method_name = service.name + "_method_names[" + std::to_string(i) + "]";
+        std::string prefix = "\"" + std::to_string(i) + "#\"";
+        if (!hasWindows()) {
+            output << "    return AsyncSend(" << method_name << ", request, key);\n  }\n\n";
+            return;
+        }
+        if (!hasWindow(method)) {
+            output << "    mrpc::Status status = AsyncSend(" << method_name << ", request, key);\n";
+            output << "    if (status.ok()) key = " << prefix << " + key;\n";
+            output << "    return status;\n  }\n\n";
+            return;
+        }
+        output << "    mrpc::Status status = " << windowName(method) << ".Acquire();\n";
+        output << "    if (!status.ok()) return status;\n";
+        output << "    status = AsyncSend(" << method_name << ", request, key);\n";
+        output << "    if (!status.ok()) {\n";
+        output << "      " << windowName(method) << ".Release();\n";
+        output << "      return status;\n";
+        output << "    }\n";
+        output << "    key = " << prefix << " + key;\n";
+        output << "    return status;\n  }\n\n";
+    }
+
+    // 窗口策略与统计接口
+    void generateWindowAccessors() {
+        if (!hasWindows()) return;
+        output << "  // 窗口满时的处理策略，默认kBlock；kAwait下挂起的回调方式调用引用调用方的请求和响应，\n";
+        output << "  // 二者须存活到回调被调用\n";
+        output << "  void SetWindowPolicy(MrpcWindowPolicy policy) {\n";
+        if (usesStubWindow()) output << "    window_.SetPolicy(policy);\n";
+        for (const auto& method : service.methods) {
+            if (hasWindow(method) && method.max_in_flight > 0) {
+                output << "    " << method.name << "_window_.SetPolicy(policy);\n";
+            }
+        }
+        output << "  }\n\n";
+        for (const auto& method : service.methods) {
+            if (!hasWindow(method)) continue;
+            output << "  MrpcWindowStats " << method.name << "WindowStats() const {\n";
+            output << "    return " << windowName(method) << ".Stats();\n  }\n\n";
+        }
+    }
+
+    // 按Async调用key中的方法序号归还信用
+    void generateReleaseWindow() {
+        if (!hasWindows()) return;
+        output << "  void ReleaseWindow(size_t method) {\n";
+        output << "    switch (method) {\n";
+        for (size_t i = 0; i < service.methods.size(); ++i) {
+            if (!hasWindow(service.methods[i])) continue;
+            output << "      case " << i << ": " << windowName(service.methods[i]) << ".Release(); break;\n";
+        }
+        output << "    }\n";
+        output << "  }\n\n";
+    }
+
+    void generateWindowMembers() {
+        std::vector<std::pair<std::string, int>> windows;
+        if (usesStubWindow()) windows.push_back({"window_", service.max_in_flight});
+        for (const auto& method : service.methods) {
+            if (hasWindow(method) && method.max_in_flight > 0) {
+                windows.push_back({method.name + "_window_", method.max_in_flight});
+            }
+        }
+        for (const auto& window : windows) {
+            if (splitMode()) {
+                output << "  std::unique_ptr<MrpcInFlightWindow> " << window.first << ";\n";
+            } else {
+                output << "  MrpcInFlightWindow " << window.first << "{" << window.second << "};\n";
+            }
+        }
+    }
+
+    // 单向调用经由回调方式发出，不留下需要Receive取回的在途调用；
+    // MrpcNoReply不含状态，各调用可共用一个
+    void generateOnewayForwarder() {
+        if (!hasOnewayMethods()) return;
+        output << "  template <typename Request>\n";
+        output << "  mrpc::Status OnewaySend(const char *method, Request &request) {\n";
+        if (options.shm) output << "    if (shm_) return shm_->OnewaySend(method, request);\n";
+        output << "    mrpc::client::MrpcClient::CallbackSend(method, request, no_reply_, [](mrpc::Status) {});\n";
+        output << "    return mrpc::Status();\n";
+        output << "  }\n\n";
+    }
+
+    // shm://地址的调用转给共享内存通道，其余地址仍走MrpcClient；方法体中的Send等调用不变
+    void generateShmForwarders() {
+        if (!options.shm) return;
+        output << R"(  template <typename Request, typename Response>
+  mrpc::Status Send(const char *method, Request &request, Response &response) {
+    if (shm_) return shm_->Send(method, request, response);
+    return mrpc::client::MrpcClient::Send(method, request, response);
+  }
+
+  template <typename Request>
+  mrpc::Status AsyncSend(const char *method, Request &request, std::string &key) {
+    if (shm_) return shm_->AsyncSend(method, request, key);
+    return mrpc::client::MrpcClient::AsyncSend(method, request, key);
+  }
+
+  template <typename Request, typename Response>
+  void CallbackSend(const char *method, Request &request, Response &response,
+                    std::function<void(mrpc::Status)> callback) {
+    if (shm_) return shm_->CallbackSend(method, request, response, callback);
+    mrpc::client::MrpcClient::CallbackSend(method, request, response, callback);
+  }
+
+)";
+    }
+
+    // 拆分模式下Stub的Receive和私有成员：按消息类型的转发函数代替MrpcClient基类，
+    // 缓存和请求合并状态以指针持有，头文件中只需前置声明
+    void generateSplitClientMembers() {
+        // 多个方法共用具名消息时，按类型生成的重载只能出现一次
+        std::set<std::string> receives, sends;
+        for (const auto& method : service.methods) {
+            if (method.oneway || !receives.insert(responseType(method)).second) continue;
+            output << "  mrpc::Status Receive(const std::string &key, " << responseType(method)
+                   << " &response);\n";
+        }
+        output << "\nprivate:\n";
+        generateReleaseWindow();
+        for (const auto& method : service.methods) {
+            std::string req = requestType(method);
+            std::string resp = responseType(method);
+            if (method.oneway) {
+                if (sends.insert("oneway " + req).second) {
+                    output << "  mrpc::Status OnewaySend(const char *method, " << req << " &request);\n";
+                }
+                continue;
+            }
+            if (!sends.insert(req + "," + resp).second) continue;
+            output << "  mrpc::Status Send(const char *method, " << req << " &request, "
+                   << resp << " &response);\n";
+            if (sends.insert(req).second) {
+                output << "  mrpc::Status AsyncSend(const char *method, " << req
+                       << " &request, std::string &key);\n";
+            }
+            output << "  void CallbackSend(const char *method, " << req << " &request, "
+                   << resp << " &response,\n";
+            output << "                    std::function<void(mrpc::Status)> callback);\n";
+        }
+        output << "\n  std::unique_ptr<mrpc::client::MrpcClient> client_;\n";
+        for (const auto& method : service.methods) {
+            if (method.cache.enabled) {
+                output << "  std::unique_ptr<MrpcResponseCache<" << responseType(method) << ">> "
+                       << method.name << "_cache_;\n";
+            }
+            if (method.coalesce) {
+                output << "  std::unique_ptr<MrpcSingleFlight<" << responseType(method) << ">> "
+                       << method.name << "_flight_;\n";
+            }
+        }
+        generateWindowMembers();
+    }
+
+    // 生成Service类
+    void generateService() override {
+        if (splitMode()) {
+            generateSplitService();
+            return;
+        }
+        output << "class " << service.name << "Service : public mrpc::server::MrpcService"
+               << (options.shm ? ", public MrpcShmService" : "") << " {\n";
+        output << "public:\n";
+        if (hasPriorities()) {
+            output << "  // workers为按优先级分发的工作线程数，0时取硬件线程数\n";
+            output << "  explicit " << service.name << "Service(size_t workers = 0)\n";
+            output << "      : mrpc::server::MrpcService(\"" << namespace_name << "." << service.name
+                   << "\"), scheduler_(workers) {\n";
+        } else {
+            output << "  " << service.name << "Service() : mrpc::server::MrpcService(\""
+                   << namespace_name << "." << service.name << "\") {\n";
+        }
+        
+        for (size_t i = 0; i < service.methods.size(); ++i) {
+            const auto& method = service.methods[i];
+            if (method.oneway) {
+                generateOnewayHandler(i);
+                continue;
+            }
+            output << "    AddHandler<" << requestType(method) << ", " 
+                   << responseType(method) << ">(\n";
+            output << "        " << service.name << "_method_names[" << i << "],\n";
+            output << "        [this](const " << requestType(method) << " &request, "
+                   << responseType(method) << " &response) {\n";
+            output << "          " << dispatched(method, "this->" + method.name + "(request, response)")
+                   << ";\n        });\n";
+            if (options.shm) {
+                output << "    AddShmHandler<" << requestType(method) << ", "
+                       << responseType(method) << ">(\n";
+                output << "        " << service.name << "_method_names[" << i << "],\n";
+                output << "        [this](const " << requestType(method) << " &request, "
+                       << responseType(method) << " &response) {\n";
+                output << "          " << dispatched(method, "this->" + method.name + "(request, response)")
+                       << ";\n        });\n";
+            }
+        }
+        output << "  }\n\n";
+        generatePriorityAccessors();
+
+        // 纯虚函数声明
+        generateHandlerDeclarations();
+        if (hasPriorities()) {
+            output << "\nprivate:\n";
+            output << "  MrpcPriorityScheduler scheduler_;\n";
+        }
+        output << "};\n\n";
+    }
+
+    // 处理函数体：有优先级时经分发器在工作线程上执行，否则直接在运行时的线程上执行
+    std::string dispatched(const Method& method, const std::string& call) {
+        if (!hasPriorities()) return "return " + call;
+        return "return scheduler_.Run(" + priorityName(method) + ", [&] { return " + call + "; })";
+    }
+
+    // 单向方法投递后即返回，任务持有请求的副本；队列满时丢弃并计入统计
+    std::string dispatchedOneway(const Method& method, const std::string& call, const std::string& capture) {
+        if (!hasPriorities()) return call + ";";
+        return "scheduler_.Post(" + priorityName(method) + ", [" + capture + "] { " + call + "; });";
+    }
+
+    std::string priorityName(const Method& method) {
+        return "MrpcPriority::k" + capitalize(method.priority);
+    }
+
+    // 调整优先级分发的参数；拆分模式下分发器在源文件中，只声明
+    void generatePriorityAccessors() {
+        if (!hasPriorities()) return;
+        std::string svc = service.name + "Service";
+        bool split = splitMode();
+        auto emit = [&](const std::string& signature, const std::string& body) {
+            output << "  " << signature << (split ? ";\n" : " { " + body + " }\n");
+        };
+        output << "  // 各优先级类别的调度权重（默认8:4:1）、有其他请求排队时批量请求可占用的工作线程数（默认一半）\n";
+        output << "  // 和各类别的排队上限（默认不限）；为批量设置排队上限可避免批量积压占满运行时的分发线程\n";
+        emit("void SetPriorityWeights(unsigned high, unsigned normal, unsigned bulk)",
+             "scheduler_.SetWeights(high, normal, bulk);");
+        emit("void SetBulkLimit(size_t workers)", "scheduler_.SetBulkLimit(workers);");
+        emit("void SetQueueLimit(MrpcPriority priority, size_t limit)", "scheduler_.SetQueueLimit(priority, limit);");
+        emit("MrpcPriorityStats PriorityStats() const", "return scheduler_.Stats();");
+        output << "\n";
+    }
+
+    // 分片服务的处理函数：解码后按分片键选出分片，在该分片的线程上调用它的实例；
+    // pinned时所有请求都交给shard_，用于一分片一地址的端点；拆分模式下请求和响应经由MrpcCodec适配
+    void generateShardedHandlers(std::ostream &out, bool pinned = false) {
+        bool split = splitMode();
+        for (size_t i = 0; i < service.methods.size(); ++i) {
+            const auto& method = service.methods[i];
+            std::string req = split ? "MrpcCodec<" + requestType(method) + ">" : requestType(method);
+            std::string resp = split ? "MrpcCodec<" + responseType(method) + ">" : responseType(method);
+            std::string shard = pinned ? "shard_"
+                                : method.shard_key.empty()
+                                    ? "executor_.Next()"
+                                    : "MrpcShardOf(" + shardKeyArg(method, split ? "request.message->" : "request.") +
+                                          ", executor_.Size())";
+            std::string request = split ? "*request.message" : "request";
+            std::string response = split ? "*response.message" : "response";
+            // 单向方法投递后立即返回，实例持有请求的副本在分片线程上处理
+            std::string capture = split ? "request = *request.message" : "request";
+            std::string post = "          executor_.Post(shard, [this, shard, " + capture + "] { instances_[shard]->" +
+                               method.name + "(request); });\n";
+            std::string run = "          return executor_.Run(shard, [&] { return instances_[shard]->" + method.name +
+                              "(" + request + ", " + response + "); });\n";
+            if (method.oneway) {
+                out << "    AddHandler<" << req << ", MrpcNoReply>(\n";
+                out << "        " << service.name << "_method_names[" << i << "],\n";
+                out << "        [this](const " << req << " &request, MrpcNoReply &) {\n";
+                out << "          size_t shard = " << shard << ";\n";
+                out << post;
+                out << "          return mrpc::Status();\n";
+                out << "        });\n";
+                if (options.shm) {
+                    out << "    AddShmOnewayHandler<" << req << ">(\n";
+                    out << "        " << service.name << "_method_names[" << i << "],\n";
+                    out << "        [this](const " << req << " &request) {\n";
+                    out << "          size_t shard = " << shard << ";\n";
+                    out << post;
+                    out << "        });\n";
+                }
+                continue;
+            }
+            std::vector<std::string> adds = {"AddHandler"};
+            if (options.shm) adds.push_back("AddShmHandler");
+            for (const auto& add : adds) {
+                out << "    " << add << "<" << req << ", " << resp << ">(\n";
+                out << "        " << service.name << "_method_names[" << i << "],\n";
+                out << "        [this](const " << req << " &request, " << resp << " &response) {\n";
+                out << "          size_t shard = " << shard << ";\n";
+                out << run;
+                out << "        });\n";
+            }
+        }
+    }
+
+    // 分片端点：第shard个分片单独对外的服务，与ShardedService共用实例和执行器；
+    // 拆分模式下放在源文件中，由分发器持有
+    void generateShardEndpoint(std::ostream &out) {
+        if (!hasShardedMethods()) return;
+        std::string svc = service.name + "Service";
+        std::string endpoint = service.name + "ShardEndpoint";
+        out << "// 一分片一地址部署时第shard个地址上注册的服务：请求不再按键哈希，都在该分片上执行，\n";
+        out << "// ShardedStub按同一哈希对地址数取模选中的连接因而正是服务端拥有该键的分片\n";
+        out << "class " << endpoint << " : public mrpc::server::MrpcService"
+            << (options.shm ? ", public MrpcShmService" : "") << " {\n";
+        out << "public:\n";
+        out << "  " << endpoint << "(std::vector<std::unique_ptr<" << svc
+            << ">> &instances, MrpcShardExecutor &executor, size_t shard)\n";
+        out << "      : mrpc::server::MrpcService(\"" << namespace_name << "." << service.name
+            << "\"), instances_(instances), executor_(executor), shard_(shard) {\n";
+        generateShardedHandlers(out, true);
+        out << "  }\n\n";
+        out << "private:\n";
+        out << "  std::vector<std::unique_ptr<" << svc << ">> &instances_;\n";
+        out << "  MrpcShardExecutor &executor_;\n";
+        out << "  size_t shard_;\n";
+        out << "};\n\n";
+    }
+
+    // 分片服务：每个分片一个用户实现的Service实例，同一分片键的请求总由同一实例在同一线程上处理。
+    // 注册Service()时所有连接共用一个监听地址，由服务端哈希；客户端要直达分片则每个分片一个地址，
+    // 第i个地址注册Endpoint(i)，ShardedStub按同样的顺序传入这些地址
+    void generateShardedService() {
+        if (!hasShardedMethods()) return;
+        std::string svc = service.name + "Service";
+        std::string sharded = service.name + "ShardedService";
+        std::string endpoint = service.name + "ShardEndpoint";
+        std::string indent(sharded.size() + 12, ' ');
+        output << "class " << sharded;
+        if (!splitMode()) {
+            output << " : public mrpc::server::MrpcService" << (options.shm ? ", public MrpcShmService" : "");
+        }
+        output << " {\n";
+        output << "public:\n";
+        output << "  // factory为每个分片构造一个实例；shards为0时取硬件线程数\n";
+        output << "  explicit " << sharded << "(std::function<std::unique_ptr<" << svc
+               << ">(size_t shard)> factory,\n";
+        if (splitMode()) {
+            output << indent << "size_t shards = 0);\n";
+            output << "  ~" << sharded << "();\n\n";
+            output << "  // 注册到服务器: server.RegisterService(service.Service())\n";
+            output << "  mrpc::server::MrpcService *Service();\n";
+            output << "  // 一分片一地址部署：第shard个地址的服务器注册Endpoint(shard)\n";
+            output << "  mrpc::server::MrpcService *Endpoint(size_t shard);\n";
+            output << "  size_t Shards() const;\n";
+            output << "  " << svc << " &Shard(size_t shard);\n\n";
+            output << "private:\n";
+            output << "  std::vector<std::unique_ptr<" << svc << ">> instances_;\n";
+            output << "  // 声明在实例之后，析构时先停止各分片的线程再释放实例\n";
+            output << "  std::unique_ptr<mrpc::server::MrpcService> service_;\n";
+            output << "};\n\n";
+            return;
+        }
+        output << indent << "size_t shards = 0)\n";
+        output << "      : mrpc::server::MrpcService(\"" << namespace_name << "." << service.name
+               << "\"), executor_(shards) {\n";
+        output << "    for (size_t i = 0; i < executor_.Size(); ++i) {\n";
+        output << "      instances_.push_back(factory(i));\n";
+        output << "      endpoints_.push_back(std::make_unique<" << endpoint << ">(instances_, executor_, i));\n";
+        output << "    }\n";
+        generateShardedHandlers(output);
+        output << "  }\n\n";
+        output << "  // 一分片一地址部署：第shard个地址的服务器注册Endpoint(shard)\n";
+        output << "  " << endpoint << " *Endpoint(size_t shard) { return endpoints_[shard].get(); }\n";
+        output << "  size_t Shards() const { return instances_.size(); }\n";
+        output << "  " << svc << " &Shard(size_t shard) { return *instances_[shard]; }\n\n";
+        output << "private:\n";
+        output << "  std::vector<std::unique_ptr<" << svc << ">> instances_;\n";
+        output << "  // 声明在实例之后，析构时先停止各分片的线程再释放实例\n";
+        output << "  MrpcShardExecutor executor_;\n";
+        output << "  std::vector<std::unique_ptr<" << endpoint << ">> endpoints_;\n";
+        output << "};\n\n";
+    }
+
+    // 单向方法的处理函数没有响应，运行时回送的确认为空
+    void generateOnewayHandler(size_t i) {
+        const auto& method = service.methods[i];
+        output << "    AddHandler<" << requestType(method) << ", MrpcNoReply>(\n";
+        output << "        " << service.name << "_method_names[" << i << "],\n";
+        std::string call = dispatchedOneway(method, "this->" + method.name + "(request)", "this, request");
+        output << "        [this](const " << requestType(method) << " &request, MrpcNoReply &) {\n";
+        output << "          " << call << "\n";
+        output << "          return mrpc::Status();\n        });\n";
+        if (options.shm) {
+            output << "    AddShmOnewayHandler<" << requestType(method) << ">(\n";
+            output << "        " << service.name << "_method_names[" << i << "],\n";
+            output << "        [this](const " << requestType(method) << " &request) {\n";
+            output << "          " << call << "\n        });\n";
+        }
+    }
+
+    // 用户实现的处理函数
+    void generateHandlerDeclarations() {
+        for (const auto& method : service.methods) {
+            if (method.oneway) {
+                output << "  virtual void " << method.name << "(const " << requestType(method)
+                       << " &request) = 0;\n";
+                continue;
+            }
+            output << "  virtual mrpc::Status " << method.name << "(const "
+                   << requestType(method) << " &request,\n"
+                   << "                                " << responseType(method) 
+                   << " &response) = 0;\n";
+        }
+    }
+
+    // 拆分模式的Service类：处理函数注册放到源文件，通过Service()交给MrpcServer
+    void generateSplitService() {
+        std::string svc = service.name + "Service";
+        output << "class " << svc << " {\n";
+        output << "public:\n";
+        if (hasPriorities()) {
+            output << "  // workers为按优先级分发的工作线程数，0时取硬件线程数\n";
+            output << "  explicit " << svc << "(size_t workers = 0);\n";
+        } else {
+            output << "  " << svc << "();\n";
+        }
+        output << "  virtual ~" << svc << "();\n\n";
+        output << "  // 注册到服务器: server.RegisterService(service.Service())\n";
+        output << "  mrpc::server::MrpcService *Service();\n\n";
+        generatePriorityAccessors();
+        generateHandlerDeclarations();
+        output << "\nprivate:\n";
+        output << "  std::unique_ptr<mrpc::server::MrpcService> service_;\n";
+        output << "};\n\n";
+    }
+
+    // 生成字段的默认值
+    std::string defaultValue(const std::string& type) {
+        if (type == "string") return "\"\"";
+        if (type == "int") return "0";
+        if (type == "float") return "0.0f";
+        if (type == "bool") return "false";
+        return "{}";
+    }
+
+    // 生成回环压测程序：实现一个简单的Service，在本机启动服务并用多线程驱动Stub
+    std::string generateLoadTest(const std::string& header_path) {
+        std::stringstream ss;
+        std::string svc = service.name;
+        // 共享内存传输额外支持--slow_client，用有响应的方法制造不读响应的客户端；
+        // 不读响应就不会归还窗口信用，因此优先选不受在途窗口限制的方法
+        const Method* slow_method = nullptr;
+        for (const auto& method : service.methods) {
+            if (method.oneway) continue;
+            if (slow_method == nullptr || (hasWindow(*slow_method) && !hasWindow(method))) slow_method = &method;
+        }
+        bool slow_client = options.shm && slow_method != nullptr;
+        ss << "// " << svc << " 回环压测程序，由CppStubGenerator生成\n";
+        ss << "#include \"" << baseName(header_path) << "\"\n";
+        if (splitMode()) {
+            ss << "#include \"mrpcpp/server.h\"\n";
+            ss << "#include \"mrpcpp/client.h\"\n";
+        }
+        ss << "#include <algorithm>\n";
+        ss << "#include <atomic>\n";
+        ss << "#include <chrono>\n";
+        ss << "#include <condition_variable>\n";
+        ss << "#include <cstdio>\n";
+        ss << "#include <cstdlib>\n";
+        ss << "#include <cstring>\n";
+        ss << "#include <deque>\n";
+        ss << "#include <functional>\n";
+        ss << "#include <mutex>\n";
+        ss << "#include <string>\n";
+        ss << "#include <thread>\n";
+        ss << "#include <vector>\n\n";
+        ss << "using namespace " << namespace_name << ";\n\n";
+        ss << "namespace {\n\n";
+
+        // 简单的处理函数：字符串字段回显请求中的第一个字符串字段
+        ss << "class LoadTest" << svc << "Service : public " << svc << "Service {\n";
+        ss << "public:\n";
+        for (size_t i = 0; i < service.methods.size(); ++i) {
+            const auto& method = service.methods[i];
+            if (i > 0) ss << "\n";
+            std::string echo;
+            for (const auto& param : method.request_params) {
+                if (param.type == "string") {
+                    echo = "request." + param.name;
+                    break;
+                }
+            }
+            if (method.oneway) {
+                ss << "  void " << method.name << "(const " << requestType(method)
+                   << " &request) override { (void)request; }\n";
+                continue;
+            }
+            ss << "  mrpc::Status " << method.name << "(const " << requestType(method) << " &request,\n";
+            ss << "                " << std::string(method.name.size(), ' ') << responseType(method)
+               << " &response) override {\n";
+            // 只有回显给响应的字符串字段时才用到请求
+            bool echoed = !echo.empty() &&
+                          std::any_of(method.response_params.begin(), method.response_params.end(),
+                                      [](const Parameter& param) { return param.type == "string"; });
+            if (!echoed) ss << "    (void)request;\n";
+            for (const auto& param : method.response_params) {
+                std::string value = (param.type == "string" && !echo.empty()) ? echo : defaultValue(param.type);
+                ss << "    response." << param.name << " = " << value << ";\n";
+            }
+            ss << "    return mrpc::Status();\n";
+            ss << "  }\n";
+        }
+        ss << "};\n\n";
+        if (hasOnewayMethods()) {
+            ss << "// 单向方法没有响应，压测框架中以空结构占位；测得的延迟为请求入队的耗时\n";
+            ss << "struct NoResponse {};\n\n";
+        }
+
+        ss << R"(struct Config {
+  std::string addr = "127.0.0.1:50051";
+  std::string method;
+  int threads = 4;
+  int concurrency = 1;
+  size_t payload = 64;
+  int duration_s = 10;
+  int warmup_s = 1;
+  bool start_server = true;
+)";
+        if (slow_client) ss << "  bool slow_client = false;  // 另起一个只发请求、从不读取响应的客户端\n";
+        ss << R"(};
+
+struct WorkerResult {
+  std::vector<uint64_t> latencies_ns;
+  uint64_t errors = 0;
+};
+
+using Clock = std::chrono::steady_clock;
+
+// 每个线程持有一个Stub；concurrency为1时使用同步调用，否则用回调方式保持concurrency个在途请求
+template <typename Stub, typename Request, typename Response>
+void RunWorker(const Config &config, std::function<void(Request &)> fill,
+               std::function<mrpc::Status(Stub &, Request &, Response &)> call,
+               std::function<void(Stub &, Request &, Response &, std::function<void(mrpc::Status)>)> callback_call,
+               const std::atomic<bool> &recording, const std::atomic<bool> &stop,
+               WorkerResult &result) {
+  Stub stub(config.addr);
+  if (config.concurrency <= 1) {
+    Request request;
+    Response response;
+    fill(request);
+    while (!stop.load(std::memory_order_relaxed)) {
+      auto start = Clock::now();
+      mrpc::Status status = call(stub, request, response);
+      if (!recording.load(std::memory_order_relaxed)) continue;
+      if (!status.ok()) result.errors++;
+      result.latencies_ns.push_back(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    }
+    return;
+  }
+
+  struct Slot {
+    Request request;
+    Response response;
+    Clock::time_point start;
+  };
+  std::vector<Slot> slots(config.concurrency);
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<std::pair<size_t, bool>> completed;
+  size_t in_flight = 0;
+
+  auto issue = [&](size_t index) {
+    Slot &slot = slots[index];
+    slot.start = Clock::now();
+    callback_call(stub, slot.request, slot.response, [&, index](mrpc::Status status) {
+      std::lock_guard<std::mutex> lock(mutex);
+      completed.emplace_back(index, status.ok());
+      cv.notify_one();
+    });
+  };
+
+  for (size_t i = 0; i < slots.size(); ++i) {
+    fill(slots[i].request);
+    in_flight++;
+    issue(i);
+  }
+  while (in_flight > 0) {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&] { return !completed.empty(); });
+    auto [index, ok] = completed.front();
+    completed.pop_front();
+    lock.unlock();
+    in_flight--;
+    if (recording.load(std::memory_order_relaxed)) {
+      if (!ok) result.errors++;
+      result.latencies_ns.push_back(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - slots[index].start).count());
+    }
+    if (!stop.load(std::memory_order_relaxed)) {
+      in_flight++;
+      issue(index);
+    }
+  }
+}
+
+template <typename Stub, typename Request, typename Response>
+int RunLoadTest(const Config &config, std::function<void(Request &)> fill,
+                std::function<mrpc::Status(Stub &, Request &, Response &)> call,
+                std::function<void(Stub &, Request &, Response &, std::function<void(mrpc::Status)>)> callback_call) {
+  std::atomic<bool> recording{false};
+  std::atomic<bool> stop{false};
+  std::vector<WorkerResult> results(config.threads);
+  std::vector<std::thread> workers;
+  for (int i = 0; i < config.threads; ++i) {
+    workers.emplace_back([&, i] {
+      RunWorker<Stub, Request, Response>(config, fill, call, callback_call, recording, stop, results[i]);
+    });
+  }
+
+  std::this_thread::sleep_for(std::chrono::seconds(config.warmup_s));
+  recording.store(true);
+  auto start = Clock::now();
+  std::this_thread::sleep_for(std::chrono::seconds(config.duration_s));
+  recording.store(false);
+  double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  stop.store(true);
+  for (auto &worker : workers) worker.join();
+
+  std::vector<uint64_t> latencies;
+  uint64_t errors = 0;
+  for (auto &result : results) {
+    latencies.insert(latencies.end(), result.latencies_ns.begin(), result.latencies_ns.end());
+    errors += result.errors;
+  }
+  if (latencies.empty()) {
+    std::fprintf(stderr, "no calls completed\n");
+    return 1;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&latencies](double p) {
+    size_t index = static_cast<size_t>(p * (latencies.size() - 1));
+    return latencies[index] / 1000.0;
+  };
+  std::printf("method=%s threads=%d concurrency=%d payload=%zu duration=%.2fs\n",
+              config.method.c_str(), config.threads, config.concurrency, config.payload, elapsed);
+  std::printf("calls=%zu errors=%llu qps=%.0f\n", latencies.size(),
+              static_cast<unsigned long long>(errors), latencies.size() / elapsed);
+  std::printf("latency_us p50=%.1f p99=%.1f p999=%.1f max=%.1f\n", percentile(0.50),
+              percentile(0.99), percentile(0.999), latencies.back() / 1000.0);
+  return errors == 0 ? 0 : 1;
+}
+
+void Usage(const char *prog) {
+  std::fprintf(stderr,
+               "Usage: %s [--addr host:port] [--method name] [--threads N] [--concurrency N]\n"
+)";
+        ss << "               \"          [--payload bytes] [--duration seconds] [--warmup seconds] [--no_server]"
+           << (slow_client ? " [--slow_client]" : "") << "\\n\",\n";
+        ss << R"(               prog);
+}
+
+} // namespace
+
+)";
+        // 按方法名分发，string字段按payload大小填充
+        ss << "int main(int argc, char *argv[]) {\n";
+        ss << "  Config config;\n";
+        ss << "  config.method = \"" << service.methods[0].name << "\";\n";
+        ss << R"(  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (arg == "--no_server") {
+      config.start_server = false;
+      continue;
+    }
+)";
+        if (slow_client) {
+            ss << R"(    if (arg == "--slow_client") {
+      config.slow_client = true;
+      continue;
+    }
+)";
+        }
+        ss << R"(    if (value == nullptr) {
+      Usage(argv[0]);
+      return 1;
+    }
+    ++i;
+    if (arg == "--addr") config.addr = value;
+    else if (arg == "--method") config.method = value;
+    else if (arg == "--threads") config.threads = std::atoi(value);
+    else if (arg == "--concurrency") config.concurrency = std::atoi(value);
+    else if (arg == "--payload") config.payload = std::strtoul(value, nullptr, 10);
+    else if (arg == "--duration") config.duration_s = std::atoi(value);
+    else if (arg == "--warmup") config.warmup_s = std::atoi(value);
+    else {
+      Usage(argv[0]);
+      return 1;
+    }
+  }
+
+)";
+        ss << "  LoadTest" << svc << "Service service;\n";
+        if (options.shm) {
+            // shm://地址在本进程内起共享内存服务端，其余地址起套接字服务端
+            ss << R"(  std::unique_ptr<mrpc::server::MrpcServer> server;
+  MrpcShmServer shm_server(config.addr);
+  std::thread server_thread;
+  if (config.start_server) {
+    if (MrpcIsShmAddress(config.addr)) {
+      shm_server.RegisterService(&service);
+      server_thread = std::thread([&shm_server, &config] {
+        if (!shm_server.Start()) {
+          std::fprintf(stderr, "cannot start shm server on %s: segment is in use or cannot be created\n", config.addr.c_str());
+        }
+      });
+    } else {
+      server = std::make_unique<mrpc::server::MrpcServer>(config.addr);
+      server->RegisterService(&service);
+      server_thread = std::thread([&server] { server->Start(); });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  }
+)";
+        } else {
+            ss << "  mrpc::server::MrpcServer server(config.addr);\n";
+            ss << "  std::thread server_thread;\n";
+            ss << "  if (config.start_server) {\n";
+            ss << "    server.RegisterService(" << (splitMode() ? "service.Service()" : "&service") << ");\n";
+            ss << R"(    server_thread = std::thread([&server] { server.Start(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  }
+)";
+        }
+        if (slow_client) {
+            // 慢客户端把自己的响应环写满后，服务端应只暂停它的槽位，压测的调用不受影响
+            const Method& method = *slow_method;
+            ss << "  std::atomic<bool> slow_stop{false};\n";
+            ss << "  std::thread slow_thread;\n";
+            ss << "  if (config.slow_client) {\n";
+            ss << "    slow_thread = std::thread([&config, &slow_stop] {\n";
+            ss << "      " << svc << "Stub stub(config.addr);\n";
+            ss << "      " << requestType(method) << " request;\n";
+            ss << "      std::string key;\n";
+            if (hasWindow(method)) {
+                // 窗口占满后阻塞的Acquire永远等不到信用，改为立即失败并轮询停止标志
+                ss << "      stub.SetWindowPolicy(MrpcWindowPolicy::kFailFast);\n";
+                ss << "      while (!slow_stop.load()) {\n";
+                ss << "        mrpc::Status status = stub.Async" << method.name << "(request, key);\n";
+                ss << "        if (status.code() == kMrpcWindowFull) {\n";
+                ss << "          std::this_thread::sleep_for(std::chrono::milliseconds(10));\n";
+                ss << "        } else if (!status.ok()) {\n";
+                ss << "          break;\n";
+                ss << "        }\n";
+                ss << "      }\n";
+            } else {
+                ss << "      while (!slow_stop.load() && stub.Async" << method.name << "(request, key).ok()) {\n";
+                ss << "      }\n";
+            }
+            ss << "    });\n";
+            ss << "  }\n";
+        }
+        ss << R"(
+  int rc = 2;
+)";
+        for (const auto& method : service.methods) {
+            std::string req = requestType(method);
+            std::string resp = method.oneway ? "NoResponse" : responseType(method);
+            ss << "  if (config.method == \"" << method.name << "\") {\n";
+            ss << "    rc = RunLoadTest<" << svc << "Stub, " << req << ", " << resp << ">(\n";
+            ss << "        config,\n";
+            ss << "        [&config](" << req << " &request) {\n";
+            if (method.request_params.empty()) ss << "          (void)config;\n";
+            for (const auto& param : method.request_params) {
+                if (param.type == "string") {
+                    ss << "          request." << param.name << " = std::string(config.payload, 'x');\n";
+                } else if (param.type == "int") {
+                    ss << "          request." << param.name << " = static_cast<int>(config.payload);\n";
+                } else if (param.type == "float") {
+                    ss << "          request." << param.name << " = static_cast<float>(config.payload);\n";
+                } else if (param.type == "bool") {
+                    ss << "          request." << param.name << " = true;\n";
+                }
+            }
+            ss << "        },\n";
+            if (method.oneway) {
+                ss << "        [](" << svc << "Stub &stub, " << req << " &request, " << resp << " &) {\n";
+                ss << "          return stub." << method.name << "(request);\n";
+                ss << "        },\n";
+                ss << "        [](" << svc << "Stub &stub, " << req << " &request, " << resp << " &,\n";
+                ss << "           std::function<void(mrpc::Status)> done) {\n";
+                ss << "          done(stub." << method.name << "(request));\n";
+                ss << "        });\n";
+                ss << "  }\n";
+                continue;
+            }
+            ss << "        [](" << svc << "Stub &stub, " << req << " &request, " << resp << " &response) {\n";
+            ss << "          return stub." << method.name << "(request, response);\n";
+            ss << "        },\n";
+            ss << "        [](" << svc << "Stub &stub, " << req << " &request, " << resp << " &response,\n";
+            ss << "           std::function<void(mrpc::Status)> done) {\n";
+            ss << "          stub.Callback" << method.name << "(request, response, done);\n";
+            ss << "        });\n";
+            ss << "  }\n";
+        }
+        ss << R"(  if (rc == 2) {
+    std::fprintf(stderr, "unknown method: %s\n", config.method.c_str());
+  }
+
+  if (config.start_server) {
+)";
+        if (options.shm) {
+            ss << "    if (server) server->Stop();\n";
+            ss << "    shm_server.Stop();\n";
+        } else {
+            ss << "    server.Stop();\n";
+        }
+        ss << "    server_thread.join();\n";
+        ss << "  }\n";
+        if (slow_client) {
+            // 服务端停止后慢客户端阻塞中的写入立即失败
+            ss << "  slow_stop.store(true);\n";
+            ss << "  if (slow_thread.joinable()) slow_thread.join();\n";
+        }
+        ss << R"(  return rc;
+}
+)";
+        return ss.str();
+    }
+
+    // 生成编解码微基准与往返模糊测试程序：覆盖每个请求和响应消息
+    std::string generateCodecTests(const std::string& header_path) {
+        std::stringstream ss;
+        std::vector<Message> messages = messageTypes();
+        ss << "// " << service.name << " 编解码微基准与往返模糊测试，由CppStubGenerator生成\n";
+        ss << "// 用法: codec_test [bench|fuzz] [--iterations N] [--seed S]\n";
+        ss << "// 以 -DMRPC_LIBFUZZER -fsanitize=fuzzer 编译时改为libFuzzer入口\n";
+        ss << "#include \"" << baseName(header_path) << "\"\n";
+        ss << "#include <algorithm>\n";
+        ss << "#include <atomic>\n";
+        ss << "#include <chrono>\n";
+        ss << "#include <cstdint>\n";
+        ss << "#include <cstdio>\n";
+        ss << "#include <cstdlib>\n";
+        ss << "#include <cstring>\n";
+        ss << "#include <limits>\n";
+        ss << "#include <new>\n";
+        ss << "#include <random>\n";
+        ss << "#include <string>\n\n";
+
+        ss << R"(// 替换全局operator new以统计每次操作的分配次数和字节数
+namespace {
+std::atomic<uint64_t> g_alloc_count{0};
+std::atomic<uint64_t> g_alloc_bytes{0};
+}  // namespace
+
+void *operator new(std::size_t size) {
+  g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+  g_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+  if (void *p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+void *operator new[](std::size_t size) { return operator new(size); }
+// 禁止内联，避免编译器把内联后的new/free配对误报为不匹配
+[[gnu::noinline]] void operator delete(void *p) noexcept { std::free(p); }
+[[gnu::noinline]] void operator delete[](void *p) noexcept { std::free(p); }
+[[gnu::noinline]] void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+[[gnu::noinline]] void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+)";
+        ss << "using namespace " << namespace_name << ";\n\n";
+        ss << R"(namespace {
+
+using Clock = std::chrono::steady_clock;
+volatile size_t g_sink = 0;
+
+// 随机生成合法的UTF-8字符串，覆盖控制字符、转义字符和多字节字符
+std::string RandomString(std::mt19937_64 &rng) {
+  static const char *const kPieces[] = {"\"", "\\", "/", "\b", "\f", "\n", "\r", "\t",
+                                        "\x01", "\x1f", "\xc3\xa9", "\xe4\xb8\xad",
+                                        "\xf0\x9f\x98\x80"};
+  std::string s;
+)";
+        if (segmentsEnabled()) {
+            ss << "  // 偶尔生成超过内联阈值的长字符串，覆盖分散-聚集编码的引用路径\n";
+            ss << "  size_t length = rng() % 8 == 0 ? MrpcSegments::kInlineMax + rng() % 1024 : rng() % 33;\n";
+        } else {
+            ss << "  size_t length = rng() % 33;\n";
+        }
+        ss << R"(  for (size_t i = 0; i < length; ++i) {
+    if (rng() % 4 == 0) {
+      s += kPieces[rng() % (sizeof(kPieces) / sizeof(kPieces[0]))];
+    } else {
+      s += static_cast<char>(0x20 + rng() % 0x5f);
+    }
+  }
+  return s;
+}
+
+)";
+        // 每个消息生成按大小填充、随机填充和逐字段比较三个函数
+        for (const auto& message : messages) {
+            ss << "void Fill(" << message.name << " &m, size_t size) {\n";
+            if (message.params.empty()) ss << "  (void)m;\n  (void)size;\n";
+            bool uses_size = false;
+            for (const auto& param : message.params) {
+                if (param.type == "string") {
+                    ss << "  m." << param.name << " = std::string(size, 'x');\n";
+                    uses_size = true;
+                } else if (param.type == "int") {
+                    ss << "  m." << param.name << " = static_cast<int>(size);\n";
+                    uses_size = true;
+                } else if (param.type == "float") {
+                    ss << "  m." << param.name << " = static_cast<float>(size) * 1.5f;\n";
+                    uses_size = true;
+                } else if (param.type == "bool") {
+                    ss << "  m." << param.name << " = true;\n";
+                }
+            }
+            if (!message.params.empty() && !uses_size) ss << "  (void)size;\n";
+            ss << "}\n\n";
+
+            ss << "void FillRandom(" << message.name << " &m, std::mt19937_64 &rng) {\n";
+            if (message.params.empty()) ss << "  (void)m;\n  (void)rng;\n";
+            for (const auto& param : message.params) {
+                if (param.type == "string") {
+                    ss << "  m." << param.name << " = RandomString(rng);\n";
+                } else if (param.type == "int") {
+                    ss << "  m." << param.name << " = std::uniform_int_distribution<int>(\n"
+                       << "      std::numeric_limits<int>::min(), std::numeric_limits<int>::max())(rng);\n";
+                } else if (param.type == "float") {
+                    ss << "  m." << param.name << " = std::uniform_real_distribution<float>(-1e6f, 1e6f)(rng);\n";
+                } else if (param.type == "bool") {
+                    ss << "  m." << param.name << " = (rng() & 1) != 0;\n";
+                }
+            }
+            ss << "}\n\n";
+
+            ss << "bool Equal(const " << message.name << " &a, const " << message.name << " &b) {\n";
+            if (message.params.empty()) {
+                ss << "  (void)a;\n  (void)b;\n  return true;\n";
+            } else {
+                ss << "  return ";
+                for (size_t i = 0; i < message.params.size(); ++i) {
+                    if (i > 0) ss << " &&\n         ";
+                    ss << "a." << message.params[i].name << " == b." << message.params[i].name;
+                }
+                ss << ";\n";
+            }
+            ss << "}\n\n";
+        }
+
+        ss << R"(// 自动调整迭代次数直到单轮耗时超过100ms，输出ns/op、B/op和allocs/op
+template <typename Op>
+void Measure(const char *message, const char *op, size_t size, size_t encoded, Op &&fn) {
+  uint64_t iterations = 1;
+  for (;;) {
+    uint64_t count = g_alloc_count.load(std::memory_order_relaxed);
+    uint64_t bytes = g_alloc_bytes.load(std::memory_order_relaxed);
+    auto start = Clock::now();
+    for (uint64_t i = 0; i < iterations; ++i) fn();
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    if (ns >= 1e8 || iterations >= (uint64_t(1) << 30)) {
+      count = g_alloc_count.load(std::memory_order_relaxed) - count;
+      bytes = g_alloc_bytes.load(std::memory_order_relaxed) - bytes;
+      std::printf("%-32s %-9s size=%-5zu encoded=%-6zu %10llu iters %10.1f ns/op %8.1f B/op %6.1f allocs/op\n",
+                  message, op, size, encoded, static_cast<unsigned long long>(iterations),
+                  ns / iterations, static_cast<double>(bytes) / iterations,
+                  static_cast<double>(count) / iterations);
+      return;
+    }
+    uint64_t next = ns > 0 ? static_cast<uint64_t>(iterations * 1.2e8 / ns) : iterations * 100;
+    iterations = std::max(iterations * 2, std::min(next, iterations * 100));
+  }
+}
+
+template <typename Message>
+void BenchMessage(const char *name) {
+  for (size_t size : {16, 256, 4096}) {
+    Message message;
+    Fill(message, size);
+    const std::string data = message.Encode();
+    Measure(name, "encode", size, data.size(), [&] { g_sink = g_sink + message.Encode().size(); });
+    Measure(name, "decode", size, data.size(), [&] {
+      Message out;
+      out.Decode(data);
+    });
+    Measure(name, "roundtrip", size, data.size(), [&] {
+      Message out;
+      out.Decode(message.Encode());
+    });
+)";
+        if (segmentsEnabled()) {
+            ss << "    MrpcSegments segments;\n";
+            ss << "    Measure(name, \"segments\", size, data.size(), [&] {\n";
+            ss << "      segments.Clear();\n";
+            ss << "      message.EncodeSegments(segments);\n";
+            ss << "      g_sink = g_sink + segments.Size();\n";
+            ss << "    });\n";
+        }
+        ss << R"(  }
+}
+
+// 随机填充后编码再解码，逐字段比较
+template <typename Message>
+bool FuzzMessage(const char *name, std::mt19937_64 &rng, uint64_t iterations) {
+  for (uint64_t i = 0; i < iterations; ++i) {
+    Message in;
+    FillRandom(in, rng);
+    Message out;
+    try {
+      out.Decode(in.Encode());
+    } catch (const std::exception &e) {
+      std::fprintf(stderr, "%s: decode failed after %llu iterations: %s\n", name,
+                   static_cast<unsigned long long>(i), e.what());
+      return false;
+    }
+    if (!Equal(in, out)) {
+      std::fprintf(stderr, "%s: round-trip mismatch after %llu iterations: %s\n", name,
+                   static_cast<unsigned long long>(i), in.Encode().c_str());
+      return false;
+    }
+)";
+        if (segmentsEnabled()) {
+            ss << "    MrpcSegments segments;\n";
+            ss << "    in.EncodeSegments(segments);\n";
+            ss << "    if (segments.Flatten() != in.Encode()) {\n";
+            ss << "      std::fprintf(stderr, \"%s: segments differ from Encode() after %llu iterations: %s\\n\", name,\n";
+            ss << "                   static_cast<unsigned long long>(i), in.Encode().c_str());\n";
+            ss << "      return false;\n";
+            ss << "    }\n";
+        }
+        ss << R"(  }
+  std::printf("%-32s fuzz ok (%llu iterations)\n", name, static_cast<unsigned long long>(iterations));
+  return true;
+}
+
+// 任意输入都不应使解码崩溃；能解码的输入再次往返后必须稳定
+template <typename Message>
+void DecodeArbitrary(const std::string &input) {
+  Message message;
+  try {
+    message.Decode(input);
+  } catch (const std::exception &) {
+    return;
+  }
+  Message again;
+  again.Decode(message.Encode());
+  if (!Equal(message, again)) std::abort();
+}
+
+}  // namespace
+
+#ifdef MRPC_LIBFUZZER
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  const std::string input(reinterpret_cast<const char *>(data), size);
+)";
+        for (const auto& message : messages) {
+            ss << "  DecodeArbitrary<" << message.name << ">(input);\n";
+        }
+        ss << R"(  return 0;
+}
+#else
+int main(int argc, char *argv[]) {
+  std::string mode = "bench";
+  uint64_t iterations = 10000;
+  uint64_t seed = std::random_device{}();
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+      iterations = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = std::strtoull(argv[++i], nullptr, 10);
+    } else if (argv[i][0] != '-') {
+      mode = argv[i];
+    } else {
+      std::fprintf(stderr, "unknown option: %s\n", argv[i]);
+      return 2;
+    }
+  }
+
+  if (mode == "bench") {
+)";
+        for (const auto& message : messages) {
+            ss << "    BenchMessage<" << message.name << ">(\"" << message.name << "\");\n";
+        }
+        ss << R"(    return 0;
+  }
+  if (mode == "fuzz") {
+    std::printf("seed=%llu\n", static_cast<unsigned long long>(seed));
+    std::mt19937_64 rng(seed);
+    bool ok = true;
+)";
+        for (const auto& message : messages) {
+            ss << "    ok = FuzzMessage<" << message.name << ">(\"" << message.name
+               << "\", rng, iterations) && ok;\n";
+        }
+        ss << R"(    return ok ? 0 : 1;
+  }
+  std::fprintf(stderr, "unknown mode: %s\n", mode.c_str());
+  return 2;
+}
+#endif
+)";
+        return ss.str();
+    }
+
+    // 截取emit写入output的内容
+    std::string capture(const std::function<void()>& emit) {
+        std::stringstream saved;
+        saved.swap(output);
+        emit();
+        saved.swap(output);
+        return saved.str();
+    }
+
+    // 拆分模式：把类内定义的成员函数移到类外，类内只留声明，返回类外定义；
+    // accessors为成员改由指针持有后函数体中需要替换的访问写法
+    std::string outlineMembers(const std::string& cls, const std::string& text,
+                               const std::vector<std::pair<std::string, std::string>>& accessors) {
+        std::vector<std::string> lines;
+        std::istringstream in(text);
+        for (std::string line; std::getline(in, line);) lines.push_back(line);
+
+        auto qualify = [&cls](std::string line) {
+            size_t name = line.find('(');
+            while (name > 0 && (std::isalnum(static_cast<unsigned char>(line[name - 1])) ||
+                                line[name - 1] == '_')) {
+                --name;
+            }
+            return line.insert(name, cls + "::");
+        };
+        auto rewrite = [&accessors](std::string line) {
+            for (const auto& accessor : accessors) {
+                for (size_t pos = line.find(accessor.first); pos != std::string::npos;
+                     pos = line.find(accessor.first, pos + accessor.second.size())) {
+                    line.replace(pos, accessor.first.size(), accessor.second);
+                }
+            }
+            return line;
+        };
+
+        std::stringstream defs;
+        for (size_t i = 0; i < lines.size(); ++i) {
+            const std::string& line = lines[i];
+            // 类作用域内的成员以两个空格缩进开头
+            bool member = line.size() > 2 && line.compare(0, 2, "  ") == 0 && line[2] != ' ' &&
+                          line.find('(') != std::string::npos;
+            size_t end = i;
+            while (member && end < lines.size() &&
+                   std::string(";{}").find(lines[end].back()) == std::string::npos) {
+                ++end;
+            }
+            if (!member || end == lines.size() || lines[end].back() == ';') {
+                for (; i <= std::min(end, lines.size() - 1); ++i) output << lines[i] << "\n";
+                --i;
+                continue;
+            }
+
+            if (lines[end].back() == '}') {
+                // 单行函数体
+                size_t open = line.find(" { ");
+                output << line.substr(0, open) << ";\n";
+                defs << qualify(line.substr(2, open - 2)) << " {\n";
+                defs << "  " << rewrite(line.substr(open + 3, line.size() - open - 5)) << "\n";
+                defs << "}\n\n";
+                continue;
+            }
+
+            // 签名的续行按类名长度重新对齐
+            for (size_t j = i; j <= end; ++j) {
+                std::string signature = lines[j];
+                if (j == end) signature = signature.substr(0, signature.size() - 2);
+                output << signature << (j == end ? ";" : "") << "\n";
+                if (j == i) {
+                    defs << qualify(lines[j].substr(2)) << "\n";
+                } else {
+                    defs << std::string(cls.size(), ' ') << lines[j] << "\n";
+                }
+            }
+            for (i = end + 1; i < lines.size() && lines[i] != "  }"; ++i) {
+                defs << rewrite(lines[i].substr(2)) << "\n";
+            }
+            defs << "}\n\n";
+        }
+        return defs.str();
+    }
+
+    // 拆分模式下Stub的构造、成员函数、Receive和按消息类型的转发函数
+    std::string generateSplitClientSource(const std::string& stub_defs) {
+        std::stringstream ss;
+        std::string stub = service.name + "Stub";
+        ss << stub << "::" << stub << "(const std::string &addr)\n";
+        ss << "    : client_(std::make_unique<mrpc::client::MrpcClient>(addr))";
+        for (const auto& method : service.methods) {
+            if (method.cache.enabled) {
+                ss << ",\n      " << method.name << "_cache_(std::make_unique<MrpcResponseCache<"
+                   << responseType(method) << ">>(" << method.cache.ttl_ms << ", "
+                   << method.cache.max_entries << "))";
+            }
+            if (method.coalesce) {
+                ss << ",\n      " << method.name << "_flight_(std::make_unique<MrpcSingleFlight<"
+                   << responseType(method) << ">>())";
+            }
+        }
+        if (usesStubWindow()) {
+            ss << ",\n      window_(std::make_unique<MrpcInFlightWindow>(" << service.max_in_flight << "))";
+        }
+        for (const auto& method : service.methods) {
+            if (hasWindow(method) && method.max_in_flight > 0) {
+                ss << ",\n      " << method.name << "_window_(std::make_unique<MrpcInFlightWindow>("
+                   << method.max_in_flight << "))";
+            }
+        }
+        ss << " {}\n\n";
+        ss << stub << "::~" << stub << "() = default;\n\n";
+        ss << stub_defs;
+
+        std::string indent(stub.size() + 20, ' ');
+        std::set<std::string> receives, sends;
+        for (const auto& method : service.methods) {
+            std::string req = requestType(method);
+            std::string resp = responseType(method);
+            if (method.oneway) {
+                if (!sends.insert("oneway " + req).second) continue;
+                // 适配器和占位响应随回调一起存活，请求在入队时已编码
+                ss << "mrpc::Status " << stub << "::OnewaySend(const char *method, " << req
+                   << " &request) {\n";
+                ss << "  auto request_codec = std::make_shared<MrpcCodec<" << req << ">>(request);\n";
+                ss << "  auto no_reply = std::make_shared<MrpcNoReply>();\n";
+                ss << "  client_->CallbackSend(method, *request_codec, *no_reply,\n";
+                ss << "                        [request_codec, no_reply](mrpc::Status) {});\n";
+                ss << "  return mrpc::Status();\n";
+                ss << "}\n\n";
+                continue;
+            }
+            if (receives.insert(resp).second) {
+                ss << "mrpc::Status " << stub << "::Receive(const std::string &key, " << resp
+                   << " &response) {\n";
+                ss << "  MrpcCodec<" << resp << "> response_codec(response);\n";
+                if (hasWindows()) {
+                    ss << "  size_t sep = key.find('#');\n";
+                    ss << "  mrpc::Status status = client_->Receive(key.substr(sep + 1), response_codec);\n";
+                    ss << "  ReleaseWindow(std::stoul(key.substr(0, sep)));\n";
+                    ss << "  return status;\n";
+                } else {
+                    ss << "  return client_->Receive(key, response_codec);\n";
+                }
+                ss << "}\n\n";
+            }
+            if (!sends.insert(req + "," + resp).second) continue;
+
+            ss << "mrpc::Status " << stub << "::Send(const char *method, " << req << " &request, "
+               << resp << " &response) {\n";
+            ss << "  MrpcCodec<" << req << "> request_codec(request);\n";
+            ss << "  MrpcCodec<" << resp << "> response_codec(response);\n";
+            ss << "  return client_->Send(method, request_codec, response_codec);\n";
+            ss << "}\n\n";
+
+            if (sends.insert(req).second) {
+                ss << "mrpc::Status " << stub << "::AsyncSend(const char *method, " << req
+                   << " &request, std::string &key) {\n";
+                ss << "  MrpcCodec<" << req << "> request_codec(request);\n";
+                ss << "  return client_->AsyncSend(method, request_codec, key);\n";
+                ss << "}\n\n";
+            }
+
+            // 回调可能在调用返回后才触发，适配器随回调一起存活
+            ss << "void " << stub << "::CallbackSend(const char *method, " << req << " &request, "
+               << resp << " &response,\n";
+            ss << indent << "std::function<void(mrpc::Status)> callback) {\n";
+            ss << "  auto request_codec = std::make_shared<MrpcCodec<" << req << ">>(request);\n";
+            ss << "  auto response_codec = std::make_shared<MrpcCodec<" << resp << ">>(response);\n";
+            ss << "  client_->CallbackSend(method, *request_codec, *response_codec,\n";
+            ss << "                        [request_codec, response_codec, callback](mrpc::Status status) {\n";
+            ss << "                          callback(status);\n";
+            ss << "                        });\n";
+            ss << "}\n\n";
+        }
+        return ss.str();
+    }
+
+    // 生成描述符运行时头文件：与具体服务无关，网关据此加载--descriptor写出的描述符并转发、转码
+    std::string generateDescriptorRuntime() {
+        return R"(// 服务描述符运行时，由CppStubGenerator生成，与具体服务无关
+// 网关加载各服务的.mrpcd描述符后，不依赖生成的消息类即可按方法全名转发调用，并在JSON与二进制编码之间转码。
+// 二进制编码与Python存根的toBytes一致：定长部分按字段顺序排列（int为int64、float为double、bool为1字节、
+// string为uint32长度，小端无填充），字符串内容按字段顺序追加在后
+#pragma once
+
+#include "mrpcpp/client.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "mrpc descriptors and the binary encoding are little-endian"
+#endif
+
+namespace mrpc {
+namespace dynamic {
+
+// 描述符文件布局，全部为小端uint32，各表按4字节对齐，名称存其在字符串表中的偏移：
+//   头部     magic "MRPD"、版本、文件大小、服务全名，方法/消息/字段表的项数与偏移，字符串表的偏移与大小
+//   方法表   id、名称、全名、请求消息、响应消息（单向方法为kMrpcNoMessage）、标志（第0位单向，第1-2位优先级）
+//   消息表   名称、首个字段、字段数、定长部分字节数
+//   字段表   名称、类型、在定长部分中的偏移
+//   字符串表 以NUL结尾的UTF-8字符串
+constexpr uint32_t kMrpcDescriptorMagic = 0x4450524d;  // "MRPD"
+constexpr uint32_t kMrpcDescriptorVersion = 1;
+constexpr uint32_t kMrpcNoMessage = 0xffffffff;
+constexpr uint32_t kMrpcMethodOneway = 1;
+constexpr uint32_t kMrpcMethodPriorityShift = 1;  // 标志的第1-2位为优先级
+
+// 通用存根返回的错误码，取值与gRPC的状态码一致
+enum MrpcDynamicCode : int {
+  kMrpcDynamicInvalidArgument = 3,
+  kMrpcDynamicUnimplemented = 12,
+  kMrpcDynamicInternal = 13,
+};
+
+enum class MrpcFieldType : uint32_t { kString = 1, kInt = 2, kFloat = 3, kBool = 4 };
+
+// 二进制编码中字段的值；字符串引用输入的内存
+using MrpcFieldView = std::variant<std::string_view, int64_t, double, bool>;
+
+// 直接在输入上解析JSON的读取器，JSON转二进制时据此把字段值读入消息计划的各个槽位，不构造DOM；
+// 语法、UTF-8校验和数字的解析与nlohmann::json一致，格式错误时抛出std::invalid_argument
+class MrpcJsonReader {
+public:
+  // 与nlohmann::json一样，整数先按int64（负数）或uint64解析，溢出时和小数一样按double解析
+  struct Number {
+    enum class Kind { kInt, kUint, kFloat } kind = Kind::kInt;
+    int64_t i = 0;
+    uint64_t u = 0;
+    double d = 0;
+
+    // 转换为字段的类型，与nlohmann::json的get<int64_t>、get<double>一致
+    int64_t AsInt() const {
+      if (kind == Kind::kInt) return i;
+      return kind == Kind::kUint ? static_cast<int64_t>(u) : static_cast<int64_t>(d);
+    }
+    double AsDouble() const {
+      if (kind == Kind::kInt) return static_cast<double>(i);
+      return kind == Kind::kUint ? static_cast<double>(u) : d;
+    }
+  };
+
+  MrpcJsonReader(std::string_view text, std::string_view context) : text_(text), context_(context) {
+    // 与nlohmann::json一样跳过开头的UTF-8 BOM
+    if (text_.substr(0, 3) == "\xef\xbb\xbf") pos_ = 3;
+  }
+
+  // 跳过空白后返回下一个字符，输入结束时返回'\0'
+  char Peek() {
+    while (pos_ < text_.size() &&
+           (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\n' || text_[pos_] == '\r')) {
+      ++pos_;
+    }
+    return pos_ < text_.size() ? text_[pos_] : '\0';
+  }
+
+  bool Consume(char c) {
+    if (pos_ >= text_.size() || Peek() != c) return false;
+    ++pos_;
+    return true;
+  }
+
+  void Expect(char c) {
+    if (!Consume(c)) Fail(std::string("expected '") + c + "'");
+  }
+
+  bool Literal(std::string_view word) {
+    Peek();
+    if (text_.substr(pos_, word.size()) != word) return false;
+    pos_ += word.size();
+    return true;
+  }
+
+  bool AtNumber() {
+    char c = Peek();
+    return c == '-' || (c >= '0' && c <= '9');
+  }
+
+  // 读取字符串；不含转义时直接引用输入，否则解码到buffer()返回的字符串中
+  template <typename Buffer>
+  std::string_view String(Buffer &&buffer) {
+    if (Peek() != '"') Fail("expected a string");
+    size_t start = ++pos_;
+    while (pos_ < text_.size()) {
+      unsigned char c = static_cast<unsigned char>(text_[pos_]);
+      if (c == '"') return text_.substr(start, pos_++ - start);
+      if (c == '\\') return Unescape(start, buffer());
+      if (c < 0x20) Fail("control character in string");
+      pos_ += c < 0x80 ? 1 : Utf8Length();
+    }
+    Fail("unterminated string");
+  }
+
+  // 按JSON数字语法读取一个数字；超出double范围时nlohmann::json报错，下溢时为0
+  Number ReadNumber() {
+    Peek();
+    size_t start = pos_;
+    bool integer = true;
+    if (At('-')) ++pos_;
+    if (At('0')) {
+      ++pos_;
+    } else if (AtDigit()) {
+      while (AtDigit()) ++pos_;
+    } else {
+      Fail("invalid number");
+    }
+    if (At('.')) {
+      integer = false;
+      ++pos_;
+      if (!AtDigit()) Fail("invalid number");
+      while (AtDigit()) ++pos_;
+    }
+    if (At('e') || At('E')) {
+      integer = false;
+      ++pos_;
+      if (At('+') || At('-')) ++pos_;
+      if (!AtDigit()) Fail("invalid number");
+      while (AtDigit()) ++pos_;
+    }
+    const char *begin = text_.data() + start;
+    const char *end = text_.data() + pos_;
+    Number number;
+    if (integer && *begin == '-' && std::from_chars(begin, end, number.i).ec == std::errc()) return number;
+    number.kind = Number::Kind::kUint;
+    if (integer && *begin != '-' && std::from_chars(begin, end, number.u).ec == std::errc()) return number;
+    number.kind = Number::Kind::kFloat;
+    if (std::from_chars(begin, end, number.d).ec == std::errc::result_out_of_range) {
+      if (Overflows(std::string_view(begin, end - begin))) Fail("number overflow");
+      number.d = *begin == '-' ? -0.0 : 0.0;
+    }
+    return number;
+  }
+
+  // 跳过一个值，只校验语法；用显式的括号栈代替递归，嵌套深度与nlohmann::json一样不受限制
+  void Skip() {
+    std::string brackets;
+    std::string scratch;
+    auto buffer = [&scratch]() -> std::string & { return scratch; };
+    do {
+      char c = Peek();
+      if (c == '{' || c == '[') {
+        ++pos_;
+        char close = c == '{' ? '}' : ']';
+        if (!Consume(close)) {
+          brackets += close;
+          if (close == '}') Key(buffer);
+          continue;
+        }
+      } else if (c == '"') {
+        String(buffer);
+      } else if (!Literal("true") && !Literal("false") && !Literal("null")) {
+        ReadNumber();
+      }
+      // 一个值读完，处理所在容器的逗号或闭合括号
+      while (!brackets.empty()) {
+        if (Consume(',')) {
+          if (brackets.back() == '}') Key(buffer);
+          break;
+        }
+        Expect(brackets.back());
+        brackets.pop_back();
+      }
+    } while (!brackets.empty());
+  }
+
+  // 对象的键及其后的冒号
+  template <typename Buffer>
+  std::string_view Key(Buffer &&buffer) {
+    std::string_view key = String(buffer);
+    Expect(':');
+    return key;
+  }
+
+  // 值之后只能有空白；与nlohmann::json一样，'\0'视为输入结束，其后的内容忽略
+  void Finish() {
+    if (Peek() != '\0') Fail("unexpected trailing data");
+  }
+
+  [[noreturn]] void Fail(const std::string &what) const {
+    throw std::invalid_argument(std::string(context_) + ": invalid JSON at offset " + std::to_string(pos_) +
+                                ": " + what);
+  }
+
+private:
+  bool At(char c) const { return pos_ < text_.size() && text_[pos_] == c; }
+  bool AtDigit() const { return pos_ < text_.size() && text_[pos_] >= '0' && text_[pos_] <= '9'; }
+
+  // 校验pos_处的多字节UTF-8序列并返回其长度，与nlohmann::json同样拒绝过长编码和代理项
+  size_t Utf8Length() const {
+    unsigned char c = static_cast<unsigned char>(text_[pos_]);
+    size_t n;
+    uint32_t cp;
+    if (c >= 0xc2 && c <= 0xdf) {
+      n = 2;
+      cp = c & 0x1f;
+    } else if (c >= 0xe0 && c <= 0xef) {
+      n = 3;
+      cp = c & 0x0f;
+    } else if (c >= 0xf0 && c <= 0xf4) {
+      n = 4;
+      cp = c & 0x07;
+    } else {
+      Fail("invalid UTF-8 in string");
+    }
+    if (pos_ + n > text_.size()) Fail("invalid UTF-8 in string");
+    for (size_t k = 1; k < n; ++k) {
+      unsigned char b = static_cast<unsigned char>(text_[pos_ + k]);
+      if ((b & 0xc0) != 0x80) Fail("invalid UTF-8 in string");
+      cp = (cp << 6) | (b & 0x3f);
+    }
+    if ((n == 3 && (cp < 0x800 || (cp >= 0xd800 && cp <= 0xdfff))) ||
+        (n == 4 && (cp < 0x10000 || cp > 0x10ffff))) {
+      Fail("invalid UTF-8 in string");
+    }
+    return n;
+  }
+
+  // 含转义的字符串：已扫描的部分原样拷贝，其余逐个解码；代理项必须成对出现
+  std::string_view Unescape(size_t start, std::string &out) {
+    out.assign(text_.data() + start, pos_ - start);
+    while (pos_ < text_.size()) {
+      unsigned char c = static_cast<unsigned char>(text_[pos_]);
+      if (c == '"') {
+        ++pos_;
+        return out;
+      }
+      if (c < 0x20) Fail("control character in string");
+      if (c != '\\') {
+        size_t n = c < 0x80 ? 1 : Utf8Length();
+        out.append(text_.data() + pos_, n);
+        pos_ += n;
+        continue;
+      }
+      if (pos_ + 1 >= text_.size()) break;
+      char escape = text_[pos_ + 1];
+      pos_ += 2;
+      switch (escape) {
+        case '"':
+        case '\\':
+        case '/': out += escape; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': AppendUtf8(out, CodePoint()); break;
+        default: Fail("invalid escape");
+      }
+    }
+    Fail("unterminated string");
+  }
+
+  // \u之后的码点，高代理项须紧跟\u低代理项
+  uint32_t CodePoint() {
+    uint32_t cp = Hex4();
+    if (cp >= 0xdc00 && cp <= 0xdfff) Fail("unpaired surrogate");
+    if (cp < 0xd800 || cp > 0xdbff) return cp;
+    if (text_.substr(pos_, 2) != "\\u") Fail("unpaired surrogate");
+    pos_ += 2;
+    uint32_t low = Hex4();
+    if (low < 0xdc00 || low > 0xdfff) Fail("unpaired surrogate");
+    return 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+  }
+
+  uint32_t Hex4() {
+    if (pos_ + 4 > text_.size()) Fail("invalid unicode escape");
+    uint32_t cp = 0;
+    for (size_t k = 0; k < 4; ++k) {
+      char h = text_[pos_ + k];
+      uint32_t digit;
+      if (h >= '0' && h <= '9') {
+        digit = h - '0';
+      } else if (h >= 'a' && h <= 'f') {
+        digit = h - 'a' + 10;
+      } else if (h >= 'A' && h <= 'F') {
+        digit = h - 'A' + 10;
+      } else {
+        Fail("invalid unicode escape");
+      }
+      cp = (cp << 4) | digit;
+    }
+    pos_ += 4;
+    return cp;
+  }
+
+  static void AppendUtf8(std::string &out, uint32_t cp) {
+    if (cp < 0x80) {
+      out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+      out += static_cast<char>(0xc0 | (cp >> 6));
+      out += static_cast<char>(0x80 | (cp & 0x3f));
+    } else if (cp < 0x10000) {
+      out += static_cast<char>(0xe0 | (cp >> 12));
+      out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+      out += static_cast<char>(0x80 | (cp & 0x3f));
+    } else {
+      out += static_cast<char>(0xf0 | (cp >> 18));
+      out += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+      out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+      out += static_cast<char>(0x80 | (cp & 0x3f));
+    }
+  }
+
+  // from_chars在结果超出double范围时不写出值：首位有效数字的数量级为正是上溢，否则是下溢
+  static bool Overflows(std::string_view token) {
+    size_t e = std::min(token.find_first_of("eE"), token.size());
+    int64_t order = 0;
+    bool fraction = false;
+    for (size_t k = 0; k < e; ++k) {
+      if (token[k] == '.') {
+        fraction = true;
+      } else if (token[k] >= '1' && token[k] <= '9') {
+        break;
+      } else if (token[k] == '0' && fraction) {
+        --order;
+      }
+    }
+    if (!fraction) {
+      size_t first = token.find_first_of("123456789");
+      size_t point = std::min(token.find('.'), e);
+      order = static_cast<int64_t>(point - first);
+    }
+    int64_t exponent = 0;
+    bool negative = false;
+    for (size_t k = e + 1; k < token.size(); ++k) {
+      if (token[k] == '-') negative = true;
+      if (token[k] >= '0' && token[k] <= '9') exponent = std::min<int64_t>(exponent * 10 + (token[k] - '0'), 1 << 30);
+    }
+    return order + (negative ? -exponent : exponent) > 0;
+  }
+
+  std::string_view text_;
+  std::string_view context_;
+  size_t pos_ = 0;
+};
+
+struct MrpcFieldPlan {
+  std::string_view name;
+  MrpcFieldType type;
+  uint32_t offset;  // 在定长部分中的偏移
+  std::string json_key;  // 预先转义好的"name":
+};
+
+// 预编译的消息计划：加载描述符时算好布局和JSON键序，编解码时不再推导
+struct MrpcMessagePlan {
+  std::string_view name;
+  std::vector<MrpcFieldPlan> fields;  // 声明顺序，即二进制布局顺序
+  std::vector<uint32_t> json_order;  // 按字段名排序，与nlohmann::json::dump输出的键序一致
+  uint32_t head_size = 0;
+
+  // 返回字段下标，不存在时返回-1
+  int Find(std::string_view field) const {
+    for (size_t i = 0; i < fields.size(); ++i) {
+      if (fields[i].name == field) return static_cast<int>(i);
     }
+    return -1;
+  }
 
-    // 生成方法名数组
-    void generateMethodNames() override {
-        output << "static const char *" << service.name << "_method_names[] = {\n";
-        for (const auto& method : service.methods) {
-            output << "    \"/" << namespace_name << "." << service.name << "/" 
-                  << method.name << "\",\n";
+  // JSON与二进制编码互转；缺失的字段取默认值，与生成代码的fromJson一致。格式错误时抛出异常
+  std::string JsonToBinary(std::string_view text) const {
+    std::vector<MrpcFieldView> values;
+    std::vector<std::string> unescaped;
+    ReadJson(text, values, unescaped);
+    return WriteBinary([&values](size_t i) { return values[i]; });
+  }
+  std::string BinaryToJson(std::string_view bytes) const {
+    std::vector<MrpcFieldView> values;
+    ReadBinary(bytes, values);
+    return WriteJson(values);
+  }
+
+  // 直接在输入上解析JSON，把各字段的值读入values中对应的槽位；未知字段校验语法后跳过，重复的键以最后一个为准。
+  // 不含转义的字符串引用text，其余解码到unescaped中该字段的位置；类型不符时与nlohmann::json的get<>一样报错，
+  // 但只检查每个键最后一次出现的值，所以读完整个对象后才报告
+  void ReadJson(std::string_view text, std::vector<MrpcFieldView> &values,
+                std::vector<std::string> &unescaped) const {
+    values.clear();
+    values.reserve(fields.size());
+    for (const auto &field : fields) values.push_back(Default(field.type));
+    MrpcJsonReader in(text, name);
+    if (fields.empty() && in.Literal("null")) {
+      in.Finish();
+      return;
+    }
+    if (!in.Consume('{')) Fail("expected a JSON object");
+    if (!in.Consume('}')) {
+      std::string key_buffer;
+      auto key_scratch = [&key_buffer]() -> std::string & { return key_buffer; };
+      do {
+        int i = Find(in.Key(key_scratch));
+        if (i < 0) {
+          in.Skip();
+        } else {
+          values[i] = ReadField(in, static_cast<size_t>(i), unescaped);
         }
-        output << "};\n\n";
+      } while (in.Consume(','));
+      in.Expect('}');
+    }
+    in.Finish();
+    for (size_t i = 0; i < fields.size(); ++i) {
+      if (values[i].index() != Default(fields[i].type).index()) {
+        Fail("wrong type for field " + std::string(fields[i].name));
+      }
     }
+  }
 
-    // 生成参数的JSON处理代码
-    std::string generateJsonCode(const std::vector<Parameter>& params, bool isToJson) {
-        std::stringstream ss;
-        if (isToJson) {
-            ss << "return json{";
-            for (size_t i = 0; i < params.size(); ++i) {
-                if (i > 0) ss << ",";
-                ss << "{\"" << params[i].name << "\", " << params[i].name << "}";
-            }
-            ss << "};";
-        } else {
-            for (const auto& param : params) {
-                std::string defaultValue;
-                if (param.type == "string") defaultValue = "\"\"";
-                else if (param.type == "int") defaultValue = "0";
-                else if (param.type == "float") defaultValue = "0.0f";
-                else if (param.type == "bool") defaultValue = "false";
-                
-                ss << param.name << " = j.value(\"" << param.name << "\", " 
-                   << defaultValue << "); ";
-            }
+  // 校验二进制编码，按字段顺序取出各字段的值
+  void ReadBinary(std::string_view bytes, std::vector<MrpcFieldView> &values) const {
+    if (bytes.size() < head_size) Fail("truncated binary message");
+    size_t end = head_size;
+    for (const auto &field : fields) {
+      if (field.type == MrpcFieldType::kString) end += Load<uint32_t>(bytes, field.offset);
+    }
+    if (end != bytes.size()) Fail("binary message length does not match its fields");
+    values.clear();
+    values.reserve(fields.size());
+    size_t pos = head_size;
+    for (const auto &field : fields) {
+      switch (field.type) {
+        case MrpcFieldType::kString: {
+          uint32_t n = Load<uint32_t>(bytes, field.offset);
+          std::string_view s = bytes.substr(pos, n);
+          ValidateUtf8(s);
+          values.emplace_back(s);
+          pos += n;
+          break;
         }
-        return ss.str();
+        case MrpcFieldType::kInt: values.emplace_back(Load<int64_t>(bytes, field.offset)); break;
+        case MrpcFieldType::kFloat: values.emplace_back(Load<double>(bytes, field.offset)); break;
+        case MrpcFieldType::kBool: values.emplace_back(bytes[field.offset] != 0); break;
+      }
     }
+  }
 
-    // 生成构造函数参数列表
-    std::string generateConstructorParams(const std::vector<Parameter>& params) {
-        std::stringstream ss;
-        for (size_t i = 0; i < params.size(); ++i) {
-            if (i > 0) ss << ", ";
-            if (params[i].type == "string") 
-                ss << "std::string " << params[i].name;
-            else
-                ss << params[i].type << " " << params[i].name;
+  // 按字段顺序写出二进制编码，get(i)返回第i个字段的值，类型须与字段一致
+  template <typename Get>
+  std::string WriteBinary(Get &&get) const {
+    std::string out(head_size, '\0');
+    for (size_t i = 0; i < fields.size(); ++i) {
+      const auto &field = fields[i];
+      MrpcFieldView value = get(i);
+      switch (field.type) {
+        case MrpcFieldType::kString: {
+          std::string_view s = std::get<std::string_view>(value);
+          if (s.size() > UINT32_MAX) Fail("string field exceeds 4 GiB");
+          Store(out, field.offset, static_cast<uint32_t>(s.size()));
+          out.append(s.data(), s.size());
+          break;
         }
-        return ss.str();
+        case MrpcFieldType::kInt: Store(out, field.offset, std::get<int64_t>(value)); break;
+        case MrpcFieldType::kFloat: Store(out, field.offset, std::get<double>(value)); break;
+        case MrpcFieldType::kBool: out[field.offset] = std::get<bool>(value) ? 1 : 0; break;
+      }
     }
+    return out;
+  }
 
-    // 生成初始化列表
-    std::string generateInitList(const std::vector<Parameter>& params) {
+  // 写出与生成代码Encode()相同的JSON：键按名称排序，无字段的消息为null
+  std::string WriteJson(const std::vector<MrpcFieldView> &values) const {
+    if (fields.empty()) return "null";
+    std::string out = "{";
+    for (uint32_t i : json_order) {
+      if (out.size() > 1) out += ',';
+      out += fields[i].json_key;
+      const MrpcFieldView &value = values[i];
+      switch (fields[i].type) {
+        case MrpcFieldType::kString: AppendJsonString(out, std::get<std::string_view>(value)); break;
+        case MrpcFieldType::kInt: out += std::to_string(std::get<int64_t>(value)); break;
+        case MrpcFieldType::kFloat: out += nlohmann::json(std::get<double>(value)).dump(); break;
+        case MrpcFieldType::kBool: out += std::get<bool>(value) ? "true" : "false"; break;
+      }
+    }
+    out += '}';
+    return out;
+  }
+
+  // 取JSON中第i个字段的值，字符串引用j的内存；类型不符时与生成代码一样抛出nlohmann::json::type_error
+  MrpcFieldView JsonField(const nlohmann::json &j, size_t i) const {
+    const auto &field = fields[i];
+    auto it = j.find(field.name);
+    bool present = it != j.end();
+    switch (field.type) {
+      case MrpcFieldType::kString:
+        return present ? std::string_view(it->get_ref<const std::string &>()) : std::string_view();
+      case MrpcFieldType::kInt: return present ? it->get<int64_t>() : int64_t{0};
+      case MrpcFieldType::kFloat: return present ? it->get<double>() : 0.0;
+      case MrpcFieldType::kBool: return present ? it->get<bool>() : false;
+    }
+    return false;
+  }
+
+  void CheckObject(const nlohmann::json &j) const {
+    if (!j.is_object() && !(j.is_null() && fields.empty())) Fail("expected a JSON object");
+  }
+
+  static MrpcFieldView Default(MrpcFieldType type) {
+    switch (type) {
+      case MrpcFieldType::kString: return std::string_view();
+      case MrpcFieldType::kInt: return int64_t{0};
+      case MrpcFieldType::kFloat: return 0.0;
+      case MrpcFieldType::kBool: return false;
+    }
+    return false;
+  }
+
+  // 读取第i个字段的值；字符串含转义时解码到unescaped[i]，首次需要时才分配。
+  // 类型不符时跳过该值，返回另一种类型的占位值，由ReadJson在最后报错
+  MrpcFieldView ReadField(MrpcJsonReader &in, size_t i, std::vector<std::string> &unescaped) const {
+    const auto &field = fields[i];
+    switch (field.type) {
+      case MrpcFieldType::kString:
+        if (in.Peek() != '"') break;
+        return in.String([&]() -> std::string & {
+          if (unescaped.empty()) unescaped.resize(fields.size());
+          return unescaped[i];
+        });
+      case MrpcFieldType::kInt:
+        if (!in.AtNumber()) break;
+        return in.ReadNumber().AsInt();
+      case MrpcFieldType::kFloat:
+        if (!in.AtNumber()) break;
+        return in.ReadNumber().AsDouble();
+      case MrpcFieldType::kBool:
+        if (in.Literal("true")) return true;
+        if (in.Literal("false")) return false;
+        break;
+    }
+    in.Skip();
+    if (field.type == MrpcFieldType::kBool) return int64_t{0};
+    return false;
+  }
+
+  [[noreturn]] void Fail(const std::string &what) const {
+    throw std::invalid_argument(std::string(name) + ": " + what);
+  }
+
+  template <typename T>
+  static T Load(std::string_view bytes, size_t offset) {
+    T value;
+    std::memcpy(&value, bytes.data() + offset, sizeof(T));
+    return value;
+  }
+
+  template <typename T>
+  static void Store(std::string &out, size_t offset, T value) {
+    std::memcpy(&out[offset], &value, sizeof(T));
+  }
+
+  // 校验UTF-8，与nlohmann::json同样拒绝过长编码和代理项
+  static void ValidateUtf8(std::string_view s) {
+    for (size_t i = 0; i < s.size();) {
+      unsigned char c = static_cast<unsigned char>(s[i]);
+      if (c < 0x80) {
+        ++i;
+        continue;
+      }
+      size_t n;
+      uint32_t cp;
+      if (c >= 0xc2 && c <= 0xdf) {
+        n = 2;
+        cp = c & 0x1f;
+      } else if (c >= 0xe0 && c <= 0xef) {
+        n = 3;
+        cp = c & 0x0f;
+      } else if (c >= 0xf0 && c <= 0xf4) {
+        n = 4;
+        cp = c & 0x07;
+      } else {
+        throw std::invalid_argument("invalid UTF-8 in string field");
+      }
+      if (i + n > s.size()) throw std::invalid_argument("invalid UTF-8 in string field");
+      for (size_t k = 1; k < n; ++k) {
+        unsigned char b = static_cast<unsigned char>(s[i + k]);
+        if ((b & 0xc0) != 0x80) throw std::invalid_argument("invalid UTF-8 in string field");
+        cp = (cp << 6) | (b & 0x3f);
+      }
+      if ((n == 3 && (cp < 0x800 || (cp >= 0xd800 && cp <= 0xdfff))) ||
+          (n == 4 && (cp < 0x10000 || cp > 0x10ffff))) {
+        throw std::invalid_argument("invalid UTF-8 in string field");
+      }
+      i += n;
+    }
+  }
+
+  // 按JSON规则追加已校验过的字符串，转义规则与nlohmann::json一致
+  static void AppendJsonString(std::string &out, std::string_view s) {
+    static const char kHex[] = "0123456789abcdef";
+    out += '"';
+    for (char ch : s) {
+      unsigned char c = static_cast<unsigned char>(ch);
+      switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+          if (c < 0x20) {
+            out += "\\u00";
+            out += kHex[c >> 4];
+            out += kHex[c & 0xf];
+          } else {
+            out += ch;
+          }
+      }
+    }
+    out += '"';
+  }
+};
+
+struct MrpcMethodPlan {
+  uint32_t id;  // 即生成代码中方法名数组的下标
+  std::string_view name;
+  std::string_view full_name;  // /<idl>.<Service>/<Method>，即调用时的方法名，以NUL结尾
+  const MrpcMessagePlan *request = nullptr;
+  const MrpcMessagePlan *response = nullptr;  // 单向方法为空
+  bool oneway = false;
+  uint32_t priority = 0;  // 0为normal、1为high、2为bulk
+};
+
+// 一个服务的描述符：文件被映射进内存，名称直接引用映射的内容，消息计划在加载时预编译
+class MrpcServiceDescriptor {
+public:
+  MrpcServiceDescriptor(const MrpcServiceDescriptor &) = delete;
+  MrpcServiceDescriptor &operator=(const MrpcServiceDescriptor &) = delete;
+
+  ~MrpcServiceDescriptor() {
+#if defined(__unix__) || defined(__APPLE__)
+    if (mapping_ != nullptr) ::munmap(mapping_, size_);
+#endif
+  }
+
+  // 映射并校验描述符文件，格式错误时抛出std::runtime_error
+  static std::shared_ptr<const MrpcServiceDescriptor> Open(const std::string &path) {
+    std::shared_ptr<MrpcServiceDescriptor> descriptor(new MrpcServiceDescriptor());
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw std::runtime_error("cannot open descriptor " + path);
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+      ::close(fd);
+      throw std::runtime_error("cannot map descriptor " + path);
+    }
+    void *mapping = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) throw std::runtime_error("cannot map descriptor " + path);
+    descriptor->mapping_ = mapping;
+    descriptor->data_ = static_cast<const char *>(mapping);
+    descriptor->size_ = static_cast<size_t>(st.st_size);
+#else
+    // 其他平台退化为读入内存
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("cannot open descriptor " + path);
+    std::stringstream content;
+    content << in.rdbuf();
+    descriptor->owned_ = content.str();
+    descriptor->data_ = descriptor->owned_.data();
+    descriptor->size_ = descriptor->owned_.size();
+#endif
+    descriptor->Build(path);
+    return descriptor;
+  }
+
+  // 从内存中的描述符构造，数据被拷贝
+  static std::shared_ptr<const MrpcServiceDescriptor> FromBytes(std::string bytes) {
+    std::shared_ptr<MrpcServiceDescriptor> descriptor(new MrpcServiceDescriptor());
+    descriptor->owned_ = std::move(bytes);
+    descriptor->data_ = descriptor->owned_.data();
+    descriptor->size_ = descriptor->owned_.size();
+    descriptor->Build("<memory>");
+    return descriptor;
+  }
+
+  // 服务全名<idl>.<Service>
+  std::string_view Name() const { return name_; }
+  const std::vector<MrpcMethodPlan> &Methods() const { return methods_; }
+  const std::vector<MrpcMessagePlan> &Messages() const { return messages_; }
+
+  const MrpcMethodPlan *FindMethod(std::string_view full_name) const {
+    auto it = by_full_name_.find(full_name);
+    return it == by_full_name_.end() ? nullptr : &methods_[it->second];
+  }
+
+  const MrpcMethodPlan *MethodById(uint32_t id) const {
+    return id < methods_.size() ? &methods_[id] : nullptr;
+  }
+
+  const MrpcMessagePlan *FindMessage(std::string_view name) const {
+    for (const auto &message : messages_) {
+      if (message.name == name) return &message;
+    }
+    return nullptr;
+  }
+
+private:
+  MrpcServiceDescriptor() = default;
+
+  uint32_t Word(size_t offset) const {
+    uint32_t value;
+    std::memcpy(&value, data_ + offset, sizeof(value));
+    return value;
+  }
+
+  // 校验布局并生成方法和消息计划；所有偏移都先做边界检查，损坏的文件不会越界读取
+  void Build(const std::string &source) {
+    auto fail = [&source](const std::string &what) {
+      throw std::runtime_error("invalid descriptor " + source + ": " + what);
+    };
+    const size_t kHeaderSize = 48;
+    if (size_ < kHeaderSize || Word(0) != kMrpcDescriptorMagic) fail("bad magic");
+    if (Word(4) != kMrpcDescriptorVersion) fail("unsupported version " + std::to_string(Word(4)));
+    if (Word(8) != size_) fail("size mismatch");
+    uint32_t method_count = Word(16), message_count = Word(24), field_count = Word(32);
+    size_t method_table = Word(20), message_table = Word(28), field_table = Word(36);
+    size_t string_table = Word(40), string_size = Word(44);
+    auto table_fits = [this](size_t offset, size_t count, size_t entry) {
+      return offset % 4 == 0 && offset <= size_ && count <= (size_ - offset) / entry;
+    };
+    if (!table_fits(method_table, method_count, 24) || !table_fits(message_table, message_count, 16) ||
+        !table_fits(field_table, field_count, 12) || string_table > size_ ||
+        string_size > size_ - string_table) {
+      fail("table out of bounds");
+    }
+    auto text = [&](uint32_t offset) {
+      if (offset >= string_size) fail("string out of bounds");
+      const char *begin = data_ + string_table + offset;
+      const void *nul = std::memchr(begin, '\0', string_size - offset);
+      if (nul == nullptr) fail("unterminated string");
+      std::string_view result(begin, static_cast<const char *>(nul) - begin);
+      try {
+        MrpcMessagePlan::ValidateUtf8(result);
+      } catch (const std::invalid_argument &) {
+        fail("invalid UTF-8 in string table");
+      }
+      return result;
+    };
+    name_ = text(Word(12));
+
+    messages_.resize(message_count);
+    for (uint32_t m = 0; m < message_count; ++m) {
+      size_t entry = message_table + m * 16;
+      MrpcMessagePlan &plan = messages_[m];
+      plan.name = text(Word(entry));
+      uint32_t first = Word(entry + 4), count = Word(entry + 8);
+      plan.head_size = Word(entry + 12);
+      if (first > field_count || count > field_count - first) fail("field range out of bounds");
+      for (uint32_t f = first; f < first + count; ++f) {
+        size_t field_entry = field_table + f * 12;
+        MrpcFieldPlan field;
+        field.name = text(Word(field_entry));
+        field.type = static_cast<MrpcFieldType>(Word(field_entry + 4));
+        field.offset = Word(field_entry + 8);
+        uint32_t width = 0;
+        switch (field.type) {
+          case MrpcFieldType::kString: width = 4; break;
+          case MrpcFieldType::kInt:
+          case MrpcFieldType::kFloat: width = 8; break;
+          case MrpcFieldType::kBool: width = 1; break;
+          default: fail("unknown type of field " + std::string(field.name));
+        }
+        if (field.offset > plan.head_size || width > plan.head_size - field.offset) {
+          fail("field " + std::string(field.name) + " out of bounds");
+        }
+        MrpcMessagePlan::AppendJsonString(field.json_key, field.name);
+        field.json_key += ':';
+        plan.fields.push_back(std::move(field));
+      }
+      plan.json_order.resize(plan.fields.size());
+      for (uint32_t i = 0; i < plan.json_order.size(); ++i) plan.json_order[i] = i;
+      std::sort(plan.json_order.begin(), plan.json_order.end(),
+                [&plan](uint32_t a, uint32_t b) { return plan.fields[a].name < plan.fields[b].name; });
+    }
+
+    methods_.resize(method_count);
+    auto message = [&](uint32_t index) -> const MrpcMessagePlan * {
+      if (index == kMrpcNoMessage) return nullptr;
+      if (index >= message_count) fail("message index out of bounds");
+      return &messages_[index];
+    };
+    for (uint32_t m = 0; m < method_count; ++m) {
+      size_t entry = method_table + m * 24;
+      MrpcMethodPlan &method = methods_[m];
+      method.id = Word(entry);
+      if (method.id != m) fail("method ids are not sequential");
+      method.name = text(Word(entry + 4));
+      method.full_name = text(Word(entry + 8));
+      method.request = message(Word(entry + 12));
+      method.response = message(Word(entry + 16));
+      method.oneway = (Word(entry + 20) & kMrpcMethodOneway) != 0;
+      method.priority = (Word(entry + 20) >> kMrpcMethodPriorityShift) & 3;
+      if (method.priority > 2) fail("method " + std::string(method.name) + " has an unknown priority");
+      if (method.request == nullptr || (method.response == nullptr) != method.oneway) {
+        fail("method " + std::string(method.name) + " has inconsistent messages");
+      }
+      by_full_name_.emplace(method.full_name, m);
+    }
+  }
+
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+  void *mapping_ = nullptr;
+  std::string owned_;
+  std::string_view name_;
+  std::vector<MrpcMessagePlan> messages_;
+  std::vector<MrpcMethodPlan> methods_;
+  std::unordered_map<std::string_view, size_t> by_full_name_;
+};
+
+// 按消息计划编解码的动态消息；继承mrpc::Parser，可直接交给MrpcClient收发
+class MrpcDynamicMessage : public mrpc::Parser {
+public:
+  using Value = std::variant<std::string, int64_t, double, bool>;
+
+  explicit MrpcDynamicMessage(const MrpcMessagePlan &plan) : plan_(&plan) {
+    values_.reserve(plan.fields.size());
+    for (const auto &field : plan.fields) values_.push_back(Default(field.type));
+  }
+
+  const MrpcMessagePlan &Plan() const { return *plan_; }
+
+  // 按字段名读写；字段不存在时抛出std::out_of_range，类型不符时抛出std::invalid_argument
+  const Value &Get(std::string_view field) const { return values_[Index(field)]; }
+  void Set(std::string_view field, Value value) {
+    size_t i = Index(field);
+    if (value.index() != values_[i].index()) plan_->Fail("wrong type for field " + std::string(field));
+    values_[i] = std::move(value);
+  }
+
+  std::string Encode() const { return toJson().dump(); }
+
+  void Decode(const std::string &data) {
+    std::vector<MrpcFieldView> views;
+    std::vector<std::string> unescaped;
+    plan_->ReadJson(data, views, unescaped);
+    for (size_t i = 0; i < views.size(); ++i) Assign(i, views[i]);
+  }
+
+  std::string ToBytes() const {
+    return plan_->WriteBinary([this](size_t i) { return View(values_[i]); });
+  }
+
+  void FromBytes(std::string_view bytes) {
+    std::vector<MrpcFieldView> views;
+    plan_->ReadBinary(bytes, views);
+    for (size_t i = 0; i < views.size(); ++i) Assign(i, views[i]);
+  }
+
+protected:
+  nlohmann::json toJson() const override {
+    if (plan_->fields.empty()) return nlohmann::json();
+    nlohmann::json j = nlohmann::json::object();
+    for (size_t i = 0; i < values_.size(); ++i) {
+      std::string key(plan_->fields[i].name);
+      std::visit([&](const auto &value) { j[key] = value; }, values_[i]);
+    }
+    return j;
+  }
+
+  void fromJson(const nlohmann::json &j) override {
+    plan_->CheckObject(j);
+    for (size_t i = 0; i < values_.size(); ++i) Assign(i, plan_->JsonField(j, i));
+  }
+
+private:
+  static Value Default(MrpcFieldType type) {
+    switch (type) {
+      case MrpcFieldType::kString: return std::string();
+      case MrpcFieldType::kInt: return int64_t{0};
+      case MrpcFieldType::kFloat: return 0.0;
+      case MrpcFieldType::kBool: return false;
+    }
+    return false;
+  }
+
+  static MrpcFieldView View(const Value &value) {
+    if (auto s = std::get_if<std::string>(&value)) return std::string_view(*s);
+    if (auto i = std::get_if<int64_t>(&value)) return *i;
+    if (auto d = std::get_if<double>(&value)) return *d;
+    return std::get<bool>(value);
+  }
+
+  void Assign(size_t i, const MrpcFieldView &view) {
+    if (auto s = std::get_if<std::string_view>(&view)) {
+      values_[i] = std::string(*s);
+    } else if (auto n = std::get_if<int64_t>(&view)) {
+      values_[i] = *n;
+    } else if (auto d = std::get_if<double>(&view)) {
+      values_[i] = *d;
+    } else {
+      values_[i] = std::get<bool>(view);
+    }
+  }
+
+  size_t Index(std::string_view field) const {
+    int i = plan_->Find(field);
+    if (i < 0) throw std::out_of_range(std::string(plan_->name) + " has no field " + std::string(field));
+    return static_cast<size_t>(i);
+  }
+
+  const MrpcMessagePlan *plan_;
+  std::vector<Value> values_;
+};
+
+// 描述符登记表：网关按方法全名查找，可在转发期间增加、替换或移除服务
+class MrpcDescriptorRegistry {
+public:
+  struct Entry {
+    std::shared_ptr<const MrpcServiceDescriptor> descriptor;  // 持有描述符，替换后正在进行的调用仍然有效
+    const MrpcMethodPlan *method = nullptr;
+    explicit operator bool() const { return method != nullptr; }
+  };
+
+  // 加载描述符文件并登记，同名服务被替换
+  std::shared_ptr<const MrpcServiceDescriptor> Load(const std::string &path) {
+    auto descriptor = MrpcServiceDescriptor::Open(path);
+    Add(descriptor);
+    return descriptor;
+  }
+
+  void Add(std::shared_ptr<const MrpcServiceDescriptor> descriptor) {
+    std::string name(descriptor->Name());
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    services_[std::move(name)] = std::move(descriptor);
+  }
+
+  bool Remove(std::string_view service) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    return services_.erase(std::string(service)) > 0;
+  }
+
+  // 按/<idl>.<Service>/<Method>查找
+  Entry Find(std::string_view full_name) const {
+    size_t slash = full_name.rfind('/');
+    if (full_name.size() < 2 || full_name[0] != '/' || slash == 0 || slash == std::string_view::npos) {
+      return {};
+    }
+    std::string service(full_name.substr(1, slash - 1));
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = services_.find(service);
+    if (it == services_.end()) return {};
+    return {it->second, it->second->FindMethod(full_name)};
+  }
+
+private:
+  mutable std::shared_mutex mutex_;
+  std::unordered_map<std::string, std::shared_ptr<const MrpcServiceDescriptor>> services_;
+};
+
+// 请求和响应在网关一侧的编码
+enum class MrpcWireFormat { kJson, kBinary };
+
+// 通用存根：按登记表中的描述符调用任意方法，请求和响应以编码后的字节传递，网关无需针对各服务编译
+class MrpcGenericStub : mrpc::client::MrpcClient {
+public:
+  MrpcGenericStub(const std::string &addr, const MrpcDescriptorRegistry &registry)
+      : mrpc::client::MrpcClient(addr), registry_(registry) {}
+
+  // 调用method（方法全名），request和response按format编码；单向方法请求发出即返回，response为空
+  mrpc::Status Call(std::string_view method, std::string_view request, std::string &response,
+                    MrpcWireFormat format = MrpcWireFormat::kBinary) {
+    MrpcDescriptorRegistry::Entry entry = registry_.Find(method);
+    if (!entry) return mrpc::Status(kMrpcDynamicUnimplemented, "unknown method " + std::string(method));
+    MrpcDynamicMessage req(*entry.method->request);
+    try {
+      if (format == MrpcWireFormat::kBinary) {
+        req.FromBytes(request);
+      } else {
+        req.Decode(std::string(request));
+      }
+    } catch (const std::exception &e) {
+      return mrpc::Status(kMrpcDynamicInvalidArgument, e.what());
+    }
+    const char *name = entry.method->full_name.data();
+    response.clear();
+    if (entry.method->oneway) {
+      // 服务端回送的空确认由一个无字段的消息接收后丢弃
+      auto no_reply = std::make_shared<MrpcDynamicMessage>(kNoReply);
+      auto held = std::make_shared<MrpcDynamicMessage>(std::move(req));
+      mrpc::client::MrpcClient::CallbackSend(name, *held, *no_reply,
+                                             [held, no_reply, entry](mrpc::Status) {});
+      return mrpc::Status();
+    }
+    MrpcDynamicMessage resp(*entry.method->response);
+    mrpc::Status status = mrpc::client::MrpcClient::Send(name, req, resp);
+    if (!status.ok()) return status;
+    try {
+      response = format == MrpcWireFormat::kBinary ? resp.ToBytes() : resp.Encode();
+    } catch (const std::exception &e) {
+      return mrpc::Status(kMrpcDynamicInternal, e.what());
+    }
+    return status;
+  }
+
+private:
+  inline static const MrpcMessagePlan kNoReply{};
+  const MrpcDescriptorRegistry &registry_;
+};
+
+}  // namespace dynamic
+}  // namespace mrpc
+)";
+    }
+
+    // 生成拆分模式的源文件：JSON编解码、运行时适配、处理函数注册和全部成员函数体
+    std::string generateSplitSource(const std::string& header_path, const std::string& method_names,
+                                    const std::string& stub_defs, const std::string& pool_defs,
+                                    const std::string& sharded_defs) {
         std::stringstream ss;
-        for (size_t i = 0; i < params.size(); ++i) {
-            if (i > 0) ss << ", ";
-            ss << params[i].name << "(" << params[i].name << ")";
+        std::vector<Message> messages = messageTypes();
+        ss << "// " << namespace_name << " 存根实现，由CppStubGenerator生成\n";
+        ss << "#include \"" << baseName(header_path) << "\"\n\n";
+        ss << "#include \"mrpcpp/server.h\"\n";
+        ss << "#include \"mrpcpp/client.h\"\n";
+        for (const auto& header : helperIncludes()) {
+            ss << "#include <" << header << ">\n";
+        }
+        generateShardIncludes(ss);
+        ss << "\n";
+        ss << "using json = nlohmann::json;\n\n";
+        ss << "namespace " << namespace_name << " {\n\n";
+        ss << method_names;
+
+        generateCacheHelper(ss, HelperPart::kDefinitions);
+        generateFlightHelper(ss, HelperPart::kDefinitions);
+        generatePoolHelper(ss, HelperPart::kDefinitions);
+        generateHedgeHelper(ss, HelperPart::kDefinitions);
+        generateWindowHelper(ss, HelperPart::kDefinitions);
+        generateShardHelper(ss, HelperPart::kDefinitions);
+        generatePriorityHelper(ss, HelperPart::kDefinitions);
+        // 存根用到的辅助类特化全部在此实例化
+        if (hasCachedMethods() || hasCoalescedMethods() || options.pool) {
+            std::set<std::string> instantiated;
+            for (const auto& method : service.methods) {
+                std::string cache = "MrpcResponseCache<" + responseType(method) + ">";
+                std::string flight = "MrpcSingleFlight<" + responseType(method) + ">";
+                if (method.cache.enabled && instantiated.insert(cache).second) {
+                    ss << "template class " << cache << ";\n";
+                }
+                if (method.coalesce && instantiated.insert(flight).second) {
+                    ss << "template class " << flight << ";\n";
+                }
+            }
+            if (options.pool) {
+                ss << "template class MrpcChannelPool<" << service.name << "Stub>;\n";
+            }
+            ss << "\n";
+        }
+
+        ss << "namespace {\n\n";
+        for (const auto& message : messages) {
+            ss << "json ToJson(const " << message.name << " &m) { "
+               << generateJsonCode(message.params, true, "m.") << " }\n";
+            ss << "void FromJson(const json &j, " << message.name << " &m) { "
+               << generateJsonCode(message.params, false, "m.") << "}\n\n";
+        }
+        // 引入的消息在其所属IDL的存根中实现，这里经由其Encode/Decode转换
+        std::vector<std::string> imported = importedTypes();
+        for (const auto& type : imported) {
+            ss << "json ToJson(const " << type << " &m) { return json::parse(m.Encode()); }\n";
+            ss << "void FromJson(const json &j, " << type << " &m) { m.Decode(j.dump()); }\n\n";
+        }
+
+        ss << R"(// 把消息适配为运行时使用的mrpc::Parser：客户端引用调用方的消息，服务端由运行时构造并持有
+template <typename Message>
+class MrpcCodec : public mrpc::Parser {
+private:
+  Message storage_;
+
+public:
+  MrpcCodec() : message(&storage_) {}
+  explicit MrpcCodec(Message &target) : message(&target) {}
+  MrpcCodec(const MrpcCodec &other) : storage_(*other.message), message(&storage_) {}
+  MrpcCodec &operator=(const MrpcCodec &other) {
+    *message = *other.message;
+    return *this;
+  }
+
+  Message *message;
+
+private:
+  json toJson() const override { return ToJson(*message); }
+  void fromJson(const json &j) override { FromJson(j, *message); }
+};
+
+)";
+        for (const auto& message : messages) {
+            ss << "template class MrpcCodec<" << message.name << ">;\n";
+        }
+        for (const auto& type : imported) {
+            ss << "template class MrpcCodec<" << type << ">;\n";
+        }
+        ss << "\n";
+        generateNoReplyHelper(ss);
+
+        if (hasService()) {
+            generateSplitDispatcher(ss);
+            generateShardedDispatcher(ss);
+        }
+        ss << "} // namespace\n\n";
+
+        for (const auto& message : messages) {
+            ss << "std::string " << message.name << "::Encode() const { return ToJson(*this).dump(); }\n";
+            ss << "void " << message.name << "::Decode(const std::string &data) { "
+               << "FromJson(json::parse(data), *this); }\n";
+            if (segmentsEnabled()) {
+                ss << "void " << message.name << "::EncodeSegments(MrpcSegments &segments) const {\n";
+                ss << generateSegmentsCode(message.params, "  ");
+                ss << "}\n";
+            }
+            ss << "\n";
         }
+
+        if (hasService()) {
+            generateSplitServiceSource(ss, stub_defs, pool_defs, sharded_defs);
+        }
+        ss << "} // namespace " << namespace_name << "\n";
         return ss.str();
     }
 
-    // 生成请求/响应类
-    void generateStructs() override {
+    // 被方法引用的引入消息类型，去重后保持出现顺序
+    std::vector<std::string> importedTypes() const {
+        std::vector<std::string> types;
         for (const auto& method : service.methods) {
-            // 请求类
-            output << "class " << method.name << "Request : public mrpc::Parser {\n";
-            output << "public:\n";
-            output << "  " << method.name << "Request() {}\n";
-            output << "  " << method.name << "Request(" 
-                   << generateConstructorParams(method.request_params) << ") : "
-                   << generateInitList(method.request_params) << " {}\n\n";
-            
-            output << "private:\n";
-            output << "  json toJson() const override { "
-                   << generateJsonCode(method.request_params, true) << " }\n";
-            output << "  void fromJson(const json &j) override { "
-                   << generateJsonCode(method.request_params, false) << "}\n\n";
-            
-            output << "public:\n";
-            for (const auto& param : method.request_params) {
-                if (param.type == "string")
-                    output << "  std::string " << param.name << ";\n";
-                else
-                    output << "  " << param.type << " " << param.name << ";\n";
+            for (const MessageRef* ref : {&method.request, &method.response}) {
+                std::string type = typeName(*ref);
+                if (!ref->from.empty() && std::find(types.begin(), types.end(), type) == types.end()) {
+                    types.push_back(type);
+                }
             }
-            output << "};\n\n";
+        }
+        return types;
+    }
 
-            // 响应类
-            output << "class " << method.name << "Response : public mrpc::Parser {\n";
-            output << "public:\n";
-            output << "  " << method.name << "Response() {}\n";
-            output << "  " << method.name << "Response("
-                   << generateConstructorParams(method.response_params) << ") : "
-                   << generateInitList(method.response_params) << " {}\n\n";
-            
-            output << "private:\n";
-            output << "  json toJson() const override { "
-                   << generateJsonCode(method.response_params, true) << " }\n";
-            output << "  void fromJson(const json &j) override { "
-                   << generateJsonCode(method.response_params, false) << "}\n\n";
-            
-            output << "public:\n";
-            for (const auto& param : method.response_params) {
-                if (param.type == "string")
-                    output << "  std::string " << param.name << ";\n";
-                else
-                    output << "  " << param.type << " " << param.name << ";\n";
+    // 服务端分发：把运行时构造的编解码适配器转交给用户实现的Service
+    void generateSplitDispatcher(std::stringstream& ss) {
+        std::string svc = service.name + "Service";
+        std::string captures = hasPriorities() ? "this, owner" : "owner";
+        ss << "class " << svc << "Dispatcher : public mrpc::server::MrpcService {\n";
+        ss << "public:\n";
+        if (hasPriorities()) {
+            ss << "  " << svc << "Dispatcher(" << svc << " *owner, size_t workers)\n";
+            ss << "      : mrpc::server::MrpcService(\"" << namespace_name << "." << service.name
+               << "\"), scheduler_(workers) {\n";
+        } else {
+            ss << "  explicit " << svc << "Dispatcher(" << svc << " *owner)\n";
+            ss << "      : mrpc::server::MrpcService(\"" << namespace_name << "." << service.name
+               << "\") {\n";
+        }
+        for (size_t i = 0; i < service.methods.size(); ++i) {
+            const auto& method = service.methods[i];
+            std::string req = "MrpcCodec<" + requestType(method) + ">";
+            if (method.oneway) {
+                ss << "    AddHandler<" << req << ", MrpcNoReply>(\n";
+                ss << "        " << service.name << "_method_names[" << i << "],\n";
+                ss << "        [" << captures << "](const " << req << " &request, MrpcNoReply &) {\n";
+                ss << "          "
+                   << dispatchedOneway(method,
+                                       "owner->" + method.name +
+                                           (hasPriorities() ? "(request)" : "(*request.message)"),
+                                       "owner, request = *request.message")
+                   << "\n";
+                ss << "          return mrpc::Status();\n";
+                ss << "        });\n";
+                continue;
             }
-            output << "};\n\n";
+            std::string resp = "MrpcCodec<" + responseType(method) + ">";
+            ss << "    AddHandler<" << req << ", " << resp << ">(\n";
+            ss << "        " << service.name << "_method_names[" << i << "],\n";
+            ss << "        [" << captures << "](const " << req << " &request, " << resp << " &response) {\n";
+            ss << "          " << dispatched(method, "owner->" + method.name + "(*request.message, *response.message)")
+               << ";\n";
+            ss << "        });\n";
         }
+        ss << "  }\n";
+        if (hasPriorities()) {
+            ss << "\n  MrpcPriorityScheduler &Scheduler() { return scheduler_; }\n\n";
+            ss << "private:\n";
+            ss << "  MrpcPriorityScheduler scheduler_;\n";
+        }
+        ss << "};\n\n";
     }
 
-    // 生成Stub类
-    void generateClient() override {
-        output << "class " << service.name << "Stub : mrpc::client::MrpcClient {\n";
-        output << "public:\n";
-        output << "  " << service.name << "Stub(const std::string &addr) : "
-               << "mrpc::client::MrpcClient(addr) {}\n\n";
+    // 存根、连接池存根和Service的成员函数体
+    void generateSplitServiceSource(std::stringstream& ss, const std::string& stub_defs,
+                                    const std::string& pool_defs, const std::string& sharded_defs) {
+        std::string svc = service.name + "Service";
+        ss << generateSplitClientSource(stub_defs);
 
-        // 为每个方法生成三种调用方式
-        for (size_t i = 0; i < service.methods.size(); ++i) {
-            const auto& method = service.methods[i];
-            
-            // 同步调用
-            output << "  mrpc::Status " << method.name << "("
-                   << method.name << "Request &request, "
-                   << method.name << "Response &response) {\n";
-            output << "    return Send(" << service.name << "_method_names[" << i 
-                   << "], request, response);\n  }\n\n";
+        if (options.pool) {
+            std::string stub = service.name + "Stub";
+            std::string pool_stub = service.name + "PoolStub";
+            std::string indent(pool_stub.size() * 2 + 3, ' ');
+            ss << pool_stub << "::" << pool_stub << "(const std::vector<std::string> &addrs,\n";
+            ss << indent << "size_t connections_per_addr, MrpcBalancePolicy policy)\n";
+            ss << "    : pool_(std::make_unique<MrpcChannelPool<" << stub
+               << ">>(addrs, connections_per_addr, policy))";
+            for (const auto& method : service.methods) {
+                if (!method.hedge.enabled) continue;
+                ss << ",\n      " << method.name << "_hedge_(std::make_unique<MrpcHedgePolicy>("
+                   << method.hedge.after_ms << ", " << method.hedge.after_percentile << ", "
+                   << method.hedge.max_extra << "))";
+            }
+            if (hasHedgedMethods()) ss << ",\n      hedge_timer_(std::make_unique<MrpcHedgeTimer>())";
+            ss << " {}\n\n";
+            ss << pool_stub << "::~" << pool_stub << "() = default;\n\n";
+            ss << pool_defs;
+        }
 
-            // 异步调用
-            output << "  mrpc::Status Async" << method.name << "("
-                   << method.name << "Request &request, std::string &key) {\n";
-            output << "    return AsyncSend(" << service.name << "_method_names[" << i 
-                   << "], request, key);\n  }\n\n";
+        if (hasPriorities()) {
+            ss << svc << "::" << svc << "(size_t workers) : service_(std::make_unique<" << svc
+               << "Dispatcher>(this, workers)) {}\n\n";
+        } else {
+            ss << svc << "::" << svc << "() : service_(std::make_unique<" << svc
+               << "Dispatcher>(this)) {}\n\n";
+        }
+        ss << svc << "::~" << svc << "() = default;\n\n";
+        ss << "mrpc::server::MrpcService *" << svc << "::Service() { return service_.get(); }\n\n";
+        if (hasPriorities()) {
+            std::string scheduler = "static_cast<" + svc + "Dispatcher *>(service_.get())->Scheduler()";
+            ss << "void " << svc << "::SetPriorityWeights(unsigned high, unsigned normal, unsigned bulk) {\n";
+            ss << "  " << scheduler << ".SetWeights(high, normal, bulk);\n}\n\n";
+            ss << "void " << svc << "::SetBulkLimit(size_t workers) {\n";
+            ss << "  " << scheduler << ".SetBulkLimit(workers);\n}\n\n";
+            ss << "void " << svc << "::SetQueueLimit(MrpcPriority priority, size_t limit) {\n";
+            ss << "  " << scheduler << ".SetQueueLimit(priority, limit);\n}\n\n";
+            ss << "MrpcPriorityStats " << svc << "::PriorityStats() const {\n";
+            ss << "  return " << scheduler << ".Stats();\n}\n\n";
+        }
 
-            // 回调方式
-            output << "  void Callback" << method.name << "("
-                   << method.name << "Request &request, "
-                   << method.name << "Response &response,\n"
-                   << "                        std::function<void(mrpc::Status)> callback) {\n";
-            output << "    CallbackSend(" << service.name << "_method_names[" << i 
-                   << "], request, response, callback);\n  }\n\n";
+        if (hasShardedMethods()) {
+            std::string stub = service.name + "Stub";
+            std::string sharded_stub = service.name + "ShardedStub";
+            std::string sharded = service.name + "ShardedService";
+            ss << sharded_stub << "::" << sharded_stub << "(const std::vector<std::string> &addrs) {\n";
+            ss << "  for (const auto &addr : addrs) stubs_.push_back(std::make_unique<" << stub << ">(addr));\n";
+            ss << "}\n\n";
+            ss << sharded_stub << "::~" << sharded_stub << "() = default;\n\n";
+            ss << sharded_defs;
+
+            // 分发器先建好，实例数取决于它的分片数
+            ss << sharded << "::" << sharded << "(std::function<std::unique_ptr<" << svc
+               << ">(size_t shard)> factory,\n";
+            ss << std::string(sharded.size() * 2 + 3, ' ') << "size_t shards) {\n";
+            ss << "  auto dispatcher = std::make_unique<" << sharded << "Dispatcher>(instances_, shards);\n";
+            ss << "  for (size_t i = 0; i < dispatcher->Shards(); ++i) instances_.push_back(factory(i));\n";
+            ss << "  service_ = std::move(dispatcher);\n";
+            ss << "}\n\n";
+            ss << sharded << "::~" << sharded << "() = default;\n\n";
+            ss << "mrpc::server::MrpcService *" << sharded << "::Service() { return service_.get(); }\n\n";
+            ss << "mrpc::server::MrpcService *" << sharded << "::Endpoint(size_t shard) {\n";
+            ss << "  return static_cast<" << sharded << "Dispatcher *>(service_.get())->Endpoint(shard);\n}\n\n";
+            ss << "size_t " << sharded << "::Shards() const { return instances_.size(); }\n\n";
+            ss << svc << " &" << sharded << "::Shard(size_t shard) { return *instances_[shard]; }\n\n";
         }
+    }
 
-        // 模板化的Receive方法
-        output << "  template<typename T>\n";
-        output << "  mrpc::Status Receive(const std::string &key, T &response) {\n";
-        output << "    return mrpc::client::MrpcClient::Receive(key, response);\n";
-        output << "  }\n";
-        output << "};\n\n";
+    // 拆分模式下分片服务的分发器：持有分片执行器，实例归外层的ShardedService所有
+    void generateShardedDispatcher(std::stringstream& ss) {
+        if (!hasShardedMethods()) return;
+        std::string svc = service.name + "Service";
+        std::string dispatcher = service.name + "ShardedServiceDispatcher";
+        std::string endpoint = service.name + "ShardEndpoint";
+        generateShardEndpoint(ss);
+        ss << "class " << dispatcher << " : public mrpc::server::MrpcService {\n";
+        ss << "public:\n";
+        ss << "  " << dispatcher << "(std::vector<std::unique_ptr<" << svc << ">> &instances, size_t shards)\n";
+        ss << "      : mrpc::server::MrpcService(\"" << namespace_name << "." << service.name
+           << "\"), instances_(instances), executor_(shards) {\n";
+        generateShardedHandlers(ss);
+        ss << "    for (size_t i = 0; i < executor_.Size(); ++i) {\n";
+        ss << "      endpoints_.push_back(std::make_unique<" << endpoint << ">(instances_, executor_, i));\n";
+        ss << "    }\n";
+        ss << "  }\n\n";
+        ss << "  size_t Shards() const { return executor_.Size(); }\n";
+        ss << "  " << endpoint << " *Endpoint(size_t shard) { return endpoints_[shard].get(); }\n\n";
+        ss << "private:\n";
+        ss << "  std::vector<std::unique_ptr<" << svc << ">> &instances_;\n";
+        ss << "  MrpcShardExecutor executor_;\n";
+        ss << "  std::vector<std::unique_ptr<" << endpoint << ">> endpoints_;\n";
+        ss << "};\n\n";
     }
 
-    // 生成Service类
-    void generateService() override {
-        output << "class " << service.name << "Service : public mrpc::server::MrpcService {\n";
-        output << "public:\n";
-        output << "  " << service.name << "Service() : mrpc::server::MrpcService(\""
-               << namespace_name << "." << service.name << "\") {\n";
-        
-        for (size_t i = 0; i < service.methods.size(); ++i) {
-            const auto& method = service.methods[i];
-            output << "    AddHandler<" << method.name << "Request, " 
-                   << method.name << "Response>(\n";
-            output << "        " << service.name << "_method_names[" << i << "],\n";
-            output << "        [this](const " << method.name << "Request &request, "
-                   << method.name << "Response &response) {\n";
-            output << "          return this->" << method.name 
-                   << "(request, response);\n        });\n";
+    // 拆分模式：精简头文件只含声明，成员函数体、JSON编解码和辅助类实现写入源文件
+    bool generateSplit(const std::string& output_path) {
+        std::string stub = service.name + "Stub";
+        std::string pool_stub = service.name + "PoolStub";
+        std::vector<std::pair<std::string, std::string>> stub_accessors;
+        for (const auto& method : service.methods) {
+            if (method.cache.enabled) stub_accessors.push_back({method.name + "_cache_.", method.name + "_cache_->"});
+            if (method.coalesce) stub_accessors.push_back({method.name + "_flight_.", method.name + "_flight_->"});
         }
-        output << "  }\n\n";
+        // 方法级窗口名以window_结尾，一条规则即可覆盖
+        if (hasWindows()) stub_accessors.push_back({"window_.", "window_->"});
 
-        // 纯虚函数声明
-        for (const auto& method : service.methods) {
-            output << "  virtual mrpc::Status " << method.name << "(const "
-                   << method.name << "Request &request,\n"
-                   << "                                " << method.name 
-                   << "Response &response) = 0;\n";
+        generateSplitHeader();
+        generateNamespaceStart();
+        // 方法名只在源文件中使用
+        std::string method_names, stub_defs, pool_defs, sharded_defs;
+        if (hasService()) method_names = capture([this] { generateMethodNames(); });
+        generateCacheHelper(output, HelperPart::kDeclarations);
+        generateFlightHelper(output, HelperPart::kDeclarations);
+        generatePoolHelper(output, HelperPart::kDeclarations);
+        generateHedgeHelper(output, HelperPart::kDeclarations);
+        generateWindowHelper(output, HelperPart::kDeclarations);
+        generateShardHelper(output, HelperPart::kDeclarations);
+        generatePriorityHelper(output, HelperPart::kDeclarations);
+        generateSegmentsHelper();
+        generateStructs();
+        if (hasService()) {
+            stub_defs = outlineMembers(stub, capture([this] { generateClient(); }), stub_accessors);
+            pool_defs = outlineMembers(pool_stub, capture([this] { generatePoolClient(); }),
+                                       {{"pool_.", "pool_->"}, {"_hedge_.", "_hedge_->"}});
+            sharded_defs = outlineMembers(service.name + "ShardedStub",
+                                          capture([this] { generateShardedClient(); }), {});
+            generateService();
+            generateShardedService();
         }
-        output << "};\n\n";
+        generateNamespaceEnd();
+
+        if (!writeFile(output_path, output.str()) ||
+            !writeFile(options.split_source_path,
+                       generateSplitSource(output_path, method_names, stub_defs, pool_defs, sharded_defs))) {
+            return false;
+        }
+        if (!options.loadtest_path.empty() &&
+            !writeFile(options.loadtest_path, generateLoadTest(output_path))) {
+            return false;
+        }
+        if (!options.codec_tests_path.empty() &&
+            !writeFile(options.codec_tests_path, generateCodecTests(output_path))) {
+            return false;
+        }
+        return true;
     }
 
     // 生成命名空间结束
@@ -216,22 +5380,59 @@ public:
     }
 
     bool generate(const std::string& output_path) override {
+        // 只定义消息的IDL没有存根可生成，也就不需要连接池
+        if (!hasService()) options.pool = false;
+        if (options.shm && splitMode()) {
+            std::cerr << "--shm is not supported together with --split" << std::endl;
+            return false;
+        }
+        if (!options.loadtest_path.empty() && service.methods.empty()) {
+            std::cerr << "--loadtest requires a service with at least one method" << std::endl;
+            return false;
+        }
+        // 运行时与服务无关，拆分与否都一样
+        if (!options.descriptor_runtime_path.empty() &&
+            !writeFile(options.descriptor_runtime_path, generateDescriptorRuntime())) {
+            return false;
+        }
+        if (splitMode()) return generateSplit(output_path);
         generateHeader();
         generateNamespaceStart();
-        generateMethodNames();
+        if (hasService()) generateMethodNames();
+        generateCacheHelper(output, HelperPart::kAll);
+        generateFlightHelper(output, HelperPart::kAll);
+        generatePoolHelper(output, HelperPart::kAll);
+        generateHedgeHelper(output, HelperPart::kAll);
+        generateWindowHelper(output, HelperPart::kAll);
+        generateShardHelper(output, HelperPart::kAll);
+        generatePriorityHelper(output, HelperPart::kAll);
+        generateSegmentsHelper();
+        generateNoReplyHelper(output);
+        generateShmHelper();
         generateStructs();
-        generateClient();
-        generateService();
+        if (hasService()) {
+            generateClient();
+            generatePoolClient();
+            generateShardedClient();
+            generateService();
+            generateShardEndpoint(output);
+            generateShardedService();
+        }
         generateNamespaceEnd();
 
         // 写入文件
-        std::ofstream out_file(output_path);
-        if (!out_file.is_open()) {
-            std::cerr << "Failed to open output file: " << output_path << std::endl;
+        if (!writeFile(output_path, output.str())) {
+            return false;
+        }
+
+        if (!options.loadtest_path.empty() &&
+            !writeFile(options.loadtest_path, generateLoadTest(output_path))) {
+            return false;
+        }
+        if (!options.codec_tests_path.empty() &&
+            !writeFile(options.codec_tests_path, generateCodecTests(output_path))) {
             return false;
         }
-        out_file << output.str();
-        out_file.close();
         return true;
     }
 };
@@ -239,13 +5440,18 @@ public:
 } // namespace generator
 } // namespace mrpc
 
+// 生成守护进程把各语言生成器编进同一个程序时关闭各自的入口
+#ifndef MRPC_GENERATOR_NO_MAIN
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <input.yaml> <output.h>" << std::endl;
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <input.yaml> <output.h> [--pool] [--loadtest <loadtest.cc>] [--codec-tests <codec_test.cc>] [--split <stub.cc>] [--shm] [--scatter-gather] [--depfile <file.d>] [--descriptor <file.mrpcd>] [--descriptor-runtime <mrpc_descriptor.h>]" << std::endl;
         return 1;
     }
 
     mrpc::generator::CppStubGenerator generator(argv[1]);
+    if (!generator.parseOptions(argc, argv, 3)) {
+        return 1;
+    }
     if (!generator.parseYaml(argv[1])) {
         std::cerr << "Failed to parse YAML file" << std::endl;
         return 1;
@@ -255,7 +5461,14 @@ int main(int argc, char* argv[]) {
         std::cerr << "Failed to generate stub file" << std::endl;
         return 1;
     }
+    if (!generator.writeDepfile(argv[2])) {
+        return 1;
+    }
+    if (!generator.writeDescriptor()) {
+        return 1;
+    }
 
     std::cout << "Successfully generated stub file: " << argv[2] << std::endl;
     return 0;
-} 
\ No newline at end of file
+}
+#endif
@@ -1,6 +1,7 @@
 #include "StubGeneratorBase.h"
 #include <iostream>
 #include <fstream>
+#include <set>
 
 namespace mrpc {
 namespace generator {
@@ -16,65 +17,1752 @@ private:
         return "string"; // 默认类型
     }
 
-    // 生成方法名数组
-    void generateMethodNames() override {
-        output << "var " << service.name << "_method_names = []string{\n";
+    // 辅助函数：将字符串首字母小写
+    std::string uncapitalize(const std::string& str) {
+        if (str.empty()) return str;
+        std::string result = str;
+        result[0] = std::tolower(result[0]);
+        return result;
+    }
+
+    // 生成包声明和导入，导入列表按需收集
+    void generateImports() {
+        std::set<std::string> imports = {"fmt", "mrpc", "strconv", "strings", "sync", "unicode/utf16", "unicode/utf8"};
+        if (hasFieldType("float")) {
+            imports.insert("math");
+        }
+        if (hasCachedMethods()) {
+            imports.insert({"container/list", "sync", "sync/atomic", "time"});
+        }
+        if (hasCoalescedMethods()) {
+            imports.insert({"sync", "sync/atomic"});
+        }
+        if (options.pool) {
+            imports.insert({"math/rand", "strconv", "strings", "sync/atomic", "time"});
+        }
+        if (hasWindows()) {
+            imports.insert({"errors", "sync", "sync/atomic"});
+        }
+        if (hasHedgedMethods()) {
+            imports.insert({"sort", "sync", "sync/atomic", "time"});
+        }
+        if (hasShardedMethods()) {
+            imports.insert({"strconv", "strings", "sync/atomic"});
+        }
+        if (!hasService()) {
+            imports.erase("mrpc");
+        }
+
+        output << "package " << yaml_filename << "\n\n";
+        output << "import (\n";
+        for (const auto& path : imports) {
+            output << "\t\"" << path << "\"\n";
+        }
+        // 引入的IDL以其名称作为包别名，与生成代码中的限定前缀一致
+        std::vector<Import> used = usedImports();
+        if (!used.empty()) output << "\n";
+        for (const auto& imported : used) {
+            output << "\t" << imported.name << " \"" << imported.go_package << "\"\n";
+        }
+        output << ")\n\n";
+    }
+
+    std::string importPrefix(const std::string& from) const override { return from + "."; }
+
+    // 对象池的Acquire/Release函数与消息类型定义在同一个包中
+    std::string poolFunc(const std::string& func, const MessageRef& ref) const {
+        return (ref.from.empty() ? "" : importPrefix(ref.from)) + func + ref.type;
+    }
+
+    // 生成分片加锁的LRU响应缓存，仅在存在cache注解时输出
+    void generateCacheHelper() {
+        if (!hasCachedMethods()) return;
+        output << R"(// MrpcCacheStats 是响应缓存的统计信息
+type MrpcCacheStats struct {
+	Hits          uint64
+	Misses        uint64
+	Evictions     uint64
+	Expirations   uint64
+	Invalidations uint64
+	Size          int
+}
+
+const mrpcCacheShards = 16
+
+type mrpcCacheEntry[T any] struct {
+	key      string
+	value    T
+	expireAt time.Time
+}
+
+type mrpcCacheShard struct {
+	mu    sync.Mutex
+	lru   *list.List
+	index map[string]*list.Element
+}
+
+// mrpcResponseCache 是分片加锁的LRU响应缓存，键为编码后的请求
+type mrpcResponseCache[T any] struct {
+	shards        [mrpcCacheShards]mrpcCacheShard
+	ttl           time.Duration
+	capacity      int
+	hits          atomic.Uint64
+	misses        atomic.Uint64
+	evictions     atomic.Uint64
+	expirations   atomic.Uint64
+	invalidations atomic.Uint64
+}
+
+func newMrpcResponseCache[T any](ttlMs int, maxEntries int) *mrpcResponseCache[T] {
+	c := &mrpcResponseCache[T]{
+		ttl:      time.Duration(ttlMs) * time.Millisecond,
+		capacity: (maxEntries + mrpcCacheShards - 1) / mrpcCacheShards,
+	}
+	if c.capacity < 1 {
+		c.capacity = 1
+	}
+	for i := range c.shards {
+		c.shards[i].lru = list.New()
+		c.shards[i].index = make(map[string]*list.Element)
+	}
+	return c
+}
+
+func (c *mrpcResponseCache[T]) shard(key string) *mrpcCacheShard {
+	h := uint32(2166136261)
+	for i := 0; i < len(key); i++ {
+		h ^= uint32(key[i])
+		h *= 16777619
+	}
+	return &c.shards[h%mrpcCacheShards]
+}
+
+func (c *mrpcResponseCache[T]) Get(key string) (T, bool) {
+	var zero T
+	s := c.shard(key)
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	elem, ok := s.index[key]
+	if !ok {
+		c.misses.Add(1)
+		return zero, false
+	}
+	entry := elem.Value.(*mrpcCacheEntry[T])
+	if !time.Now().Before(entry.expireAt) {
+		s.lru.Remove(elem)
+		delete(s.index, key)
+		c.expirations.Add(1)
+		c.misses.Add(1)
+		return zero, false
+	}
+	s.lru.MoveToFront(elem)
+	c.hits.Add(1)
+	return entry.value, true
+}
+
+func (c *mrpcResponseCache[T]) Put(key string, value T) {
+	s := c.shard(key)
+	expireAt := time.Now().Add(c.ttl)
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	if elem, ok := s.index[key]; ok {
+		entry := elem.Value.(*mrpcCacheEntry[T])
+		entry.value = value
+		entry.expireAt = expireAt
+		s.lru.MoveToFront(elem)
+		return
+	}
+	if s.lru.Len() >= c.capacity {
+		oldest := s.lru.Back()
+		s.lru.Remove(oldest)
+		delete(s.index, oldest.Value.(*mrpcCacheEntry[T]).key)
+		c.evictions.Add(1)
+	}
+	s.index[key] = s.lru.PushFront(&mrpcCacheEntry[T]{key: key, value: value, expireAt: expireAt})
+}
+
+func (c *mrpcResponseCache[T]) Invalidate(key string) {
+	s := c.shard(key)
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	if elem, ok := s.index[key]; ok {
+		s.lru.Remove(elem)
+		delete(s.index, key)
+		c.invalidations.Add(1)
+	}
+}
+
+func (c *mrpcResponseCache[T]) Clear() {
+	for i := range c.shards {
+		s := &c.shards[i]
+		s.mu.Lock()
+		c.invalidations.Add(uint64(s.lru.Len()))
+		s.lru.Init()
+		s.index = make(map[string]*list.Element)
+		s.mu.Unlock()
+	}
+}
+
+func (c *mrpcResponseCache[T]) Stats() MrpcCacheStats {
+	stats := MrpcCacheStats{
+		Hits:          c.hits.Load(),
+		Misses:        c.misses.Load(),
+		Evictions:     c.evictions.Load(),
+		Expirations:   c.expirations.Load(),
+		Invalidations: c.invalidations.Load(),
+	}
+	for i := range c.shards {
+		s := &c.shards[i]
+		s.mu.Lock()
+		stats.Size += s.lru.Len()
+		s.mu.Unlock()
+	}
+	return stats
+}
+
+)";
+    }
+
+    // 生成请求合并辅助类型，仅在存在coalesce注解时输出
+    void generateFlightHelper() {
+        if (!hasCoalescedMethods()) return;
+        output << R"(type mrpcFlight[T any] struct {
+	done      chan struct{}
+	value     T
+	err       error
+	callbacks []func(T, error)
+}
+
+// mrpcSingleFlight 合并在途的相同请求：同一请求已发出时，后来者挂到首个调用上并共享其响应
+type mrpcSingleFlight[T any] struct {
+	mu      sync.Mutex
+	flights map[string]*mrpcFlight[T]
+	shared  atomic.Uint64
+}
+
+func newMrpcSingleFlight[T any]() *mrpcSingleFlight[T] {
+	return &mrpcSingleFlight[T]{flights: make(map[string]*mrpcFlight[T])}
+}
+
+func (g *mrpcSingleFlight[T]) Do(key string, fn func() (T, error)) (T, error) {
+	g.mu.Lock()
+	if f, ok := g.flights[key]; ok {
+		g.mu.Unlock()
+		g.shared.Add(1)
+		<-f.done
+		return f.value, f.err
+	}
+	f := &mrpcFlight[T]{done: make(chan struct{})}
+	g.flights[key] = f
+	g.mu.Unlock()
+	value, err := fn()
+	g.finish(key, f, value, err)
+	return value, err
+}
+
+func (g *mrpcSingleFlight[T]) DoCallback(key string, start func(done func(T, error)), callback func(T, error)) {
+	g.mu.Lock()
+	if f, ok := g.flights[key]; ok {
+		f.callbacks = append(f.callbacks, callback)
+		g.mu.Unlock()
+		g.shared.Add(1)
+		return
+	}
+	f := &mrpcFlight[T]{done: make(chan struct{}), callbacks: []func(T, error){callback}}
+	g.flights[key] = f
+	g.mu.Unlock()
+	start(func(value T, err error) {
+		g.finish(key, f, value, err)
+	})
+}
+
+func (g *mrpcSingleFlight[T]) finish(key string, f *mrpcFlight[T], value T, err error) {
+	g.mu.Lock()
+	delete(g.flights, key)
+	f.value, f.err = value, err
+	callbacks := f.callbacks
+	f.callbacks = nil
+	g.mu.Unlock()
+	close(f.done)
+	for _, callback := range callbacks {
+		callback(value, err)
+	}
+}
+
+// SharedCalls 返回被合并（未实际发出）的调用数
+func (g *mrpcSingleFlight[T]) SharedCalls() uint64 {
+	return g.shared.Load()
+}
+
+)";
+    }
+
+    // 生成连接池辅助类型，仅在开启--pool时输出
+    void generatePoolHelper() {
+        if (!options.pool) return;
+        output << R"(// MrpcBalancePolicy 是连接池的选路策略
+type MrpcBalancePolicy int
+
+const (
+	MrpcRoundRobin MrpcBalancePolicy = iota
+	MrpcLeastOutstanding
+	MrpcPowerOfTwoChoices
+)
+
+// MrpcChannelStats 是连接池中单条连接的状态
+type MrpcChannelStats struct {
+	Addr                string
+	Outstanding         int64
+	ConsecutiveFailures int32
+	Healthy             bool
+}
+
+type mrpcChannel[C any] struct {
+	addr         string
+	client       C
+	outstanding  atomic.Int64
+	failures     atomic.Int32
+	ejectedUntil atomic.Int64
+}
+
+// mrpcChannelPool 是多端点、多连接的通道池：按策略选出健康的连接，连续失败的连接会被暂时摘除
+type mrpcChannelPool[C any] struct {
+	channels    []*mrpcChannel[C]
+	policy      MrpcBalancePolicy
+	maxFailures int32
+	ejectFor    time.Duration
+	next        atomic.Uint64
+}
+
+func newMrpcChannelPool[C any](addrs []string, connsPerAddr int, policy MrpcBalancePolicy, dial func(string) C) *mrpcChannelPool[C] {
+	if connsPerAddr < 1 {
+		connsPerAddr = 1
+	}
+	p := &mrpcChannelPool[C]{policy: policy, maxFailures: 3, ejectFor: time.Second}
+	for _, addr := range addrs {
+		for i := 0; i < connsPerAddr; i++ {
+			p.channels = append(p.channels, &mrpcChannel[C]{addr: addr, client: dial(addr)})
+		}
+	}
+	return p
+}
+
+func (p *mrpcChannelPool[C]) healthy(ch *mrpcChannel[C], now int64) bool {
+	return ch.ejectedUntil.Load() <= now
+}
+
+// pick 选出一条连接并占用一个在途名额，调用结束后必须release
+func (p *mrpcChannelPool[C]) pick() int {
+	i := p.selectChannel(time.Now().UnixNano())
+	p.channels[i].outstanding.Add(1)
+	return i
+}
+
+// pickExcept 让对冲的备份调用尽量发往尚未使用的健康连接，找不到时退化为pick
+func (p *mrpcChannelPool[C]) pickExcept(used []int) int {
+	now := time.Now().UnixNano()
+	isUsed := func(i int) bool {
+		for _, u := range used {
+			if u == i {
+				return true
+			}
+		}
+		return false
+	}
+	i := p.selectChannel(now)
+	for step := 1; step < len(p.channels) && isUsed(i); step++ {
+		next := (i + step) % len(p.channels)
+		if !isUsed(next) && p.healthy(p.channels[next], now) {
+			i = next
+		}
+	}
+	p.channels[i].outstanding.Add(1)
+	return i
+}
+
+func (p *mrpcChannelPool[C]) selectChannel(now int64) int {
+	n := len(p.channels)
+	start := int(p.next.Add(1) % uint64(n))
+	if p.policy == MrpcPowerOfTwoChoices && n > 1 {
+		a := rand.Intn(n)
+		b := (a + 1 + rand.Intn(n-1)) % n
+		aOk, bOk := p.healthy(p.channels[a], now), p.healthy(p.channels[b], now)
+		switch {
+		case aOk && bOk:
+			if p.channels[a].outstanding.Load() <= p.channels[b].outstanding.Load() {
+				return a
+			}
+			return b
+		case aOk:
+			return a
+		case bOk:
+			return b
+		}
+	}
+	// 轮询或最少在途：从轮转起点扫描健康连接，全部不健康时退化为不过滤
+	best := -1
+	for k := 0; k < n; k++ {
+		i := (start + k) % n
+		if !p.healthy(p.channels[i], now) {
+			continue
+		}
+		if p.policy == MrpcRoundRobin {
+			return i
+		}
+		if best < 0 || p.channels[i].outstanding.Load() < p.channels[best].outstanding.Load() {
+			best = i
+		}
+	}
+	if best < 0 {
+		return start
+	}
+	return best
+}
+
+func (p *mrpcChannelPool[C]) release(i int, err error) {
+	ch := p.channels[i]
+	ch.outstanding.Add(-1)
+	if err == nil {
+		ch.failures.Store(0)
+		return
+	}
+	if ch.failures.Add(1) >= p.maxFailures {
+		ch.ejectedUntil.Store(time.Now().Add(p.ejectFor).UnixNano())
+		ch.failures.Store(0)
+	}
+}
+
+func (p *mrpcChannelPool[C]) stats() []MrpcChannelStats {
+	now := time.Now().UnixNano()
+	stats := make([]MrpcChannelStats, 0, len(p.channels))
+	for _, ch := range p.channels {
+		stats = append(stats, MrpcChannelStats{
+			Addr:                ch.addr,
+			Outstanding:         ch.outstanding.Load(),
+			ConsecutiveFailures: ch.failures.Load(),
+			Healthy:             p.healthy(ch, now),
+		})
+	}
+	return stats
+}
+
+)";
+        generateSplitKeyHelper();
+    }
+
+    // 连接池和分片客户端的异步key都带有连接序号，两者共用一个拆分函数
+    void generateSplitKeyHelper() {
+        output << R"(// mrpcSplitPoolKey 拆出异步key中的连接序号
+func mrpcSplitPoolKey(key string) (int, string, error) {
+	sep := strings.IndexByte(key, '#')
+	if sep < 0 {
+		return 0, "", fmt.Errorf("invalid pool key: %s", key)
+	}
+	i, err := strconv.Atoi(key[:sep])
+	return i, key[sep+1:], err
+}
+
+)";
+    }
+
+    // 生成分片键哈希，仅在存在shard_key注解时输出
+    void generateShardHelper() {
+        if (!hasShardedMethods()) return;
+        output << R"(// mrpcShardOf 分片键的哈希：对键的文本形式（字符串取原字节，整数取十进制，布尔取true/false）做FNV-1a 64后取模，
+// 与C++、Python的存根和服务选出的分片一致
+func mrpcShardOf(key string, shards int) int {
+	hash := uint64(14695981039346656037)
+	for i := 0; i < len(key); i++ {
+		hash ^= uint64(key[i])
+		hash *= 1099511628211
+	}
+	return int(hash % uint64(shards))
+}
+
+)";
+        if (!options.pool) generateSplitKeyHelper();
+    }
+
+    // 生成在途窗口，仅在存在max_in_flight注解时输出
+    void generateWindowHelper() {
+        if (!hasWindows()) return;
+        output << R"(// MrpcWindowPolicy 是在途窗口满时的处理策略
+type MrpcWindowPolicy int32
+
+const (
+	MrpcWindowBlock    MrpcWindowPolicy = iota // 阻塞调用方，直到有调用完成归还信用
+	MrpcWindowFailFast                         // 立即返回ErrMrpcWindowFull
+	MrpcWindowAwait                            // 回调方式的调用挂起，有信用归还时再发出；同步和异步调用等同MrpcWindowBlock
+)
+
+// ErrMrpcWindowFull 表示在途窗口已满，或挂起的调用也已达上限
+var ErrMrpcWindowFull = errors.New("mrpc: in-flight window is full")
+
+// MrpcWindowStats 是在途窗口的统计快照
+type MrpcWindowStats struct {
+	Capacity int
+	InFlight int
+	Parked   int
+	Rejected uint64
+}
+
+// mrpcWindow 是基于信用的在途调用窗口：每个发出的调用占用一个信用，完成后归还；
+// 挂起的调用也以容量为上限，窗口满时客户端占用的内存因此有界
+type mrpcWindow struct {
+	mu       sync.Mutex
+	cond     *sync.Cond
+	capacity int
+	inFlight int
+	rejected uint64
+	parked   []func()
+	policy   atomic.Int32
+}
+
+func newMrpcWindow(capacity int) *mrpcWindow {
+	if capacity < 1 {
+		capacity = 1
+	}
+	w := &mrpcWindow{capacity: capacity}
+	w.cond = sync.NewCond(&w.mu)
+	return w
+}
+
+func (w *mrpcWindow) setPolicy(policy MrpcWindowPolicy) { w.policy.Store(int32(policy)) }
+
+// acquire 占用一个信用；MrpcWindowFailFast在窗口满时立即失败，其余策略阻塞等待
+func (w *mrpcWindow) acquire() error {
+	w.mu.Lock()
+	defer w.mu.Unlock()
+	if w.inFlight >= w.capacity && MrpcWindowPolicy(w.policy.Load()) == MrpcWindowFailFast {
+		w.rejected++
+		return ErrMrpcWindowFull
+	}
+	for w.inFlight >= w.capacity {
+		w.cond.Wait()
+	}
+	w.inFlight++
+	return nil
+}
+
+func (w *mrpcWindow) call(send func() error) error {
+	if err := w.acquire(); err != nil {
+		return err
+	}
+	defer w.release()
+	return send()
+}
+
+// start 回调方式的调用：有信用时立即执行run，窗口满时按策略拒绝、挂起或阻塞
+func (w *mrpcWindow) start(run func()) error {
+	w.mu.Lock()
+	if w.inFlight >= w.capacity {
+		policy := MrpcWindowPolicy(w.policy.Load())
+		if policy == MrpcWindowFailFast || (policy == MrpcWindowAwait && len(w.parked) >= w.capacity) {
+			w.rejected++
+			w.mu.Unlock()
+			return ErrMrpcWindowFull
+		}
+		if policy == MrpcWindowAwait {
+			w.parked = append(w.parked, run)
+			w.mu.Unlock()
+			return nil
+		}
+		for w.inFlight >= w.capacity {
+			w.cond.Wait()
+		}
+	}
+	w.inFlight++
+	w.mu.Unlock()
+	run()
+	return nil
+}
+
+// release 归还一个信用；有挂起的调用时信用直接转交给最早挂起的那个，由当前goroutine发出
+func (w *mrpcWindow) release() {
+	w.mu.Lock()
+	if len(w.parked) == 0 {
+		w.inFlight--
+		w.mu.Unlock()
+		w.cond.Signal()
+		return
+	}
+	run := w.parked[0]
+	w.parked[0] = nil
+	w.parked = w.parked[1:]
+	w.mu.Unlock()
+	run()
+}
+
+func (w *mrpcWindow) stats() MrpcWindowStats {
+	w.mu.Lock()
+	defer w.mu.Unlock()
+	return MrpcWindowStats{Capacity: w.capacity, InFlight: w.inFlight, Parked: len(w.parked), Rejected: w.rejected}
+}
+
+)";
+        // 窗口满是本地的背压，不计为连接失败
+        if (options.pool) {
+            output << R"(func mrpcChannelErr(err error) error {
+	if errors.Is(err, ErrMrpcWindowFull) {
+		return nil
+	}
+	return err
+}
+
+)";
+        }
+    }
+
+    // 方法占用的窗口：配置了方法级窗口时用自己的，否则共用客户端级窗口
+    std::string windowField(const Method& method) {
+        return method.max_in_flight > 0 ? "h." + uncapitalize(method.name) + "Window" : "h.window";
+    }
+
+    // 同步调用在窗口内发出
+    std::string windowedSend(const Method& method, const std::string& call) {
+        if (!hasWindow(method)) return call;
+        return windowField(method) + ".call(func() error { return " + call + " })";
+    }
+
+    // 回调方式的调用经窗口准入后发出：返回CallbackSend所在的缩进，完成回调中先归还信用
+    std::string openWindowStart(const Method& method, const std::string& indent) {
+        if (!hasWindow(method)) return indent;
+        output << indent << "if err := " << windowField(method) << ".start(func() {\n";
+        return indent + "\t";
+    }
+
+    void releaseWindow(const Method& method, const std::string& indent) {
+        if (hasWindow(method)) output << indent << windowField(method) << ".release()\n";
+    }
+
+    // 被拒绝时执行rejected中的语句
+    void closeWindowStart(const Method& method, const std::string& indent,
+                          const std::vector<std::string>& rejected) {
+        if (!hasWindow(method)) return;
+        output << indent << "}); err != nil {\n";
+        for (const auto& line : rejected) output << indent << "\t" << line << "\n";
+        output << indent << "}\n";
+    }
+
+    std::string channelErr(const Method& method) const {
+        return hasWindow(method) ? "mrpcChannelErr(err)" : "err";
+    }
+
+    // 生成对冲调用的辅助类型，仅在连接池中存在hedge注解时输出
+    void generateHedgeHelper() {
+        if (!hasHedgedMethods()) return;
+        output << R"(// MrpcHedgeStats 是一个对冲方法的统计，Hedges/Calls即对冲带来的额外负载
+type MrpcHedgeStats struct {
+	Calls       uint64
+	Hedges      uint64
+	HedgeWins   uint64
+	ThresholdUs int64 // 当前对冲阈值，按分位数对冲且样本不足时为-1
+}
+
+const (
+	mrpcHedgeSamples    = 512 // 按分位数对冲时保留的最近延迟样本数
+	mrpcHedgeMinSamples = 64  // 样本少于此数时不对冲
+	mrpcHedgeRecompute  = 32  // 每收到这么多样本重新计算一次阈值
+)
+
+// mrpcHedgePolicy 对冲阈值与统计：阈值为固定时长，或最近若干次尝试延迟的分位数
+type mrpcHedgePolicy struct {
+	percentile float64
+	maxExtra   int
+	threshold  atomic.Int64
+	mu         sync.Mutex
+	samples    [mrpcHedgeSamples]int64
+	recorded   int
+	calls      atomic.Uint64
+	hedges     atomic.Uint64
+	wins       atomic.Uint64
+}
+
+func newMrpcHedgePolicy(afterMs int64, afterPercentile float64, maxExtra int) *mrpcHedgePolicy {
+	p := &mrpcHedgePolicy{percentile: afterPercentile, maxExtra: maxExtra}
+	if afterPercentile > 0 {
+		p.threshold.Store(-1)
+	} else {
+		p.threshold.Store(afterMs * 1000)
+	}
+	return p
+}
+
+func (p *mrpcHedgePolicy) record(latency time.Duration) {
+	if p.percentile <= 0 {
+		return
+	}
+	p.mu.Lock()
+	defer p.mu.Unlock()
+	p.samples[p.recorded%mrpcHedgeSamples] = latency.Microseconds()
+	p.recorded++
+	count := p.recorded
+	if count > mrpcHedgeSamples {
+		count = mrpcHedgeSamples
+	}
+	if count < mrpcHedgeMinSamples || p.recorded%mrpcHedgeRecompute != 0 {
+		return
+	}
+	sorted := append([]int64(nil), p.samples[:count]...)
+	sort.Slice(sorted, func(a, b int) bool { return sorted[a] < sorted[b] })
+	k := int(float64(count) * p.percentile / 100)
+	if k > count-1 {
+		k = count - 1
+	}
+	p.threshold.Store(sorted[k])
+}
+
+func (p *mrpcHedgePolicy) stats() MrpcHedgeStats {
+	return MrpcHedgeStats{
+		Calls:       p.calls.Load(),
+		Hedges:      p.hedges.Load(),
+		HedgeWins:   p.wins.Load(),
+		ThresholdUs: p.threshold.Load(),
+	}
+}
+
+// mrpcHedge 先在一条连接上调用，超过阈值仍未返回时换一条连接发出备份调用，最多maxExtra个。
+// 第一个成功的结果胜出；运行时没有取消接口，落后的调用照常完成，结果被丢弃。
+// 失败的调用只在没有其他调用在途时才作为结果；channelErr为nil时连接的健康按err判断
+func mrpcHedge[C, T any](pool *mrpcChannelPool[C], policy *mrpcHedgePolicy, call func(C) (T, error),
+	channelErr func(error) error) (T, error) {
+	type attempt struct {
+		value T
+		err   error
+		hedge bool
+	}
+	policy.calls.Add(1)
+	results := make(chan attempt, policy.maxExtra+1)
+	used := make([]int, 0, policy.maxExtra+1)
+	var timer *time.Timer
+	var fire <-chan time.Time
+	defer func() {
+		if timer != nil {
+			timer.Stop()
+		}
+	}()
+	launch := func() {
+		i := pool.pickExcept(used)
+		used = append(used, i)
+		hedge := len(used) > 1
+		start := time.Now()
+		go func() {
+			value, err := call(pool.channels[i].client)
+			policy.record(time.Since(start))
+			if channelErr != nil {
+				pool.release(i, channelErr(err))
+			} else {
+				pool.release(i, err)
+			}
+			results <- attempt{value, err, hedge}
+		}()
+		// 从最近一次调用发出时开始计时下一次对冲
+		fire = nil
+		if threshold := policy.threshold.Load(); threshold >= 0 && len(used) <= policy.maxExtra {
+			timer = time.NewTimer(time.Duration(threshold) * time.Microsecond)
+			fire = timer.C
+		}
+	}
+
+	launch()
+	pending := 1
+	for {
+		select {
+		case <-fire:
+			policy.hedges.Add(1)
+			launch()
+			pending++
+		case r := <-results:
+			pending--
+			if r.err == nil || pending == 0 {
+				if r.err == nil && r.hedge {
+					policy.wins.Add(1)
+				}
+				return r.value, r.err
+			}
+		}
+	}
+}
+
+)";
+    }
+
+    // 单向方法在运行时中仍要登记一个响应类型，仅在存在oneway注解时输出
+    void generateNoReplyHelper() {
+        if (!hasOnewayMethods()) return;
+        output << R"(// mrpcNoReply 单向方法的占位响应：不含字段，服务端回送的确认直接丢弃
+type mrpcNoReply struct{}
+
+func (*mrpcNoReply) ToString() (string, error) { return "null", nil }
+func (*mrpcNoReply) FromString(string) error   { return nil }
+
+)";
+    }
+
+    // 是否存在需要取回响应的方法
+    bool hasReplyMethods() const {
         for (const auto& method : service.methods) {
-            output << "\t\"/" << yaml_filename << "." << service.name << "/" 
-                  << method.name << "\",\n";
+            if (!method.oneway) return true;
         }
-        output << "}\n\n";
+        return false;
     }
 
-    // 生成请求和响应结构体
-    void generateStructs() override {
+    std::string hedgeField(const Method& method) {
+        return uncapitalize(method.name) + "Hedge";
+    }
+
+    // 对冲调用表达式，返回值与同步方法一致
+    std::string hedgedCall(const Method& method, const std::string& indent) {
+        std::string client = service.name + "Client";
+        return "mrpcHedge(h.pool, h." + hedgeField(method) + ", func(c *" + client + ") (" +
+               generateGoType(method.response_params[0].type) + ", error) {\n" + indent + "\treturn c." + method.name +
+               "(request)\n" + indent + "}, " + (hasWindow(method) ? "mrpcChannelErr" : "nil") + ")";
+    }
+
+    // 生成多连接的PoolClient，每次调用按策略选择连接
+    void generatePoolClient() {
+        if (!options.pool) return;
+        std::string client = service.name + "Client";
+        std::string pool_client = service.name + "PoolClient";
+        output << "type " << pool_client << " struct {\n";
+        output << "\tpool *mrpcChannelPool[*" << client << "]\n";
         for (const auto& method : service.methods) {
-            // 生成请求结构体
-            output << "type " << method.name << "Request struct {\n";
-            for (const auto& param : method.request_params) {
-                output << "\t" << capitalize(param.name) << " " << 
-                         generateGoType(param.type) << " `json:\"" << 
-                         param.name << "\"`\n";
+            if (method.hedge.enabled) output << "\t" << hedgeField(method) << " *mrpcHedgePolicy\n";
+        }
+        output << "}\n\n";
+
+        output << "func New" << pool_client << "(addrs []string, connsPerAddr int, policy MrpcBalancePolicy) *"
+               << pool_client << " {\n";
+        if (!hasHedgedMethods()) {
+            output << "\treturn &" << pool_client << "{pool: newMrpcChannelPool(addrs, connsPerAddr, policy, New"
+                   << client << ")}\n";
+        } else {
+            output << "\treturn &" << pool_client << "{\n";
+            output << "\t\tpool: newMrpcChannelPool(addrs, connsPerAddr, policy, New" << client << "),\n";
+            for (const auto& method : service.methods) {
+                if (!method.hedge.enabled) continue;
+                output << "\t\t" << hedgeField(method) << ": newMrpcHedgePolicy(" << method.hedge.after_ms << ", "
+                       << method.hedge.after_percentile << ", " << method.hedge.max_extra << "),\n";
+            }
+            output << "\t}\n";
+        }
+        output << "}\n\n";
+
+        for (const auto& method : service.methods) {
+            // 单向方法只有一种调用方式
+            if (method.oneway) {
+                output << "func (h *" << pool_client << ") " << method.name << "(request *"
+                       << requestType(method) << ") error {\n";
+                output << "\ti := h.pool.pick()\n";
+                output << "\terr := h.pool.channels[i].client." << method.name << "(request)\n";
+                output << "\th.pool.release(i, err)\n";
+                output << "\treturn err\n";
+                output << "}\n\n";
+                continue;
+            }
+            std::string value_type = generateGoType(method.response_params[0].type);
+
+            // 同步方法，带hedge注解时按对冲策略调用
+            output << "func (h *" << pool_client << ") " << method.name << "(request *" << requestType(method)
+                   << ") (" << value_type << ", error) {\n";
+            if (method.hedge.enabled) {
+                output << "\treturn " << hedgedCall(method, "\t") << "\n";
+            } else {
+                output << "\ti := h.pool.pick()\n";
+                output << "\tvalue, err := h.pool.channels[i].client." << method.name << "(request)\n";
+                output << "\th.pool.release(i, " << channelErr(method) << ")\n";
+                output << "\treturn value, err\n";
             }
             output << "}\n\n";
-            
-            // 生成请求ToString方法
-            output << "func (r *" << method.name << "Request) ToString() (string, error) {\n";
-            output << "\tdata, err := json.Marshal(r)\n";
+
+            // 异步方法，key中带上连接序号以便Receive找回连接；发出的调用无法撤回，因此不做对冲
+            output << "func (h *" << pool_client << ") Async" << method.name << "(request *" << requestType(method)
+                   << ") (string, error) {\n";
+            output << "\ti := h.pool.pick()\n";
+            output << "\tkey, err := h.pool.channels[i].client.Async" << method.name << "(request)\n";
+            output << "\tif err != nil {\n";
+            output << "\t\th.pool.release(i, " << channelErr(method) << ")\n";
+            output << "\t\treturn key, err\n";
+            output << "\t}\n";
+            output << "\treturn strconv.Itoa(i) + \"#\" + key, nil\n";
+            output << "}\n\n";
+
+            // 回调方法
+            output << "func (h *" << pool_client << ") Callback" << method.name << "(request *" << requestType(method)
+                   << ", callback func(" << value_type << ", error)) {\n";
+            if (method.hedge.enabled) {
+                output << "\tgo func() {\n";
+                output << "\t\tcallback(" << hedgedCall(method, "\t\t") << ")\n";
+                output << "\t}()\n";
+            } else {
+                output << "\ti := h.pool.pick()\n";
+                output << "\th.pool.channels[i].client.Callback" << method.name << "(request, func(value "
+                       << value_type << ", err error) {\n";
+                output << "\t\th.pool.release(i, " << channelErr(method) << ")\n";
+                output << "\t\tcallback(value, err)\n";
+                output << "\t})\n";
+            }
+            output << "}\n\n";
+        }
+
+        // Receive与单连接客户端的签名保持一致
+        if (hasReplyMethods()) {
+            if (service.methods.size() > 1) {
+                output << "func (h *" << pool_client << ") Receive(key string, methodIndex int) (string, error) {\n";
+            } else {
+                output << "func (h *" << pool_client << ") Receive(key string) (string, error) {\n";
+            }
+            output << "\ti, inner, err := mrpcSplitPoolKey(key)\n";
             output << "\tif err != nil {\n";
             output << "\t\treturn \"\", err\n";
             output << "\t}\n";
-            output << "\treturn string(data), nil\n";
+            if (service.methods.size() > 1) {
+                output << "\tvalue, err := h.pool.channels[i].client.Receive(inner, methodIndex)\n";
+            } else {
+                output << "\tvalue, err := h.pool.channels[i].client.Receive(inner)\n";
+            }
+            output << "\th.pool.release(i, err)\n";
+            output << "\treturn value, err\n";
             output << "}\n\n";
-    
-            // 生成请求FromString方法
-            output << "func (r *" << method.name << "Request) FromString(data string) error {\n";
-            output << "\treturn json.Unmarshal([]byte(data), r)\n";
+        }
+
+        for (const auto& method : service.methods) {
+            if (method.oneway) continue;
+            std::string response = responseType(method);
+            output << "func (h *" << pool_client << ") Receive" << method.name
+                   << "(key string) (*" << response << ", error) {\n";
+            output << "\ti, inner, err := mrpcSplitPoolKey(key)\n";
+            output << "\tif err != nil {\n";
+            output << "\t\treturn nil, err\n";
+            output << "\t}\n";
+            output << "\tresponse, err := h.pool.channels[i].client.Receive" << method.name << "(inner)\n";
+            output << "\th.pool.release(i, err)\n";
+            output << "\treturn response, err\n";
             output << "}\n\n";
-            
-            // 生成响应结构体
-            output << "type " << method.name << "Response struct {\n";
-            for (const auto& param : method.response_params) {
-                output << "\t" << capitalize(param.name) << " " << 
-                         generateGoType(param.type) << " `json:\"" << 
-                         param.name << "\"`\n";
+        }
+
+        output << "func (h *" << pool_client << ") ChannelStats() []MrpcChannelStats {\n";
+        output << "\treturn h.pool.stats()\n";
+        output << "}\n\n";
+
+        // 每条连接的客户端各有自己的缓存和请求合并：失效作用于全部连接，统计为各连接之和
+        for (const auto& method : service.methods) {
+            if (method.cache.enabled) {
+                output << "func (h *" << pool_client << ") Invalidate" << method.name << "(request *"
+                       << requestType(method) << ") {\n";
+                output << "\tfor _, ch := range h.pool.channels {\n";
+                output << "\t\tch.client.Invalidate" << method.name << "(request)\n";
+                output << "\t}\n";
+                output << "}\n\n";
+                output << "func (h *" << pool_client << ") Invalidate" << method.name << "Cache() {\n";
+                output << "\tfor _, ch := range h.pool.channels {\n";
+                output << "\t\tch.client.Invalidate" << method.name << "Cache()\n";
+                output << "\t}\n";
+                output << "}\n\n";
+                output << "// " << method.name << "CacheStats 汇总各连接的缓存统计；落到不同连接的相同请求互不共享缓存\n";
+                output << "func (h *" << pool_client << ") " << method.name << "CacheStats() MrpcCacheStats {\n";
+                output << "\tvar total MrpcCacheStats\n";
+                output << "\tfor _, ch := range h.pool.channels {\n";
+                output << "\t\tstats := ch.client." << method.name << "CacheStats()\n";
+                output << "\t\ttotal.Hits += stats.Hits\n";
+                output << "\t\ttotal.Misses += stats.Misses\n";
+                output << "\t\ttotal.Evictions += stats.Evictions\n";
+                output << "\t\ttotal.Expirations += stats.Expirations\n";
+                output << "\t\ttotal.Invalidations += stats.Invalidations\n";
+                output << "\t\ttotal.Size += stats.Size\n";
+                output << "\t}\n";
+                output << "\treturn total\n";
+                output << "}\n\n";
+            }
+            if (method.coalesce) {
+                output << "func (h *" << pool_client << ") " << method.name << "CoalescedCalls() uint64 {\n";
+                output << "\tvar total uint64\n";
+                output << "\tfor _, ch := range h.pool.channels {\n";
+                output << "\t\ttotal += ch.client." << method.name << "CoalescedCalls()\n";
+                output << "\t}\n";
+                output << "\treturn total\n";
+                output << "}\n\n";
             }
+        }
+
+        for (const auto& method : service.methods) {
+            if (!method.hedge.enabled) continue;
+            output << "func (h *" << pool_client << ") " << method.name << "HedgeStats() MrpcHedgeStats {\n";
+            output << "\treturn h." << hedgeField(method) << ".stats()\n";
             output << "}\n\n";
-            
-            // 生成响应ToString方法
-            output << "func (r *" << method.name << "Response) ToString() (string, error) {\n";
-            output << "\tdata, err := json.Marshal(r)\n";
+        }
+
+        // 每条连接的客户端各有自己的窗口
+        if (hasWindows()) {
+            output << "func (h *" << pool_client << ") SetWindowPolicy(policy MrpcWindowPolicy) {\n";
+            output << "\tfor _, ch := range h.pool.channels {\n";
+            output << "\t\tch.client.SetWindowPolicy(policy)\n";
+            output << "\t}\n";
+            output << "}\n\n";
+        }
+
+        output << "func (h *" << pool_client << ") Close() {\n";
+        output << "\tfor _, ch := range h.pool.channels {\n";
+        output << "\t\tch.client.Close()\n";
+        output << "\t}\n";
+        output << "}\n";
+    }
+
+    // 选择分片的表达式：有分片键时按键的文本形式哈希，否则轮转
+    std::string shardOf(const Method& method) {
+        if (method.shard_key.empty()) return "int(h.next.Add(1) % uint64(len(h.clients)))";
+        std::string field = "request." + capitalize(method.shard_key);
+        std::string type = shardKeyType(method);
+        if (type == "int") field = "strconv.Itoa(" + field + ")";
+        if (type == "bool") field = "strconv.FormatBool(" + field + ")";
+        return "mrpcShardOf(" + field + ", len(h.clients))";
+    }
+
+    // 生成分片客户端：addrs[i]为注册了C++ ShardedService::Endpoint(i)的地址，带分片键的方法直接选择分片的连接
+    void generateShardedClient() {
+        std::string client = service.name + "Client";
+        std::string sharded_client = service.name + "ShardedClient";
+        output << "// " << sharded_client << " 按分片键的哈希对地址数取模选择分片的连接；没有分片键的方法轮流使用各连接。\n";
+        output << "// addrs[i]须是注册了" << service.name << "ShardedService::Endpoint(i)的服务器地址，顺序与分片一致\n";
+        output << "type " << sharded_client << " struct {\n";
+        output << "\tclients []*" << client << "\n";
+        output << "\tnext    atomic.Uint64\n";
+        output << "}\n\n";
+
+        output << "func New" << sharded_client << "(addrs []string) *" << sharded_client << " {\n";
+        output << "\th := &" << sharded_client << "{}\n";
+        output << "\tfor _, addr := range addrs {\n";
+        output << "\t\th.clients = append(h.clients, New" << client << "(addr))\n";
+        output << "\t}\n";
+        output << "\treturn h\n";
+        output << "}\n\n";
+
+        output << "func (h *" << sharded_client << ") Shards() int {\n";
+        output << "\treturn len(h.clients)\n";
+        output << "}\n\n";
+
+        for (const auto& method : service.methods) {
+            if (method.oneway) {
+                output << "func (h *" << sharded_client << ") " << method.name << "(request *"
+                       << requestType(method) << ") error {\n";
+                output << "\treturn h.clients[" << shardOf(method) << "]." << method.name << "(request)\n";
+                output << "}\n\n";
+                continue;
+            }
+            std::string value_type = generateGoType(method.response_params[0].type);
+
+            output << "func (h *" << sharded_client << ") " << method.name << "(request *" << requestType(method)
+                   << ") (" << value_type << ", error) {\n";
+            output << "\treturn h.clients[" << shardOf(method) << "]." << method.name << "(request)\n";
+            output << "}\n\n";
+
+            // 异步方法，key中带上分片序号以便Receive找回连接
+            output << "func (h *" << sharded_client << ") Async" << method.name << "(request *"
+                   << requestType(method) << ") (string, error) {\n";
+            output << "\ti := " << shardOf(method) << "\n";
+            output << "\tkey, err := h.clients[i].Async" << method.name << "(request)\n";
+            output << "\tif err != nil {\n";
+            output << "\t\treturn key, err\n";
+            output << "\t}\n";
+            output << "\treturn strconv.Itoa(i) + \"#\" + key, nil\n";
+            output << "}\n\n";
+
+            output << "func (h *" << sharded_client << ") Callback" << method.name << "(request *"
+                   << requestType(method) << ", callback func(" << value_type << ", error)) {\n";
+            output << "\th.clients[" << shardOf(method) << "].Callback" << method.name << "(request, callback)\n";
+            output << "}\n\n";
+        }
+
+        // Receive与单连接客户端的签名保持一致
+        if (hasReplyMethods()) {
+            if (service.methods.size() > 1) {
+                output << "func (h *" << sharded_client << ") Receive(key string, methodIndex int) (string, error) {\n";
+            } else {
+                output << "func (h *" << sharded_client << ") Receive(key string) (string, error) {\n";
+            }
+            output << "\ti, inner, err := mrpcSplitPoolKey(key)\n";
             output << "\tif err != nil {\n";
             output << "\t\treturn \"\", err\n";
             output << "\t}\n";
-            output << "\treturn string(data), nil\n";
+            if (service.methods.size() > 1) {
+                output << "\treturn h.clients[i].Receive(inner, methodIndex)\n";
+            } else {
+                output << "\treturn h.clients[i].Receive(inner)\n";
+            }
             output << "}\n\n";
-            
-            // 生成响应FromString方法
-            output << "func (r *" << method.name << "Response) FromString(data string) error {\n";
-            output << "\treturn json.Unmarshal([]byte(data), r)\n";
+        }
+
+        for (const auto& method : service.methods) {
+            if (method.oneway) continue;
+            output << "func (h *" << sharded_client << ") Receive" << method.name
+                   << "(key string) (*" << responseType(method) << ", error) {\n";
+            output << "\ti, inner, err := mrpcSplitPoolKey(key)\n";
+            output << "\tif err != nil {\n";
+            output << "\t\treturn nil, err\n";
+            output << "\t}\n";
+            output << "\treturn h.clients[i].Receive" << method.name << "(inner)\n";
             output << "}\n\n";
         }
+
+        output << "func (h *" << sharded_client << ") Close() {\n";
+        output << "\tfor _, c := range h.clients {\n";
+        output << "\t\tc.Close()\n";
+        output << "\t}\n";
+        output << "}\n";
+    }
+
+    // 生成方法名数组
+    void generateMethodNames() override {
+        output << "var " << service.name << "_method_names = []string{\n";
+        for (const auto& method : service.methods) {
+            output << "\t\"/" << yaml_filename << "." << service.name << "/" 
+                  << method.name << "\",\n";
+        }
+        output << "}\n\n";
+    }
+
+    // 是否存在指定类型的字段
+    bool hasFieldType(const std::string& type) const {
+        for (const auto& message : messageTypes()) {
+            for (const auto& param : message.params) {
+                if (param.type == type) return true;
+            }
+        }
+        return false;
+    }
+
+    // 生成免反射的JSON编解码辅助代码：追加式编码和直接在字符串上解析的解码器
+    void generateCodecHelper() {
+        output << R"(// mrpcBufferPool 复用ToString的编码缓冲区
+var mrpcBufferPool = sync.Pool{
+	New: func() any {
+		buf := make([]byte, 0, 256)
+		return &buf
+	},
+}
+
+func mrpcPutBuffer(buf *[]byte) {
+	// 过大的缓冲区不放回，避免池长期持有大块内存
+	if cap(*buf) <= 64<<10 {
+		mrpcBufferPool.Put(buf)
+	}
+}
+
+// mrpcAppendString 按JSON规则转义并追加字符串，非法UTF-8替换为\ufffd；
+// 与encoding/json一样把<、>和&转义为\u003c、\u003e和\u0026，输出可安全嵌入HTML
+func mrpcAppendString(buf []byte, s string) []byte {
+	const hex = "0123456789abcdef"
+	buf = append(buf, '"')
+	start := 0
+	for i := 0; i < len(s); {
+		c := s[i]
+		if c < utf8.RuneSelf {
+			if c >= 0x20 && c != '"' && c != '\\' && c != '<' && c != '>' && c != '&' {
+				i++
+				continue
+			}
+			buf = append(buf, s[start:i]...)
+			switch c {
+			case '"', '\\':
+				buf = append(buf, '\\', c)
+			case '\n':
+				buf = append(buf, '\\', 'n')
+			case '\r':
+				buf = append(buf, '\\', 'r')
+			case '\t':
+				buf = append(buf, '\\', 't')
+			default:
+				buf = append(buf, '\\', 'u', '0', '0', hex[c>>4], hex[c&0xf])
+			}
+			i++
+			start = i
+			continue
+		}
+		r, size := utf8.DecodeRuneInString(s[i:])
+		if r == utf8.RuneError && size == 1 {
+			buf = append(buf, s[start:i]...)
+			buf = append(buf, `\ufffd`...)
+			i += size
+			start = i
+			continue
+		}
+		if r == '\u2028' || r == '\u2029' {
+			buf = append(buf, s[start:i]...)
+			buf = append(buf, '\\', 'u', '2', '0', '2', hex[r&0xf])
+			i += size
+			start = i
+			continue
+		}
+		i += size
+	}
+	buf = append(buf, s[start:]...)
+	return append(buf, '"')
+}
+
+// mrpcDecoder 直接在输入字符串上解析JSON；不含转义的字符串字段直接引用输入的子串，不再复制
+type mrpcDecoder struct {
+	data    string
+	pos     int
+	key     string
+	err     error
+	started bool
+	done    bool
+}
+
+func (d *mrpcDecoder) fail(what string) error {
+	return fmt.Errorf("mrpc: %s at offset %d", what, d.pos)
+}
+
+func (d *mrpcDecoder) skipSpace() {
+	for d.pos < len(d.data) {
+		switch d.data[d.pos] {
+		case ' ', '\t', '\n', '\r':
+			d.pos++
+		default:
+			return
+		}
+	}
+}
+
+// consume 跳过空白后，若下一个字符为c则读掉它
+func (d *mrpcDecoder) consume(c byte) bool {
+	d.skipSpace()
+	if d.pos < len(d.data) && d.data[d.pos] == c {
+		d.pos++
+		return true
+	}
+	return false
+}
+
+func (d *mrpcDecoder) literal(word string) bool {
+	d.skipSpace()
+	if len(d.data)-d.pos >= len(word) && d.data[d.pos:d.pos+len(word)] == word {
+		d.pos += len(word)
+		return true
+	}
+	return false
+}
+
+// nextField 读取下一个字段名到d.key；对象结束或出错时返回false，null视为空对象，与encoding/json一致
+func (d *mrpcDecoder) nextField() bool {
+	if d.err != nil || d.done {
+		return false
+	}
+	if !d.started {
+		d.started = true
+		if d.literal("null") {
+			d.done = true
+			return false
+		}
+		if !d.consume('{') {
+			d.err = d.fail("expected '{'")
+			return false
+		}
+		if d.consume('}') {
+			d.done = true
+			return false
+		}
+	} else if !d.consume(',') {
+		if d.consume('}') {
+			d.done = true
+			return false
+		}
+		d.err = d.fail("expected ',' or '}'")
+		return false
+	}
+	d.skipSpace()
+	if d.pos >= len(d.data) || d.data[d.pos] != '"' {
+		d.err = d.fail("expected string key")
+		return false
+	}
+	key, err := d.readRawString()
+	if err != nil {
+		d.err = err
+		return false
+	}
+	if !d.consume(':') {
+		d.err = d.fail("expected ':'")
+		return false
+	}
+	d.key = key
+	return true
+}
+
+// mrpcFieldName 返回与字段名key对应的字段：先找完全相同的，再与encoding/json一样按Unicode大小写折叠匹配，
+// 多个字段都匹配时取声明在前的；没有匹配时原样返回key
+func mrpcFieldName(key string, names ...string) string {
+	for _, name := range names {
+		if key == name {
+			return name
+		}
+	}
+	for _, name := range names {
+		if strings.EqualFold(key, name) {
+			return name
+		}
+	}
+	return key
+}
+
+// finish 返回解析过程中的错误，并检查对象之后没有多余数据
+func (d *mrpcDecoder) finish() error {
+	if d.err != nil {
+		return d.err
+	}
+	d.skipSpace()
+	if d.pos != len(d.data) {
+		return d.fail("unexpected trailing data")
+	}
+	return nil
+}
+
+// readRawString 读取以引号开头的字符串；无转义且为合法UTF-8时直接返回子串
+func (d *mrpcDecoder) readRawString() (string, error) {
+	start := d.pos + 1
+	for i := start; i < len(d.data); {
+		c := d.data[i]
+		switch {
+		case c == '"':
+			d.pos = i + 1
+			return d.data[start:i], nil
+		case c == '\\' || c < 0x20:
+			return d.readEscapedString(start)
+		case c >= utf8.RuneSelf:
+			r, size := utf8.DecodeRuneInString(d.data[i:])
+			if r == utf8.RuneError && size == 1 {
+				return d.readEscapedString(start)
+			}
+			i += size
+		default:
+			i++
+		}
+	}
+	return "", d.fail("unterminated string")
+}
+
+func mrpcHex4(s string) (rune, bool) {
+	if len(s) < 4 {
+		return 0, false
+	}
+	var r rune
+	for i := 0; i < 4; i++ {
+		c := s[i]
+		switch {
+		case '0' <= c && c <= '9':
+			c -= '0'
+		case 'a' <= c && c <= 'f':
+			c = c - 'a' + 10
+		case 'A' <= c && c <= 'F':
+			c = c - 'A' + 10
+		default:
+			return 0, false
+		}
+		r = r<<4 | rune(c)
+	}
+	return r, true
+}
+
+// readEscapedString 处理转义和非法UTF-8的慢路径
+func (d *mrpcDecoder) readEscapedString(start int) (string, error) {
+	buf := make([]byte, 0, len(d.data)-start)
+	for i := start; i < len(d.data); {
+		c := d.data[i]
+		switch {
+		case c == '"':
+			d.pos = i + 1
+			return string(buf), nil
+		case c < 0x20:
+			d.pos = i
+			return "", d.fail("invalid character in string")
+		case c == '\\':
+			if i+1 >= len(d.data) {
+				d.pos = i
+				return "", d.fail("unterminated string")
+			}
+			switch e := d.data[i+1]; e {
+			case '"', '\\', '/':
+				buf = append(buf, e)
+			case 'b':
+				buf = append(buf, '\b')
+			case 'f':
+				buf = append(buf, '\f')
+			case 'n':
+				buf = append(buf, '\n')
+			case 'r':
+				buf = append(buf, '\r')
+			case 't':
+				buf = append(buf, '\t')
+			case 'u':
+				r, ok := mrpcHex4(d.data[i+2:])
+				if !ok {
+					d.pos = i
+					return "", d.fail("invalid unicode escape")
+				}
+				i += 6
+				if utf16.IsSurrogate(r) {
+					// 代理对需要紧跟第二个\uXXXX，否则按encoding/json替换为U+FFFD
+					r2, ok := rune(0), false
+					if i+1 < len(d.data) && d.data[i] == '\\' && d.data[i+1] == 'u' {
+						r2, ok = mrpcHex4(d.data[i+2:])
+					}
+					if dec := utf16.DecodeRune(r, r2); ok && dec != utf8.RuneError {
+						r = dec
+						i += 6
+					} else {
+						r = utf8.RuneError
+					}
+				}
+				buf = utf8.AppendRune(buf, r)
+				continue
+			default:
+				d.pos = i
+				return "", d.fail("invalid escape")
+			}
+			i += 2
+		case c >= utf8.RuneSelf:
+			r, size := utf8.DecodeRuneInString(d.data[i:])
+			if r == utf8.RuneError && size == 1 {
+				buf = append(buf, "\ufffd"...)
+			} else {
+				buf = append(buf, d.data[i:i+size]...)
+			}
+			i += size
+		default:
+			buf = append(buf, c)
+			i++
+		}
+	}
+	return "", d.fail("unterminated string")
+}
+
+func mrpcIsDigit(c byte) bool {
+	return '0' <= c && c <= '9'
+}
+
+// readNumber 按JSON数字语法读取一个数字
+func (d *mrpcDecoder) readNumber() (string, error) {
+	d.skipSpace()
+	s, start := d.data, d.pos
+	i := start
+	if i < len(s) && s[i] == '-' {
+		i++
+	}
+	switch {
+	case i < len(s) && s[i] == '0':
+		i++
+	case i < len(s) && '1' <= s[i] && s[i] <= '9':
+		for i < len(s) && mrpcIsDigit(s[i]) {
+			i++
+		}
+	default:
+		return "", d.fail("invalid number")
+	}
+	if i < len(s) && s[i] == '.' {
+		i++
+		if i >= len(s) || !mrpcIsDigit(s[i]) {
+			return "", d.fail("invalid number")
+		}
+		for i < len(s) && mrpcIsDigit(s[i]) {
+			i++
+		}
+	}
+	if i < len(s) && (s[i] == 'e' || s[i] == 'E') {
+		i++
+		if i < len(s) && (s[i] == '+' || s[i] == '-') {
+			i++
+		}
+		if i >= len(s) || !mrpcIsDigit(s[i]) {
+			return "", d.fail("invalid number")
+		}
+		for i < len(s) && mrpcIsDigit(s[i]) {
+			i++
+		}
+	}
+	d.pos = i
+	return s[start:i], nil
+}
+
+// 以下读取函数遇到null时保留字段原值，与encoding/json一致
+func (d *mrpcDecoder) readString(dst *string) error {
+	if d.literal("null") {
+		return nil
+	}
+	if d.pos >= len(d.data) || d.data[d.pos] != '"' {
+		return d.fail("expected string")
+	}
+	s, err := d.readRawString()
+	if err != nil {
+		return err
+	}
+	*dst = s
+	return nil
+}
+
+func (d *mrpcDecoder) readInt(dst *int) error {
+	if d.literal("null") {
+		return nil
+	}
+	token, err := d.readNumber()
+	if err != nil {
+		return err
+	}
+	v, err := strconv.ParseInt(token, 10, strconv.IntSize)
+	if err != nil {
+		return d.fail("cannot decode " + token + " as int")
+	}
+	*dst = int(v)
+	return nil
+}
+
+func (d *mrpcDecoder) readFloat(dst *float64) error {
+	if d.literal("null") {
+		return nil
+	}
+	token, err := d.readNumber()
+	if err != nil {
+		return err
+	}
+	v, err := strconv.ParseFloat(token, 64)
+	if err != nil {
+		return d.fail("cannot decode " + token + " as float64")
+	}
+	*dst = v
+	return nil
+}
+
+func (d *mrpcDecoder) readBool(dst *bool) error {
+	switch {
+	case d.literal("null"):
+	case d.literal("true"):
+		*dst = true
+	case d.literal("false"):
+		*dst = false
+	default:
+		return d.fail("expected bool")
+	}
+	return nil
+}
+
+// skipValue 跳过未知字段的值，限制嵌套深度以防栈溢出
+func (d *mrpcDecoder) skipValue(depth int) error {
+	if depth > 10000 {
+		return d.fail("exceeded max depth")
+	}
+	d.skipSpace()
+	if d.pos >= len(d.data) {
+		return d.fail("unexpected end of input")
+	}
+	switch d.data[d.pos] {
+	case '"':
+		_, err := d.readRawString()
+		return err
+	case '{', '[':
+		closing := byte('}')
+		if d.data[d.pos] == '[' {
+			closing = ']'
+		}
+		d.pos++
+		if d.consume(closing) {
+			return nil
+		}
+		for {
+			if closing == '}' {
+				d.skipSpace()
+				if d.pos >= len(d.data) || d.data[d.pos] != '"' {
+					return d.fail("expected string key")
+				}
+				if _, err := d.readRawString(); err != nil {
+					return err
+				}
+				if !d.consume(':') {
+					return d.fail("expected ':'")
+				}
+			}
+			if err := d.skipValue(depth + 1); err != nil {
+				return err
+			}
+			if d.consume(',') {
+				continue
+			}
+			if d.consume(closing) {
+				return nil
+			}
+			return d.fail("expected ',' or closing bracket")
+		}
+	}
+	if d.literal("true") || d.literal("false") || d.literal("null") {
+		return nil
+	}
+	_, err := d.readNumber()
+	return err
+}
+)";
+        if (hasFieldType("float")) {
+            output << "\n" << R"(// mrpcAppendFloat 使用与encoding/json相同的浮点格式
+func mrpcAppendFloat(buf []byte, f float64) []byte {
+	abs := math.Abs(f)
+	format := byte('f')
+	if abs != 0 && (abs < 1e-6 || abs >= 1e21) {
+		format = 'e'
+	}
+	buf = strconv.AppendFloat(buf, f, format, -1, 64)
+	if format == 'e' {
+		// 将e-07规整为e-7
+		n := len(buf)
+		if n >= 4 && buf[n-4] == 'e' && buf[n-3] == '-' && buf[n-2] == '0' {
+			buf[n-2] = buf[n-1]
+			buf = buf[:n-1]
+		}
+	}
+	return buf
+}
+
+// mrpcCheckFloat NaN和Inf无法用JSON表示
+func mrpcCheckFloat(f float64) error {
+	if math.IsNaN(f) || math.IsInf(f, 0) {
+		return fmt.Errorf("mrpc: unsupported float value %v", f)
+	}
+	return nil
+}
+)";
+        }
+        output << "\n";
+    }
+
+    // 生成单个消息结构体及其编解码方法：按字段展开编码和解码，不经过反射
+    void generateMessageStruct(const std::string& name, const std::vector<Parameter>& params) {
+        output << "type " << name << " struct {\n";
+        for (const auto& param : params) {
+            output << "\t" << capitalize(param.name) << " " <<
+                     generateGoType(param.type) << " `json:\"" <<
+                     param.name << "\"`\n";
+        }
+        output << "}\n\n";
+
+        // 浮点字段的NaN/Inf检查，ToString和MarshalJSON共用
+        auto checkFloats = [&](const std::string& zero) {
+            for (const auto& param : params) {
+                if (param.type != "float") continue;
+                output << "\tif err := mrpcCheckFloat(r." << capitalize(param.name) << "); err != nil {\n";
+                output << "\t\treturn " << zero << ", err\n";
+                output << "\t}\n";
+            }
+        };
+
+        // AppendTo方法
+        bool has_float = false;
+        for (const auto& param : params) {
+            if (param.type == "float") has_float = true;
+        }
+        output << "// AppendTo 将JSON编码追加到buf后返回" << (has_float ? "，浮点字段须为有限值" : "") << "\n";
+        output << "func (r *" << name << ") AppendTo(buf []byte) []byte {\n";
+        if (params.empty()) {
+            output << "\treturn append(buf, \"{}\"...)\n";
+        }
+        for (size_t i = 0; i < params.size(); ++i) {
+            const auto& param = params[i];
+            std::string field = "r." + capitalize(param.name);
+            output << "\tbuf = append(buf, `" << (i == 0 ? "{" : ",") << "\"" << param.name << "\":`...)\n";
+            if (param.type == "int") {
+                output << "\tbuf = strconv.AppendInt(buf, int64(" << field << "), 10)\n";
+            } else if (param.type == "float") {
+                output << "\tbuf = mrpcAppendFloat(buf, " << field << ")\n";
+            } else if (param.type == "bool") {
+                output << "\tbuf = strconv.AppendBool(buf, " << field << ")\n";
+            } else {
+                output << "\tbuf = mrpcAppendString(buf, " << field << ")\n";
+            }
+        }
+        if (!params.empty()) {
+            output << "\treturn append(buf, '}')\n";
+        }
+        output << "}\n\n";
+
+        // MarshalJSON/UnmarshalJSON方法，使encoding/json也走生成的代码
+        output << "func (r *" << name << ") MarshalJSON() ([]byte, error) {\n";
+        checkFloats("nil");
+        output << "\treturn r.AppendTo(make([]byte, 0, 64)), nil\n";
+        output << "}\n\n";
+
+        output << "func (r *" << name << ") UnmarshalJSON(data []byte) error {\n";
+        output << "\treturn r.FromString(string(data))\n";
+        output << "}\n\n";
+
+        // ToString方法
+        output << "func (r *" << name << ") ToString() (string, error) {\n";
+        checkFloats("\"\"");
+        output << "\tbuf := mrpcBufferPool.Get().(*[]byte)\n";
+        output << "\t*buf = r.AppendTo((*buf)[:0])\n";
+        output << "\tdata := string(*buf)\n";
+        output << "\tmrpcPutBuffer(buf)\n";
+        output << "\treturn data, nil\n";
+        output << "}\n\n";
+
+        // FromString方法：逐个读取字段名并就地分派，字段名与encoding/json一样不区分大小写，未知字段跳过
+        output << "func (r *" << name << ") FromString(data string) error {\n";
+        output << "\td := mrpcDecoder{data: data}\n";
+        output << "\tfor d.nextField() {\n";
+        if (params.empty()) {
+            output << "\t\td.err = d.skipValue(0)\n";
+        } else {
+            output << "\t\tswitch mrpcFieldName(d.key";
+            for (const auto& param : params) output << ", \"" << param.name << "\"";
+            output << ") {\n";
+            for (const auto& param : params) {
+                std::string field = "&r." + capitalize(param.name);
+                output << "\t\tcase \"" << param.name << "\":\n";
+                if (param.type == "int") {
+                    output << "\t\t\td.err = d.readInt(" << field << ")\n";
+                } else if (param.type == "float") {
+                    output << "\t\t\td.err = d.readFloat(" << field << ")\n";
+                } else if (param.type == "bool") {
+                    output << "\t\t\td.err = d.readBool(" << field << ")\n";
+                } else {
+                    output << "\t\t\td.err = d.readString(" << field << ")\n";
+                }
+            }
+            output << "\t\tdefault:\n";
+            output << "\t\t\td.err = d.skipValue(0)\n";
+            output << "\t\t}\n";
+        }
+        output << "\t}\n";
+        output << "\treturn d.finish()\n";
+        output << "}\n\n";
+
+        // Reset方法和对象池
+        std::string pool = uncapitalize(name) + "Pool";
+        output << "// Reset 清空所有字段以便复用\n";
+        output << "func (r *" << name << ") Reset() {\n";
+        output << "\t*r = " << name << "{}\n";
+        output << "}\n\n";
+
+        output << "var " << pool << " = sync.Pool{\n";
+        output << "\tNew: func() any { return new(" << name << ") },\n";
+        output << "}\n\n";
+
+        output << "// Acquire" << name << " 从对象池取出一个空消息，用完后调用Release" << name << "放回\n";
+        output << "func Acquire" << name << "() *" << name << " {\n";
+        output << "\treturn " << pool << ".Get().(*" << name << ")\n";
+        output << "}\n\n";
+
+        output << "// Release" << name << " 清空消息并放回对象池，调用后不得再使用r\n";
+        output << "func Release" << name << "(r *" << name << ") {\n";
+        output << "\tr.Reset()\n";
+        output << "\t" << pool << ".Put(r)\n";
+        output << "}\n\n";
+    }
+
+    // 生成请求和响应结构体
+    void generateStructs() override {
+        for (const auto& message : service.messages) {
+            generateMessageStruct(message.name, message.params);
+        }
+        for (const auto& method : service.methods) {
+            if (!method.request.named) generateMessageStruct(method.request.type, method.request_params);
+            if (!method.response.named && !method.oneway) {
+                generateMessageStruct(method.response.type, method.response_params);
+            }
+        }
     }
 
     // 生成客户端结构体和方法
@@ -82,76 +1770,291 @@ private:
         // 生成客户端结构体
         output << "type " << service.name << "Client struct {\n";
         output << "\tclient *mrpc.Client\n";
+        for (const auto& method : service.methods) {
+            if (!method.cache.enabled) continue;
+            output << "\t" << uncapitalize(method.name) << "Cache *mrpcResponseCache["
+                   << responseType(method) << "]\n";
+        }
+        for (const auto& method : service.methods) {
+            if (!method.coalesce) continue;
+            output << "\t" << uncapitalize(method.name) << "Flight *mrpcSingleFlight["
+                   << responseType(method) << "]\n";
+        }
+        if (usesStubWindow()) output << "\twindow *mrpcWindow\n";
+        for (const auto& method : service.methods) {
+            if (!hasWindow(method) || method.max_in_flight == 0) continue;
+            output << "\t" << uncapitalize(method.name) << "Window *mrpcWindow\n";
+        }
         output << "}\n\n";
         
         // 生成构造函数
         output << "func New" << service.name << "Client(s string) *" << service.name << "Client {\n";
         output << "\treturn &" << service.name << "Client{\n";
         output << "\t\tclient: mrpc.NewClient(s),\n";
+        for (const auto& method : service.methods) {
+            if (!method.cache.enabled) continue;
+            output << "\t\t" << uncapitalize(method.name) << "Cache: newMrpcResponseCache["
+                   << responseType(method) << "](" << method.cache.ttl_ms << ", "
+                   << method.cache.max_entries << "),\n";
+        }
+        for (const auto& method : service.methods) {
+            if (!method.coalesce) continue;
+            output << "\t\t" << uncapitalize(method.name) << "Flight: newMrpcSingleFlight["
+                   << responseType(method) << "](),\n";
+        }
+        if (usesStubWindow()) output << "\t\twindow: newMrpcWindow(" << service.max_in_flight << "),\n";
+        for (const auto& method : service.methods) {
+            if (!hasWindow(method) || method.max_in_flight == 0) continue;
+            output << "\t\t" << uncapitalize(method.name) << "Window: newMrpcWindow("
+                   << method.max_in_flight << "),\n";
+        }
         output << "\t}\n";
         output << "}\n\n";
         
         // 为每个方法生成同步、异步和回调方法
         for (size_t i = 0; i < service.methods.size(); i++) {
             const auto& method = service.methods[i];
+
+            // 单向方法：请求入队即返回，不等待响应，也不留下需要Receive取回的在途调用
+            if (method.oneway) {
+                output << "// " << method.name << " 是单向调用，返回的错误只反映请求是否入队\n";
+                output << "func (h *" << service.name << "Client) " << method.name << "(request *"
+                       << requestType(method) << ") error {\n";
+                output << "\th.client.CallbackSend(" << service.name << "_method_names[" << i
+                       << "], request, &mrpcNoReply{}, func(error) {})\n";
+                output << "\treturn nil\n";
+                output << "}\n\n";
+                continue;
+            }
             
             // 同步方法
             output << "func (h *" << service.name << "Client) " << method.name << 
-                     "(request *" << method.name << "Request) (";
+                     "(request *" << requestType(method) << ") (";
             
             auto first_response = method.response_params[0];
+            std::string first_field = capitalize(first_response.name);
+            std::string method_name = service.name + "_method_names[" + std::to_string(i) + "]";
+            std::string cache_field = "h." + uncapitalize(method.name) + "Cache";
+            std::string flight_field = "h." + uncapitalize(method.name) + "Flight";
             output << generateGoType(first_response.type) << ", error) {\n";
-            output << "\tresponse := &" << method.name << "Response{}\n";
-            output << "\terr := h.client.Send(" << service.name << "_method_names[" << 
-                     std::to_string(i) << "], request, response)\n";
-            output << "\treturn response." << capitalize(first_response.name) << ", err\n";
+            if (method.needsRequestKey()) {
+                output << "\trequestKey, err := request.ToString()\n";
+                output << "\tif err != nil {\n";
+                output << "\t\treturn " << responseType(method) << "{}." << first_field << ", err\n";
+                output << "\t}\n";
+                if (method.cache.enabled) {
+                    output << "\tif cached, ok := " << cache_field << ".Get(requestKey); ok {\n";
+                    output << "\t\treturn cached." << first_field << ", nil\n";
+                    output << "\t}\n";
+                }
+                if (method.coalesce) {
+                    output << "\tresponse, err := " << flight_field << ".Do(requestKey, func() ("
+                           << responseType(method) << ", error) {\n";
+                    output << "\t\tresult := " << responseType(method) << "{}\n";
+                    output << "\t\terr := "
+                           << windowedSend(method, "h.client.Send(" + method_name + ", request, &result)") << "\n";
+                    output << "\t\treturn result, err\n";
+                    output << "\t})\n";
+                } else {
+                    output << "\tresponse := " << responseType(method) << "{}\n";
+                    output << "\terr = "
+                           << windowedSend(method, "h.client.Send(" + method_name + ", request, &response)") << "\n";
+                }
+                if (method.cache.enabled) {
+                    output << "\tif err == nil {\n";
+                    output << "\t\t" << cache_field << ".Put(requestKey, response)\n";
+                    output << "\t}\n";
+                }
+                output << "\treturn response." << first_field << ", err\n";
+            } else {
+                // 出错时运行时可能仍持有response，此时不放回对象池
+                output << "\tresponse := " << poolFunc("Acquire", method.response) << "()\n";
+                output << "\terr := "
+                       << windowedSend(method, "h.client.Send(" + method_name + ", request, response)") << "\n";
+                output << "\tvalue := response." << first_field << "\n";
+                output << "\tif err == nil {\n";
+                output << "\t\t" << poolFunc("Release", method.response) << "(response)\n";
+                output << "\t}\n";
+                output << "\treturn value, err\n";
+            }
             output << "}\n\n";
             
             // 异步方法
             output << "func (h *" << service.name << "Client) Async" << method.name << 
-                     "(request *" << method.name << "Request) (string, error) {\n";
-            output << "\treturn h.client.AsyncSend(" << service.name << "_method_names[" << 
-                     std::to_string(i) << "], request)\n";
+                     "(request *" << requestType(method) << ") (string, error) {\n";
+            if (hasWindow(method)) {
+                // 占用的信用由ReceiveX归还
+                output << "\tif err := " << windowField(method) << ".acquire(); err != nil {\n";
+                output << "\t\treturn \"\", err\n";
+                output << "\t}\n";
+                output << "\tkey, err := h.client.AsyncSend(" << method_name << ", request)\n";
+                output << "\tif err != nil {\n";
+                output << "\t\t" << windowField(method) << ".release()\n";
+                output << "\t}\n";
+                output << "\treturn key, err\n";
+            } else {
+                output << "\treturn h.client.AsyncSend(" << method_name << ", request)\n";
+            }
             output << "}\n\n";
             
             // 回调方法
             output << "func (h *" << service.name << "Client) Callback" << method.name << 
-                     "(request *" << method.name << "Request, callback func(" << 
+                     "(request *" << requestType(method) << ", callback func(" << 
                      generateGoType(first_response.type) << ", error)) {\n";
-            output << "\tresponse := &" << method.name << "Response{}\n";
-            output << "\th.client.CallbackSend(" << service.name << "_method_names[" << 
-                     std::to_string(i) << "], request, response, func(err error) {\n";
-            output << "\t\tcallback(response." << capitalize(first_response.name) << ", err)\n";
-            output << "\t})\n";
+            if (method.needsRequestKey()) {
+                output << "\trequestKey, err := request.ToString()\n";
+                output << "\tif err != nil {\n";
+                output << "\t\tcallback(" << responseType(method) << "{}." << first_field << ", err)\n";
+                output << "\t\treturn\n";
+                output << "\t}\n";
+                if (method.cache.enabled) {
+                    output << "\tif cached, ok := " << cache_field << ".Get(requestKey); ok {\n";
+                    output << "\t\tcallback(cached." << first_field << ", nil)\n";
+                    output << "\t\treturn\n";
+                    output << "\t}\n";
+                }
+            }
+            if (method.coalesce) {
+                output << "\t" << flight_field << ".DoCallback(requestKey, func(done func("
+                       << responseType(method) << ", error)) {\n";
+                output << "\t\tresponse := &" << responseType(method) << "{}\n";
+                std::string in = openWindowStart(method, "\t\t");
+                output << in << "h.client.CallbackSend(" << method_name
+                       << ", request, response, func(err error) {\n";
+                releaseWindow(method, in + "\t");
+                output << in << "\tdone(*response, err)\n";
+                output << in << "})\n";
+                closeWindowStart(method, "\t\t", {"done(*response, err)"});
+                output << "\t}, func(response " << responseType(method) << ", err error) {\n";
+                if (method.cache.enabled) {
+                    output << "\t\tif err == nil {\n";
+                    output << "\t\t\t" << cache_field << ".Put(requestKey, response)\n";
+                    output << "\t\t}\n";
+                }
+                output << "\t\tcallback(response." << first_field << ", err)\n";
+                output << "\t})\n";
+            } else {
+                output << "\tresponse := " << poolFunc("Acquire", method.response) << "()\n";
+                std::string in = openWindowStart(method, "\t");
+                output << in << "h.client.CallbackSend(" << method_name
+                       << ", request, response, func(err error) {\n";
+                releaseWindow(method, in + "\t");
+                output << in << "\tvalue := response." << first_field << "\n";
+                output << in << "\tif err == nil {\n";
+                if (method.cache.enabled) {
+                    output << in << "\t\t" << cache_field << ".Put(requestKey, *response)\n";
+                }
+                output << in << "\t\t" << poolFunc("Release", method.response) << "(response)\n";
+                output << in << "\t}\n";
+                output << in << "\tcallback(value, err)\n";
+                output << in << "})\n";
+                closeWindowStart(method, "\t", {poolFunc("Release", method.response) + "(response)",
+                                                 "callback(" + responseType(method) + "{}." + first_field + ", err)"});
+            }
+            output << "}\n\n";
+
+            // 缓存失效与统计接口
+            if (method.cache.enabled) {
+                output << "func (h *" << service.name << "Client) Invalidate" << method.name <<
+                         "(request *" << requestType(method) << ") {\n";
+                output << "\tif cacheKey, err := request.ToString(); err == nil {\n";
+                output << "\t\t" << cache_field << ".Invalidate(cacheKey)\n";
+                output << "\t}\n";
+                output << "}\n\n";
+                output << "func (h *" << service.name << "Client) Invalidate" << method.name <<
+                         "Cache() {\n";
+                output << "\t" << cache_field << ".Clear()\n";
+                output << "}\n\n";
+                output << "func (h *" << service.name << "Client) " << method.name <<
+                         "CacheStats() MrpcCacheStats {\n";
+                output << "\treturn " << cache_field << ".Stats()\n";
+                output << "}\n\n";
+            }
+
+            // 请求合并统计接口
+            if (method.coalesce) {
+                output << "func (h *" << service.name << "Client) " << method.name <<
+                         "CoalescedCalls() uint64 {\n";
+                output << "\treturn " << flight_field << ".SharedCalls()\n";
+                output << "}\n\n";
+            }
+
+            if (hasWindow(method)) {
+                output << "func (h *" << service.name << "Client) " << method.name <<
+                         "WindowStats() MrpcWindowStats {\n";
+                output << "\treturn " << windowField(method) << ".stats()\n";
+                output << "}\n\n";
+            }
+        }
+
+        // 窗口策略对本客户端的全部窗口生效
+        if (hasWindows()) {
+            output << "// SetWindowPolicy 设置在途窗口满时的处理策略，默认MrpcWindowBlock\n";
+            output << "func (h *" << service.name << "Client) SetWindowPolicy(policy MrpcWindowPolicy) {\n";
+            if (usesStubWindow()) output << "\th.window.setPolicy(policy)\n";
+            for (const auto& method : service.methods) {
+                if (!hasWindow(method) || method.max_in_flight == 0) continue;
+                output << "\th." << uncapitalize(method.name) << "Window.setPolicy(policy)\n";
+            }
             output << "}\n\n";
         }
         
-        // 生成Receive方法
-        if (service.methods.size() > 1) {
+        // 生成类型化的ReceiveX方法，返回完整响应，调用方用完后可Release放回对象池
+        for (const auto& method : service.methods) {
+            if (method.oneway) continue;
+            output << "func (h *" << service.name << "Client) Receive" << method.name
+                   << "(key string) (*" << responseType(method) << ", error) {\n";
+            output << "\tresponse := " << poolFunc("Acquire", method.response) << "()\n";
+            if (hasWindow(method)) {
+                output << "\terr := h.client.Receive(key, response)\n";
+                output << "\t" << windowField(method) << ".release()\n";
+                output << "\tif err != nil {\n";
+            } else {
+                output << "\tif err := h.client.Receive(key, response); err != nil {\n";
+            }
+            output << "\t\treturn nil, err\n";
+            output << "\t}\n";
+            output << "\treturn response, nil\n";
+            output << "}\n\n";
+        }
+
+        // 生成Receive方法：保留旧签名，只返回第一个字段
+        auto receiveFirstField = [&](const Method& method, const std::string& indent) {
+            const auto& first_response = method.response_params[0];
+            std::string value = "response." + capitalize(first_response.name);
+            if (generateGoType(first_response.type) != "string") {
+                value = "fmt.Sprint(" + value + ")";
+            }
+            output << indent << "response, err := h.Receive" << method.name << "(key)\n";
+            output << indent << "if err != nil {\n";
+            output << indent << "\treturn \"\", err\n";
+            output << indent << "}\n";
+            output << indent << "value := " << value << "\n";
+            output << indent << "" << poolFunc("Release", method.response) << "(response)\n";
+            output << indent << "return value, nil\n";
+        };
+        // 全部为单向方法时没有可取回的响应
+        if (hasReplyMethods() && service.methods.size() > 1) {
+            output << "// Deprecated: 只返回第一个字段，使用ReceiveX获取完整响应\n";
             output << "func (h *" << service.name << "Client) Receive(key string, methodIndex int) (string, error) {\n";
             output << "\tswitch methodIndex {\n";
             for (size_t i = 0; i < service.methods.size(); i++) {
-                const auto& method = service.methods[i];
+                if (service.methods[i].oneway) continue;
                 output << "\tcase " << std::to_string(i) << ":\n";
-                output << "\t\tresponse := &" << method.name << "Response{}\n";
-                output << "\t\terr := h.client.Receive(key, response)\n";
-                auto first_response = method.response_params[0];
-                output << "\t\treturn response." << capitalize(first_response.name) << ", err\n";
+                receiveFirstField(service.methods[i], "\t\t");
             }
             output << "\tdefault:\n";
             output << "\t\treturn \"\", fmt.Errorf(\"unknown method index: %d\", methodIndex)\n";
             output << "\t}\n";
             output << "}\n\n";
-        } else {
+        } else if (hasReplyMethods()) {
             const auto& method = service.methods[0];
+            output << "// Deprecated: 只返回第一个字段，使用Receive" << method.name << "获取完整响应\n";
             output << "func (h *" << service.name << "Client) Receive(key string) (string, error) {\n";
-            output << "\tresponse := &" << method.name << "Response{}\n";
-            output << "\terr := h.client.Receive(key, response)\n";
-            auto first_response = method.response_params[0];
-            output << "\treturn response." << capitalize(first_response.name) << ", err\n";
+            receiveFirstField(method, "\t");
             output << "}\n\n";
         }
-        
+
         // 生成Close方法
         output << "func (h *" << service.name << "Client) Close() {\n";
         output << "\th.client.Close()\n";
@@ -174,11 +2077,22 @@ private:
             const auto& method = service.methods[i];
             output << "\tsvc.AddHandler(\n";
             output << "\t\t" << service.name << "_method_names[" << i << "],\n";
-            output << "\t\tfunc() mrpc.Parser { return &" << method.name << "Request{} },\n";
-            output << "\t\tfunc() mrpc.Parser { return &" << method.name << "Response{} },\n";
+            output << "\t\tfunc() mrpc.Parser { return &" << requestType(method) << "{} },\n";
+            // 单向方法没有响应，回送的确认为空
+            if (method.oneway) {
+                output << "\t\tfunc() mrpc.Parser { return &mrpcNoReply{} },\n";
+                output << "\t\tfunc(request mrpc.Parser, _ mrpc.Parser) error {\n";
+                output << "\t\t\treq := request.(*" << requestType(method) << ")\n";
+                output << "\t\t\t_ = req\n";
+                output << "\t\t\treturn nil\n";
+                output << "\t\t},\n";
+                output << "\t)\n";
+                continue;
+            }
+            output << "\t\tfunc() mrpc.Parser { return &" << responseType(method) << "{} },\n";
             output << "\t\tfunc(request mrpc.Parser, response mrpc.Parser) error {\n";
-            output << "\t\t\treq := request.(*" << method.name << "Request)\n";
-            output << "\t\t\tresp := response.(*" << method.name << "Response)\n";
+            output << "\t\t\treq := request.(*" << requestType(method) << ")\n";
+            output << "\t\t\tresp := response.(*" << responseType(method) << ")\n";
             
             // 生成默认实现
             if (method.name == "SayHello") {
@@ -192,6 +2106,8 @@ private:
                 }
             } else if (method.name == "SayGoodbye") {
                 output << "\t\t\tresp.Message = \"Goodbye \" + req.Name\n";
+            } else {
+                output << "\t\t\t_, _ = req, resp\n";
             }
             
             output << "\t\t\treturn nil\n";
@@ -212,34 +2128,250 @@ private:
         output << "}";
     }
 
+    // 生成编解码微基准与往返模糊测试，输出为同包的_test.go文件
+    std::string generateCodecTests() {
+        std::stringstream ss;
+        std::vector<Message> messages = messageTypes();
+        std::set<std::string> imports = {"fmt", "testing"};
+        for (const auto& message : messages) {
+            for (const auto& param : message.params) {
+                if (param.type == "float") imports.insert("math");
+                if (param.type == "string") imports.insert({"strings", "unicode/utf8"});
+            }
+        }
+
+        ss << "// " << service.name << " 编解码微基准与往返模糊测试，由GoStubGenerator生成\n";
+        ss << "// 基准: go test -bench . -benchmem\n";
+        ss << "// 模糊: go test -fuzz FuzzSayHelloRequest 形式逐个运行\n";
+        ss << "package " << yaml_filename << "\n\n";
+        ss << "import (\n";
+        for (const auto& path : imports) {
+            ss << "\t\"" << path << "\"\n";
+        }
+        ss << ")\n\n";
+        ss << "var mrpcBenchSizes = []int{16, 256, 4096}\n\n";
+
+        // 通用的基准流程：编码、解码和往返三个子基准
+        ss << R"(type mrpcCodec interface {
+	ToString() (string, error)
+	FromString(data string) error
+}
+
+func mrpcBenchCodec[T any, P interface {
+	*T
+	mrpcCodec
+}](b *testing.B, size int, msg P) {
+	data, err := msg.ToString()
+	if err != nil {
+		b.Fatal(err)
+	}
+	b.Run(fmt.Sprintf("encode/%d", size), func(b *testing.B) {
+		b.ReportAllocs()
+		b.SetBytes(int64(len(data)))
+		for i := 0; i < b.N; i++ {
+			if _, err := msg.ToString(); err != nil {
+				b.Fatal(err)
+			}
+		}
+	})
+	b.Run(fmt.Sprintf("decode/%d", size), func(b *testing.B) {
+		b.ReportAllocs()
+		b.SetBytes(int64(len(data)))
+		for i := 0; i < b.N; i++ {
+			if err := P(new(T)).FromString(data); err != nil {
+				b.Fatal(err)
+			}
+		}
+	})
+	b.Run(fmt.Sprintf("roundtrip/%d", size), func(b *testing.B) {
+		b.ReportAllocs()
+		b.SetBytes(int64(len(data)))
+		for i := 0; i < b.N; i++ {
+			encoded, err := msg.ToString()
+			if err != nil {
+				b.Fatal(err)
+			}
+			if err := P(new(T)).FromString(encoded); err != nil {
+				b.Fatal(err)
+			}
+		}
+	})
+}
+
+// 任意输入都不应导致panic；能解码的输入再次往返后必须稳定
+func mrpcFuzzDecode[T comparable, P interface {
+	*T
+	mrpcCodec
+}](t *testing.T, data string) {
+	first := P(new(T))
+	if err := first.FromString(data); err != nil {
+		return
+	}
+	encoded, err := first.ToString()
+	if err != nil {
+		t.Fatal(err)
+	}
+	second := P(new(T))
+	if err := second.FromString(encoded); err != nil {
+		t.Fatalf("re-decode %q: %v", encoded, err)
+	}
+	if *first != *second {
+		t.Fatalf("unstable round trip: %+v != %+v", *first, *second)
+	}
+}
+
+)";
+        for (const auto& message : messages) {
+            const std::string& name = message.name;
+            // 基准：按不同负载大小填充字段
+            ss << "func Benchmark" << name << "(b *testing.B) {\n";
+            ss << "\tfor _, size := range mrpcBenchSizes {\n";
+            ss << "\t\tmsg := &" << name << "{";
+            if (message.params.empty()) {
+                ss << "}\n";
+                ss << "\t\tmrpcBenchCodec(b, size, msg)\n";
+            } else {
+                ss << "\n";
+                for (const auto& param : message.params) {
+                    ss << "\t\t\t" << capitalize(param.name) << ": ";
+                    if (param.type == "string") ss << "strings.Repeat(\"x\", size)";
+                    else if (param.type == "int") ss << "size";
+                    else if (param.type == "float") ss << "float64(size) * 1.5";
+                    else if (param.type == "bool") ss << "true";
+                    else ss << "strings.Repeat(\"x\", size)";
+                    ss << ",\n";
+                }
+                ss << "\t\t}\n";
+                ss << "\t\tmrpcBenchCodec(b, size, msg)\n";
+            }
+            ss << "\t}\n";
+            ss << "}\n\n";
+
+            // 模糊：以随机字段值构造消息，编码后解码必须逐字段相等
+            if (!message.params.empty()) {
+                ss << "func Fuzz" << name << "(f *testing.F) {\n";
+                for (const char* seed : {"zero", "value"}) {
+                    bool zero = std::string(seed) == "zero";
+                    ss << "\tf.Add(";
+                    for (size_t i = 0; i < message.params.size(); ++i) {
+                        const auto& param = message.params[i];
+                        if (i > 0) ss << ", ";
+                        if (param.type == "int") ss << (zero ? "0" : "-42");
+                        else if (param.type == "float") ss << (zero ? "0.0" : "3.25");
+                        else if (param.type == "bool") ss << (zero ? "false" : "true");
+                        else ss << (zero ? "\"\"" : "\"he said \\\"hi\\\"\\n\\u4e2d\"");
+                    }
+                    ss << ")\n";
+                }
+                ss << "\tf.Fuzz(func(t *testing.T";
+                for (const auto& param : message.params) {
+                    ss << ", " << uncapitalize(param.name) << " " << generateGoType(param.type);
+                }
+                ss << ") {\n";
+                // 非法UTF-8会被替换、NaN/Inf无法编码，这些输入不参与往返比较
+                for (const auto& param : message.params) {
+                    std::string var = uncapitalize(param.name);
+                    if (param.type == "float") {
+                        ss << "\t\tif math.IsNaN(" << var << ") || math.IsInf(" << var << ", 0) {\n";
+                        ss << "\t\t\tt.Skip()\n";
+                        ss << "\t\t}\n";
+                    } else if (generateGoType(param.type) == "string") {
+                        ss << "\t\tif !utf8.ValidString(" << var << ") {\n";
+                        ss << "\t\t\tt.Skip()\n";
+                        ss << "\t\t}\n";
+                    }
+                }
+                ss << "\t\tin := " << name << "{";
+                for (size_t i = 0; i < message.params.size(); ++i) {
+                    if (i > 0) ss << ", ";
+                    ss << capitalize(message.params[i].name) << ": " << uncapitalize(message.params[i].name);
+                }
+                ss << "}\n";
+                ss << "\t\tdata, err := in.ToString()\n";
+                ss << "\t\tif err != nil {\n";
+                ss << "\t\t\tt.Fatal(err)\n";
+                ss << "\t\t}\n";
+                ss << "\t\tvar out " << name << "\n";
+                ss << "\t\tif err := out.FromString(data); err != nil {\n";
+                ss << "\t\t\tt.Fatalf(\"decode %q: %v\", data, err)\n";
+                ss << "\t\t}\n";
+                ss << "\t\tif in != out {\n";
+                ss << "\t\t\tt.Fatalf(\"round trip mismatch: %+v != %+v\", in, out)\n";
+                ss << "\t\t}\n";
+                ss << "\t})\n";
+                ss << "}\n\n";
+            }
+
+            ss << "func Fuzz" << name << "FromString(f *testing.F) {\n";
+            ss << "\tf.Add(\"{}\")\n";
+            ss << "\tf.Add(\"not json\")\n";
+            ss << "\tf.Fuzz(mrpcFuzzDecode[" << name << "])\n";
+            ss << "}\n";
+            if (&message != &messages.back()) ss << "\n";
+        }
+        return ss.str();
+    }
+
 public:
     GoStubGenerator(const std::string& yaml_path) 
         : StubGeneratorBase(yaml_path) {}
 
     bool generate(const std::string& output_path) override {
-        // 生成包声明和导入
-        output << "package " << yaml_filename << "\n\n";
-        output << "import (\n";
-        output << "\t\"encoding/json\"\n";
-        output << "\t\"fmt\"\n";
-        output << "\t\"mrpc\"\n";
-        output << ")\n\n";
-        
-        generateMethodNames();
+        if (options.shm) {
+            std::cerr << "--shm is only supported by the C++ generator" << std::endl;
+            return false;
+        }
+        if (options.scatter_gather) {
+            std::cerr << "--scatter-gather is only supported by the C++ generator" << std::endl;
+            return false;
+        }
+        if (!options.descriptor_runtime_path.empty()) {
+            std::cerr << "--descriptor-runtime is only supported by the C++ generator" << std::endl;
+            return false;
+        }
+        // Go只能按包路径导入，引入的IDL必须声明go_package
+        for (const auto& imported : usedImports()) {
+            if (imported.go_package.empty()) {
+                std::cerr << "Imported IDL " << imported.path << " has no go_package" << std::endl;
+                return false;
+            }
+        }
+        // 只定义消息的IDL没有存根可生成，也就不需要连接池
+        if (!hasService()) options.pool = false;
+        generateImports();
+        if (hasService()) generateMethodNames();
+        generateCacheHelper();
+        generateFlightHelper();
+        generatePoolHelper();
+        generateWindowHelper();
+        generateHedgeHelper();
+        generateShardHelper();
+        generateNoReplyHelper();
+        generateCodecHelper();
         generateStructs();
-        generateClient();
-        output << "\n";
-        generateService();
+        if (hasService()) {
+            generateClient();
+            output << "\n";
+            if (options.pool) {
+                generatePoolClient();
+                output << "\n";
+            }
+            if (hasShardedMethods()) {
+                generateShardedClient();
+                output << "\n";
+            }
+            generateService();
+        }
         
         // 写入文件
-        std::ofstream out_file(output_path);
-        if (!out_file) {
-            std::cerr << "Failed to open output file: " << output_path << std::endl;
+        if (!writeFile(output_path, output.str())) {
+            return false;
+        }
+
+        if (!options.codec_tests_path.empty() &&
+            !writeFile(options.codec_tests_path, generateCodecTests())) {
             return false;
         }
-        
-        out_file << output.str();
-        out_file.close();
         return true;
     }
 };
@@ -247,13 +2379,18 @@ public:
 } // namespace generator
 } // namespace mrpc
 
+// 生成守护进程把各语言生成器编进同一个程序时关闭各自的入口
+#ifndef MRPC_GENERATOR_NO_MAIN
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <input.yaml> <output.go>" << std::endl;
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <input.yaml> <output.go> [--pool] [--codec-tests <codec_test.go>] [--depfile <file.d>] [--descriptor <file.mrpcd>]" << std::endl;
         return 1;
     }
     
     mrpc::generator::GoStubGenerator generator(argv[1]);
+    if (!generator.parseOptions(argc, argv, 3)) {
+        return 1;
+    }
     if (!generator.parseYaml(argv[1])) {
         std::cerr << "Failed to parse YAML file" << std::endl;
         return 1;
@@ -263,7 +2400,14 @@ int main(int argc, char* argv[]) {
         std::cerr << "Failed to generate stub file" << std::endl;
         return 1;
     }
+    if (!generator.writeDepfile(argv[2])) {
+        return 1;
+    }
+    if (!generator.writeDescriptor()) {
+        return 1;
+    }
 
     std::cout << "Successfully generated Go stub at: " << argv[2] << std::endl;
     return 0;
-} 
\ No newline at end of file
+}
+#endif
@@ -21,11 +21,702 @@ private:
     // 生成固定的导入语句
     void generateImports() {
         output << "import mrpc\n";
+        // 引入的IDL生成为同目录下的<name>_mrpc模块
+        for (const auto& imported : usedImports()) {
+            output << "import " << imported.name << "_mrpc\n";
+        }
         output << "import json\n";
+        output << "import struct\n";
+        if (options.pool) {
+            output << "import random\n";
+        }
+        if (hasShardedMethods()) {
+            output << "import itertools\n";
+        }
+        if (hasHedgedMethods()) {
+            output << "import queue\n";
+        }
+        if (hasCachedMethods() || hasCoalescedMethods() || options.pool || hasWindows()) {
+            output << "import threading\n";
+        }
+        if (hasCachedMethods() || options.pool) {
+            output << "import time\n";
+        }
+        if (hasCachedMethods() && hasWindows()) {
+            output << "from collections import OrderedDict, deque\n";
+        } else if (hasCachedMethods()) {
+            output << "from collections import OrderedDict\n";
+        } else if (hasWindows()) {
+            output << "from collections import deque\n";
+        }
         output << "from typing import Callable, Optional\n\n";  // 添加了 Optional
         output << "Callback = Callable[[str, Exception | None], None]\n\n\n";
     }
 
+    // 生成分片加锁的LRU响应缓存，仅在存在cache注解时输出
+    void generateCacheHelper() {
+        if (!hasCachedMethods()) return;
+        output << R"(class _MrpcResponseCache:
+    """分片加锁的LRU响应缓存，键为编码后的请求"""
+
+    _SHARDS = 16
+
+    def __init__(self, ttl_ms: int, max_entries: int):
+        self._ttl = ttl_ms / 1000.0
+        self._capacity = max(1, (max_entries + self._SHARDS - 1) // self._SHARDS)
+        self._locks = [threading.Lock() for _ in range(self._SHARDS)]
+        self._shards = [OrderedDict() for _ in range(self._SHARDS)]
+        self._stats = {"hits": 0, "misses": 0, "evictions": 0, "expirations": 0, "invalidations": 0}
+
+    def get(self, key: str):
+        index = hash(key) % self._SHARDS
+        with self._locks[index]:
+            shard = self._shards[index]
+            entry = shard.get(key)
+            if entry is None:
+                self._stats["misses"] += 1
+                return None
+            if entry[1] <= time.monotonic():
+                del shard[key]
+                self._stats["expirations"] += 1
+                self._stats["misses"] += 1
+                return None
+            shard.move_to_end(key)
+            self._stats["hits"] += 1
+            return entry[0]
+
+    def put(self, key: str, value):
+        index = hash(key) % self._SHARDS
+        with self._locks[index]:
+            shard = self._shards[index]
+            if key in shard:
+                shard.move_to_end(key)
+            elif len(shard) >= self._capacity:
+                shard.popitem(last=False)
+                self._stats["evictions"] += 1
+            shard[key] = (value, time.monotonic() + self._ttl)
+
+    def invalidate(self, key: str):
+        index = hash(key) % self._SHARDS
+        with self._locks[index]:
+            if self._shards[index].pop(key, None) is not None:
+                self._stats["invalidations"] += 1
+
+    def clear(self):
+        for lock, shard in zip(self._locks, self._shards):
+            with lock:
+                self._stats["invalidations"] += len(shard)
+                shard.clear()
+
+    def stats(self) -> dict:
+        stats = dict(self._stats)
+        stats["size"] = sum(len(shard) for shard in self._shards)
+        return stats
+
+
+)";
+    }
+
+    // 生成请求合并辅助类，仅在存在coalesce注解时输出
+    void generateFlightHelper() {
+        if (!hasCoalescedMethods()) return;
+        output << R"(class _MrpcFlight:
+    __slots__ = ("event", "result", "error", "callbacks")
+
+    def __init__(self):
+        self.event = threading.Event()
+        self.result = None
+        self.error = None
+        self.callbacks = []
+
+
+class _MrpcSingleFlight:
+    """合并在途的相同请求：同一请求已发出时，后来者挂到首个调用上并共享其响应"""
+
+    def __init__(self):
+        self._lock = threading.Lock()
+        self._flights = {}
+        self.shared_calls = 0
+
+    def do(self, key: str, fn):
+        with self._lock:
+            flight = self._flights.get(key)
+            leader = flight is None
+            if leader:
+                flight = self._flights[key] = _MrpcFlight()
+            else:
+                self.shared_calls += 1
+        if not leader:
+            flight.event.wait()
+            if flight.error is not None:
+                raise flight.error
+            return flight.result
+        try:
+            result = fn()
+        except Exception as e:
+            flight.error = e
+            self._finish(key, flight, (None, e))
+            raise
+        self._finish(key, flight, result)
+        return result
+
+    def do_callback(self, key: str, start, callback):
+        with self._lock:
+            flight = self._flights.get(key)
+            if flight is not None:
+                flight.callbacks.append(callback)
+                self.shared_calls += 1
+                return
+            flight = self._flights[key] = _MrpcFlight()
+            flight.callbacks.append(callback)
+        start(lambda response, err: self._finish(key, flight, (response, err)))
+
+    def _finish(self, key: str, flight: _MrpcFlight, result):
+        with self._lock:
+            del self._flights[key]
+            flight.result = result
+            callbacks, flight.callbacks = flight.callbacks, []
+        flight.event.set()
+        for callback in callbacks:
+            callback(*result)
+
+
+)";
+    }
+
+    // 生成连接池辅助类，仅在开启--pool时输出
+    void generatePoolHelper() {
+        if (!options.pool) return;
+        output << R"(MRPC_ROUND_ROBIN = "round_robin"
+MRPC_LEAST_OUTSTANDING = "least_outstanding"
+MRPC_POWER_OF_TWO_CHOICES = "power_of_two_choices"
+
+
+class _MrpcChannel:
+    __slots__ = ("addr", "client", "outstanding", "failures", "ejected_until")
+
+    def __init__(self, addr: str, client):
+        self.addr = addr
+        self.client = client
+        self.outstanding = 0
+        self.failures = 0
+        self.ejected_until = 0.0
+
+
+class _MrpcChannelPool:
+    """多端点、多连接的通道池：按策略选出健康的连接，连续失败的连接会被暂时摘除"""
+
+    def __init__(self, addrs: list[str], connections_per_addr: int, policy: str, dial,
+                 max_failures: int = 3, eject_seconds: float = 1.0):
+        self._policy = policy
+        self._max_failures = max_failures
+        self._eject_seconds = eject_seconds
+        self._lock = threading.Lock()
+        self._next = 0
+        self.channels = [_MrpcChannel(addr, dial(addr))
+                         for addr in addrs for _ in range(max(1, connections_per_addr))]
+
+    def pick(self) -> int:
+        """选出一条连接并占用一个在途名额，调用结束后必须release"""
+        now = time.monotonic()
+        with self._lock:
+            index = self._select(now)
+            self.channels[index].outstanding += 1
+            return index
+
+    def pick_except(self, used: list[int]) -> int:
+        """对冲的备份调用尽量发往尚未使用的健康连接，找不到时退化为pick"""
+        now = time.monotonic()
+        with self._lock:
+            index = self._select(now)
+            for step in range(1, len(self.channels)):
+                if index not in used:
+                    break
+                candidate = (index + step) % len(self.channels)
+                if candidate not in used and self.channels[candidate].ejected_until <= now:
+                    index = candidate
+            self.channels[index].outstanding += 1
+            return index
+
+    def _select(self, now: float) -> int:
+        n = len(self.channels)
+        start = self._next % n
+        self._next += 1
+        if self._policy == MRPC_POWER_OF_TWO_CHOICES and n > 1:
+            a, b = random.sample(range(n), 2)
+            a_ok = self.channels[a].ejected_until <= now
+            b_ok = self.channels[b].ejected_until <= now
+            if a_ok and b_ok:
+                return a if self.channels[a].outstanding <= self.channels[b].outstanding else b
+            if a_ok or b_ok:
+                return a if a_ok else b
+        # 轮询或最少在途：从轮转起点扫描健康连接，全部不健康时退化为不过滤
+        best = -1
+        for k in range(n):
+            index = (start + k) % n
+            if self.channels[index].ejected_until > now:
+                continue
+            if self._policy == MRPC_ROUND_ROBIN:
+                return index
+            if best < 0 or self.channels[index].outstanding < self.channels[best].outstanding:
+                best = index
+        return start if best < 0 else best
+
+    def release(self, index: int, err):
+        with self._lock:
+            channel = self.channels[index]
+            channel.outstanding -= 1
+            if err is None:
+                channel.failures = 0
+                return
+            channel.failures += 1
+            if channel.failures >= self._max_failures:
+                channel.ejected_until = time.monotonic() + self._eject_seconds
+                channel.failures = 0
+
+    def stats(self) -> list[dict]:
+        now = time.monotonic()
+        with self._lock:
+            return [{"addr": c.addr, "outstanding": c.outstanding, "consecutive_failures": c.failures,
+                     "healthy": c.ejected_until <= now} for c in self.channels]
+
+
+)";
+    }
+
+    // 生成在途窗口，仅在存在max_in_flight注解时输出
+    void generateWindowHelper() {
+        if (!hasWindows()) return;
+        output << R"(MRPC_WINDOW_BLOCK = "block"  # 阻塞调用方，直到有调用完成归还信用
+MRPC_WINDOW_FAIL_FAST = "fail_fast"  # 立即返回MrpcWindowFullError
+MRPC_WINDOW_AWAIT = "await"  # 回调方式的调用挂起，有信用归还时再发出；同步和异步调用等同block
+
+
+class MrpcWindowFullError(Exception):
+    """在途窗口已满，或挂起的调用也已达上限"""
+
+
+class _MrpcWindow:
+    """基于信用的在途调用窗口：每个发出的调用占用一个信用，完成后归还；挂起的调用也以容量为上限"""
+
+    def __init__(self, capacity: int):
+        self.capacity = max(1, capacity)
+        self.policy = MRPC_WINDOW_BLOCK
+        self._cond = threading.Condition()
+        self._in_flight = 0
+        self._rejected = 0
+        self._parked = deque()
+
+    def _reject(self) -> Exception:
+        self._rejected += 1
+        return MrpcWindowFullError("in-flight window is full")
+
+    def acquire(self) -> Exception | None:
+        """占用一个信用；fail_fast在窗口满时立即失败，其余策略阻塞等待"""
+        with self._cond:
+            if self._in_flight >= self.capacity and self.policy == MRPC_WINDOW_FAIL_FAST:
+                return self._reject()
+            while self._in_flight >= self.capacity:
+                self._cond.wait()
+            self._in_flight += 1
+        return None
+
+    def call(self, send, *args) -> Exception | None:
+        err = self.acquire()
+        if err is not None:
+            return err
+        try:
+            return send(*args)
+        finally:
+            self.release()
+
+    def callback(self, send, args: tuple, done):
+        """回调方式的调用：完成时先归还信用再调用done，被拒绝时直接以错误调用done"""
+        def on_done(err):
+            self.release()
+            done(err)
+
+        err = self._admit(lambda: send(*args, on_done))
+        if err is not None:
+            done(err)
+
+    def _admit(self, run) -> Exception | None:
+        """有信用时立即执行run；窗口满时按策略拒绝、挂起或阻塞"""
+        with self._cond:
+            if self._in_flight >= self.capacity:
+                if self.policy == MRPC_WINDOW_FAIL_FAST or (
+                        self.policy == MRPC_WINDOW_AWAIT and len(self._parked) >= self.capacity):
+                    return self._reject()
+                if self.policy == MRPC_WINDOW_AWAIT:
+                    self._parked.append(run)
+                    return None
+                while self._in_flight >= self.capacity:
+                    self._cond.wait()
+            self._in_flight += 1
+        run()
+        return None
+
+    def release(self):
+        """归还一个信用；有挂起的调用时信用直接转交给最早挂起的那个，由当前线程发出"""
+        with self._cond:
+            if not self._parked:
+                self._in_flight -= 1
+                self._cond.notify()
+                return
+            run = self._parked.popleft()
+        run()
+
+    def stats(self) -> dict:
+        with self._cond:
+            return {"capacity": self.capacity, "in_flight": self._in_flight,
+                    "parked": len(self._parked), "rejected": self._rejected}
+
+
+)";
+        if (options.pool) {
+            output << R"(def _mrpc_channel_err(err):
+    """窗口满是本地的背压，不计为连接失败"""
+    return None if isinstance(err, MrpcWindowFullError) else err
+
+
+)";
+        }
+    }
+
+    // 生成对冲调用的辅助类，仅在连接池中存在hedge注解时输出
+    void generateHedgeHelper() {
+        if (!hasHedgedMethods()) return;
+        output << R"(class _MrpcHedgePolicy:
+    """对冲阈值与统计：阈值为固定时长，或最近若干次尝试延迟的分位数"""
+
+    _SAMPLES = 512  # 按分位数对冲时保留的最近延迟样本数
+    _MIN_SAMPLES = 64  # 样本少于此数时不对冲
+    _RECOMPUTE = 32  # 每收到这么多样本重新计算一次阈值
+
+    def __init__(self, after_ms: int, after_percentile: float, max_extra: int):
+        self.percentile = after_percentile
+        self.max_extra = max_extra
+        self.threshold = -1.0 if after_percentile > 0 else after_ms / 1000.0  # 秒，样本不足时为-1
+        self._lock = threading.Lock()
+        self._samples = [0.0] * self._SAMPLES
+        self._recorded = 0
+        self._calls = 0
+        self._hedges = 0
+        self._wins = 0
+
+    def record(self, latency: float):
+        if self.percentile <= 0:
+            return
+        with self._lock:
+            self._samples[self._recorded % self._SAMPLES] = latency
+            self._recorded += 1
+            count = min(self._recorded, self._SAMPLES)
+            if count < self._MIN_SAMPLES or self._recorded % self._RECOMPUTE != 0:
+                return
+            ordered = sorted(self._samples[:count])
+            self.threshold = ordered[min(count - 1, int(count * self.percentile / 100))]
+
+    def count(self, calls: int = 0, hedges: int = 0, wins: int = 0):
+        with self._lock:
+            self._calls += calls
+            self._hedges += hedges
+            self._wins += wins
+
+    def stats(self) -> dict:
+        """hedges/calls即对冲带来的额外负载"""
+        with self._lock:
+            threshold_us = int(self.threshold * 1e6) if self.threshold >= 0 else -1
+            return {"calls": self._calls, "hedges": self._hedges, "hedge_wins": self._wins,
+                    "threshold_us": threshold_us}
+
+
+def _mrpc_hedge(pool, policy: _MrpcHedgePolicy, send, channel_err=None) -> tuple:
+    """先在一条连接上调用，超过阈值仍未返回时换一条连接发出备份调用，最多max_extra个。
+    send(client, done)以回调方式发出调用，返回胜出调用的回调参数，最后一个是错误。
+    第一个成功的结果胜出；运行时没有取消接口，落后的调用照常完成，结果被丢弃。
+    失败的调用只在没有其他调用在途时才作为结果"""
+    results = queue.Queue()
+    used = []
+
+    def launch(hedge: bool) -> float:
+        index = pool.pick_except(used)
+        used.append(index)
+        start = time.monotonic()
+
+        def on_done(*args):
+            policy.record(time.monotonic() - start)
+            err = args[-1]
+            pool.release(index, err if channel_err is None else channel_err(err))
+            results.put((args, hedge))
+
+        send(pool.channels[index].client, on_done)
+        return start
+
+    policy.count(calls=1)
+    last = launch(False)
+    pending = 1
+    while True:
+        # 从最近一次调用发出时开始计时下一次对冲
+        timeout = None
+        if len(used) <= policy.max_extra and policy.threshold >= 0:
+            timeout = max(0.0, last + policy.threshold - time.monotonic())
+        try:
+            args, hedge = results.get(timeout=timeout)
+        except queue.Empty:
+            policy.count(hedges=1)
+            last = launch(True)
+            pending += 1
+            continue
+        pending -= 1
+        if args[-1] is None or pending == 0:
+            if args[-1] is None and hedge:
+                policy.count(wins=1)
+            return args
+
+
+)";
+    }
+
+    // 方法占用的窗口：配置了方法级窗口时用自己的，否则共用客户端级窗口
+    std::string windowField(const Method& method) const {
+        return method.max_in_flight > 0 ? "self._" + method.name + "_window" : "self._window";
+    }
+
+    std::string channelErr(const Method& method, const std::string& err) const {
+        return hasWindow(method) ? "_mrpc_channel_err(" + err + ")" : err;
+    }
+
+    // 单向方法在运行时中仍要登记一个响应类型，仅在存在oneway注解时输出
+    void generateNoReplyHelper() {
+        if (!hasOnewayMethods()) return;
+        output << R"(class _MrpcNoReply(mrpc.Parser):
+    """单向方法的占位响应：不含字段，服务端回送的确认直接丢弃"""
+    __slots__ = ()
+
+    def toString(self) -> str:
+        return "null"
+
+    def fromString(self, data: str):
+        pass
+
+    def toBytes(self) -> bytes:
+        return b""
+
+    def fromBytes(self, data: bytes):
+        pass
+
+
+# 不含状态，各次单向调用共用
+_MRPC_NO_REPLY = _MrpcNoReply()
+
+
+)";
+    }
+
+    // 生成分片键哈希，仅在存在shard_key注解时输出
+    void generateShardHelper() {
+        if (!hasShardedMethods()) return;
+        output << R"(def _mrpc_shard_of(key, shards: int) -> int:
+    """分片键的哈希：对键的文本形式（字符串取UTF-8字节，整数取十进制，布尔取true/false）做FNV-1a 64后取模，
+    与C++、Go的存根和服务选出的分片一致"""
+    if isinstance(key, bool):
+        key = "true" if key else "false"
+    h = 0xCBF29CE484222325
+    for b in str(key).encode("utf-8"):
+        h = ((h ^ b) * 0x100000001B3) & 0xFFFFFFFFFFFFFFFF
+    return h % shards
+
+
+)";
+    }
+
+    // 生成分片客户端：addrs[i]为注册了C++ ShardedService::Endpoint(i)的地址，带分片键的方法按键的哈希
+    // 对地址数取模直接选择分片的连接，没有分片键的方法轮流使用各连接
+    void generateShardedClient() {
+        std::string sharded_client = service.name + "ShardedClient";
+        output << "class " << sharded_client << ":\n";
+        output << "    \"\"\"addrs[i]须是注册了" << service.name
+               << "ShardedService::Endpoint(i)的服务器地址，顺序与分片一致\"\"\"\n\n";
+        output << "    def __init__(self, addrs: list[str]):\n";
+        output << "        self._clients = [" << service.name << "Client(addr) for addr in addrs]\n";
+        output << "        self._next = itertools.count()\n\n";
+        output << "    def Shards(self) -> int:\n";
+        output << "        return len(self._clients)\n";
+
+        for (const auto& method : service.methods) {
+            std::string shard = method.shard_key.empty()
+                                    ? "next(self._next) % len(self._clients)"
+                                    : "_mrpc_shard_of(request." + method.shard_key + ", len(self._clients))";
+            if (method.oneway) {
+                output << "\n    def " << method.name << "(self, request: " << requestType(method)
+                       << ") -> Exception | None:\n";
+                output << "        return self._clients[" << shard << "]." << method.name << "(request)\n";
+                continue;
+            }
+
+            output << "\n    def " << method.name << "(self, request: " << requestType(method)
+                   << ") -> tuple[" << valueType(method) << ", Exception | None]:\n";
+            output << "        return self._clients[" << shard << "]." << method.name << "(request)\n";
+
+            // 异步方法，key中带上分片序号以便Receive找回连接
+            output << "\n    def Async" << method.name << "(self, request: " << requestType(method)
+                   << ") -> tuple[str, Exception | None]:\n";
+            output << "        index = " << shard << "\n";
+            output << "        key, err = self._clients[index].Async" << method.name << "(request)\n";
+            output << "        if err is not None:\n";
+            output << "            return key, err\n";
+            output << "        return f\"{index}#{key}\", None\n";
+
+            output << "\n    def Callback" << method.name << "(self, request: " << requestType(method)
+                   << ", callback: Callable[[";
+            for (const auto& param : method.response_params) {
+                auto [type_str, _] = getPythonTypeAndDefault(param.type);
+                output << type_str << ", ";
+            }
+            output << "Exception | None], None]):\n";
+            output << "        self._clients[" << shard << "].Callback" << method.name << "(request, callback)\n";
+
+            output << "\n    def Receive" << method.name << "(self, key: str) -> tuple["
+                   << valueType(method) << ", Exception | None]:\n";
+            output << "        index, _, inner = key.partition(\"#\")\n";
+            output << "        return self._clients[int(index)].Receive" << method.name << "(inner)\n";
+        }
+    }
+
+    // 对冲调用表达式，结果是胜出调用的回调参数
+    std::string hedgedCall(const Method& method) const {
+        return "_mrpc_hedge(self._pool, self._" + method.name + "_hedge, lambda client, done: client.Callback" +
+               method.name + "(request, done)" + (hasWindow(method) ? ", _mrpc_channel_err)" : ")");
+    }
+
+    // 生成多连接的PoolClient，每次调用按策略选择连接
+    void generatePoolClient() {
+        if (!options.pool) return;
+        std::string pool_client = service.name + "PoolClient";
+        output << "class " << pool_client << ":\n";
+        output << "    def __init__(self, addrs: list[str], connections_per_addr: int = 1,\n";
+        output << "                 policy: str = MRPC_POWER_OF_TWO_CHOICES):\n";
+        output << "        self._pool = _MrpcChannelPool(addrs, connections_per_addr, policy, "
+               << service.name << "Client)\n";
+        for (const auto& method : service.methods) {
+            if (!method.hedge.enabled) continue;
+            output << "        self._" << method.name << "_hedge = _MrpcHedgePolicy(" << method.hedge.after_ms << ", "
+                   << method.hedge.after_percentile << ", " << method.hedge.max_extra << ")\n";
+        }
+        output << "\n";
+
+        for (const auto& method : service.methods) {
+            // 单向方法只有一种调用方式
+            if (method.oneway) {
+                output << "    def " << method.name << "(self, request: " << requestType(method)
+                       << ") -> Exception | None:\n";
+                output << "        index = self._pool.pick()\n";
+                output << "        err = self._pool.channels[index].client." << method.name << "(request)\n";
+                output << "        self._pool.release(index, err)\n";
+                output << "        return err\n\n";
+                continue;
+            }
+
+            // 同步方法，带hedge注解时按对冲策略调用
+            output << "    def " << method.name << "(self, request: " << requestType(method)
+                   << ") -> tuple[" << valueType(method) << ", Exception | None]:\n";
+            if (method.hedge.enabled) {
+                output << "        args = " << hedgedCall(method) << "\n";
+                if (method.response_params.size() == 1) {
+                    output << "        return args[0], args[-1]\n\n";
+                } else {
+                    output << "        return args[:-1], args[-1]\n\n";
+                }
+            } else {
+                output << "        index = self._pool.pick()\n";
+                output << "        value, err = self._pool.channels[index].client." << method.name
+                       << "(request)\n";
+                output << "        self._pool.release(index, " << channelErr(method, "err") << ")\n";
+                output << "        return value, err\n\n";
+            }
+
+            // 异步方法，key中带上连接序号以便Receive找回连接；发出的调用无法撤回，因此不做对冲
+            output << "    def Async" << method.name << "(self, request: " << requestType(method)
+                   << ") -> tuple[str, Exception | None]:\n";
+            output << "        index = self._pool.pick()\n";
+            output << "        key, err = self._pool.channels[index].client.Async" << method.name
+                   << "(request)\n";
+            output << "        if err is not None:\n";
+            output << "            self._pool.release(index, " << channelErr(method, "err") << ")\n";
+            output << "            return key, err\n";
+            output << "        return f\"{index}#{key}\", None\n\n";
+
+            // 回调方法，最后一个参数是错误
+            output << "    def Callback" << method.name << "(self, request: " << requestType(method)
+                   << ", callback: Callable[[";
+            for (const auto& param : method.response_params) {
+                auto [type_str, _] = getPythonTypeAndDefault(param.type);
+                output << type_str << ", ";
+            }
+            output << "Exception | None], None]):\n";
+            if (method.hedge.enabled) {
+                // 等待对冲结果会阻塞，放到单独的线程中
+                output << "        threading.Thread(target=lambda: callback(*" << hedgedCall(method)
+                       << "), daemon=True).start()\n\n";
+            } else {
+                output << "        index = self._pool.pick()\n\n";
+                output << "        def on_done(*args):\n";
+                output << "            self._pool.release(index, " << channelErr(method, "args[-1]") << ")\n";
+                output << "            callback(*args)\n\n";
+                output << "        self._pool.channels[index].client.Callback" << method.name
+                       << "(request, on_done)\n\n";
+            }
+
+            // 接收方法
+            output << "    def Receive" << method.name << "(self, key: str) -> tuple["
+                   << valueType(method) << ", Exception | None]:\n";
+            output << "        index, _, inner = key.partition(\"#\")\n";
+            output << "        index = int(index)\n";
+            output << "        value, err = self._pool.channels[index].client.Receive" << method.name
+                   << "(inner)\n";
+            output << "        self._pool.release(index, err)\n";
+            output << "        return value, err\n\n";
+        }
+
+        output << "    def ChannelStats(self) -> list[dict]:\n";
+        output << "        return self._pool.stats()\n";
+
+        // 每条连接的客户端各有自己的缓存和请求合并：失效作用于全部连接，统计为各连接之和
+        for (const auto& method : service.methods) {
+            if (method.cache.enabled) {
+                output << "\n    def Invalidate" << method.name << "(self, request: " << requestType(method) << "):\n";
+                output << "        for channel in self._pool.channels:\n";
+                output << "            channel.client.Invalidate" << method.name << "(request)\n";
+                output << "\n    def Invalidate" << method.name << "Cache(self):\n";
+                output << "        for channel in self._pool.channels:\n";
+                output << "            channel.client.Invalidate" << method.name << "Cache()\n";
+                output << "\n    def " << method.name << "CacheStats(self) -> dict:\n";
+                output << "        # 落到不同连接的相同请求互不共享缓存\n";
+                output << "        stats = [channel.client." << method.name
+                       << "CacheStats() for channel in self._pool.channels]\n";
+                output << "        return {key: sum(s[key] for s in stats) for key in stats[0]}\n";
+            }
+            if (method.coalesce) {
+                output << "\n    def " << method.name << "CoalescedCalls(self) -> int:\n";
+                output << "        return sum(channel.client." << method.name
+                       << "CoalescedCalls() for channel in self._pool.channels)\n";
+            }
+        }
+
+        for (const auto& method : service.methods) {
+            if (!method.hedge.enabled) continue;
+            output << "\n    def " << method.name << "HedgeStats(self) -> dict:\n";
+            output << "        return self._" << method.name << "_hedge.stats()\n";
+        }
+
+        // 每条连接的客户端各有自己的窗口
+        if (hasWindows()) {
+            output << "\n    def SetWindowPolicy(self, policy: str):\n";
+            output << "        for channel in self._pool.channels:\n";
+            output << "            channel.client.SetWindowPolicy(policy)\n";
+        }
+    }
+
     // 生成方法名数组
     void generateMethodNames() override {
         output << service.name << "_METHOD_NAMES = [\n";
@@ -36,92 +727,294 @@ private:
         output << "]\n\n\n";
     }
 
-    // 生成请求和响应结构体
-    void generateStructs() override {
-        for (const auto& method : service.methods) {
-            // 生成请求类
-            output << "class " << method.name << "Request(mrpc.Parser):\n";
-            
-            // 构造函数
+    // 获取字段在二进制编码中的struct格式和字节数：字符串只在定长部分记录长度
+    std::pair<char, int> getStructFormat(const std::string& type) {
+        if (type == "int") return {'q', 8};
+        if (type == "float") return {'d', 8};
+        if (type == "bool") return {'?', 1};
+        return {'I', 4};
+    }
+
+    bool isStringField(const Parameter& param) {
+        return getStructFormat(param.type).first == 'I';
+    }
+
+    // 生成二进制编解码方法：定长字段和字符串长度由预编译的struct一次打包，字符串按序追加在后
+    void generateBinaryCodec(const std::string& name, const std::vector<Parameter>& params) {
+        std::string layout = "_" + name + "_LAYOUT";
+        int head_size = 0;
+        std::vector<Parameter> strings;
+        for (const auto& param : params) {
+            head_size += getStructFormat(param.type).second;
+            if (isStringField(param)) strings.push_back(param);
+        }
+
+        // toBytes方法
+        output << "    def toBytes(self) -> bytes:\n";
+        if (params.empty()) {
+            output << "        return b\"\"\n\n";
+        } else {
+            for (const auto& param : strings) {
+                output << "        " << param.name << " = (self." << param.name << " or \"\").encode()\n";
+            }
+            output << "        return " << layout << ".pack(";
+            for (size_t i = 0; i < params.size(); ++i) {
+                const auto& param = params[i];
+                if (i > 0) output << ", ";
+                if (isStringField(param)) {
+                    output << "len(" << param.name << ")";
+                } else if (param.type == "bool") {
+                    output << "self." << param.name;
+                } else {
+                    auto [_, default_value] = getPythonTypeAndDefault(param.type);
+                    output << "self." << param.name << " or " << default_value;
+                }
+            }
+            output << ")";
+            for (const auto& param : strings) {
+                output << " + " << param.name;
+            }
+            output << "\n\n";
+        }
+
+        // fromBytes方法：先校验定长部分和总长度，字段先解码到局部变量，全部成功后才赋值，失败时对象不变
+        output << "    def fromBytes(self, data: bytes):\n";
+        if (params.empty()) {
+            output << "        if len(data) != 0:\n";
+            output << "            raise ValueError(\"" << name << ": expected 0 bytes, got %d\" % len(data))\n\n";
+            return;
+        }
+        std::string unpacked;
+        for (size_t i = 0; i < params.size(); ++i) {
+            if (i > 0) unpacked += ", ";
+            if (isStringField(params[i])) unpacked += "n_" + params[i].name;
+            else if (strings.empty()) unpacked += "self." + params[i].name;
+            else unpacked += params[i].name;
+        }
+        if (params.size() == 1) unpacked = "(" + unpacked + ",)";
+        if (strings.empty()) {
+            output << "        if len(data) != " << head_size << ":\n";
+            output << "            raise ValueError(\"" << name << ": expected " << head_size
+                   << " bytes, got %d\" % len(data))\n";
+            output << "        " << unpacked << " = " << layout << ".unpack(data)\n\n";
+            return;
+        }
+        output << "        if len(data) < " << head_size << ":\n";
+        output << "            raise ValueError(\"" << name << ": expected at least " << head_size
+               << " bytes, got %d\" % len(data))\n";
+        output << "        " << unpacked << " = " << layout << ".unpack_from(data)\n";
+        output << "        end = " << head_size;
+        for (const auto& param : strings) {
+            output << " + n_" << param.name;
+        }
+        output << "\n";
+        output << "        if len(data) != end:\n";
+        output << "            raise ValueError(\"" << name << ": expected %d bytes, got %d\" % (end, len(data)))\n";
+        if (strings.size() > 1) {
+            output << "        offset = " << head_size << "\n";
+        }
+        for (size_t i = 0; i < strings.size(); ++i) {
+            const auto& param = strings[i];
+            std::string begin = strings.size() == 1 ? std::to_string(head_size) : "offset";
+            std::string stop = i + 1 == strings.size() ? "end" : "offset + n_" + param.name;
+            // 最后一个字符串是最后可能失败的一步，可直接赋值
+            std::string target = i + 1 == strings.size() ? "self." + param.name : param.name;
+            output << "        " << target << " = str(data[" << begin << ":" << stop << "], \"utf-8\")\n";
+            if (i + 1 < strings.size()) {
+                output << "        offset += n_" << param.name << "\n";
+            }
+        }
+        for (const auto& param : params) {
+            if (param.name == strings.back().name) continue;
+            output << "        self." << param.name << " = " << param.name << "\n";
+        }
+        output << "\n";
+    }
+
+    // 生成单个消息类：__slots__避免每个实例的__dict__，JSON编码用于跨语言互通，二进制编码用于Python之间
+    void generateMessageClass(const std::string& name, const std::vector<Parameter>& params,
+                              bool is_request, bool named = false) {
+        output << "_" << name << "_LAYOUT = struct.Struct(\"<";
+        for (const auto& param : params) {
+            output << getStructFormat(param.type).first;
+        }
+        output << "\")\n\n\n";
+
+        output << "class " << name << "(mrpc.Parser):\n";
+        output << "    __slots__ = (";
+        for (size_t i = 0; i < params.size(); ++i) {
+            if (i > 0) output << ", ";
+            output << "\"" << params[i].name << "\"";
+        }
+        output << (params.size() == 1 ? ",)\n\n" : ")\n\n");
+
+        // 构造函数：请求字段可由参数传入，响应字段初始化为默认值，
+        // 具名消息可能两者兼用，字段可传入且默认为类型默认值
+        if (named) {
             output << "    def __init__(self";
-            for (const auto& param : method.request_params) {
-                auto [type_str, _] = getPythonTypeAndDefault(param.type);
-                output << ", " << param.name << ": Optional[" << type_str << "] = None";
+            for (const auto& param : params) {
+                auto [type_str, default_value] = getPythonTypeAndDefault(param.type);
+                output << ", " << param.name << ": " << type_str << " = " << default_value;
             }
             output << "):\n";
-            
-            // 初始化参数
-            for (const auto& param : method.request_params) {
+            for (const auto& param : params) {
                 output << "        self." << param.name << " = " << param.name << "\n";
             }
-            output << "\n";
-
-            // toString方法
-            output << "    def toString(self) -> str:\n";
-            output << "        return json.dumps({";
-            for (size_t i = 0; i < method.request_params.size(); ++i) {
-                if (i > 0) output << ", ";
-                const auto& param = method.request_params[i];
-                output << "\"" << param.name << "\": self." << param.name;
+        } else if (is_request) {
+            output << "    def __init__(self";
+            for (const auto& param : params) {
+                auto [type_str, _] = getPythonTypeAndDefault(param.type);
+                output << ", " << param.name << ": Optional[" << type_str << "] = None";
             }
-            output << "})\n\n";
-
-            // fromString方法
-            output << "    def fromString(self, data: str):\n";
-            output << "        obj = json.loads(data)\n";
-            for (const auto& param : method.request_params) {
-                auto [_, default_value] = getPythonTypeAndDefault(param.type);
-                output << "        self." << param.name << " = obj.get(\"" 
-                    << param.name << "\", " << default_value << ")\n";
+            output << "):\n";
+            for (const auto& param : params) {
+                output << "        self." << param.name << " = " << param.name << "\n";
             }
-            output << "\n\n";
-
-            // 生成响应类
-            output << "class " << method.name << "Response(mrpc.Parser):\n";
-            
-            // 构造函数
+        } else {
             output << "    def __init__(self):\n";
-            for (const auto& param : method.response_params) {
+            for (const auto& param : params) {
                 auto [_, default_value] = getPythonTypeAndDefault(param.type);
                 output << "        self." << param.name << " = " << default_value << "\n";
             }
-            output << "\n";
+        }
+        if (params.empty()) output << "        pass\n";
+        output << "\n";
 
-            // toString方法
-            output << "    def toString(self) -> str:\n";
-            output << "        return json.dumps({";
-            for (size_t i = 0; i < method.response_params.size(); ++i) {
-                if (i > 0) output << ", ";
-                const auto& param = method.response_params[i];
-                output << "\"" << param.name << "\": self." << param.name;
-            }
-            output << "})\n\n";
+        // toString方法
+        output << "    def toString(self) -> str:\n";
+        output << "        return json.dumps({";
+        for (size_t i = 0; i < params.size(); ++i) {
+            if (i > 0) output << ", ";
+            output << "\"" << params[i].name << "\": self." << params[i].name;
+        }
+        output << "})\n\n";
 
-            // fromString方法
-            output << "    def fromString(self, data: str):\n";
-            output << "        obj = json.loads(data)\n";
-            for (const auto& param : method.response_params) {
-                auto [_, default_value] = getPythonTypeAndDefault(param.type);
-                output << "        self." << param.name << " = obj.get(\"" 
-                    << param.name << "\", " << default_value << ")\n";
+        // fromString方法
+        output << "    def fromString(self, data: str):\n";
+        output << "        obj = json.loads(data)\n";
+        for (const auto& param : params) {
+            auto [_, default_value] = getPythonTypeAndDefault(param.type);
+            output << "        self." << param.name << " = obj.get(\""
+                << param.name << "\", " << default_value << ")\n";
+        }
+        output << "\n";
+
+        generateBinaryCodec(name, params);
+        output << "\n";
+    }
+
+    // 生成请求和响应结构体
+    void generateStructs() override {
+        for (const auto& message : service.messages) {
+            generateMessageClass(message.name, message.params, false, true);
+        }
+        for (const auto& method : service.methods) {
+            if (!method.request.named) {
+                generateMessageClass(method.request.type, method.request_params, true);
             }
-            output << "\n\n";
+            if (!method.response.named && !method.oneway) {
+                generateMessageClass(method.response.type, method.response_params, false);
+            }
+        }
+    }
+
+    std::string importPrefix(const std::string& from) const override { return from + "_mrpc."; }
+
+    // 生成同步方法返回值的类型：单字段为其类型，多字段为元组
+    std::string valueType(const Method& method) {
+        if (method.response_params.size() == 1) {
+            return getPythonTypeAndDefault(method.response_params[0].type).first;
+        }
+        std::string type = "tuple[";
+        for (size_t j = 0; j < method.response_params.size(); ++j) {
+            if (j > 0) type += ", ";
+            type += getPythonTypeAndDefault(method.response_params[j].type).first;
+        }
+        return type + "]";
+    }
+
+    // 生成响应字段的返回值表达式：单字段直接返回，多字段返回元组
+    std::string responseValues(const Method& method, const std::string& var) {
+        if (method.response_params.size() == 1) {
+            return var + "." + method.response_params[0].name;
         }
+        return "(" + callbackArgs(method, var) + ")";
+    }
+
+    // 生成以逗号分隔的响应字段列表
+    std::string callbackArgs(const Method& method, const std::string& var) {
+        std::string args;
+        for (size_t j = 0; j < method.response_params.size(); ++j) {
+            if (j > 0) args += ", ";
+            args += var + "." + method.response_params[j].name;
+        }
+        return args;
+    }
+
+    // 同步调用在窗口内发出
+    std::string windowedSend(const Method& method, const std::string& send, const std::string& args) const {
+        if (!hasWindow(method)) return send + "(" + args + ")";
+        return windowField(method) + ".call(" + send + ", " + args + ")";
+    }
+
+    // 回调方式的调用经窗口准入后发出，完成时归还信用
+    std::string windowedCallback(const Method& method, const std::string& send, const std::string& args,
+                                 const std::string& done) const {
+        if (!hasWindow(method)) return send + "(" + args + ", " + done + ")";
+        return windowField(method) + ".callback(" + send + ", (" + args + "), " + done + ")";
     }
 
     // 生成客户端类
     void generateClient() override {
         output << "class " << service.name << "Client(mrpc.Client):\n";
         output << "    def __init__(self, server_address: str):\n";
-        output << "        super().__init__(server_address)\n\n";
+        output << "        super().__init__(server_address)\n";
+        for (const auto& method : service.methods) {
+            if (!method.cache.enabled) continue;
+            output << "        self._" << method.name << "_cache = _MrpcResponseCache("
+                   << method.cache.ttl_ms << ", " << method.cache.max_entries << ")\n";
+        }
+        for (const auto& method : service.methods) {
+            if (!method.coalesce) continue;
+            output << "        self._" << method.name << "_flight = _MrpcSingleFlight()\n";
+        }
+        if (usesStubWindow()) output << "        self._window = _MrpcWindow(" << service.max_in_flight << ")\n";
+        for (const auto& method : service.methods) {
+            if (!hasWindow(method) || method.max_in_flight == 0) continue;
+            output << "        self._" << method.name << "_window = _MrpcWindow(" << method.max_in_flight << ")\n";
+        }
+        output << "\n";
+
+        // 窗口策略对本客户端的全部窗口生效
+        if (hasWindows()) {
+            output << "    def SetWindowPolicy(self, policy: str):\n";
+            output << "        \"\"\"设置在途窗口满时的处理策略，默认MRPC_WINDOW_BLOCK\"\"\"\n";
+            if (usesStubWindow()) output << "        self._window.policy = policy\n";
+            for (const auto& method : service.methods) {
+                if (!hasWindow(method) || method.max_in_flight == 0) continue;
+                output << "        self._" << method.name << "_window.policy = policy\n";
+            }
+            output << "\n";
+        }
 
         // 为每个方法生成四个相关函数
         for (size_t i = 0; i < service.methods.size(); ++i) {
             const auto& method = service.methods[i];
+
+            // 单向方法：请求入队即返回，不等待响应，也不留下需要Receive取回的在途调用
+            if (method.oneway) {
+                output << "    def " << method.name << "(self, request: " << requestType(method)
+                       << ") -> Exception | None:\n";
+                output << "        \"\"\"单向调用，返回的错误只反映请求是否入队\"\"\"\n";
+                output << "        super().CallbackSend(" << service.name << "_METHOD_NAMES[" << i
+                       << "], request, _MRPC_NO_REPLY, lambda err: None)\n";
+                output << "        return None\n\n";
+                continue;
+            }
             
             // 生成主方法
             output << "    def " << method.name << "(self, request: " 
-                  << method.name << "Request) -> tuple[";
+                  << requestType(method) << ") -> tuple[";
             
             if (method.response_params.size() == 1) {
                 auto [type_str, _] = getPythonTypeAndDefault(method.response_params[0].type);
@@ -136,30 +1029,59 @@ private:
                 output << "]";
             }
             output << ", Exception | None]:\n";
-            output << "        response = " << method.name << "Response()\n";
-            output << "        err = super().Send(" << service.name << "_METHOD_NAMES[" 
-                  << i << "], request, response)\n";
-            
-            if (method.response_params.size() == 1) {
-                output << "        return response." << method.response_params[0].name << ", err\n\n";
-            } else {
-                output << "        return (";
-                for (size_t j = 0; j < method.response_params.size(); ++j) {
-                    if (j > 0) output << ", ";
-                    output << "response." << method.response_params[j].name;
+            std::string cache_field = "self._" + method.name + "_cache";
+            std::string flight_field = "self._" + method.name + "_flight";
+            std::string method_name = service.name + "_METHOD_NAMES[" + std::to_string(i) + "]";
+            if (method.needsRequestKey()) {
+                output << "        request_key = request.toString()\n";
+                if (method.cache.enabled) {
+                    output << "        response = " << cache_field << ".get(request_key)\n";
+                    output << "        if response is not None:\n";
+                    output << "            return " << responseValues(method, "response") << ", None\n";
+                }
+                if (method.coalesce) {
+                    output << "        send = super().Send\n\n";
+                    output << "        def call():\n";
+                    output << "            result = " << responseType(method) << "()\n";
+                    output << "            return result, " << windowedSend(method, "send", method_name + ", request, result")
+                           << "\n\n";
+                    output << "        response, err = " << flight_field << ".do(request_key, call)\n";
+                } else {
+                    output << "        response = " << responseType(method) << "()\n";
+                    output << "        err = " << windowedSend(method, "super().Send", method_name + ", request, response")
+                           << "\n";
+                }
+                if (method.cache.enabled) {
+                    output << "        if err is None:\n";
+                    output << "            " << cache_field << ".put(request_key, response)\n";
                 }
-                output << "), err\n\n";
+            } else {
+                output << "        response = " << responseType(method) << "()\n";
+                output << "        err = " << windowedSend(method, "super().Send", method_name + ", request, response")
+                       << "\n";
             }
+            output << "        return " << responseValues(method, "response") << ", err\n\n";
             
             // 生成异步方法
             output << "    def Async" << method.name << "(self, request: " 
-                  << method.name << "Request) -> tuple[str, Exception | None]:\n";
-            output << "        return super().AsyncSend(" << service.name 
-                  << "_METHOD_NAMES[" << i << "], request)\n\n";
+                  << requestType(method) << ") -> tuple[str, Exception | None]:\n";
+            if (hasWindow(method)) {
+                // 占用的信用由ReceiveX归还
+                output << "        err = " << windowField(method) << ".acquire()\n";
+                output << "        if err is not None:\n";
+                output << "            return \"\", err\n";
+                output << "        key, err = super().AsyncSend(" << method_name << ", request)\n";
+                output << "        if err is not None:\n";
+                output << "            " << windowField(method) << ".release()\n";
+                output << "        return key, err\n\n";
+            } else {
+                output << "        return super().AsyncSend(" << service.name
+                       << "_METHOD_NAMES[" << i << "], request)\n\n";
+            }
             
             // 生成回调方法
             output << "    def Callback" << method.name << "(self, request: " 
-                  << method.name << "Request, callback: ";
+                  << requestType(method) << ", callback: ";
             
             // 生成回调函数类型
             output << "Callable[[";
@@ -169,18 +1091,74 @@ private:
             }
             output << "Exception | None], None]):\n";
             
-            output << "        response = " << method.name << "Response()\n";
-            output << "        super().CallbackSend(\n";
-            output << "            " << service.name << "_METHOD_NAMES[" << i << "],\n";
-            output << "            request,\n";
-            output << "            response,\n";
-            output << "            lambda err: callback(";
-            for (size_t j = 0; j < method.response_params.size(); ++j) {
-                if (j > 0) output << ", ";
-                output << "response." << method.response_params[j].name;
-            }
-            output << ", err),\n";
-            output << "        )\n\n";
+            if (method.needsRequestKey()) {
+                output << "        request_key = request.toString()\n";
+                if (method.cache.enabled) {
+                    output << "        cached = " << cache_field << ".get(request_key)\n";
+                    output << "        if cached is not None:\n";
+                    output << "            callback(" << callbackArgs(method, "cached") << ", None)\n";
+                    output << "            return\n";
+                }
+                output << "\n        def on_done(response, err):\n";
+                if (method.cache.enabled) {
+                    output << "            if err is None:\n";
+                    output << "                " << cache_field << ".put(request_key, response)\n";
+                }
+                output << "            callback(" << callbackArgs(method, "response") << ", err)\n\n";
+                if (method.coalesce) {
+                    output << "        callback_send = super().CallbackSend\n\n";
+                    output << "        def start(done):\n";
+                    output << "            response = " << responseType(method) << "()\n";
+                    output << "            " << windowedCallback(method, "callback_send", method_name + ", request, response",
+                                                           "lambda err: done(response, err)") << "\n\n";
+                    output << "        " << flight_field << ".do_callback(request_key, start, on_done)\n\n";
+                } else {
+                    output << "        response = " << responseType(method) << "()\n";
+                    output << "        " << windowedCallback(method, "super().CallbackSend", method_name + ", request, response",
+                                                       "lambda err: on_done(response, err)") << "\n\n";
+                }
+            } else {
+                output << "        response = " << responseType(method) << "()\n";
+                if (hasWindow(method)) {
+                    output << "        " << windowField(method) << ".callback(\n";
+                    output << "            super().CallbackSend,\n";
+                    output << "            (" << method_name << ", request, response),\n";
+                } else {
+                    output << "        super().CallbackSend(\n";
+                    output << "            " << service.name << "_METHOD_NAMES[" << i << "],\n";
+                    output << "            request,\n";
+                    output << "            response,\n";
+                }
+                output << "            lambda err: callback(";
+                for (size_t j = 0; j < method.response_params.size(); ++j) {
+                    if (j > 0) output << ", ";
+                    output << "response." << method.response_params[j].name;
+                }
+                output << ", err),\n";
+                output << "        )\n\n";
+            }
+
+            // 缓存失效与统计接口
+            if (method.cache.enabled) {
+                output << "    def Invalidate" << method.name << "(self, request: "
+                      << requestType(method) << "):\n";
+                output << "        " << cache_field << ".invalidate(request.toString())\n\n";
+                output << "    def Invalidate" << method.name << "Cache(self):\n";
+                output << "        " << cache_field << ".clear()\n\n";
+                output << "    def " << method.name << "CacheStats(self) -> dict:\n";
+                output << "        return " << cache_field << ".stats()\n\n";
+            }
+
+            // 请求合并统计接口
+            if (method.coalesce) {
+                output << "    def " << method.name << "CoalescedCalls(self) -> int:\n";
+                output << "        return " << flight_field << ".shared_calls\n\n";
+            }
+
+            if (hasWindow(method)) {
+                output << "    def " << method.name << "WindowStats(self) -> dict:\n";
+                output << "        return " << windowField(method) << ".stats()\n\n";
+            }
             
             // 生成接收方法
             output << "    def Receive" << method.name << "(self, key: str) -> tuple[";
@@ -197,8 +1175,9 @@ private:
                 output << "]";
             }
             output << ", Exception | None]:\n";
-            output << "        response = " << method.name << "Response()\n";
+            output << "        response = " << responseType(method) << "()\n";
             output << "        err = super().Receive(key, response)\n";
+            if (hasWindow(method)) output << "        " << windowField(method) << ".release()\n";
             
             if (method.response_params.size() == 1) {
                 output << "        return response." << method.response_params[0].name << ", err\n";
@@ -225,9 +1204,18 @@ private:
         // 注册所有方法的处理函数
         for (size_t i = 0; i < service.methods.size(); ++i) {
             const auto& method = service.methods[i];  // 获取当前方法的引用
+            // 单向方法没有响应，回送的确认为空
+            if (method.oneway) {
+                output << "        self.AddHandler(\n";
+                output << "            " << service.name << "_METHOD_NAMES[" << i << "], "
+                    << requestType(method) << ", _MrpcNoReply,\n";
+                output << "            lambda request, response: self." << method.name << "(request)\n";
+                output << "        )\n";
+                continue;
+            }
             output << "        self.AddHandler(\n";
             output << "            " << service.name << "_METHOD_NAMES[" << i << "], "
-                << method.name << "Request, " << method.name << "Response,\n";
+                << requestType(method) << ", " << responseType(method) << ",\n";
             output << "            lambda request, response: self." << method.name 
                 << "(request, response)\n";
             output << "        )\n";
@@ -236,9 +1224,15 @@ private:
 
         // 为每个方法生成抽象方法
         for (const auto& method : service.methods) {
-            output << "    def " << method.name << "(self, request: '" << method.name 
-                << "Request', response: '" << method.name 
-                << "Response') -> mrpc.MrpcError | None:\n";
+            if (method.oneway) {
+                output << "    def " << method.name << "(self, request: '" << requestType(method)
+                    << "') -> None:\n";
+                output << "        pass\n";
+                continue;
+            }
+            output << "    def " << method.name << "(self, request: '" << requestType(method) 
+                << "', response: '" << responseType(method) 
+                << "') -> mrpc.MrpcError | None:\n";
             output << "        pass\n";
         }
 
@@ -255,27 +1249,268 @@ private:
         return result;
     }
 
+    // 生成编解码微基准与往返模糊测试脚本，从生成的存根模块导入消息类
+    std::string generateCodecTests(const std::string& output_path) {
+        std::stringstream ss;
+        std::vector<Message> messages = messageTypes();
+        std::string module = baseName(output_path);
+        if (module.size() > 3 && module.compare(module.size() - 3, 3, ".py") == 0) {
+            module = module.substr(0, module.size() - 3);
+        }
+
+        ss << "# " << service.name << " 编解码微基准与往返模糊测试，由PythonStubGenerator生成\n";
+        ss << "# 用法: python " << module << "_codec_test.py [bench|fuzz] [--iterations N] [--seed S]\n";
+        ss << "import argparse\n";
+        ss << "import random\n";
+        ss << "import sys\n";
+        ss << "import time\n";
+        ss << "import tracemalloc\n\n";
+        ss << "from " << module << " import (\n";
+        for (const auto& message : messages) {
+            ss << "    " << message.name << ",\n";
+        }
+        ss << ")\n\n";
+        ss << "BENCH_SIZES = (16, 256, 4096)\n\n";
+
+        // 每个消息的字段列表，填充和比较按字段类型进行
+        ss << "MESSAGES = [\n";
+        for (const auto& message : messages) {
+            ss << "    (" << message.name << ", (";
+            for (size_t i = 0; i < message.params.size(); ++i) {
+                if (i > 0) ss << ", ";
+                ss << "(\"" << message.params[i].name << "\", \"" << message.params[i].type << "\")";
+            }
+            ss << (message.params.size() == 1 ? ",)),\n" : ")),\n");
+        }
+        ss << "]\n";
+
+        ss << R"py(
+_PIECES = ('"', "\\", "/", "\b", "\f", "\n", "\r", "\t", "\x00", "\x1f", "é", "中", "\U0001f600")
+
+
+def _random_string(rng: random.Random) -> str:
+    # 覆盖控制字符、转义字符和多字节字符
+    out = []
+    for _ in range(rng.randrange(33)):
+        if rng.randrange(4) == 0:
+            out.append(rng.choice(_PIECES))
+        else:
+            out.append(chr(0x20 + rng.randrange(0x5F)))
+    return "".join(out)
+
+
+def _fill(msg, fields, size: int):
+    for name, kind in fields:
+        if kind == "int":
+            setattr(msg, name, size)
+        elif kind == "float":
+            setattr(msg, name, size * 1.5)
+        elif kind == "bool":
+            setattr(msg, name, True)
+        else:
+            setattr(msg, name, "x" * size)
+
+
+def _fill_random(msg, fields, rng: random.Random):
+    for name, kind in fields:
+        if kind == "int":
+            setattr(msg, name, rng.randint(-(2**31), 2**31 - 1))
+        elif kind == "float":
+            setattr(msg, name, rng.uniform(-1e6, 1e6))
+        elif kind == "bool":
+            setattr(msg, name, rng.random() < 0.5)
+        else:
+            setattr(msg, name, _random_string(rng))
+
+
+def _equal(a, b, fields) -> bool:
+    return all(getattr(a, name) == getattr(b, name) for name, _ in fields)
+
+
+def _measure(label: str, op: str, size: int, encoded: int, fn):
+    # 自动调整迭代次数直到单轮耗时超过0.1s
+    iterations = 1
+    while True:
+        start = time.perf_counter_ns()
+        for _ in range(iterations):
+            fn()
+        elapsed = time.perf_counter_ns() - start
+        if elapsed >= 100_000_000 or iterations >= 1 << 24:
+            break
+        target = int(iterations * 120_000_000 / max(elapsed, 1))
+        iterations = max(iterations * 2, min(target, iterations * 100))
+
+    # 分配量单独测量，避免tracemalloc的开销计入耗时；Python无法统计分配次数，只报告峰值字节
+    tracemalloc.start()
+    base, _ = tracemalloc.get_traced_memory()
+    tracemalloc.reset_peak()
+    fn()
+    _, peak = tracemalloc.get_traced_memory()
+    tracemalloc.stop()
+    print(f"{label:<32} {op:<10} size={size:<5} encoded={encoded:<6} {iterations:>10} iters "
+          f"{elapsed / iterations:>10.1f} ns/op {max(peak - base, 0):>8} B/op")
+
+
+def bench():
+    for cls, fields in MESSAGES:
+        for size in BENCH_SIZES:
+            msg = cls()
+            _fill(msg, fields, size)
+            data = msg.toString()
+            _measure(cls.__name__, "encode", size, len(data), msg.toString)
+            _measure(cls.__name__, "decode", size, len(data), lambda: cls().fromString(data))
+            _measure(cls.__name__, "roundtrip", size, len(data), lambda: cls().fromString(msg.toString()))
+            binary = msg.toBytes()
+            _measure(cls.__name__, "to_bytes", size, len(binary), msg.toBytes)
+            _measure(cls.__name__, "from_bytes", size, len(binary), lambda: cls().fromBytes(binary))
+
+
+def _mutate(data: str, rng: random.Random) -> str:
+    chars = list(data)
+    for _ in range(1 + rng.randrange(4)):
+        pos = rng.randrange(len(chars) + 1)
+        action = rng.randrange(3)
+        if action == 0 and pos < len(chars):
+            del chars[pos]
+        elif action == 1:
+            chars.insert(pos, rng.choice('{}[]":,\\0123456789-.eEtfn ' + "".join(_PIECES)))
+        elif pos < len(chars):
+            chars[pos] = chr(rng.randrange(0x80))
+    return "".join(chars)
+
+
+def fuzz(iterations: int, seed: int) -> bool:
+    rng = random.Random(seed)
+    print(f"seed={seed}")
+    ok = True
+    for cls, fields in MESSAGES:
+        name = cls.__name__
+        for i in range(iterations):
+            # 随机字段值编码后解码必须逐字段相等
+            src = cls()
+            _fill_random(src, fields, rng)
+            data = src.toString()
+            dst = cls()
+            dst.fromString(data)
+            if not _equal(src, dst, fields):
+                print(f"{name}: round-trip mismatch after {i} iterations: {data}", file=sys.stderr)
+                ok = False
+                break
+            dst = cls()
+            dst.fromBytes(src.toBytes())
+            if not _equal(src, dst, fields):
+                print(f"{name}: binary round-trip mismatch after {i} iterations: {data}", file=sys.stderr)
+                ok = False
+                break
+
+            # 截断或多出字节的二进制输入必须以ValueError拒绝，且不改动已有的字段
+            binary = src.toBytes()
+            if binary and rng.randrange(2):
+                bad = binary[:rng.randrange(len(binary))]
+            else:
+                bad = binary + bytes(rng.randrange(256) for _ in range(rng.randrange(1, 9)))
+            try:
+                dst.fromBytes(bad)
+            except ValueError:
+                pass
+            else:
+                print(f"{name}: accepted malformed binary input {bad!r}", file=sys.stderr)
+                ok = False
+                break
+            if not _equal(src, dst, fields):
+                print(f"{name}: rejected binary input {bad!r} modified the message", file=sys.stderr)
+                ok = False
+                break
+
+            # 变异后的输入可以被拒绝，但能解码的输入再次往返后必须稳定
+            mutated = _mutate(data, rng)
+            first = cls()
+            try:
+                first.fromString(mutated)
+                encoded = first.toString()
+            except Exception:
+                continue
+            second = cls()
+            second.fromString(encoded)
+            if second.toString() != encoded:
+                print(f"{name}: unstable round trip for input {mutated!r}", file=sys.stderr)
+                ok = False
+                break
+        else:
+            print(f"{name:<32} fuzz ok ({iterations} iterations)")
+    return ok
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser()
+    parser.add_argument("mode", nargs="?", default="bench", choices=("bench", "fuzz"))
+    parser.add_argument("--iterations", type=int, default=10000)
+    parser.add_argument("--seed", type=int, default=random.randrange(2**32))
+    args = parser.parse_args()
+    if args.mode == "bench":
+        bench()
+        return 0
+    return 0 if fuzz(args.iterations, args.seed) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
+)py";
+        return ss.str();
+    }
+
 public:
     PythonStubGenerator(const std::string& yaml_path) 
         : StubGeneratorBase(yaml_path) {}
 
     bool generate(const std::string& output_path) override {
+        if (options.shm) {
+            std::cerr << "--shm is only supported by the C++ generator" << std::endl;
+            return false;
+        }
+        if (options.scatter_gather) {
+            std::cerr << "--scatter-gather is only supported by the C++ generator" << std::endl;
+            return false;
+        }
+        if (!options.descriptor_runtime_path.empty()) {
+            std::cerr << "--descriptor-runtime is only supported by the C++ generator" << std::endl;
+            return false;
+        }
+        // 只定义消息的IDL没有存根可生成，也就不需要连接池
+        if (!hasService()) options.pool = false;
         generateImports();
-        generateMethodNames();
+        generateCacheHelper();
+        generateFlightHelper();
+        generatePoolHelper();
+        generateWindowHelper();
+        generateHedgeHelper();
+        generateShardHelper();
+        generateNoReplyHelper();
+        if (hasService()) generateMethodNames();
         generateStructs();
-        generateClient();
-        output << "\n\n";
-        generateService();
+        if (hasService()) {
+            generateClient();
+            output << "\n\n";
+            if (options.pool) {
+                generatePoolClient();
+                output << "\n\n";
+            }
+            if (hasShardedMethods()) {
+                generateShardedClient();
+                output << "\n\n";
+            }
+            generateService();
+        }
         
         // 写入文件
-        std::ofstream out_file(output_path);
-        if (!out_file) {
-            std::cerr << "Failed to open output file: " << output_path << std::endl;
+        if (!writeFile(output_path, output.str())) {
+            return false;
+        }
+
+        if (!options.codec_tests_path.empty() &&
+            !writeFile(options.codec_tests_path, generateCodecTests(output_path))) {
             return false;
         }
-        
-        out_file << output.str();
-        out_file.close();
         return true;
     }
 };
@@ -283,13 +1518,18 @@ public:
 } // namespace generator
 } // namespace mrpc
 
+// 生成守护进程把各语言生成器编进同一个程序时关闭各自的入口
+#ifndef MRPC_GENERATOR_NO_MAIN
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <input.yaml> <output.py>" << std::endl;
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <input.yaml> <output.py> [--pool] [--codec-tests <codec_test.py>] [--depfile <file.d>] [--descriptor <file.mrpcd>]" << std::endl;
         return 1;
     }
     
     mrpc::generator::PythonStubGenerator generator(argv[1]);
+    if (!generator.parseOptions(argc, argv, 3)) {
+        return 1;
+    }
     if (!generator.parseYaml(argv[1])) {
         std::cerr << "Failed to parse YAML file" << std::endl;
         return 1;
@@ -299,7 +1539,14 @@ int main(int argc, char* argv[]) {
         std::cerr << "Failed to generate stub file" << std::endl;
         return 1;
     }
+    if (!generator.writeDepfile(argv[2])) {
+        return 1;
+    }
+    if (!generator.writeDescriptor()) {
+        return 1;
+    }
 
     std::cout << "Successfully generated Python stub at: " << argv[2] << std::endl;
     return 0;
-} 
\ No newline at end of file
+}
+#endif
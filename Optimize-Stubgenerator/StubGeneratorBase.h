@@ -1,10 +1,14 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <filesystem>
 #include <sstream>
 #include <iostream>
+#include <fstream>
 #include <yaml-cpp/yaml.h>
 
 namespace mrpc {
@@ -16,17 +20,82 @@ struct Parameter {
     std::string type;
 };
 
+// 用于存储缓存注解的结构体
+struct CacheOption {
+    bool enabled = false;
+    int ttl_ms = 1000;
+    int max_entries = 1024;
+};
+
+// 用于存储对冲注解的结构体：阈值为固定时长或最近延迟的分位数，二选一
+struct HedgeOption {
+    bool enabled = false;
+    int after_ms = 0;
+    double after_percentile = 0;
+    int max_extra = 1;  // 每次调用最多额外发出的备份请求数
+};
+
+// 方法引用的消息类型
+struct MessageRef {
+    std::string type;  // 内联定义时为<Method>Request/<Method>Response，否则为具名消息名
+    std::string from;  // 具名消息来自引入的IDL时为该IDL名，否则为空
+    bool named = false;  // 引用具名消息，不随方法单独生成
+};
+
 // 用于存储方法信息的结构体
 struct Method {
     std::string name;
     std::vector<Parameter> request_params;
     std::vector<Parameter> response_params;
+    MessageRef request;
+    MessageRef response;
+    CacheOption cache;
+    bool coalesce = false;  // 合并在途的相同请求
+    bool oneway = false;  // 单向调用：没有响应，请求发出后不等待
+    int max_in_flight = 0;  // 方法级在途窗口，非0时代替存根级窗口
+    HedgeOption hedge;  // 只作用于连接池存根，方法须是幂等的
+    std::string shard_key;  // 非空时按该请求字段的哈希把请求路由到固定的分片
+    std::string priority = "normal";  // 服务端分发的优先级类别：high、normal或bulk
+
+    // 缓存和请求合并都以编码后的请求作为键
+    bool needsRequestKey() const { return cache.enabled || coalesce; }
+};
+
+// 用于存储消息类型信息的结构体
+struct Message {
+    std::string name;
+    std::vector<Parameter> params;
 };
 
-// 用于存储服务信息的结构体
+// 用于存储引入的IDL信息的结构体
+struct Import {
+    std::string name;  // 不含扩展名的文件名，即生成代码的命名空间/包名
+    std::string path;
+    std::string go_package;  // 该IDL声明的Go导入路径
+};
+
+// 用于存储服务信息的结构体；只定义具名消息的IDL没有服务，name为空
 struct Service {
     std::string name;
     std::vector<Method> methods;
+    std::vector<Message> messages;  // 本文件定义的具名消息
+    std::vector<Import> imports;  // 直接引入的IDL
+    std::string go_package;
+    int max_in_flight = 0;  // 存根级在途窗口，未单独配置窗口的方法共用；0为不限
+    std::vector<std::string> dependencies;  // 解析时读到的全部IDL（含传递引入），用于depfile
+};
+
+// 用于存储命令行选项的结构体
+struct GeneratorOptions {
+    bool pool = false;  // 额外生成多连接负载均衡的存根
+    std::string loadtest_path;  // 非空时额外生成回环压测程序
+    std::string codec_tests_path;  // 非空时额外生成编解码基准与模糊测试
+    std::string split_source_path;  // 非空时C++存根拆分为精简头文件和该源文件
+    std::string depfile_path;  // 非空时写出Make/Ninja格式的依赖文件
+    bool shm = false;  // 存根和服务额外支持shm://地址的共享内存传输
+    bool scatter_gather = false;  // 消息额外生成分散-聚集编码，长字符串字段按引用输出
+    std::string descriptor_path;  // 非空时写出服务的二进制描述符，供网关在运行时转发和转码
+    std::string descriptor_runtime_path;  // 非空时额外生成与服务无关的描述符运行时头文件（仅C++）
 };
 
 // 存根生成器基类
@@ -34,6 +103,7 @@ class StubGeneratorBase {
 protected:
     std::string yaml_filename;  // 不含扩展名的yaml文件名
     Service service;
+    GeneratorOptions options;
     std::stringstream output;
 
     // 辅助函数：将字符串首字母大写
@@ -44,8 +114,127 @@ protected:
         return result;
     }
 
+    // 只定义具名消息的IDL没有服务
+    bool hasService() const { return !service.name.empty(); }
+
+    // 是否存在带缓存注解的方法
+    bool hasCachedMethods() const {
+        for (const auto& method : service.methods) {
+            if (method.cache.enabled) return true;
+        }
+        return false;
+    }
+
+    // 连接池存根中是否存在对冲的方法；单连接存根没有可发备份请求的其他连接
+    bool hasHedgedMethods() const {
+        if (!options.pool) return false;
+        for (const auto& method : service.methods) {
+            if (method.hedge.enabled) return true;
+        }
+        return false;
+    }
+
+    // 是否存在声明了分片键的方法；有则额外生成分片的服务和存根
+    bool hasShardedMethods() const {
+        for (const auto& method : service.methods) {
+            if (!method.shard_key.empty()) return true;
+        }
+        return false;
+    }
+
+    // 分片键字段的类型
+    static std::string shardKeyType(const Method& method) {
+        for (const auto& param : method.request_params) {
+            if (param.name == method.shard_key) return param.type;
+        }
+        return "";
+    }
+
+    // 是否有方法声明了非normal的优先级；有则服务端按优先级分队列分发全部方法
+    bool hasPriorities() const {
+        for (const auto& method : service.methods) {
+            if (method.priority != "normal") return true;
+        }
+        return false;
+    }
+
+    // 是否存在开启请求合并的方法
+    bool hasCoalescedMethods() const {
+        for (const auto& method : service.methods) {
+            if (method.coalesce) return true;
+        }
+        return false;
+    }
+
+    // 方法是否受在途窗口限制；单向调用入队即完成，不占用窗口
+    bool hasWindow(const Method& method) const {
+        return !method.oneway && (method.max_in_flight > 0 || service.max_in_flight > 0);
+    }
+
+    bool hasWindows() const {
+        for (const auto& method : service.methods) {
+            if (hasWindow(method)) return true;
+        }
+        return false;
+    }
+
+    // 是否有方法共用存根级窗口
+    bool usesStubWindow() const {
+        for (const auto& method : service.methods) {
+            if (hasWindow(method) && method.max_in_flight == 0) return true;
+        }
+        return false;
+    }
+
+    // 是否存在单向方法
+    bool hasOnewayMethods() const {
+        for (const auto& method : service.methods) {
+            if (method.oneway) return true;
+        }
+        return false;
+    }
+
+    // 按生成顺序列出本文件生成的消息：先具名消息，再各方法内联定义的请求和响应
+    std::vector<Message> messageTypes() const {
+        std::vector<Message> messages = service.messages;
+        for (const auto& method : service.methods) {
+            if (!method.request.named) messages.push_back({method.request.type, method.request_params});
+            if (!method.response.named && !method.oneway) {
+                messages.push_back({method.response.type, method.response_params});
+            }
+        }
+        return messages;
+    }
+
+    // 被方法引用到的引入IDL；只引入类型而未使用的IDL不生成导入
+    std::vector<Import> usedImports() const {
+        std::vector<Import> used;
+        for (const auto& imported : service.imports) {
+            for (const auto& method : service.methods) {
+                if (method.request.from == imported.name || method.response.from == imported.name) {
+                    used.push_back(imported);
+                    break;
+                }
+            }
+        }
+        return used;
+    }
+
+    // 引入IDL中的类型在各语言中的限定前缀
+    virtual std::string importPrefix(const std::string& from) const = 0;
+
+    std::string typeName(const MessageRef& ref) const {
+        return ref.from.empty() ? ref.type : importPrefix(ref.from) + ref.type;
+    }
+    std::string requestType(const Method& method) const { return typeName(method.request); }
+    std::string responseType(const Method& method) const { return typeName(method.response); }
+
     // 从路径中提取yaml文件名（不含扩展名）
     void extractYamlFilename(const std::string& yaml_path) {
+        yaml_filename = stemOf(yaml_path);
+    }
+
+    static std::string stemOf(const std::string& yaml_path) {
         size_t lastSlash = yaml_path.find_last_of("/\\");
         size_t lastDot = yaml_path.find_last_of(".");
         
@@ -56,10 +245,32 @@ protected:
         }
         
         if (lastDot == std::string::npos || lastDot < lastSlash) {
-            yaml_filename = yaml_path.substr(lastSlash);
-        } else {
-            yaml_filename = yaml_path.substr(lastSlash, lastDot - lastSlash);
+            return yaml_path.substr(lastSlash);
+        }
+        return yaml_path.substr(lastSlash, lastDot - lastSlash);
+    }
+
+    // 从路径中提取文件名（含扩展名），用于生成#include
+    static std::string baseName(const std::string& path) {
+        size_t lastSlash = path.find_last_of("/\\");
+        return lastSlash == std::string::npos ? path : path.substr(lastSlash + 1);
+    }
+
+    // 将生成的内容写入文件；内容未变时不重写，避免触发下游的增量编译
+    static bool writeFile(const std::string& path, const std::string& content) {
+        std::ifstream existing(path, std::ios::binary);
+        if (existing) {
+            std::stringstream current;
+            current << existing.rdbuf();
+            if (current.str() == content) return true;
+        }
+        std::ofstream out_file(path, std::ios::binary);
+        if (!out_file.is_open()) {
+            std::cerr << "Failed to open output file: " << path << std::endl;
+            return false;
         }
+        out_file << content;
+        return true;
     }
 
     // 纯虚函数：生成方法名数组
@@ -81,45 +292,401 @@ public:
 
     virtual ~StubGeneratorBase() = default;
 
-    // 解析yaml文件
-    bool parseYaml(const std::string& yaml_path) {
-        try {
-            YAML::Node config = YAML::LoadFile(yaml_path);
-            
-            service.name = config["service"]["name"].as<std::string>();
-            
-            const YAML::Node& methods = config["service"]["methods"];
-            for (const auto& method : methods) {
-                Method m;
-                m.name = method.first.as<std::string>();
-
-                // 解析请求参数
-                auto request = method.second["request"];
-                for (const auto& param : request) {
-                    Parameter p;
-                    p.name = param.first.as<std::string>();
-                    p.type = param.second.as<std::string>();
-                    m.request_params.push_back(p);
+    // 常驻进程复用已解析的IR和选项，不再重复读取yaml和命令行
+    void setOptions(const GeneratorOptions& opts) { options = opts; }
+    void setService(const Service& parsed) { service = parsed; }
+    const Service& getService() const { return service; }
+
+    // 解析输入输出文件之后的可选参数
+    bool parseOptions(int argc, char* argv[], int first) {
+        for (int i = first; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--pool") {
+                options.pool = true;
+            } else if (arg == "--loadtest" && i + 1 < argc) {
+                options.loadtest_path = argv[++i];
+            } else if (arg == "--codec-tests" && i + 1 < argc) {
+                options.codec_tests_path = argv[++i];
+            } else if (arg == "--split" && i + 1 < argc) {
+                options.split_source_path = argv[++i];
+            } else if (arg == "--depfile" && i + 1 < argc) {
+                options.depfile_path = argv[++i];
+            } else if (arg == "--descriptor" && i + 1 < argc) {
+                options.descriptor_path = argv[++i];
+            } else if (arg == "--descriptor-runtime" && i + 1 < argc) {
+                options.descriptor_runtime_path = argv[++i];
+            } else if (arg == "--shm") {
+                options.shm = true;
+            } else if (arg == "--scatter-gather") {
+                options.scatter_gather = true;
+            } else {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // 解析一组字段定义
+    static std::vector<Parameter> parseParams(const YAML::Node& node) {
+        std::vector<Parameter> params;
+        for (const auto& param : node) {
+            Parameter p;
+            p.name = param.first.as<std::string>();
+            p.type = param.second.as<std::string>();
+            params.push_back(p);
+        }
+        return params;
+    }
+
+    // 解析方法的请求或响应：字段表为内联定义，字符串为具名消息的引用（本文件或引入IDL中的，
+    // 引入的可写成<idl>.<Message>），找到后拷贝其字段
+    static bool parseMessageRef(const YAML::Node& node, const std::string& inline_name,
+                                const Service& idl, const std::map<std::string, Service>& imported,
+                                MessageRef& ref, std::vector<Parameter>& params) {
+        if (!node.IsScalar()) {
+            ref.type = inline_name;
+            params = parseParams(node);
+            return true;
+        }
+        std::string name = node.as<std::string>();
+        std::string from;
+        size_t dot = name.find('.');
+        if (dot != std::string::npos) {
+            from = name.substr(0, dot);
+            name = name.substr(dot + 1);
+        }
+        std::vector<std::pair<std::string, const Message*>> matches;
+        if (from.empty()) {
+            for (const auto& message : idl.messages) {
+                if (message.name == name) matches.push_back({"", &message});
+            }
+        }
+        for (const auto& entry : imported) {
+            if (!from.empty() && entry.first != from) continue;
+            for (const auto& message : entry.second.messages) {
+                if (message.name == name) matches.push_back({entry.first, &message});
+            }
+        }
+        if (matches.empty()) {
+            std::cerr << "Unknown message type: " << node.as<std::string>() << std::endl;
+            return false;
+        }
+        // 本文件的定义优先，多个引入IDL中同名时必须显式限定
+        if (matches.size() > 1 && !matches[0].first.empty()) {
+            std::cerr << "Ambiguous message type " << name << ", qualify it as <idl>." << name << std::endl;
+            return false;
+        }
+        ref.type = name;
+        ref.from = matches[0].first;
+        ref.named = true;
+        params = matches[0].second->params;
+        return true;
+    }
+
+    // 解析一个IDL文件，先递归解析其引入的IDL；stack为当前的引入链，用于发现循环引入
+    static bool parseIdl(const std::string& path, Service& idl, std::vector<std::string>& stack) {
+        YAML::Node config = YAML::LoadFile(path);
+        idl.dependencies.push_back(path);
+        idl.go_package = config["go_package"].as<std::string>("");
+
+        // 引入路径相对于当前IDL所在目录
+        std::map<std::string, Service> imported;
+        size_t slash = path.find_last_of("/\\");
+        std::string dir = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+        for (const auto& item : config["import"]) {
+            std::string import_path = item.as<std::string>();
+            if (!import_path.empty() && import_path[0] != '/') import_path = dir + import_path;
+            // 规整路径，否则a/../b这类写法会绕过循环检测
+            import_path = std::filesystem::path(import_path).lexically_normal().string();
+            if (std::find(stack.begin(), stack.end(), import_path) != stack.end() || import_path == path) {
+                std::cerr << "Import cycle: " << path << " imports " << import_path << std::endl;
+                return false;
+            }
+            Service dependency;
+            stack.push_back(path);
+            bool ok = parseIdl(import_path, dependency, stack);
+            stack.pop_back();
+            if (!ok) return false;
+            std::string name = stemOf(import_path);
+            idl.imports.push_back({name, import_path, dependency.go_package});
+            for (const auto& file : dependency.dependencies) {
+                if (std::find(idl.dependencies.begin(), idl.dependencies.end(), file) == idl.dependencies.end()) {
+                    idl.dependencies.push_back(file);
                 }
+            }
+            imported[name] = dependency;
+        }
 
-                // 解析响应参数
-                auto response = method.second["response"];
-                for (const auto& param : response) {
-                    Parameter p;
-                    p.name = param.first.as<std::string>();
-                    p.type = param.second.as<std::string>();
-                    m.response_params.push_back(p);
+        // 具名消息: messages: {Name: {field: type}}
+        for (const auto& message : config["messages"]) {
+            Message m;
+            m.name = message.first.as<std::string>();
+            m.params = parseParams(message.second);
+            idl.messages.push_back(m);
+        }
+
+        if (!config["service"]) return true;
+        idl.name = config["service"]["name"].as<std::string>();
+        idl.max_in_flight = config["service"]["max_in_flight"].as<int>(0);
+        
+        const YAML::Node& methods = config["service"]["methods"];
+        for (const auto& method : methods) {
+            Method m;
+            m.name = method.first.as<std::string>();
+
+            // 解析单向调用注解: oneway: true，单向方法不能声明响应，也不能带缓存和请求合并
+            m.oneway = method.second["oneway"].as<bool>(false);
+            if (m.oneway && (method.second["response"] || method.second["cache"] ||
+                             method.second["coalesce"].as<bool>(false))) {
+                std::cerr << "Oneway method " << m.name << " cannot have response, cache or coalesce"
+                          << std::endl;
+                return false;
+            }
+
+            // 解析请求和响应
+            if (!parseMessageRef(method.second["request"], m.name + "Request", idl, imported,
+                                 m.request, m.request_params) ||
+                (!m.oneway && !parseMessageRef(method.second["response"], m.name + "Response", idl,
+                                               imported, m.response, m.response_params))) {
+                return false;
+            }
+
+            // 解析缓存注解: cache: {ttl_ms, max_entries}
+            auto cache = method.second["cache"];
+            if (cache) {
+                m.cache.enabled = true;
+                m.cache.ttl_ms = cache["ttl_ms"].as<int>(m.cache.ttl_ms);
+                m.cache.max_entries = cache["max_entries"].as<int>(m.cache.max_entries);
+                if (m.cache.ttl_ms <= 0 || m.cache.max_entries <= 0) {
+                    std::cerr << "Invalid cache for method " << m.name
+                              << ": expected ttl_ms > 0 and max_entries > 0" << std::endl;
+                    return false;
+                }
+            }
+
+            // 解析请求合并注解: coalesce: true
+            m.coalesce = method.second["coalesce"].as<bool>(false);
+
+            // 解析在途窗口注解: max_in_flight: N
+            m.max_in_flight = method.second["max_in_flight"].as<int>(0);
+            if (m.max_in_flight < 0 || idl.max_in_flight < 0 || (m.oneway && m.max_in_flight > 0)) {
+                std::cerr << "Invalid max_in_flight for method " << m.name << std::endl;
+                return false;
+            }
+
+            // 解析对冲注解: hedge: {after_ms | after_percentile, max_extra}
+            auto hedge = method.second["hedge"];
+            if (hedge) {
+                m.hedge.enabled = true;
+                m.hedge.after_ms = hedge["after_ms"].as<int>(0);
+                m.hedge.after_percentile = hedge["after_percentile"].as<double>(0);
+                m.hedge.max_extra = hedge["max_extra"].as<int>(m.hedge.max_extra);
+                bool by_time = hedge["after_ms"].IsDefined();
+                bool by_percentile = hedge["after_percentile"].IsDefined();
+                if (m.oneway || by_time == by_percentile || m.hedge.max_extra < 1 ||
+                    (by_time && m.hedge.after_ms <= 0) ||
+                    (by_percentile && (m.hedge.after_percentile <= 0 || m.hedge.after_percentile >= 100))) {
+                    std::cerr << "Invalid hedge for method " << m.name
+                              << ": expected after_ms > 0 or 0 < after_percentile < 100, and max_extra >= 1"
+                              << std::endl;
+                    return false;
                 }
+            }
 
-                service.methods.push_back(m);
+            // 解析分片键注解: shard_key: <请求字段>，浮点数的文本形式各语言不一致，不能作为分片键
+            m.shard_key = method.second["shard_key"].as<std::string>("");
+            std::string key_type = shardKeyType(m);
+            if (!m.shard_key.empty() && key_type != "string" && key_type != "int" && key_type != "bool") {
+                std::cerr << "Invalid shard_key for method " << m.name
+                          << ": expected a string, int or bool field of the request" << std::endl;
+                return false;
             }
-            return true;
+
+            // 解析优先级注解: priority: high|normal|bulk
+            m.priority = method.second["priority"].as<std::string>(m.priority);
+            if (m.priority != "high" && m.priority != "normal" && m.priority != "bulk") {
+                std::cerr << "Invalid priority for method " << m.name << ": expected high, normal or bulk"
+                          << std::endl;
+                return false;
+            }
+
+            idl.methods.push_back(m);
+        }
+
+        // 分片服务在各分片的线程上按FIFO顺序直接调用实例，不经过优先级分发器
+        bool sharded = std::any_of(idl.methods.begin(), idl.methods.end(),
+                                   [](const Method& m) { return !m.shard_key.empty(); });
+        auto prioritised = std::find_if(idl.methods.begin(), idl.methods.end(),
+                                        [](const Method& m) { return m.priority != "normal"; });
+        if (sharded && prioritised != idl.methods.end()) {
+            std::cerr << "Invalid priority for method " << prioritised->name
+                      << ": priority is not supported on services with shard_key methods" << std::endl;
+            return false;
+        }
+
+        // 同一文件内生成的消息不能重名
+        std::vector<std::string> names;
+        for (const auto& message : idl.messages) names.push_back(message.name);
+        for (const auto& m : idl.methods) {
+            if (!m.request.named) names.push_back(m.request.type);
+            if (!m.response.named && !m.oneway) names.push_back(m.response.type);
+        }
+        std::sort(names.begin(), names.end());
+        auto duplicate = std::adjacent_find(names.begin(), names.end());
+        if (duplicate != names.end()) {
+            std::cerr << "Duplicate message type " << *duplicate << " in " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // 解析yaml文件（含import引入的IDL）
+    bool parseYaml(const std::string& yaml_path) {
+        try {
+            std::vector<std::string> stack;
+            return parseIdl(yaml_path, service, stack);
         } catch (const YAML::Exception& e) {
             std::cerr << "Error parsing YAML file: " << e.what() << std::endl;
             return false;
         }
     }
 
+    // 写出依赖文件：输出依赖于该IDL及其全部（传递）引入的IDL，路径中的空格按Make规则转义
+    bool writeDepfile(const std::string& output_path) const {
+        if (options.depfile_path.empty()) return true;
+        auto escape = [](const std::string& path) {
+            std::string escaped;
+            for (char c : path) {
+                if (c == ' ' || c == '#') escaped += '\\';
+                if (c == '$') escaped += '$';
+                escaped += c;
+            }
+            return escaped;
+        };
+        std::stringstream ss;
+        ss << escape(output_path) << ":";
+        for (const auto& file : service.dependencies) {
+            ss << " \\\n  " << escape(file);
+        }
+        ss << "\n";
+        return writeFile(options.depfile_path, ss.str());
+    }
+
+    // 字段在描述符中的类型编号及其在二进制编码定长部分的字节数，与Python存根toBytes的布局一致；
+    // 没有二进制编码的类型编号为0
+    static std::pair<uint32_t, uint32_t> descriptorFieldType(const std::string& type) {
+        if (type == "string") return {1, 4};
+        if (type == "int") return {2, 8};
+        if (type == "float") return {3, 8};
+        if (type == "bool") return {4, 1};
+        return {0, 0};
+    }
+
+    // 方法标志：第0位为单向，第1-2位为优先级（0为normal、1为high、2为bulk），网关可据此排队
+    static uint32_t descriptorMethodFlags(const Method& method) {
+        uint32_t priority = method.priority == "high" ? 1u : method.priority == "bulk" ? 2u : 0u;
+        return (method.oneway ? 1u : 0u) | priority << 1;
+    }
+
+    // 写出服务的二进制描述符：方法、消息、字段、类型和方法ID，全部为小端uint32并按4字节对齐，
+    // 运行时可直接映射使用，布局见C++生成器--descriptor-runtime输出的mrpc_descriptor.h
+    bool writeDescriptor() const {
+        if (options.descriptor_path.empty()) return true;
+        if (!hasService()) {
+            std::cerr << "--descriptor requires an IDL with a service" << std::endl;
+            return false;
+        }
+        const uint32_t kNoMessage = 0xffffffff;
+        std::string strings;
+        std::map<std::string, uint32_t> interned;
+        auto intern = [&](const std::string& text) {
+            auto it = interned.find(text);
+            if (it != interned.end()) return it->second;
+            uint32_t offset = static_cast<uint32_t>(strings.size());
+            strings += text;
+            strings += '\0';
+            interned.emplace(text, offset);
+            return offset;
+        };
+
+        // 方法表每项6个字，消息表4个字，字段表3个字；具名消息被多个方法引用时只写一份
+        std::vector<uint32_t> methods, messages, fields;
+        std::map<std::string, uint32_t> message_index;
+        auto addMessage = [&](const MessageRef& ref, const std::vector<Parameter>& params, uint32_t& index) {
+            std::string name = ref.from.empty() ? ref.type : ref.from + "." + ref.type;
+            auto it = message_index.find(name);
+            if (it != message_index.end()) {
+                index = it->second;
+                return true;
+            }
+            uint32_t first = static_cast<uint32_t>(fields.size() / 3);
+            uint32_t head_size = 0;
+            for (const auto& param : params) {
+                auto [type, width] = descriptorFieldType(param.type);
+                if (type == 0) {
+                    std::cerr << "Field " << param.name << " of " << name << " has type " << param.type
+                              << ", which has no descriptor encoding" << std::endl;
+                    return false;
+                }
+                fields.insert(fields.end(), {intern(param.name), type, head_size});
+                head_size += width;
+            }
+            index = static_cast<uint32_t>(messages.size() / 4);
+            messages.insert(messages.end(),
+                            {intern(name), first, static_cast<uint32_t>(params.size()), head_size});
+            message_index.emplace(name, index);
+            return true;
+        };
+
+        // 方法ID即方法名数组的下标，全名与存根调用时使用的方法名一致
+        std::string qualified = yaml_filename + "." + service.name;
+        for (size_t i = 0; i < service.methods.size(); ++i) {
+            const auto& method = service.methods[i];
+            uint32_t request = kNoMessage, response = kNoMessage;
+            if (!addMessage(method.request, method.request_params, request) ||
+                (!method.oneway && !addMessage(method.response, method.response_params, response))) {
+                return false;
+            }
+            methods.insert(methods.end(), {static_cast<uint32_t>(i), intern(method.name),
+                                           intern("/" + qualified + "/" + method.name), request, response,
+                                           descriptorMethodFlags(method)});
+        }
+        uint32_t service_name = intern(qualified);
+        while (strings.size() % 4 != 0) strings += '\0';
+
+        // 头部之后依次是方法表、消息表、字段表和字符串表
+        const uint32_t kHeaderWords = 12;
+        uint32_t method_offset = kHeaderWords * 4;
+        uint32_t message_offset = method_offset + static_cast<uint32_t>(methods.size() * 4);
+        uint32_t field_offset = message_offset + static_cast<uint32_t>(messages.size() * 4);
+        uint32_t string_offset = field_offset + static_cast<uint32_t>(fields.size() * 4);
+        uint32_t size = string_offset + static_cast<uint32_t>(strings.size());
+        std::vector<uint32_t> words = {0x4450524d,  // "MRPD"
+                                       1,
+                                       size,
+                                       service_name,
+                                       static_cast<uint32_t>(methods.size() / 6),
+                                       method_offset,
+                                       static_cast<uint32_t>(messages.size() / 4),
+                                       message_offset,
+                                       static_cast<uint32_t>(fields.size() / 3),
+                                       field_offset,
+                                       string_offset,
+                                       static_cast<uint32_t>(strings.size())};
+        words.insert(words.end(), methods.begin(), methods.end());
+        words.insert(words.end(), messages.begin(), messages.end());
+        words.insert(words.end(), fields.begin(), fields.end());
+
+        std::string bytes;
+        bytes.reserve(size);
+        for (uint32_t word : words) {
+            for (int shift = 0; shift < 32; shift += 8) bytes += static_cast<char>((word >> shift) & 0xff);
+        }
+        bytes += strings;
+        return writeFile(options.descriptor_path, bytes);
+    }
+
     // 生成存根文件
     virtual bool generate(const std::string& output_path) = 0;
 };
@@ -0,0 +1,303 @@
+// 生成守护进程：内存中保存已解析的IR，监听IDL目录，变更后只重新生成受影响的输出
+// 构建: g++ -std=c++17 -O2 -o StubGeneratorWatch StubGeneratorWatch.cpp -lyaml-cpp
+#define MRPC_GENERATOR_NO_MAIN
+#include "CppStubGenerator.cpp"
+#include "GoStubGenerator.cpp"
+#include "PythonStubGenerator.cpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <thread>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace mrpc {
+namespace generator {
+
+namespace fs = std::filesystem;
+
+// 一种输出语言及其输出目录
+struct WatchTarget {
+    std::string language;  // cpp、go或python
+    std::string out_dir;
+};
+
+// 用于存储守护进程命令行选项的结构体
+struct WatchConfig {
+    std::vector<std::string> dirs;
+    std::vector<WatchTarget> targets;
+    GeneratorOptions options;  // shm和scatter_gather只作用于C++输出
+    bool split = false;  // C++输出拆分为头文件和源文件
+    std::string descriptor_dir;  // 非空时为每个含服务的IDL在此目录写出<name>.mrpcd描述符
+    int debounce_ms = 100;  // 一次保存常触发多个事件，静默这么久后才开始生成
+    bool once = false;  // 只全量生成一次，不进入监听
+};
+
+class StubGeneratorWatcher {
+private:
+    // 内存中的IDL：源文本和解析出的IR
+    struct Idl {
+        std::string content;
+        Service service;
+    };
+
+    WatchConfig config;
+    std::map<std::string, Idl> idls;
+
+    static bool isIdl(const fs::path& path) {
+        std::string ext = path.extension().string();
+        return ext == ".yaml" || ext == ".yml";
+    }
+
+    static std::string join(const std::string& dir, const std::string& file) {
+        return (fs::path(dir) / file).string();
+    }
+
+    // 列出监听目录下的全部IDL
+    std::set<std::string> scanIdls() const {
+        std::set<std::string> paths;
+        for (const auto& dir : config.dirs) {
+            std::error_code ec;
+            for (const auto& entry : fs::directory_iterator(dir, ec)) {
+                if (entry.is_regular_file() && isIdl(entry.path())) {
+                    paths.insert(entry.path().string());
+                }
+            }
+            if (ec) std::cerr << "Failed to scan " << dir << ": " << ec.message() << std::endl;
+        }
+        return paths;
+    }
+
+    // 按IDL名推导输出文件名，与helloworld的命名一致
+    static std::string outputPath(const WatchTarget& target, const std::string& name) {
+        if (target.language == "cpp") return join(target.out_dir, name + ".mrpc.h");
+        if (target.language == "go") return join(target.out_dir, name + ".mrpc.go");
+        return join(target.out_dir, name + "_mrpc.py");
+    }
+
+    template <typename Generator>
+    static bool generateWith(const std::string& idl_path, const Service& service,
+                             const GeneratorOptions& options, const std::string& output_path) {
+        Generator generator(idl_path);
+        generator.setOptions(options);
+        generator.setService(service);
+        return generator.generate(output_path);
+    }
+
+    // 重新生成一个IDL的全部输出：内容未变时跳过（force时除外），解析失败时保留上一次的IR和输出
+    bool regenerate(const std::string& path, bool force = false) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            if (idls.erase(path) > 0) std::cout << "removed " << path << std::endl;
+            return true;
+        }
+        std::stringstream content;
+        content << in.rdbuf();
+        auto it = idls.find(path);
+        if (!force && it != idls.end() && it->second.content == content.str()) return true;
+
+        auto start = std::chrono::steady_clock::now();
+        // IR只解析一次，各语言的生成器共用
+        CppStubGenerator parser(path);
+        if (!parser.parseYaml(path)) {
+            std::cerr << "Failed to parse " << path << ", keeping previous outputs" << std::endl;
+            return false;
+        }
+        Idl& idl = idls[path];
+        idl.content = content.str();
+        idl.service = parser.getService();
+
+        std::string name = fs::path(path).stem().string();
+        bool ok = true;
+        for (const auto& target : config.targets) {
+            std::string output_path = outputPath(target, name);
+            GeneratorOptions options = config.options;
+            if (target.language == "cpp") {
+                if (config.split) options.split_source_path = join(target.out_dir, name + ".mrpc.cc");
+                ok = generateWith<CppStubGenerator>(path, idl.service, options, output_path) && ok;
+            } else if (target.language == "go") {
+                // 共享内存和分散-聚集编码只有C++支持，其他语言照常生成
+                options.shm = options.scatter_gather = false;
+                ok = generateWith<GoStubGenerator>(path, idl.service, options, output_path) && ok;
+            } else {
+                options.shm = options.scatter_gather = false;
+                ok = generateWith<PythonStubGenerator>(path, idl.service, options, output_path) && ok;
+            }
+        }
+        // 网关映射的描述符随IDL一起更新
+        if (!config.descriptor_dir.empty() && !idl.service.name.empty()) {
+            GeneratorOptions options;
+            options.descriptor_path = join(config.descriptor_dir, name + ".mrpcd");
+            parser.setOptions(options);
+            ok = parser.writeDescriptor() && ok;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << (ok ? "regenerated " : "failed to regenerate ") << path << " in " << ms << " ms"
+                  << std::endl;
+        return ok;
+    }
+
+    // 被引入的IDL变更后，引入它的IDL（含传递引入）也要重新生成
+    void regenerateDependents(const std::string& path) {
+        std::string changed = fs::path(path).lexically_normal().string();
+        std::vector<std::string> dependents;
+        for (const auto& entry : idls) {
+            const auto& deps = entry.second.service.dependencies;
+            if (entry.first != path && std::find(deps.begin() + 1, deps.end(), changed) != deps.end()) {
+                dependents.push_back(entry.first);
+            }
+        }
+        for (const auto& dependent : dependents) regenerate(dependent, true);
+    }
+
+    // 处理一次变更：先生成变更的IDL，再生成依赖它的IDL
+    void onChanged(const std::string& path) {
+        bool known = idls.count(path) > 0;
+        std::string before = known ? idls[path].content : "";
+        regenerate(path);
+        auto it = idls.find(path);
+        if (it == idls.end() ? known : it->second.content != before) regenerateDependents(path);
+    }
+
+#ifdef __linux__
+    // inotify监听：阻塞等待第一个事件，之后在防抖窗口内继续收集，窗口内无新事件时统一生成
+    bool watch() {
+        int fd = inotify_init1(IN_CLOEXEC);
+        if (fd < 0) {
+            std::perror("inotify_init1");
+            return false;
+        }
+        std::map<int, std::string> dirs;
+        for (const auto& dir : config.dirs) {
+            // 编辑器常以写临时文件再改名的方式保存，因此同时关注改名和删除
+            int wd = inotify_add_watch(fd, dir.c_str(),
+                                       IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE);
+            if (wd < 0) {
+                std::perror(("inotify_add_watch " + dir).c_str());
+                close(fd);
+                return false;
+            }
+            dirs[wd] = dir;
+        }
+        std::cout << "watching " << dirs.size() << " directories" << std::endl;
+
+        alignas(inotify_event) char buffer[64 * 1024];
+        for (;;) {
+            std::set<std::string> changed;
+            int timeout = -1;
+            for (;;) {
+                pollfd pfd{fd, POLLIN, 0};
+                int ready = poll(&pfd, 1, timeout);
+                if (ready < 0 && errno == EINTR) continue;
+                if (ready < 0) {
+                    std::perror("poll");
+                    close(fd);
+                    return false;
+                }
+                if (ready == 0) break;
+                ssize_t n = read(fd, buffer, sizeof(buffer));
+                for (char* p = buffer; n > 0 && p < buffer + n;) {
+                    auto* event = reinterpret_cast<inotify_event*>(p);
+                    if (event->len > 0 && isIdl(event->name)) {
+                        changed.insert(join(dirs[event->wd], event->name));
+                    }
+                    p += sizeof(inotify_event) + event->len;
+                }
+                timeout = config.debounce_ms;
+            }
+            for (const auto& path : changed) onChanged(path);
+        }
+    }
+#else
+    // 其他平台没有inotify，退化为按防抖间隔轮询修改时间
+    bool watch() {
+        std::map<std::string, fs::file_time_type> seen;
+        for (const auto& path : scanIdls()) seen[path] = fs::last_write_time(path);
+        std::cout << "polling " << config.dirs.size() << " directories" << std::endl;
+        for (;;) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(config.debounce_ms));
+            std::map<std::string, fs::file_time_type> now;
+            for (const auto& path : scanIdls()) {
+                std::error_code ec;
+                now[path] = fs::last_write_time(path, ec);
+            }
+            for (const auto& entry : now) {
+                auto it = seen.find(entry.first);
+                if (it == seen.end() || it->second != entry.second) onChanged(entry.first);
+            }
+            for (const auto& entry : seen) {
+                if (now.count(entry.first) == 0) onChanged(entry.first);
+            }
+            seen.swap(now);
+        }
+    }
+#endif
+
+public:
+    explicit StubGeneratorWatcher(const WatchConfig& watch_config) : config(watch_config) {}
+
+    // 先全量生成一次，再监听后续变更
+    bool run() {
+        bool ok = true;
+        for (const auto& path : scanIdls()) {
+            ok = regenerate(path) && ok;
+        }
+        if (config.once) return ok;
+        return watch();
+    }
+};
+
+} // namespace generator
+} // namespace mrpc
+
+int main(int argc, char* argv[]) {
+    mrpc::generator::WatchConfig config;
+    std::string bad_arg;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--watch" && has_value) {
+            config.dirs.push_back(argv[++i]);
+        } else if ((arg == "--cpp" || arg == "--go" || arg == "--python") && has_value) {
+            config.targets.push_back({arg.substr(2), argv[++i]});
+        } else if (arg == "--pool") {
+            config.options.pool = true;
+        } else if (arg == "--shm") {
+            config.options.shm = true;
+        } else if (arg == "--scatter-gather") {
+            config.options.scatter_gather = true;
+        } else if (arg == "--split") {
+            config.split = true;
+        } else if (arg == "--descriptors" && has_value) {
+            config.descriptor_dir = argv[++i];
+        } else if (arg == "--debounce-ms" && has_value) {
+            config.debounce_ms = std::atoi(argv[++i]);
+        } else if (arg == "--once") {
+            config.once = true;
+        } else {
+            // 单次生成器的--loadtest、--codec-tests、--depfile等选项在守护进程中不支持
+            bad_arg = arg;
+            config.dirs.clear();
+            break;
+        }
+    }
+    if (!bad_arg.empty()) std::cerr << "Unsupported or incomplete argument: " << bad_arg << std::endl;
+    if (config.dirs.empty() || (config.targets.empty() && config.descriptor_dir.empty())) {
+        std::cerr << "Usage: " << argv[0] << " --watch <idl_dir>... [--cpp <out_dir>] [--go <out_dir>]"
+                  << " [--python <out_dir>] [--pool] [--shm] [--scatter-gather] [--split] [--descriptors <out_dir>]"
+                  << " [--debounce-ms <ms>] [--once]" << std::endl;
+        return 1;
+    }
+
+    mrpc::generator::StubGeneratorWatcher watcher(config);
+    return watcher.run() ? 0 : 1;
+}
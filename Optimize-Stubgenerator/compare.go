@@ -1,45 +1,601 @@
 package helloworld
 
 import (
-	"encoding/json"
 	"fmt"
 	"mrpc"
+	"strconv"
+	"strings"
+	"sync"
+	"unicode/utf16"
+	"unicode/utf8"
 )
 
 var Greeter_method_names = []string{
 	"/helloworld.Greeter/SayHello",
 }
 
+// mrpcBufferPool 复用ToString的编码缓冲区
+var mrpcBufferPool = sync.Pool{
+	New: func() any {
+		buf := make([]byte, 0, 256)
+		return &buf
+	},
+}
+
+func mrpcPutBuffer(buf *[]byte) {
+	// 过大的缓冲区不放回，避免池长期持有大块内存
+	if cap(*buf) <= 64<<10 {
+		mrpcBufferPool.Put(buf)
+	}
+}
+
+// mrpcAppendString 按JSON规则转义并追加字符串，非法UTF-8替换为\ufffd；
+// 与encoding/json一样把<、>和&转义为\u003c、\u003e和\u0026，输出可安全嵌入HTML
+func mrpcAppendString(buf []byte, s string) []byte {
+	const hex = "0123456789abcdef"
+	buf = append(buf, '"')
+	start := 0
+	for i := 0; i < len(s); {
+		c := s[i]
+		if c < utf8.RuneSelf {
+			if c >= 0x20 && c != '"' && c != '\\' && c != '<' && c != '>' && c != '&' {
+				i++
+				continue
+			}
+			buf = append(buf, s[start:i]...)
+			switch c {
+			case '"', '\\':
+				buf = append(buf, '\\', c)
+			case '\n':
+				buf = append(buf, '\\', 'n')
+			case '\r':
+				buf = append(buf, '\\', 'r')
+			case '\t':
+				buf = append(buf, '\\', 't')
+			default:
+				buf = append(buf, '\\', 'u', '0', '0', hex[c>>4], hex[c&0xf])
+			}
+			i++
+			start = i
+			continue
+		}
+		r, size := utf8.DecodeRuneInString(s[i:])
+		if r == utf8.RuneError && size == 1 {
+			buf = append(buf, s[start:i]...)
+			buf = append(buf, `\ufffd`...)
+			i += size
+			start = i
+			continue
+		}
+		if r == '\u2028' || r == '\u2029' {
+			buf = append(buf, s[start:i]...)
+			buf = append(buf, '\\', 'u', '2', '0', '2', hex[r&0xf])
+			i += size
+			start = i
+			continue
+		}
+		i += size
+	}
+	buf = append(buf, s[start:]...)
+	return append(buf, '"')
+}
+
+// mrpcDecoder 直接在输入字符串上解析JSON；不含转义的字符串字段直接引用输入的子串，不再复制
+type mrpcDecoder struct {
+	data    string
+	pos     int
+	key     string
+	err     error
+	started bool
+	done    bool
+}
+
+func (d *mrpcDecoder) fail(what string) error {
+	return fmt.Errorf("mrpc: %s at offset %d", what, d.pos)
+}
+
+func (d *mrpcDecoder) skipSpace() {
+	for d.pos < len(d.data) {
+		switch d.data[d.pos] {
+		case ' ', '\t', '\n', '\r':
+			d.pos++
+		default:
+			return
+		}
+	}
+}
+
+// consume 跳过空白后，若下一个字符为c则读掉它
+func (d *mrpcDecoder) consume(c byte) bool {
+	d.skipSpace()
+	if d.pos < len(d.data) && d.data[d.pos] == c {
+		d.pos++
+		return true
+	}
+	return false
+}
+
+func (d *mrpcDecoder) literal(word string) bool {
+	d.skipSpace()
+	if len(d.data)-d.pos >= len(word) && d.data[d.pos:d.pos+len(word)] == word {
+		d.pos += len(word)
+		return true
+	}
+	return false
+}
+
+// nextField 读取下一个字段名到d.key；对象结束或出错时返回false，null视为空对象，与encoding/json一致
+func (d *mrpcDecoder) nextField() bool {
+	if d.err != nil || d.done {
+		return false
+	}
+	if !d.started {
+		d.started = true
+		if d.literal("null") {
+			d.done = true
+			return false
+		}
+		if !d.consume('{') {
+			d.err = d.fail("expected '{'")
+			return false
+		}
+		if d.consume('}') {
+			d.done = true
+			return false
+		}
+	} else if !d.consume(',') {
+		if d.consume('}') {
+			d.done = true
+			return false
+		}
+		d.err = d.fail("expected ',' or '}'")
+		return false
+	}
+	d.skipSpace()
+	if d.pos >= len(d.data) || d.data[d.pos] != '"' {
+		d.err = d.fail("expected string key")
+		return false
+	}
+	key, err := d.readRawString()
+	if err != nil {
+		d.err = err
+		return false
+	}
+	if !d.consume(':') {
+		d.err = d.fail("expected ':'")
+		return false
+	}
+	d.key = key
+	return true
+}
+
+// mrpcFieldName 返回与字段名key对应的字段：先找完全相同的，再与encoding/json一样按Unicode大小写折叠匹配，
+// 多个字段都匹配时取声明在前的；没有匹配时原样返回key
+func mrpcFieldName(key string, names ...string) string {
+	for _, name := range names {
+		if key == name {
+			return name
+		}
+	}
+	for _, name := range names {
+		if strings.EqualFold(key, name) {
+			return name
+		}
+	}
+	return key
+}
+
+// finish 返回解析过程中的错误，并检查对象之后没有多余数据
+func (d *mrpcDecoder) finish() error {
+	if d.err != nil {
+		return d.err
+	}
+	d.skipSpace()
+	if d.pos != len(d.data) {
+		return d.fail("unexpected trailing data")
+	}
+	return nil
+}
+
+// readRawString 读取以引号开头的字符串；无转义且为合法UTF-8时直接返回子串
+func (d *mrpcDecoder) readRawString() (string, error) {
+	start := d.pos + 1
+	for i := start; i < len(d.data); {
+		c := d.data[i]
+		switch {
+		case c == '"':
+			d.pos = i + 1
+			return d.data[start:i], nil
+		case c == '\\' || c < 0x20:
+			return d.readEscapedString(start)
+		case c >= utf8.RuneSelf:
+			r, size := utf8.DecodeRuneInString(d.data[i:])
+			if r == utf8.RuneError && size == 1 {
+				return d.readEscapedString(start)
+			}
+			i += size
+		default:
+			i++
+		}
+	}
+	return "", d.fail("unterminated string")
+}
+
+func mrpcHex4(s string) (rune, bool) {
+	if len(s) < 4 {
+		return 0, false
+	}
+	var r rune
+	for i := 0; i < 4; i++ {
+		c := s[i]
+		switch {
+		case '0' <= c && c <= '9':
+			c -= '0'
+		case 'a' <= c && c <= 'f':
+			c = c - 'a' + 10
+		case 'A' <= c && c <= 'F':
+			c = c - 'A' + 10
+		default:
+			return 0, false
+		}
+		r = r<<4 | rune(c)
+	}
+	return r, true
+}
+
+// readEscapedString 处理转义和非法UTF-8的慢路径
+func (d *mrpcDecoder) readEscapedString(start int) (string, error) {
+	buf := make([]byte, 0, len(d.data)-start)
+	for i := start; i < len(d.data); {
+		c := d.data[i]
+		switch {
+		case c == '"':
+			d.pos = i + 1
+			return string(buf), nil
+		case c < 0x20:
+			d.pos = i
+			return "", d.fail("invalid character in string")
+		case c == '\\':
+			if i+1 >= len(d.data) {
+				d.pos = i
+				return "", d.fail("unterminated string")
+			}
+			switch e := d.data[i+1]; e {
+			case '"', '\\', '/':
+				buf = append(buf, e)
+			case 'b':
+				buf = append(buf, '\b')
+			case 'f':
+				buf = append(buf, '\f')
+			case 'n':
+				buf = append(buf, '\n')
+			case 'r':
+				buf = append(buf, '\r')
+			case 't':
+				buf = append(buf, '\t')
+			case 'u':
+				r, ok := mrpcHex4(d.data[i+2:])
+				if !ok {
+					d.pos = i
+					return "", d.fail("invalid unicode escape")
+				}
+				i += 6
+				if utf16.IsSurrogate(r) {
+					// 代理对需要紧跟第二个\uXXXX，否则按encoding/json替换为U+FFFD
+					r2, ok := rune(0), false
+					if i+1 < len(d.data) && d.data[i] == '\\' && d.data[i+1] == 'u' {
+						r2, ok = mrpcHex4(d.data[i+2:])
+					}
+					if dec := utf16.DecodeRune(r, r2); ok && dec != utf8.RuneError {
+						r = dec
+						i += 6
+					} else {
+						r = utf8.RuneError
+					}
+				}
+				buf = utf8.AppendRune(buf, r)
+				continue
+			default:
+				d.pos = i
+				return "", d.fail("invalid escape")
+			}
+			i += 2
+		case c >= utf8.RuneSelf:
+			r, size := utf8.DecodeRuneInString(d.data[i:])
+			if r == utf8.RuneError && size == 1 {
+				buf = append(buf, "\ufffd"...)
+			} else {
+				buf = append(buf, d.data[i:i+size]...)
+			}
+			i += size
+		default:
+			buf = append(buf, c)
+			i++
+		}
+	}
+	return "", d.fail("unterminated string")
+}
+
+func mrpcIsDigit(c byte) bool {
+	return '0' <= c && c <= '9'
+}
+
+// readNumber 按JSON数字语法读取一个数字
+func (d *mrpcDecoder) readNumber() (string, error) {
+	d.skipSpace()
+	s, start := d.data, d.pos
+	i := start
+	if i < len(s) && s[i] == '-' {
+		i++
+	}
+	switch {
+	case i < len(s) && s[i] == '0':
+		i++
+	case i < len(s) && '1' <= s[i] && s[i] <= '9':
+		for i < len(s) && mrpcIsDigit(s[i]) {
+			i++
+		}
+	default:
+		return "", d.fail("invalid number")
+	}
+	if i < len(s) && s[i] == '.' {
+		i++
+		if i >= len(s) || !mrpcIsDigit(s[i]) {
+			return "", d.fail("invalid number")
+		}
+		for i < len(s) && mrpcIsDigit(s[i]) {
+			i++
+		}
+	}
+	if i < len(s) && (s[i] == 'e' || s[i] == 'E') {
+		i++
+		if i < len(s) && (s[i] == '+' || s[i] == '-') {
+			i++
+		}
+		if i >= len(s) || !mrpcIsDigit(s[i]) {
+			return "", d.fail("invalid number")
+		}
+		for i < len(s) && mrpcIsDigit(s[i]) {
+			i++
+		}
+	}
+	d.pos = i
+	return s[start:i], nil
+}
+
+// 以下读取函数遇到null时保留字段原值，与encoding/json一致
+func (d *mrpcDecoder) readString(dst *string) error {
+	if d.literal("null") {
+		return nil
+	}
+	if d.pos >= len(d.data) || d.data[d.pos] != '"' {
+		return d.fail("expected string")
+	}
+	s, err := d.readRawString()
+	if err != nil {
+		return err
+	}
+	*dst = s
+	return nil
+}
+
+func (d *mrpcDecoder) readInt(dst *int) error {
+	if d.literal("null") {
+		return nil
+	}
+	token, err := d.readNumber()
+	if err != nil {
+		return err
+	}
+	v, err := strconv.ParseInt(token, 10, strconv.IntSize)
+	if err != nil {
+		return d.fail("cannot decode " + token + " as int")
+	}
+	*dst = int(v)
+	return nil
+}
+
+func (d *mrpcDecoder) readFloat(dst *float64) error {
+	if d.literal("null") {
+		return nil
+	}
+	token, err := d.readNumber()
+	if err != nil {
+		return err
+	}
+	v, err := strconv.ParseFloat(token, 64)
+	if err != nil {
+		return d.fail("cannot decode " + token + " as float64")
+	}
+	*dst = v
+	return nil
+}
+
+func (d *mrpcDecoder) readBool(dst *bool) error {
+	switch {
+	case d.literal("null"):
+	case d.literal("true"):
+		*dst = true
+	case d.literal("false"):
+		*dst = false
+	default:
+		return d.fail("expected bool")
+	}
+	return nil
+}
+
+// skipValue 跳过未知字段的值，限制嵌套深度以防栈溢出
+func (d *mrpcDecoder) skipValue(depth int) error {
+	if depth > 10000 {
+		return d.fail("exceeded max depth")
+	}
+	d.skipSpace()
+	if d.pos >= len(d.data) {
+		return d.fail("unexpected end of input")
+	}
+	switch d.data[d.pos] {
+	case '"':
+		_, err := d.readRawString()
+		return err
+	case '{', '[':
+		closing := byte('}')
+		if d.data[d.pos] == '[' {
+			closing = ']'
+		}
+		d.pos++
+		if d.consume(closing) {
+			return nil
+		}
+		for {
+			if closing == '}' {
+				d.skipSpace()
+				if d.pos >= len(d.data) || d.data[d.pos] != '"' {
+					return d.fail("expected string key")
+				}
+				if _, err := d.readRawString(); err != nil {
+					return err
+				}
+				if !d.consume(':') {
+					return d.fail("expected ':'")
+				}
+			}
+			if err := d.skipValue(depth + 1); err != nil {
+				return err
+			}
+			if d.consume(',') {
+				continue
+			}
+			if d.consume(closing) {
+				return nil
+			}
+			return d.fail("expected ',' or closing bracket")
+		}
+	}
+	if d.literal("true") || d.literal("false") || d.literal("null") {
+		return nil
+	}
+	_, err := d.readNumber()
+	return err
+}
+
 type SayHelloRequest struct {
 	Name string `json:"name"`
 }
 
+// AppendTo 将JSON编码追加到buf后返回
+func (r *SayHelloRequest) AppendTo(buf []byte) []byte {
+	buf = append(buf, `{"name":`...)
+	buf = mrpcAppendString(buf, r.Name)
+	return append(buf, '}')
+}
+
+func (r *SayHelloRequest) MarshalJSON() ([]byte, error) {
+	return r.AppendTo(make([]byte, 0, 64)), nil
+}
+
+func (r *SayHelloRequest) UnmarshalJSON(data []byte) error {
+	return r.FromString(string(data))
+}
+
 func (r *SayHelloRequest) ToString() (string, error) {
-	data, err := json.Marshal(r)
-	if err != nil {
-		return "", err
-	}
-	return string(data), nil
+	buf := mrpcBufferPool.Get().(*[]byte)
+	*buf = r.AppendTo((*buf)[:0])
+	data := string(*buf)
+	mrpcPutBuffer(buf)
+	return data, nil
 }
 
 func (r *SayHelloRequest) FromString(data string) error {
-	return json.Unmarshal([]byte(data), r)
+	d := mrpcDecoder{data: data}
+	for d.nextField() {
+		switch mrpcFieldName(d.key, "name") {
+		case "name":
+			d.err = d.readString(&r.Name)
+		default:
+			d.err = d.skipValue(0)
+		}
+	}
+	return d.finish()
+}
+
+// Reset 清空所有字段以便复用
+func (r *SayHelloRequest) Reset() {
+	*r = SayHelloRequest{}
+}
+
+var sayHelloRequestPool = sync.Pool{
+	New: func() any { return new(SayHelloRequest) },
+}
+
+// AcquireSayHelloRequest 从对象池取出一个空消息，用完后调用ReleaseSayHelloRequest放回
+func AcquireSayHelloRequest() *SayHelloRequest {
+	return sayHelloRequestPool.Get().(*SayHelloRequest)
+}
+
+// ReleaseSayHelloRequest 清空消息并放回对象池，调用后不得再使用r
+func ReleaseSayHelloRequest(r *SayHelloRequest) {
+	r.Reset()
+	sayHelloRequestPool.Put(r)
 }
 
 type SayHelloResponse struct {
 	Message string `json:"message"`
 }
 
+// AppendTo 将JSON编码追加到buf后返回
+func (r *SayHelloResponse) AppendTo(buf []byte) []byte {
+	buf = append(buf, `{"message":`...)
+	buf = mrpcAppendString(buf, r.Message)
+	return append(buf, '}')
+}
+
+func (r *SayHelloResponse) MarshalJSON() ([]byte, error) {
+	return r.AppendTo(make([]byte, 0, 64)), nil
+}
+
+func (r *SayHelloResponse) UnmarshalJSON(data []byte) error {
+	return r.FromString(string(data))
+}
+
 func (r *SayHelloResponse) ToString() (string, error) {
-	data, err := json.Marshal(r)
-	if err != nil {
-		return "", err
-	}
-	return string(data), nil
+	buf := mrpcBufferPool.Get().(*[]byte)
+	*buf = r.AppendTo((*buf)[:0])
+	data := string(*buf)
+	mrpcPutBuffer(buf)
+	return data, nil
 }
 
 func (r *SayHelloResponse) FromString(data string) error {
-	return json.Unmarshal([]byte(data), r)
+	d := mrpcDecoder{data: data}
+	for d.nextField() {
+		switch mrpcFieldName(d.key, "message") {
+		case "message":
+			d.err = d.readString(&r.Message)
+		default:
+			d.err = d.skipValue(0)
+		}
+	}
+	return d.finish()
+}
+
+// Reset 清空所有字段以便复用
+func (r *SayHelloResponse) Reset() {
+	*r = SayHelloResponse{}
+}
+
+var sayHelloResponsePool = sync.Pool{
+	New: func() any { return new(SayHelloResponse) },
+}
+
+// AcquireSayHelloResponse 从对象池取出一个空消息，用完后调用ReleaseSayHelloResponse放回
+func AcquireSayHelloResponse() *SayHelloResponse {
+	return sayHelloResponsePool.Get().(*SayHelloResponse)
+}
+
+// ReleaseSayHelloResponse 清空消息并放回对象池，调用后不得再使用r
+func ReleaseSayHelloResponse(r *SayHelloResponse) {
+	r.Reset()
+	sayHelloResponsePool.Put(r)
 }
 
 type GreeterClient struct {
@@ -53,9 +609,13 @@ func NewGreeterClient(s string) *GreeterClient {
 }
 
 func (h *GreeterClient) SayHello(request *SayHelloRequest) (string, error) {
-	response := &SayHelloResponse{}
+	response := AcquireSayHelloResponse()
 	err := h.client.Send(Greeter_method_names[0], request, response)
-	return response.Message, err
+	value := response.Message
+	if err == nil {
+		ReleaseSayHelloResponse(response)
+	}
+	return value, err
 }
 
 func (h *GreeterClient) AsyncSayHello(request *SayHelloRequest) (string, error) {
@@ -63,16 +623,33 @@ func (h *GreeterClient) AsyncSayHello(request *SayHelloRequest) (string, error)
 }
 
 func (h *GreeterClient) CallbackSayHello(request *SayHelloRequest, callback func(string, error)) {
-	response := &SayHelloResponse{}
+	response := AcquireSayHelloResponse()
 	h.client.CallbackSend(Greeter_method_names[0], request, response, func(err error) {
-		callback(response.Message, err)
+		value := response.Message
+		if err == nil {
+			ReleaseSayHelloResponse(response)
+		}
+		callback(value, err)
 	})
 }
 
+func (h *GreeterClient) ReceiveSayHello(key string) (*SayHelloResponse, error) {
+	response := AcquireSayHelloResponse()
+	if err := h.client.Receive(key, response); err != nil {
+		return nil, err
+	}
+	return response, nil
+}
+
+// Deprecated: 只返回第一个字段，使用ReceiveSayHello获取完整响应
 func (h *GreeterClient) Receive(key string) (string, error) {
-	response := &SayHelloResponse{}
-	err := h.client.Receive(key, response)
-	return response.Message, err
+	response, err := h.ReceiveSayHello(key)
+	if err != nil {
+		return "", err
+	}
+	value := response.Message
+	ReleaseSayHelloResponse(response)
+	return value, nil
 }
 
 func (h *GreeterClient) Close() {
@@ -1,5 +1,6 @@
 import mrpc
 import json
+import struct
 from typing import Callable, Optional
 
 Callback = Callable[[str, Exception | None], None]
@@ -10,7 +11,12 @@ Greeter_METHOD_NAMES = [
 ]
 
 
+_SayHelloRequest_LAYOUT = struct.Struct("<I")
+
+
 class SayHelloRequest(mrpc.Parser):
+    __slots__ = ("name",)
+
     def __init__(self, name: Optional[str] = None):
         self.name = name
 
@@ -21,8 +27,26 @@ class SayHelloRequest(mrpc.Parser):
         obj = json.loads(data)
         self.name = obj.get("name", "")
 
+    def toBytes(self) -> bytes:
+        name = (self.name or "").encode()
+        return _SayHelloRequest_LAYOUT.pack(len(name)) + name
+
+    def fromBytes(self, data: bytes):
+        if len(data) < 4:
+            raise ValueError("SayHelloRequest: expected at least 4 bytes, got %d" % len(data))
+        (n_name,) = _SayHelloRequest_LAYOUT.unpack_from(data)
+        end = 4 + n_name
+        if len(data) != end:
+            raise ValueError("SayHelloRequest: expected %d bytes, got %d" % (end, len(data)))
+        self.name = str(data[4:end], "utf-8")
+
+
+_SayHelloResponse_LAYOUT = struct.Struct("<I")
+
 
 class SayHelloResponse(mrpc.Parser):
+    __slots__ = ("message",)
+
     def __init__(self):
         self.message = ""
 
@@ -33,6 +57,19 @@ class SayHelloResponse(mrpc.Parser):
         obj = json.loads(data)
         self.message = obj.get("message", "")
 
+    def toBytes(self) -> bytes:
+        message = (self.message or "").encode()
+        return _SayHelloResponse_LAYOUT.pack(len(message)) + message
+
+    def fromBytes(self, data: bytes):
+        if len(data) < 4:
+            raise ValueError("SayHelloResponse: expected at least 4 bytes, got %d" % len(data))
+        (n_message,) = _SayHelloResponse_LAYOUT.unpack_from(data)
+        end = 4 + n_message
+        if len(data) != end:
+            raise ValueError("SayHelloResponse: expected %d bytes, got %d" % (end, len(data)))
+        self.message = str(data[4:end], "utf-8")
+
 
 class GreeterClient(mrpc.Client):
     def __init__(self, server_address: str):